@@ -10,7 +10,15 @@
 #include <glm/ext.hpp>
 #include <Input.h>
 
+Camera::Camera()
+	: m_theta(0), m_phi(0), m_position(0), m_stationary(true), m_lastMouseX(0), m_lastMouseY(0),
+	m_aspectRatio(16.f / 9.f), m_viewDirty(true), m_projectionDirty(true)
+{
+
+}
+
 Camera::Camera(glm::vec3 a_position, float a_theta, float a_phi, bool a_stationary)
+	: Camera()
 {
 	m_position = a_position;
 	m_theta = a_theta;
@@ -23,6 +31,9 @@ void Camera::Update(float a_deltaTime)
 	aie::Input* input = aie::Input::getInstance();
 	float thetaR = glm::radians(m_theta);
 	float phiR = glm::radians(m_phi);
+	glm::vec3 lastPosition = m_position;
+	float lastTheta = m_theta;
+	float lastPhi = m_phi;
 
 	// Calculate the forwards and right axes and the up axis for the camerta
 	glm::vec3 forward(glm::cos(phiR) * glm::cos(thetaR),
@@ -62,20 +73,70 @@ void Camera::Update(float a_deltaTime)
 		// Now store the frames last values for the next
 		m_lastMouseX = mX;
 		m_lastMouseY = mY;
+
+		if (m_position != lastPosition || m_theta != lastTheta || m_phi != lastPhi)
+			m_viewDirty = true;
 	}
 
+	UpdateMatrices();
 }
 
-glm::mat4 Camera::GetViewMatrix()
+void Camera::SetAspectRatio(float a_width, float a_height)
 {
-	float thetaR = glm::radians(m_theta);
-	float phiR = glm::radians(m_phi);
-	glm::vec3 forward(glm::cos(phiR) * glm::cos(thetaR), 
-		glm::sin(phiR), glm::cos(phiR) * glm::sin(thetaR));
-	return glm::lookAt(m_position, m_position + forward, glm::vec3(0, 1, 0));
+	float aspectRatio = a_width / a_height;
+	if (aspectRatio != m_aspectRatio)
+	{
+		m_aspectRatio = aspectRatio;
+		m_projectionDirty = true;
+	}
+}
+
+bool Camera::IsSphereVisible(const glm::vec3& a_center, float a_radius)
+{
+	UpdateMatrices();
+	for (unsigned int i = 0; i < PLANE_Count; i++)
+	{
+		if (glm::dot(glm::vec3(m_frustumPlanes[i]), a_center) + m_frustumPlanes[i].w < -a_radius)
+			return false;
+	}
+	return true;
 }
 
-glm::mat4 Camera::GetProjectionMatrix(float a_width, float a_height)
+void Camera::UpdateMatrices()
 {
-	return glm::perspective(glm::pi<float>() * 0.25f, a_width / a_height, 0.1f, 1000.f);
+	if (m_viewDirty == false && m_projectionDirty == false)
+		return;
+
+	if (m_viewDirty)
+	{
+		float thetaR = glm::radians(m_theta);
+		float phiR = glm::radians(m_phi);
+		glm::vec3 forward(glm::cos(phiR) * glm::cos(thetaR), 
+			glm::sin(phiR), glm::cos(phiR) * glm::sin(thetaR));
+		m_viewMatrix = glm::lookAt(m_position, m_position + forward, glm::vec3(0, 1, 0));
+		m_inverseView = glm::inverse(m_viewMatrix);
+	}
+
+	if (m_projectionDirty)
+	{
+		m_projectionMatrix = glm::perspective(glm::pi<float>() * 0.25f, m_aspectRatio, 0.1f, 1000.f);
+		m_inverseProjection = glm::inverse(m_projectionMatrix);
+	}
+
+	m_projectionView = m_projectionMatrix * m_viewMatrix;
+	m_inverseProjectionView = m_inverseView * m_inverseProjection;
+
+	// Each plane is a row of the projection view added to or taken from the last
+	glm::mat4 rows = glm::transpose(m_projectionView);
+	m_frustumPlanes[PLANE_LEFT] = rows[3] + rows[0];
+	m_frustumPlanes[PLANE_RIGHT] = rows[3] - rows[0];
+	m_frustumPlanes[PLANE_BOTTOM] = rows[3] + rows[1];
+	m_frustumPlanes[PLANE_TOP] = rows[3] - rows[1];
+	m_frustumPlanes[PLANE_NEAR] = rows[3] + rows[2];
+	m_frustumPlanes[PLANE_FAR] = rows[3] - rows[2];
+	for (unsigned int i = 0; i < PLANE_Count; i++)
+		m_frustumPlanes[i] /= glm::length(glm::vec3(m_frustumPlanes[i]));
+
+	m_viewDirty = false;
+	m_projectionDirty = false;
 }
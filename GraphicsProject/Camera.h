@@ -12,8 +12,21 @@
 class Camera
 {
 public:
+	// Frustum planes, each pointing inwards as (normal, distance)
+	enum ePlane : unsigned int
+	{
+		PLANE_LEFT = 0,
+		PLANE_RIGHT,
+		PLANE_BOTTOM,
+		PLANE_TOP,
+		PLANE_NEAR,
+		PLANE_FAR,
+
+		PLANE_Count
+	};
+
 	// Default Constructor
-	Camera() {};
+	Camera();
 
 	// Constructor
 	Camera(glm::vec3 a_position, float a_theta, float a_phi, bool a_stationary);
@@ -21,9 +34,12 @@ public:
 	// Destructor
 	~Camera() {};
 
-	// Update function
+	// Update function, the matrices are rebuilt here if the camera moved
 	void Update(float a_deltaTime);
 
+	// Set the shape of the view, the projection is rebuilt if it changed
+	void SetAspectRatio(float a_width, float a_height);
+
 	// Get position of camera
 	glm::vec3 GetPosition() { return m_position; }
 
@@ -36,17 +52,40 @@ public:
 	// Get camera phi angle
 	float GetPhi() { return m_phi; }
 
-	// Get camera view matrix
-	glm::mat4 GetViewMatrix();
+	// Cached matrices, only rebuilt when the camera moves or the aspect
+	// ratio changes rather than every time they are asked for
+	const glm::mat4& GetViewMatrix()				{ UpdateMatrices(); return m_viewMatrix; }
+	const glm::mat4& GetProjectionMatrix()			{ UpdateMatrices(); return m_projectionMatrix; }
+	const glm::mat4& GetProjectionView()			{ UpdateMatrices(); return m_projectionView; }
+	const glm::mat4& GetInverseViewMatrix()			{ UpdateMatrices(); return m_inverseView; }
+	const glm::mat4& GetInverseProjectionMatrix()	{ UpdateMatrices(); return m_inverseProjection; }
+	const glm::mat4& GetInverseProjectionView()		{ UpdateMatrices(); return m_inverseProjectionView; }
+	const glm::vec4& GetFrustumPlane(ePlane a_plane) { UpdateMatrices(); return m_frustumPlanes[a_plane]; }
+
+	// Whether a world space sphere is at least partly inside the frustum
+	bool IsSphereVisible(const glm::vec3& a_center, float a_radius);
 
-	// Get camera projection matrix
-	glm::mat4 GetProjectionMatrix(float a_width, float a_height);
 private:
+	// Rebuild whichever matrices are out of date
+	void UpdateMatrices();
+
 	float m_theta; // In Degrees
 	float m_phi;   // In Degrees
 	glm::vec3 m_position;
 	bool m_stationary;
 
 	float m_lastMouseX, m_lastMouseY;
+
+	float m_aspectRatio;
+	bool m_viewDirty;
+	bool m_projectionDirty;
+
+	glm::mat4 m_viewMatrix;
+	glm::mat4 m_projectionMatrix;
+	glm::mat4 m_projectionView;
+	glm::mat4 m_inverseView;
+	glm::mat4 m_inverseProjection;
+	glm::mat4 m_inverseProjectionView;
+	glm::vec4 m_frustumPlanes[PLANE_Count];
 };
 
@@ -0,0 +1,186 @@
+/*----------------------------------------------
+	File Name: DeferredRenderer.cpp
+	Purpose: Light the scene from a g-buffer
+	Author: Logan Ryan
+	Modified: 8 April 2021
+------------------------------------------------
+	Copyright 2021 Logan Ryan
+----------------------------------------------*/
+#include "DeferredRenderer.h"
+#include "Scene.h"
+#include "Instance.h"
+#include "Camera.h"
+
+#include <gl_core_4_4.h>
+#include <cstdio>
+
+DeferredRenderer::DeferredRenderer()
+	: m_framebuffer(0), m_depth(0), m_width(0), m_height(0), m_vao(0)
+{
+	for (unsigned int i = 0; i < TARGET_Count; i++)
+		m_targets[i] = 0;
+}
+
+DeferredRenderer::~DeferredRenderer()
+{
+	Destroy();
+	if (m_vao != 0)
+		glDeleteVertexArrays(1, &m_vao);
+}
+
+bool DeferredRenderer::LoadShaders()
+{
+	// The g-buffer shaders share lit.vert, only the output differs
+	if (m_gbufferShader.loadShader(aie::eShaderStage::VERTEX, "./bin/shaders/lit.vert") == false ||
+		m_gbufferShader.loadShader(aie::eShaderStage::FRAGMENT, "./bin/shaders/gbuffer.frag") == false)
+	{
+		printf("G-Buffer Shader had an error: %s\n", m_gbufferShader.getLastError());
+		return false;
+	}
+
+	if (m_lightingShader.loadShader(aie::eShaderStage::VERTEX, "./bin/shaders/deferred.vert") == false ||
+		m_lightingShader.loadShader(aie::eShaderStage::FRAGMENT, "./bin/shaders/deferred.frag") == false ||
+		m_lightingShader.beginLink() == false)
+	{
+		printf("Deferred Lighting Shader had an error: %s\n", m_lightingShader.getLastError());
+		return false;
+	}
+	return true;
+}
+
+bool DeferredRenderer::Draw(Scene* a_scene)
+{
+	// A g-buffer that failed isn't retried until the size changes
+	int width = (int)a_scene->GetWindowSize().x;
+	int height = (int)a_scene->GetWindowSize().y;
+	if (width != m_width || height != m_height)
+		Create(width, height);
+	if (m_framebuffer == 0)
+		return false;
+
+	// === G-Buffer Pass ===
+	// Blending would mix the targets' alpha into each other
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glDisable(GL_BLEND);
+
+	// Cleared per target so the screen's clear colour is left alone
+	const float black[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < (int)TARGET_Count; i++)
+		glClearBufferfv(GL_COLOR, i, black);
+	glClearBufferfi(GL_DEPTH_STENCIL, 0, 1.f, 0);
+
+	for (auto instance : a_scene->GetVisibleInstances())
+		instance->DrawGeometry(a_scene, &m_gbufferShader);
+
+	// === Lighting Pass ===
+	// Lights the screen directly, the clear colour is kept where nothing was drawn
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (m_lightingShader.isReady())
+	{
+		glDisable(GL_DEPTH_TEST);
+		glDepthMask(GL_FALSE);
+
+		m_lightingShader.bind();
+
+		const char* samplers[TARGET_Count] = { "AlbedoTexture", "NormalTexture", "MaterialTexture", "AmbientTexture" };
+		for (unsigned int i = 0; i < TARGET_Count; i++)
+		{
+			glActiveTexture(GL_TEXTURE0 + i);
+			glBindTexture(GL_TEXTURE_2D, m_targets[i]);
+			m_lightingShader.bindUniform(samplers[i], (int)i);
+		}
+		glActiveTexture(GL_TEXTURE0 + TARGET_Count);
+		glBindTexture(GL_TEXTURE_2D, m_depth);
+		m_lightingShader.bindUniform("DepthTexture", (int)TARGET_Count);
+		glActiveTexture(GL_TEXTURE0);
+
+		m_lightingShader.bindUniform("InverseProjectionView", a_scene->GetCamera()->GetInverseProjectionView());
+
+		a_scene->BindLighting(&m_lightingShader);
+
+		glBindVertexArray(m_vao);
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+		glBindVertexArray(0);
+
+		glDepthMask(GL_TRUE);
+		glEnable(GL_DEPTH_TEST);
+	}
+
+	// === Depth Copy ===
+	// Particles and gizmos are drawn after this and need the scene's depth
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, m_framebuffer);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+	glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height,
+		GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	glEnable(GL_BLEND);
+	return true;
+}
+
+bool DeferredRenderer::Create(int a_width, int a_height)
+{
+	Destroy();
+
+	if (m_vao == 0)
+		glGenVertexArrays(1, &m_vao);
+
+	m_width = a_width;
+	m_height = a_height;
+
+	// Normals need more precision than the colours, and hold the specular power
+	const GLenum formats[TARGET_Count] = { GL_RGBA8, GL_RGBA16F, GL_RGBA8, GL_RGBA8 };
+
+	glGenFramebuffers(1, &m_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+
+	glGenTextures(TARGET_Count, m_targets);
+	GLenum attachments[TARGET_Count];
+	for (unsigned int i = 0; i < TARGET_Count; i++)
+	{
+		glBindTexture(GL_TEXTURE_2D, m_targets[i]);
+		glTexStorage2D(GL_TEXTURE_2D, 1, formats[i], m_width, m_height);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+		attachments[i] = GL_COLOR_ATTACHMENT0 + i;
+		glFramebufferTexture2D(GL_FRAMEBUFFER, attachments[i], GL_TEXTURE_2D, m_targets[i], 0);
+	}
+	glDrawBuffers(TARGET_Count, attachments);
+
+	// Matches the window's depth format so it can be blitted to the screen
+	glGenTextures(1, &m_depth);
+	glBindTexture(GL_TEXTURE_2D, m_depth);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, m_width, m_height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_depth, 0);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("G-Buffer framebuffer is incomplete (0x%x)\n", status);
+		Destroy();
+		return false;
+	}
+	return true;
+}
+
+void DeferredRenderer::Destroy()
+{
+	if (m_framebuffer != 0)
+	{
+		glDeleteFramebuffers(1, &m_framebuffer);
+		glDeleteTextures(TARGET_Count, m_targets);
+		glDeleteTextures(1, &m_depth);
+	}
+
+	m_framebuffer = 0;
+	m_depth = 0;
+	for (unsigned int i = 0; i < TARGET_Count; i++)
+		m_targets[i] = 0;
+}
@@ -0,0 +1,65 @@
+/*----------------------------------------------
+	File Name: DeferredRenderer.h
+	Purpose: Light the scene from a g-buffer
+	Author: Logan Ryan
+	Modified: 8 April 2021
+------------------------------------------------
+	Copyright 2021 Logan Ryan
+----------------------------------------------*/
+#pragma once
+#include "Shader.h"
+#include "ShaderVariants.h"
+
+class Scene;
+
+// Draws the scene's instances into a g-buffer, then lights every pixel once
+// with a full screen pass. Point lights come from the scene's light clusters,
+// the same lists forward lighting uses. The g-buffer's depth is copied to the
+// screen afterwards so particles and gizmos draw over the result as normal
+class DeferredRenderer
+{
+public:
+	// G-buffer targets, in the order gbuffer.frag writes them
+	enum eTarget : unsigned int
+	{
+		ALBEDO = 0,	// Diffuse color
+		NORMAL,		// World normal and specular power
+		MATERIAL,	// Specular color
+		AMBIENT,	// Ambient color
+
+		TARGET_Count
+	};
+
+	// Constructor
+	DeferredRenderer();
+	// Destructor
+	~DeferredRenderer();
+
+	// Start the g-buffer and lighting shaders compiling
+	bool LoadShaders();
+
+	// Draw and light the scene, the g-buffer follows the scene's window size.
+	// False if the g-buffer couldn't be created and nothing was drawn
+	bool Draw(Scene* a_scene);
+
+	// Getters
+	aie::ShaderVariants& GetGBufferShader() { return m_gbufferShader; }
+	aie::ShaderProgram& GetLightingShader() { return m_lightingShader; }
+	unsigned int GetTarget(eTarget a_target) { return m_targets[a_target]; }
+
+protected:
+	// Create the g-buffer, false if the framebuffer can't be used
+	bool Create(int a_width, int a_height);
+	void Destroy();
+
+	aie::ShaderVariants	m_gbufferShader;
+	aie::ShaderProgram	m_lightingShader;
+
+	unsigned int		m_framebuffer;
+	unsigned int		m_targets[TARGET_Count];
+	unsigned int		m_depth;
+	int					m_width, m_height;
+
+	// The full screen triangle has no vertex buffers but still needs a vertex array
+	unsigned int		m_vao;
+};
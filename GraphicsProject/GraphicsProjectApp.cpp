@@ -9,20 +9,32 @@
 #include "GraphicsProjectApp.h"
 #include "Gizmos.h"
 #include "Input.h"
+#include "Texture.h"
+#include "TextureCache.h"
+#include "TextureCooker.h"
+#include "gl_core_4_4.h"
 #include <imgui.h>
 #include <glm/glm.hpp>
 #include <glm/gtx/transform.hpp>
 #include <glm/gtx/quaternion.hpp>
 #include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/random.hpp>
 #include <glm/gtc/quaternion.hpp>
 #include <glm/ext.hpp>
 #include <math.h>
 #include <vector>
 #include <string>
+#include <fstream>
 
 #include "Scene.h"
 #include "Instance.h"
 
+// Light counts the forward and deferred renderers are compared at
+static const int BENCHMARK_LIGHTS[3] = { 4, 64, 1024 };
+// Frames left to settle after changing, then frames averaged
+static const int BENCHMARK_WARMUP_FRAMES = 10;
+static const int BENCHMARK_FRAMES = 60;
+
 #define M_PI 3.14159265
 #define GLM_ENABLE_EXPERIMENTAL
 
@@ -59,6 +71,26 @@ bool GraphicsProjectApp::startup() {
 	// initialise gizmo primitive counts
 	Gizmos::create(10000, 10000, 10000, 10000);
 
+	// build the grid and axis once, they are drawn every frame until destroyed
+	vec4 white(1);
+	vec4 black(0, 0, 0, 1);
+	vec3 gridPoints[84];
+	vec4 gridColours[84];
+	for (int i = 0; i < 21; ++i) {
+		gridPoints[i * 4 + 0] = vec3(-10 + i, 0, 10);
+		gridPoints[i * 4 + 1] = vec3(-10 + i, 0, -10);
+		gridPoints[i * 4 + 2] = vec3(10, 0, -10 + i);
+		gridPoints[i * 4 + 3] = vec3(-10, 0, -10 + i);
+		for (int j = 0; j < 4; ++j)
+			gridColours[i * 4 + j] = i == 10 ? white : black;
+	}
+
+	Gizmos::beginRetained();
+	Gizmos::addLines(gridPoints, gridColours, 84);
+	// add a transform so that we can see the axis
+	Gizmos::addTransform(mat4(1));
+	m_gridGizmo = Gizmos::endRetained();
+
 	// create simple camera transforms
 	m_viewMatrix = glm::lookAt(vec3(10), vec3(0), vec3(0, 1, 0));
 	m_projectionMatrix = glm::perspective(glm::pi<float>() * 0.25f, 
@@ -78,28 +110,31 @@ bool GraphicsProjectApp::startup() {
 void GraphicsProjectApp::shutdown() {
 
 	// Destroy everything in the app
+	Gizmos::destroyRetained(m_gridGizmo);
 	Gizmos::destroy();
+	m_spriteBenchmark.Destroy();
+
+	delete m_spearTexture;
+	m_spearTexture = nullptr;
+
+	if (m_sceneTimers[0] != 0)
+		glDeleteQueries(2, m_sceneTimers);
 }
 
 void GraphicsProjectApp::update(float deltaTime) {
 
-	// wipe the gizmos clean for this frame
+	// wipe the gizmos clean for this frame, the grid is retained
 	Gizmos::clear();
 
-	// draw a simple grid with gizmos
-	vec4 white(1);
-	vec4 black(0, 0, 0, 1);
-	for (int i = 0; i < 21; ++i) {
-		Gizmos::addLine(vec3(-10 + i, 0, 10),
-						vec3(-10 + i, 0, -10),
-						i == 10 ? white : black);
-		Gizmos::addLine(vec3(10, 0, -10 + i),
-						vec3(-10, 0, -10 + i),
-						i == 10 ? white : black);
+	// Stop if a shader failed to build in the background
+	if (CheckShaders() == false)
+	{
+		quit();
+		return;
 	}
 
-	// add a transform so that we can see the axis
-	Gizmos::addTransform(mat4(1));
+	// Pick up shader edits without restarting
+	m_shaderWatcher.update();
 
 	m_camera.Update(deltaTime);
 
@@ -113,24 +148,19 @@ void GraphicsProjectApp::update(float deltaTime) {
 													 glm::sin(time * 2),
 													 0));
 
+	// Switch light counts and modes while comparing renderers
+	UpdateBenchmark(deltaTime);
+
+	// Add, remove and move the extra point lights
+	UpdateExtraLights(time);
+
 	// Control Model Transform
+	// Moved in place so the instance keeps its virtual texture
 	if (m_selectedItem >= 0)
 	{
-		std::vector<Instance*>::iterator it = m_scene->GetInstances().begin();
-		std::advance(it, m_selectedItem);
-		const char* modelName = m_scene->GetInstances()[m_selectedItem]->GetName();
-		aie::OBJMesh* modelMesh = m_scene->GetInstances()[m_selectedItem]->GetMesh();
-		aie::ShaderProgram* modelShader = m_scene->GetInstances()[m_selectedItem]->GetShader();
-		it = m_scene->GetInstances().erase(it);
-
-		Instance* newModel = new Instance(modelName,
-			m_position,
+		m_scene->GetInstances()[m_selectedItem]->SetTransform(m_position,
 			m_rotation,
-			glm::vec3(m_scale),
-			modelMesh,
-			modelShader);
-
-		m_scene->GetInstances().insert(it, newModel);
+			glm::vec3(m_scale));
 	}
 
 	// Get camera transform for particle emitter
@@ -155,65 +185,88 @@ void GraphicsProjectApp::draw() {
 	// wipe the screen to the background colour
 	clearScreen();
 
-	glm::mat4 projectionMatrix = m_scene->GetCamera()->GetProjectionMatrix(getWindowWidth(), (float)getWindowHeight());
-	glm::mat4 viewMatrix = m_scene->GetCamera()->GetViewMatrix();
 
+	// Time the scene on the GPU
+	if (m_sceneTimers[0] == 0)
+		glGenQueries(2, m_sceneTimers);
+
+	glBeginQuery(GL_TIME_ELAPSED, m_sceneTimers[m_frameCount % 2]);
 	m_scene->Draw();
+	glEndQuery(GL_TIME_ELAPSED);
 
-	// === Draw Particle emitter ===
-	m_particleShader.bind();
-
-	// Create particle transform
-	// Get Euler angles from projection matrix
-	float xAngle = atan2f(projectionMatrix[3][1], projectionMatrix[3][2]);
-	float yAngle = acosf(projectionMatrix[3][3]);
-	float zAngle = atan2(projectionMatrix[1][3], projectionMatrix[2][3]);
-
-	// Build transform
-	glm::mat4 particleTransform = glm::translate(m_emitterPosition) *
-		glm::rotate(glm::mat4(1), zAngle, glm::vec3(0, 0, 1)) *
-		glm::rotate(glm::mat4(1), yAngle + 90.f, glm::vec3(0, 1, 0)) *
-		glm::rotate(glm::mat4(1), xAngle, glm::vec3(1, 0, 0)) *
-		glm::scale(glm::mat4(1), glm::vec3(1));
+	// Read last frame's time if it has finished
+	if (m_frameCount > 0)
+	{
+		unsigned int lastTimer = m_sceneTimers[(m_frameCount + 1) % 2];
+		int available = 0;
+		glGetQueryObjectiv(lastTimer, GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available != 0)
+		{
+			GLuint64 elapsed = 0;
+			glGetQueryObjectui64v(lastTimer, GL_QUERY_RESULT, &elapsed);
+			m_sceneGPUTime = elapsed / 1000000.f;
+		}
+	}
+	m_frameCount++;
 
-	// Set Starting Color
-	m_emitter->SetStartingColor(m_emitterStartingColor);
-	m_emitter->SetEndColor(m_emitterEndColor);
+	// Cached by the camera, and up to date for the window once the scene has drawn
+	const glm::mat4& projectionMatrix = m_scene->GetCamera()->GetProjectionMatrix();
+	const glm::mat4& projectionView = m_scene->GetCamera()->GetProjectionView();
 
-	// Bind particle transform
-	auto pvm = projectionMatrix * viewMatrix * particleTransform;
-	m_particleShader.bindUniform("ProjectionViewModel", pvm);
+	// === Draw Particle emitter ===
+	// Skipped while its shader is still compiling
+	if (m_particleShader.isReady())
+	{
+		m_particleShader.bind();
+
+		// Create particle transform
+		// Get Euler angles from projection matrix
+		float xAngle = atan2f(projectionMatrix[3][1], projectionMatrix[3][2]);
+		float yAngle = acosf(projectionMatrix[3][3]);
+		float zAngle = atan2(projectionMatrix[1][3], projectionMatrix[2][3]);
+
+		// Build transform
+		glm::mat4 particleTransform = glm::translate(m_emitterPosition) *
+			glm::rotate(glm::mat4(1), zAngle, glm::vec3(0, 0, 1)) *
+			glm::rotate(glm::mat4(1), yAngle + 90.f, glm::vec3(0, 1, 0)) *
+			glm::rotate(glm::mat4(1), xAngle, glm::vec3(1, 0, 0)) *
+			glm::scale(glm::mat4(1), glm::vec3(1));
+
+		// Set Starting Color
+		m_emitter->SetStartingColor(m_emitterStartingColor);
+		m_emitter->SetEndColor(m_emitterEndColor);
+
+		// Bind particle transform
+		auto pvm = projectionView * particleTransform;
+		m_particleShader.bindUniform("ProjectionViewModel", pvm);
+
+		m_emitter->draw();
+	}
 
-	m_emitter->draw();
+	Gizmos::draw(projectionView);
 
-	Gizmos::draw(projectionMatrix * viewMatrix);
+	// Sprites over everything while one of their scenes is being timed
+	m_spriteBenchmark.Draw(getWindowWidth(), getWindowHeight());
 }
 
 bool GraphicsProjectApp::LoadShaderAndMeshLogic(Light a_light)
 {
+	// Time startup so the shader binary cache's saving can be seen
+	m_shaderStartTime = getTime();
+
 #pragma region LoadShader
 
-	#pragma region Phong
-		m_phongShader.loadShader(aie::eShaderStage::VERTEX,
-			"./bin/shaders/phong.vert");
-		m_phongShader.loadShader(aie::eShaderStage::FRAGMENT,
-			"./bin/shaders/phong.frag");
-		if (m_phongShader.link() == false)
-		{
-			printf("Phong Shader had an error: %s\n", m_phongShader.getLastError());
-			return false;
-		}
-	#pragma endregion
+	// Programs are only submitted here, the driver compiles them while the
+	// meshes load and draws using them are skipped until they are ready
 
-	#pragma region NormalMapShader
-		m_normalMapShaders.loadShader(aie::eShaderStage::VERTEX,
-			"./bin/shaders/normalMap.vert");
-		m_normalMapShaders.loadShader(aie::eShaderStage::FRAGMENT,
-			"./bin/shaders/normalMap.frag");
-		if (m_normalMapShaders.link() == false)
+	#pragma region Lit
+		// Variants are compiled once the meshes show which features they need
+		if (m_litShader.loadShader(aie::eShaderStage::VERTEX,
+			"./bin/shaders/lit.vert") == false ||
+			m_litShader.loadShader(aie::eShaderStage::FRAGMENT,
+			"./bin/shaders/lit.frag") == false)
 		{
-			printf("Normal Map Shader had an error: %s\n",
-				m_normalMapShaders.getLastError());
+			printf("Lit Shader had an error: %s\n", m_litShader.getLastError());
 			return false;
 		}
 	#pragma endregion
@@ -223,14 +276,36 @@ bool GraphicsProjectApp::LoadShaderAndMeshLogic(Light a_light)
 			"./bin/shaders/particle.vert");
 		m_particleShader.loadShader(aie::eShaderStage::FRAGMENT,
 			"./bin/shaders/particle.frag");
-		if (m_particleShader.link() == false)
-		{
-			printf("Particle Shader had an error: %s\n",
-				m_particleShader.getLastError());
+		m_particleShader.beginLink();
+	#pragma endregion
+
+	#pragma region Deferred
+		if (m_deferredRenderer.LoadShaders() == false)
 			return false;
-		}
 	#pragma endregion
 
+	#pragma region Shadows
+		if (m_shadowMap.LoadShaders() == false)
+			return false;
+	#pragma endregion
+
+	#pragma region Occlusion
+		if (m_occlusionCuller.LoadShaders() == false)
+			return false;
+	#pragma endregion
+
+	m_shaderWatcher.watch(&m_litShader);
+	m_shaderWatcher.watch(&m_particleShader);
+	m_shaderWatcher.watch(&m_deferredRenderer.GetGBufferShader());
+	m_shaderWatcher.watch(&m_deferredRenderer.GetLightingShader());
+	m_shaderWatcher.watch(&m_shadowMap.GetShader());
+	m_shaderWatcher.watch(&m_occlusionCuller.GetDepthShader());
+	m_shaderWatcher.watch(&m_occlusionCuller.GetHiZShader());
+
+	m_shadersPending = true;
+	float shaderTime = getTime();
+	printf("Shaders submitted in %.1fms\n", (shaderTime - m_shaderStartTime) * 1000.f);
+
 #pragma endregion
 
 #pragma region MeshLogic
@@ -257,10 +332,20 @@ bool GraphicsProjectApp::LoadShaderAndMeshLogic(Light a_light)
 		}
 	#pragma endregion
 
+	printf("Meshes loaded in %.1fms\n", (getTime() - shaderTime) * 1000.f);
+
+	m_spearTexture = LoadVirtualTexture(m_spearMesh);
+
+	// Textures shared between the meshes
+	aie::TextureCache::getInstance()->printReport();
+
 #pragma endregion
 
 	m_scene = new Scene(&m_camera, glm::vec2(getWindowWidth(), getWindowHeight()), a_light,
 		glm::vec3(0.25f));
+	m_scene->SetDeferredRenderer(&m_deferredRenderer);
+	m_scene->SetShadowMap(&m_shadowMap);
+	m_scene->SetOcclusionCuller(&m_occlusionCuller);
 
 	// Shogun Knife (Imported Model)
 	m_scene->AddInstances(new Instance("Knife", 
@@ -268,15 +353,17 @@ bool GraphicsProjectApp::LoadShaderAndMeshLogic(Light a_light)
 		glm::vec3(0, 0, 0),
 		glm::vec3(0.01f), 
 		&m_gunMesh, 
-		&m_normalMapShaders));
+		&m_litShader));
 
 	// Soul Spear
-	m_scene->AddInstances(new Instance("Spear", 
+	Instance* spear = new Instance("Spear", 
 		glm::vec3(-5, 0, -5),
 		glm::vec3(0, 0, 0),
 		glm::vec3(1),
 		&m_spearMesh,
-		&m_normalMapShaders));
+		&m_litShader);
+	spear->SetVirtualTexture(m_spearTexture);
+	m_scene->AddInstances(spear);
 
 	// Dragon (Stanford Model)
 	m_position = glm::vec3(-5, 0, 5);
@@ -288,7 +375,7 @@ bool GraphicsProjectApp::LoadShaderAndMeshLogic(Light a_light)
 		m_rotation,
 		glm::vec3(m_scale),
 		&m_dragonMesh,
-		&m_phongShader));
+		&m_litShader));
 
 	// Particle Emitter
 	m_emitter = new ParticleEmitter();
@@ -306,9 +393,163 @@ bool GraphicsProjectApp::LoadShaderAndMeshLogic(Light a_light)
 	// Add a green light on the right side
 	m_scene->GetPointLights().push_back(Light(glm::vec3(-5, 3, 0), glm::vec3(0, 1, 0), 50));
 
+	// Start the shader variants the instances need compiling
+	for (auto instance : m_scene->GetInstances())
+		instance->PrepareShaders(m_scene);
+
 	return true;
 }
 
+bool GraphicsProjectApp::CheckShaders()
+{
+	if (m_shadersPending == false)
+		return true;
+
+	// Every program and set of variants started at startup
+	struct Variants { const char* name; aie::ShaderVariants* shader; };
+	struct Program { const char* name; aie::ShaderProgram* shader; };
+	const Variants variants[] = {
+		{ "Lit", &m_litShader },
+		{ "G-Buffer", &m_deferredRenderer.GetGBufferShader() },
+	};
+	const Program programs[] = {
+		{ "Particle", &m_particleShader },
+		{ "Deferred Lighting", &m_deferredRenderer.GetLightingShader() },
+		{ "Shadow", &m_shadowMap.GetShader() },
+		{ "Depth", &m_occlusionCuller.GetDepthShader() },
+		{ "Hi-Z", &m_occlusionCuller.GetHiZShader() },
+	};
+
+	bool ready = true;
+	unsigned int programCount = 0;
+	unsigned int cachedPrograms = 0;
+
+	for (auto& variant : variants)
+	{
+		aie::eLinkStatus status = variant.shader->getLinkStatus();
+		if (status == aie::LINK_FAILED)
+		{
+			printf("%s Shader had an error: %s\n", variant.name, variant.shader->getLastError());
+			return false;
+		}
+		ready = ready && status == aie::LINKED;
+		programCount += (unsigned int)variant.shader->getVariantCount();
+		cachedPrograms += variant.shader->getCachedVariantCount();
+	}
+
+	for (auto& program : programs)
+	{
+		aie::eLinkStatus status = program.shader->getLinkStatus();
+		if (status == aie::LINK_FAILED)
+		{
+			printf("%s Shader had an error: %s\n", program.name, program.shader->getLastError());
+			return false;
+		}
+		ready = ready && status == aie::LINKED;
+		programCount++;
+		cachedPrograms += program.shader->isFromBinaryCache() ? 1 : 0;
+	}
+
+	if (ready)
+	{
+		m_shadersPending = false;
+		printf("Shaders ready after %.1fms (%u of %u programs from binary cache)\n",
+			(getTime() - m_shaderStartTime) * 1000.f, cachedPrograms, programCount);
+	}
+	return true;
+}
+
+aie::VirtualTexture* GraphicsProjectApp::LoadVirtualTexture(aie::OBJMesh& a_mesh)
+{
+	for (size_t i = 0; i < a_mesh.getMaterialCount(); i++)
+	{
+		auto& diffuse = a_mesh.getMaterial(i).diffuseTexture;
+		if (diffuse == nullptr)
+			continue;
+
+		// Cook the tiles once, the same as running with -cook <image> <file> tiled
+		std::string source = diffuse->getFilename();
+		std::string cooked = source.substr(0, source.find_last_of('.')) + ".vtex";
+		if (std::ifstream(cooked).is_open() == false &&
+			aie::TextureCooker::cookTiled(source.c_str(), cooked.c_str()) == false)
+			return nullptr;
+
+		aie::VirtualTexture* texture = new aie::VirtualTexture();
+		if (texture->load(cooked.c_str()) == false)
+		{
+			delete texture;
+			return nullptr;
+		}
+		return texture;
+	}
+	return nullptr;
+}
+
+void GraphicsProjectApp::UpdateBenchmark(float a_deltaTime)
+{
+	if (m_benchmarkStep < 0)
+		return;
+
+	// Average once the new light count and mode have settled, the GPU time
+	// is a frame behind
+	m_benchmarkFrames++;
+	if (m_benchmarkFrames > BENCHMARK_WARMUP_FRAMES)
+	{
+		m_benchmarkGPUTime += m_sceneGPUTime;
+		m_benchmarkFrameTime += a_deltaTime * 1000.f;
+	}
+
+	if (m_benchmarkFrames == BENCHMARK_WARMUP_FRAMES + BENCHMARK_FRAMES)
+	{
+		float* result = m_benchmarkResults[m_benchmarkStep / RENDER_MODE_Count][m_benchmarkStep % RENDER_MODE_Count];
+		result[0] = m_benchmarkGPUTime / BENCHMARK_FRAMES;
+		result[1] = m_benchmarkFrameTime / BENCHMARK_FRAMES;
+
+		m_benchmarkStep++;
+		m_benchmarkFrames = 0;
+		m_benchmarkGPUTime = 0;
+		m_benchmarkFrameTime = 0;
+
+		// Finished, put the scene back how it was
+		if (m_benchmarkStep == 3 * RENDER_MODE_Count)
+		{
+			printf("Lights  Forward GPU/Frame  Deferred GPU/Frame\n");
+			for (int i = 0; i < 3; i++)
+				printf("%6d  %6.2f / %6.2fms  %6.2f / %6.2fms\n", BENCHMARK_LIGHTS[i],
+					m_benchmarkResults[i][FORWARD][0], m_benchmarkResults[i][FORWARD][1],
+					m_benchmarkResults[i][DEFERRED][0], m_benchmarkResults[i][DEFERRED][1]);
+
+			m_benchmarkStep = -1;
+			m_benchmarkDone = true;
+			m_scene->SetRenderMode(m_benchmarkSavedMode);
+			m_extraLights = m_benchmarkSavedLights;
+			return;
+		}
+	}
+
+	// Both modes are timed with the same lights before the count changes
+	m_extraLights = BENCHMARK_LIGHTS[m_benchmarkStep / RENDER_MODE_Count] - 2;
+	m_scene->SetRenderMode((eRenderMode)(m_benchmarkStep % RENDER_MODE_Count));
+}
+
+void GraphicsProjectApp::UpdateExtraLights(float a_time)
+{
+	// The first two point lights are the stationary ones
+	std::vector<Light>& lights = m_scene->GetPointLights();
+	size_t count = 2 + (size_t)m_extraLights;
+	while (lights.size() > count)
+		lights.pop_back();
+	while (lights.size() < count)
+	{
+		glm::vec3 position = glm::vec3(glm::linearRand(-10.f, 10.f), 0, glm::linearRand(-10.f, 10.f));
+		lights.push_back(Light(position, glm::linearRand(glm::vec3(0.2f), glm::vec3(1)), 2));
+	}
+
+	// Bob the extra lights up and down
+	for (size_t i = 2; i < lights.size(); i++)
+		lights[i].m_direction.y = 1.f + glm::sin(a_time * 2 + i) * 0.75f;
+}
+
 void GraphicsProjectApp::IMGUI_Logic()
 {
 	// Light settings
@@ -320,6 +561,142 @@ void GraphicsProjectApp::IMGUI_Logic()
 	ImGui::DragFloat3("Light 2 Direction", &m_scene->GetPointLights()[1].m_direction[0], 0.1f, -10.f, 10.f);
 	ImGui::DragFloat3("Light 2 Color", &m_scene->GetPointLights()[1].m_color[0], 1.f, 0.f, 255.f);
 	ImGui::DragFloat3("Ambient Light", &m_scene->GetAmbientLight()[0], 0.25f, -1.f, 1.f);
+	ImGui::SliderInt("Extra Lights", &m_extraLights, 0, 2048);
+	LightClusters& clusters = m_scene->GetLightClusters();
+	ImGui::Text("Clusters: %u lights, %u indices, %.2fms", clusters.GetLightCount(),
+		clusters.GetIndexCount(), clusters.GetUpdateTime());
+	ImGui::End();
+
+	// Renderer settings
+	ImGui::Begin("Renderer");
+	int renderMode = (int)m_scene->GetRenderMode();
+	if (ImGui::Combo("Mode", &renderMode, "Forward\0Deferred\0\0"))
+		m_scene->SetRenderMode((eRenderMode)renderMode);
+	ImGui::Text("Scene GPU: %.2fms  Frame: %.2fms", m_sceneGPUTime, 1000.f / ImGui::GetIO().Framerate);
+
+	if (m_benchmarkStep >= 0)
+		ImGui::Text("Comparing... %d of %d", m_benchmarkStep + 1, 3 * (int)RENDER_MODE_Count);
+	else if (ImGui::Button("Compare Forward and Deferred"))
+	{
+		m_benchmarkSavedMode = m_scene->GetRenderMode();
+		m_benchmarkSavedLights = m_extraLights;
+		m_benchmarkStep = 0;
+		m_benchmarkFrames = 0;
+		m_benchmarkGPUTime = 0;
+		m_benchmarkFrameTime = 0;
+	}
+
+	// GPU time then whole frame time for each mode
+	if (m_benchmarkDone)
+	{
+		ImGui::Columns(3, "RendererComparison");
+		ImGui::Text("Lights"); ImGui::NextColumn();
+		ImGui::Text("Forward"); ImGui::NextColumn();
+		ImGui::Text("Deferred"); ImGui::NextColumn();
+		for (int i = 0; i < 3; i++)
+		{
+			ImGui::Text("%d", BENCHMARK_LIGHTS[i]); ImGui::NextColumn();
+			for (unsigned int mode = 0; mode < RENDER_MODE_Count; mode++)
+			{
+				ImGui::Text("%.2f / %.2fms", m_benchmarkResults[i][mode][0], m_benchmarkResults[i][mode][1]);
+				ImGui::NextColumn();
+			}
+		}
+		ImGui::Columns(1);
+	}
+	ImGui::End();
+
+	// 2D renderer benchmarks
+	ImGui::Begin("Sprites");
+	for (unsigned int scene = 0; scene < SPRITE_SCENE_Count; scene++)
+	{
+		eSpriteScene spriteScene = (eSpriteScene)scene;
+		ImGui::PushID(scene);
+		ImGui::Text("%s", SpriteBenchmark::GetSceneName(spriteScene));
+
+		if (m_spriteBenchmark.IsRunning())
+		{
+			if (m_spriteBenchmark.GetScene() == spriteScene)
+				ImGui::Text("Timing... %d of %u", m_spriteBenchmark.GetConfig() + 1, SpriteBenchmark::GetConfigCount(spriteScene));
+		}
+		else if (ImGui::Button("Run"))
+			m_spriteBenchmark.Start(spriteScene);
+
+		// Draw calls, quads and CPU time for each configuration
+		if (m_spriteBenchmark.HasResults(spriteScene))
+		{
+			ImGui::Columns(4, "SpriteResults");
+			ImGui::Text("Config"); ImGui::NextColumn();
+			ImGui::Text("Batches"); ImGui::NextColumn();
+			ImGui::Text("Quads"); ImGui::NextColumn();
+			ImGui::Text("CPU"); ImGui::NextColumn();
+			for (unsigned int config = 0; config < SpriteBenchmark::GetConfigCount(spriteScene); config++)
+			{
+				const SpriteBenchmark::Result& result = m_spriteBenchmark.GetResult(spriteScene, config);
+				ImGui::Text("%s", SpriteBenchmark::GetConfigName(spriteScene, config)); ImGui::NextColumn();
+				ImGui::Text("%u", result.batches); ImGui::NextColumn();
+				ImGui::Text("%u", result.quads); ImGui::NextColumn();
+				ImGui::Text("%.2fms", result.cpuTime); ImGui::NextColumn();
+			}
+			ImGui::Columns(1);
+		}
+		ImGui::PopID();
+	}
+	ImGui::End();
+
+	// Shadow settings
+	ImGui::Begin("Shadows");
+	bool shadows = m_shadowMap.IsEnabled();
+	if (ImGui::Checkbox("Enabled", &shadows))
+		m_shadowMap.SetEnabled(shadows);
+
+	int cascades = (int)m_shadowMap.GetCascadeCount();
+	int resolution = 0;
+	while ((512u << resolution) < m_shadowMap.GetResolution() && resolution < 3)
+		resolution++;
+	bool cascadesChanged = ImGui::SliderInt("Cascades", &cascades, 1, ShadowMap::MAX_CASCADES);
+	bool resolutionChanged = ImGui::Combo("Resolution", &resolution, "512\0" "1024\0" "2048\0" "4096\0\0");
+	if (cascadesChanged || resolutionChanged)
+		m_shadowMap.SetCascades(cascades, 512u << resolution);
+
+	float shadowDistance = m_shadowMap.GetShadowDistance();
+	if (ImGui::DragFloat("Distance", &shadowDistance, 1.f, 5.f, 500.f))
+		m_shadowMap.SetShadowDistance(shadowDistance);
+	float splitBlend = m_shadowMap.GetSplitBlend();
+	if (ImGui::SliderFloat("Split Blend", &splitBlend, 0.f, 1.f))
+		m_shadowMap.SetSplitBlend(splitBlend);
+
+	// Included in the scene's GPU time too
+	ImGui::Text("Shadow pass: CPU %.2fms  GPU %.2fms", m_shadowMap.GetUpdateTime(), m_shadowMap.GetGPUTime());
+	for (unsigned int i = 0; i < m_shadowMap.GetCascadeCount(); i++)
+		ImGui::Text("Cascade %u: %u drawn, %u culled", i, m_shadowMap.GetDrawnCount(i), m_shadowMap.GetCulledCount(i));
+	ImGui::End();
+
+	// Occlusion settings
+	ImGui::Begin("Occlusion");
+	bool culling = m_occlusionCuller.IsEnabled();
+	if (ImGui::Checkbox("Culling", &culling))
+		m_occlusionCuller.SetEnabled(culling);
+	int occlusionMode = (int)m_occlusionCuller.GetMode();
+	if (ImGui::Combo("Mode", &occlusionMode, "GPU Hi-Z\0CPU Raster\0\0"))
+		m_occlusionCuller.SetMode((eOcclusionMode)occlusionMode);
+	bool prepass = m_occlusionCuller.IsDepthPrepassEnabled();
+	if (ImGui::Checkbox("Depth Pre-Pass", &prepass))
+		m_occlusionCuller.SetDepthPrepass(prepass);
+	ImGui::Text("Occluded: %u of %u tested", m_occlusionCuller.GetOccludedCount(), m_occlusionCuller.GetTestedCount());
+	if (m_occlusionCuller.GetMode() == CPU_RASTER)
+	{
+		float occluderSize = m_occlusionCuller.GetOccluderSize();
+		if (ImGui::SliderFloat("Occluder Size", &occluderSize, 0.f, 1.f))
+			m_occlusionCuller.SetOccluderSize(occluderSize);
+
+		// Triangles per millisecond measures the rasterizer on its own
+		SoftwareOcclusion& software = m_occlusionCuller.GetSoftwareOcclusion();
+		ImGui::Text("Occluders: %u, %u triangles", m_occlusionCuller.GetOccluderCount(), software.GetTriangleCount());
+		ImGui::Text("Setup: %.2fms  Raster: %.2fms", software.GetSetupTime(), software.GetRasterTime());
+		if (software.GetRasterTime() > 0)
+			ImGui::Text("%.0f triangles per ms", software.GetTriangleCount() / software.GetRasterTime());
+	}
 	ImGui::End();
 
 	// Model settings
@@ -393,5 +770,45 @@ void GraphicsProjectApp::IMGUI_Logic()
 	ImGui::DragFloat3("Position", &m_emitterPosition[0], 0.1f, -10.f, 10.f);
 	ImGui::ColorEdit3("Starting Color", &m_emitterStartingColor[0]);
 	ImGui::ColorEdit3("Ending Color", &m_emitterEndColor[0]);
+	int sortMode = m_emitter->GetSortMode();
+	if (ImGui::Combo("Sorting", &sortMode, "None\0Back To Front\0Incremental\0Additive\0\0"))
+	{
+		m_emitter->SetSortMode((eParticleSortMode)sortMode);
+	}
+	ImGui::End();
+
+	// Texture memory, video memory and pixels kept in system memory
+	ImGui::Begin("Texture Memory");
+	ImGui::Text("GPU: %.2f MB", aie::Texture::getTotalMemorySize() / (1024.f * 1024.f));
+	ImGui::Text("CPU: %.2f MB", aie::Texture::getTotalCPUMemorySize() / (1024.f * 1024.f));
+	ImGui::Text("Shared: %.2f MB saved", aie::TextureCache::getInstance()->getBytesSaved() / (1024.f * 1024.f));
+	if (m_spearTexture != nullptr)
+	{
+		// Tiles the feedback asked for that were already resident
+		const aie::VirtualTexture::TileCache& tiles = m_spearTexture->getTileCache();
+		unsigned int requests = tiles.getHitCount() + tiles.getMissCount();
+		ImGui::Text("Virtual: %u of %u tiles hit (%.1f%%), %u evicted", tiles.getHitCount(), requests,
+			requests > 0 ? 100.f * tiles.getHitCount() / requests : 0.f, tiles.getEvictionCount());
+	}
+	if (ImGui::CollapsingHeader("Textures"))
+	{
+		const char* residencyNames[] = { "GPU Only", "CPU Readback", "Streaming" };
+		ImGui::Columns(5, "TextureMemory");
+		ImGui::Text("File"); ImGui::NextColumn();
+		ImGui::Text("Size"); ImGui::NextColumn();
+		ImGui::Text("GPU KB"); ImGui::NextColumn();
+		ImGui::Text("CPU KB"); ImGui::NextColumn();
+		ImGui::Text("Residency"); ImGui::NextColumn();
+		ImGui::Separator();
+		for (auto texture : aie::Texture::getTextures())
+		{
+			ImGui::Text("%s", texture->getFilename().c_str()); ImGui::NextColumn();
+			ImGui::Text("%u x %u", texture->getWidth(), texture->getHeight()); ImGui::NextColumn();
+			ImGui::Text("%u", texture->getMemorySize() / 1024); ImGui::NextColumn();
+			ImGui::Text("%u", texture->getCPUMemorySize() / 1024); ImGui::NextColumn();
+			ImGui::Text("%s", residencyNames[texture->getResidency()]); ImGui::NextColumn();
+		}
+		ImGui::Columns(1);
+	}
 	ImGui::End();
 }
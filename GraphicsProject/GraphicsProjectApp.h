@@ -11,12 +11,19 @@
 #include "Application.h"
 #include "Mesh.h"
 #include "Shader.h"
+#include "ShaderVariants.h"
+#include "ShaderWatcher.h"
 #include <glm/mat4x4.hpp>
 #include "OBJMesh.h"
 #include "Camera.h"
 
 #include "Scene.h"
 #include "ParticleEmitter.h"
+#include "DeferredRenderer.h"
+#include "ShadowMap.h"
+#include "OcclusionCuller.h"
+#include "SpriteBenchmark.h"
+#include "VirtualTexture.h"
 
 class GraphicsProjectApp : public aie::Application {
 public:
@@ -50,13 +57,29 @@ protected:
 	glm::mat4	m_projectionMatrix;
 
 	// === SHADER ===
-	aie::ShaderProgram m_phongShader;
-	aie::ShaderProgram m_normalMapShaders;
+	// Lit meshes, with a variant for each set of material features
+	aie::ShaderVariants m_litShader;
 	aie::ShaderProgram m_particleShader;
+
+	// Draws the scene when it is in deferred mode
+	DeferredRenderer m_deferredRenderer;
+	// The sun's cascaded shadows
+	ShadowMap m_shadowMap;
+	// Depth pre-pass and hi-z culling
+	OcclusionCuller m_occlusionCuller;
+
+	// Reloads shaders when their files are saved
+	aie::ShaderWatcher m_shaderWatcher;
+
+	// Shaders compile in the background after startup
+	bool m_shadersPending = false;
+	float m_shaderStartTime = 0;
 	// ==============
 
 	// === TEXTURE ===
 	aie::Texture m_particleTexture;
+	// The spear's diffuse map, streamed in tiles as it is seen
+	aie::VirtualTexture* m_spearTexture = nullptr;
 	// ===============
 
 	// Create a Dragon
@@ -76,6 +99,32 @@ protected:
 
 	Scene*			   m_scene;
 
+	// Retained gizmo for the ground grid and axis
+	unsigned int m_gridGizmo = 0;
+
+	// Small moving point lights added on top of the stationary two
+	int m_extraLights = 0;
+
+	// GPU time spent drawing the scene, each frame's query is read the frame
+	// after so it doesn't wait on the GPU
+	unsigned int m_sceneTimers[2] = { 0, 0 };
+	unsigned int m_frameCount = 0;
+	float m_sceneGPUTime = 0;
+
+	// Forward against deferred at a few light counts, a step for each pair
+	int m_benchmarkStep = -1;
+	int m_benchmarkFrames = 0;
+	float m_benchmarkGPUTime = 0;
+	float m_benchmarkFrameTime = 0;
+	bool m_benchmarkDone = false;
+	eRenderMode m_benchmarkSavedMode = FORWARD;
+	int m_benchmarkSavedLights = 0;
+	// GPU and frame time in ms for each light count and mode
+	float m_benchmarkResults[3][RENDER_MODE_Count][2];
+
+	// Times the 2D renderer on fixed sprite scenes drawn over the screen
+	SpriteBenchmark m_spriteBenchmark;
+
 	// Selected object
 	int m_selectedItem = -1;
 
@@ -89,6 +138,15 @@ protected:
 public:
 	// Load shaders and meshes
 	bool LoadShaderAndMeshLogic(Light a_light);
+	// Report shaders once they finish compiling, false if one failed
+	bool CheckShaders();
+	// Stream a mesh's diffuse map through a virtual texture, cooking its tiles
+	// next to the image the first time. nullptr if it has none or can't load
+	aie::VirtualTexture* LoadVirtualTexture(aie::OBJMesh& a_mesh);
+	// Step the forward and deferred comparison
+	void UpdateBenchmark(float a_deltaTime);
+	// Keep the extra point lights at the count set in the UI
+	void UpdateExtraLights(float a_time);
 	// Setup IMGUI
 	void IMGUI_Logic();
 };
\ No newline at end of file
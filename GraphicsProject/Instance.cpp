@@ -13,20 +13,23 @@
 #include "Camera.h"
 #include "Mesh.h"
 #include "Shader.h"
+#include "ShaderVariants.h"
+#include "DeferredRenderer.h"
 
 #include <Texture.h>
+#include <VirtualTexture.h>
 #include <Application.h>
 #include <glm/ext.hpp>
 
 
-Instance::Instance(const char* a_name, glm::mat4 a_transform, aie::OBJMesh* a_mesh, aie::ShaderProgram* a_shader)
-	: m_transform(a_transform), m_mesh(a_mesh), m_shader(a_shader), m_name(a_name)
+Instance::Instance(const char* a_name, glm::mat4 a_transform, aie::OBJMesh* a_mesh, aie::ShaderVariants* a_shader)
+	: m_transform(a_transform), m_mesh(a_mesh), m_shader(a_shader), m_virtualTexture(nullptr), m_name(a_name)
 {
 
 }
 
-Instance::Instance(const char* a_name, glm::vec3 a_position, glm::vec3 a_eulerAngles, glm::vec3 a_scale, aie::OBJMesh* a_mesh, aie::ShaderProgram* a_shader)
-	: m_mesh(a_mesh), m_shader(a_shader), m_name(a_name)
+Instance::Instance(const char* a_name, glm::vec3 a_position, glm::vec3 a_eulerAngles, glm::vec3 a_scale, aie::OBJMesh* a_mesh, aie::ShaderVariants* a_shader)
+	: m_mesh(a_mesh), m_shader(a_shader), m_virtualTexture(nullptr), m_name(a_name)
 {
 	m_position = a_position;
 	m_eulerAngles = a_eulerAngles;
@@ -37,28 +40,102 @@ Instance::Instance(const char* a_name, glm::vec3 a_position, glm::vec3 a_eulerAn
 
 void Instance::Draw(Scene* a_scene)
 {
-	m_shader->bind();
+	DrawVariants(a_scene, m_shader, true);
+}
+
+void Instance::DrawGeometry(Scene* a_scene, aie::ShaderVariants* a_shader)
+{
+	DrawVariants(a_scene, a_shader, false);
+}
+
+void Instance::DrawDepth(const glm::mat4& a_projectionView, aie::ShaderProgram* a_shader)
+{
+	a_shader->bindUniform("ProjectionViewModel", a_projectionView * m_transform);
+	m_mesh->drawPositions();
+}
+
+void Instance::DrawFeedback(Scene* a_scene)
+{
+	// Lighting is still bound so no two samplers are left sharing a unit
+	if (m_virtualTexture != nullptr)
+		DrawVariants(a_scene, m_shader, true, true);
+}
+
+void Instance::GetBounds(glm::vec3& a_center, float& a_radius)
+{
+	glm::vec3 boundsMin = m_mesh->getBoundsMin();
+	glm::vec3 boundsMax = m_mesh->getBoundsMax();
+
+	// Grow the radius by the largest scale on any axis
+	float scale = glm::max(glm::length(glm::vec3(m_transform[0])),
+		glm::max(glm::length(glm::vec3(m_transform[1])), glm::length(glm::vec3(m_transform[2]))));
+
+	a_center = glm::vec3(m_transform * glm::vec4((boundsMin + boundsMax) * 0.5f, 1));
+	a_radius = glm::length(boundsMax - boundsMin) * 0.5f * scale;
+}
+
+void Instance::PrepareShaders(Scene* a_scene)
+{
+	for (unsigned int features : m_mesh->getShaderFeatures())
+	{
+		GetVariant(m_shader, features);
+
+		// Deferred mode draws with the g-buffer shaders instead
+		if (a_scene->GetDeferredRenderer() != nullptr)
+			GetVariant(&a_scene->GetDeferredRenderer()->GetGBufferShader(), features);
+	}
+}
 
+void Instance::DrawVariants(Scene* a_scene, aie::ShaderVariants* a_shader, bool a_lit, bool a_feedback)
+{
 	// Bind the transform
-	auto pvm = a_scene->GetCamera()->GetProjectionMatrix(a_scene->GetWindowSize().x,
-		a_scene->GetWindowSize().y) * a_scene->GetCamera()->GetViewMatrix() * m_transform;
-
-	m_shader->bindUniform("ProjectionViewModel", pvm);
-	m_shader->bindUniform("CameraPosition", a_scene->GetCamera()->GetPosition());
-	m_shader->bindUniform("AmbientColor", a_scene->GetAmbientLight());
-	m_shader->bindUniform("LightColor", a_scene->GetLight().m_color);
-	m_shader->bindUniform("LightDirection", a_scene->GetLight().m_direction);
-	m_shader->bindUniform("ModelMatrix", m_transform);
-
-	int numLights = a_scene->GetNumLights();
-	m_shader->bindUniform("numLights", numLights);
-	m_shader->bindUniform("PointLightPosition", numLights, 
-		a_scene->GetPointLightPositions());
-	m_shader->bindUniform("PointLightColor", numLights, 
-		a_scene->GetPointLightColor());
-
-	// Draw the mesh
-	m_mesh->draw();
+	glm::mat4 pvm = a_scene->GetCamera()->GetProjectionView() * m_transform;
+
+	// Draw the chunks needing each shader variant with that variant
+	for (unsigned int features : m_mesh->getShaderFeatures())
+	{
+		aie::ShaderProgram* shader = GetVariant(a_shader, features);
+
+		// Skip the draw while the shader is still compiling
+		if (shader->isReady() == false)
+			continue;
+
+		shader->bind();
+
+		shader->bindUniform("ProjectionViewModel", pvm);
+		shader->bindUniform("ModelMatrix", m_transform);
+
+		if (a_lit)
+			a_scene->BindLighting(shader);
+
+		// The g-buffer shader only samples it, the lit shader also writes feedback
+		if (m_virtualTexture != nullptr)
+		{
+			m_virtualTexture->bind(shader->getHandle(), VIRTUAL_TEXTURE_UNIT);
+			if (a_shader == m_shader)
+				shader->bindUniform("VirtualFeedbackPass", a_feedback ? 1 : 0);
+		}
+
+		// Draw the mesh
+		m_mesh->draw(false, (int)features);
+	}
+}
+
+aie::ShaderProgram* Instance::GetVariant(aie::ShaderVariants* a_shader, unsigned int a_features)
+{
+	// Point lights are looked up per cluster, so variants only differ by feature
+	if (m_virtualTexture != nullptr)
+		a_features |= aie::VIRTUAL_TEXTURE;
+	return a_shader->getVariant(a_features);
+}
+
+void Instance::SetTransform(glm::vec3 a_position, glm::vec3 a_eulerAngles, glm::vec3 a_scale)
+{
+	m_position = a_position;
+	m_eulerAngles = a_eulerAngles;
+	m_scale = a_scale;
+
+	m_transform = MakeTransform(a_position, a_eulerAngles, a_scale);
 }
 
 glm::mat4 Instance::MakeTransform(glm::vec3 a_position, glm::vec3 a_eulerAngles, glm::vec3 a_scale)
@@ -16,21 +16,41 @@ namespace aie
 {
 	class OBJMesh;
 	class ShaderProgram;
+	class ShaderVariants;
+	class VirtualTexture;
 }
 
 class Instance
 {
 public:
+	// The virtual texture's cache and indirection, after the shadow map's unit
+	static const unsigned int VIRTUAL_TEXTURE_UNIT = 9;
+
 	// Constructor with transform
 	Instance(const char* a_name, glm::mat4 a_transform, aie::OBJMesh* a_mesh,
-		aie::ShaderProgram* a_shader);
+		aie::ShaderVariants* a_shader);
 	// Constructor with position, euler angles and scale
 	Instance(const char* a_name, glm::vec3 a_position, glm::vec3 a_eulerAngles,
 		glm::vec3 a_scale, aie::OBJMesh* a_mesh, 
-		aie::ShaderProgram* a_shader);
+		aie::ShaderVariants* a_shader);
 
 	// Draw Function
 	void Draw(Scene* a_scene);
+	// Draw with another set of shaders without binding any lighting,
+	// used to fill the deferred renderer's g-buffer
+	void DrawGeometry(Scene* a_scene, aie::ShaderVariants* a_shader);
+
+	// Draw only depth, through the mesh's position stream
+	void DrawDepth(const glm::mat4& a_projectionView, aie::ShaderProgram* a_shader);
+
+	// Draw the virtual texture tiles each pixel needs into its feedback buffer
+	void DrawFeedback(Scene* a_scene);
+
+	// World space sphere around the mesh
+	void GetBounds(glm::vec3& a_center, float& a_radius);
+
+	// Start compiling the shader variants the mesh's materials need
+	void PrepareShaders(Scene* a_scene);
 
 	// Get Functions
 	const char* GetName() { return m_name; }
@@ -39,16 +59,30 @@ public:
 	glm::vec3 GetEulerAngles() { return m_eulerAngles; }
 	glm::vec3 GetScale() { return m_scale; }
 	aie::OBJMesh* GetMesh() { return m_mesh; }
-	aie::ShaderProgram* GetShader() { return m_shader; }
+	aie::ShaderVariants* GetShader() { return m_shader; }
+	aie::VirtualTexture* GetVirtualTexture() { return m_virtualTexture; }
+
+	// Stream the diffuse colour from a virtual texture, it isn't owned
+	void SetVirtualTexture(aie::VirtualTexture* a_texture) { m_virtualTexture = a_texture; }
+
+	// Move the instance, keeping its mesh, shader and virtual texture
+	void SetTransform(glm::vec3 a_position, glm::vec3 a_eulerAngles, glm::vec3 a_scale);
 
 	// Create transform
 	static glm::mat4 MakeTransform(glm::vec3 a_position,
 		glm::vec3 a_eulerAngles, glm::vec3 a_scale);
 
 protected:
+	// Draw each chunk of the mesh with the variant its material needs
+	void DrawVariants(Scene* a_scene, aie::ShaderVariants* a_shader, bool a_lit, bool a_feedback = false);
+
+	// Get the variant for a set of material features, and the virtual texture if set
+	aie::ShaderProgram* GetVariant(aie::ShaderVariants* a_shader, unsigned int a_features);
+
 	glm::mat4			m_transform;
 	aie::OBJMesh*		m_mesh;
-	aie::ShaderProgram* m_shader;
+	aie::ShaderVariants* m_shader;
+	aie::VirtualTexture* m_virtualTexture;
 	const char*			m_name;
 	glm::vec3			m_position;
 	glm::vec3			m_eulerAngles;
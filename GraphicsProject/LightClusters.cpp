@@ -0,0 +1,364 @@
+/*----------------------------------------------
+	File Name: LightClusters.cpp
+	Purpose: Bin point lights into view clusters
+	Author: Logan Ryan
+	Modified: 8 April 2021
+------------------------------------------------
+	Copyright 2021 Logan Ryan
+----------------------------------------------*/
+#include "LightClusters.h"
+#include "Scene.h"
+#include "Shader.h"
+
+#include <gl_core_4_4.h>
+#include <StreamBuffer.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define CLUSTERS_USE_SSE
+#endif
+
+// Padding clusters and lights can never pass a test
+const float EMPTY_BOUND = 1e30f;
+
+LightClusters::LightClusters(unsigned int a_tilesX, unsigned int a_tilesY, unsigned int a_slices)
+	: m_tilesX(a_tilesX), m_tilesY(a_tilesY), m_slices(a_slices),
+	m_near(0), m_far(0), m_tanHalfX(0), m_tanHalfY(0), m_screenSize(0),
+	m_lightCount(0), m_indexCount(0), m_valid(false), m_updateTime(0),
+	m_threadCount(1), m_job(0), m_pending(0), m_quit(false)
+{
+	m_rowStride = (m_tilesX + 3) & ~3u;
+	m_clusterLights.resize(m_tilesX * m_tilesY * m_slices);
+
+	// Leave cores for the main thread and the texture loader
+	unsigned int cores = std::thread::hardware_concurrency();
+	unsigned int workers = cores > 2 ? (cores - 2 < 3 ? cores - 2 : 3) : 0;
+	m_threadCount = workers + 1;
+	for (unsigned int i = 0; i < workers; i++)
+		m_workers.push_back(std::thread(&LightClusters::WorkerThread, this, i));
+}
+
+LightClusters::~LightClusters()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_startWork.notify_all();
+	for (auto& worker : m_workers)
+		worker.join();
+}
+
+void LightClusters::Update(const std::vector<Light>& a_lights, const glm::mat4& a_view,
+	const glm::mat4& a_projection, glm::vec2 a_screenSize)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Recover the frustum from the projection
+	float tanHalfX = 1.f / a_projection[0][0];
+	float tanHalfY = 1.f / a_projection[1][1];
+	float nearPlane = a_projection[3][2] / (a_projection[2][2] - 1.f);
+	float farPlane = a_projection[3][2] / (a_projection[2][2] + 1.f);
+	if (nearPlane != m_near || farPlane != m_far ||
+		tanHalfX != m_tanHalfX || tanHalfY != m_tanHalfY)
+		BuildClusters(nearPlane, farPlane, tanHalfX, tanHalfY);
+	m_screenSize = a_screenSize;
+
+	TransformLights(a_lights, a_view);
+
+	// Slices are interleaved between the threads so near and far work is shared
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_job++;
+		m_pending = m_threadCount - 1;
+	}
+	m_startWork.notify_all();
+
+	BinSlices(0, m_threadCount);
+
+	{
+		std::unique_lock<std::mutex> lock(m_mutex);
+		m_workDone.wait(lock, [this]() { return m_pending == 0; });
+	}
+
+	m_valid = Upload(a_lights);
+
+	m_updateTime = std::chrono::duration<float, std::milli>(
+		std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void LightClusters::BindUniforms(aie::ShaderProgram* a_shader)
+{
+	// w turns cluster lighting off if the lists couldn't be uploaded
+	a_shader->bindUniform("ClusterGrid", glm::vec4(m_tilesX, m_tilesY, m_slices, m_valid ? 1 : 0));
+	a_shader->bindUniform("ClusterTileSize", m_screenSize / glm::vec2(m_tilesX, m_tilesY));
+
+	// Slice = log(depth) * scale + bias
+	float scale = m_slices / std::log(m_far / m_near);
+	a_shader->bindUniform("ClusterDepth", glm::vec4(m_near, m_far, scale, -std::log(m_near) * scale));
+}
+
+void LightClusters::BuildClusters(float a_near, float a_far, float a_tanHalfX, float a_tanHalfY)
+{
+	m_near = a_near;
+	m_far = a_far;
+	m_tanHalfX = a_tanHalfX;
+	m_tanHalfY = a_tanHalfY;
+
+	m_sliceDepths.resize(m_slices + 1);
+	for (unsigned int s = 0; s <= m_slices; s++)
+		m_sliceDepths[s] = m_near * std::pow(m_far / m_near, s / (float)m_slices);
+
+	size_t count = m_rowStride * m_tilesY * m_slices;
+	m_minX.assign(count, EMPTY_BOUND);
+	m_minY.assign(count, EMPTY_BOUND);
+	m_minZ.assign(count, EMPTY_BOUND);
+	m_maxX.assign(count, -EMPTY_BOUND);
+	m_maxY.assign(count, -EMPTY_BOUND);
+	m_maxZ.assign(count, -EMPTY_BOUND);
+
+	// Bounds of each cluster's piece of the frustum, view space looks down -z
+	for (unsigned int s = 0; s < m_slices; s++)
+	{
+		float depthNear = m_sliceDepths[s];
+		float depthFar = m_sliceDepths[s + 1];
+		for (unsigned int y = 0; y < m_tilesY; y++)
+		{
+			float y0 = (-1.f + 2.f * y / m_tilesY) * m_tanHalfY;
+			float y1 = (-1.f + 2.f * (y + 1) / m_tilesY) * m_tanHalfY;
+			for (unsigned int x = 0; x < m_tilesX; x++)
+			{
+				float x0 = (-1.f + 2.f * x / m_tilesX) * m_tanHalfX;
+				float x1 = (-1.f + 2.f * (x + 1) / m_tilesX) * m_tanHalfX;
+
+				size_t i = (s * m_tilesY + y) * m_rowStride + x;
+				m_minX[i] = glm::min(x0 * depthNear, x0 * depthFar);
+				m_maxX[i] = glm::max(x1 * depthNear, x1 * depthFar);
+				m_minY[i] = glm::min(y0 * depthNear, y0 * depthFar);
+				m_maxY[i] = glm::max(y1 * depthNear, y1 * depthFar);
+				m_minZ[i] = -depthFar;
+				m_maxZ[i] = -depthNear;
+			}
+		}
+	}
+}
+
+void LightClusters::TransformLights(const std::vector<Light>& a_lights, const glm::mat4& a_view)
+{
+	m_lightCount = (unsigned int)a_lights.size();
+	unsigned int padded = (m_lightCount + 3) & ~3u;
+	m_lightX.resize(padded);
+	m_lightY.resize(padded);
+	m_lightZ.resize(padded);
+	m_lightRadius.resize(padded);
+
+	for (unsigned int i = 0; i < m_lightCount; i++)
+	{
+		m_lightX[i] = a_lights[i].m_direction.x;
+		m_lightY[i] = a_lights[i].m_direction.y;
+		m_lightZ[i] = a_lights[i].m_direction.z;
+		m_lightRadius[i] = a_lights[i].GetRadius();
+	}
+	for (unsigned int i = m_lightCount; i < padded; i++)
+	{
+		m_lightX[i] = m_lightY[i] = m_lightZ[i] = 0;
+		m_lightRadius[i] = -1;
+	}
+
+#ifdef CLUSTERS_USE_SSE
+	// Four lights at a time
+	__m128 m00 = _mm_set1_ps(a_view[0][0]), m01 = _mm_set1_ps(a_view[0][1]), m02 = _mm_set1_ps(a_view[0][2]);
+	__m128 m10 = _mm_set1_ps(a_view[1][0]), m11 = _mm_set1_ps(a_view[1][1]), m12 = _mm_set1_ps(a_view[1][2]);
+	__m128 m20 = _mm_set1_ps(a_view[2][0]), m21 = _mm_set1_ps(a_view[2][1]), m22 = _mm_set1_ps(a_view[2][2]);
+	__m128 m30 = _mm_set1_ps(a_view[3][0]), m31 = _mm_set1_ps(a_view[3][1]), m32 = _mm_set1_ps(a_view[3][2]);
+	for (unsigned int i = 0; i < padded; i += 4)
+	{
+		__m128 x = _mm_loadu_ps(&m_lightX[i]);
+		__m128 y = _mm_loadu_ps(&m_lightY[i]);
+		__m128 z = _mm_loadu_ps(&m_lightZ[i]);
+		__m128 vx = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m00, x), _mm_mul_ps(m10, y)), _mm_add_ps(_mm_mul_ps(m20, z), m30));
+		__m128 vy = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m01, x), _mm_mul_ps(m11, y)), _mm_add_ps(_mm_mul_ps(m21, z), m31));
+		__m128 vz = _mm_add_ps(_mm_add_ps(_mm_mul_ps(m02, x), _mm_mul_ps(m12, y)), _mm_add_ps(_mm_mul_ps(m22, z), m32));
+		_mm_storeu_ps(&m_lightX[i], vx);
+		_mm_storeu_ps(&m_lightY[i], vy);
+		_mm_storeu_ps(&m_lightZ[i], vz);
+	}
+#else
+	for (unsigned int i = 0; i < padded; i++)
+	{
+		glm::vec4 position = a_view * glm::vec4(m_lightX[i], m_lightY[i], m_lightZ[i], 1);
+		m_lightX[i] = position.x;
+		m_lightY[i] = position.y;
+		m_lightZ[i] = position.z;
+	}
+#endif
+}
+
+void LightClusters::BinSlices(unsigned int a_first, unsigned int a_step)
+{
+	for (unsigned int s = a_first; s < m_slices; s += a_step)
+	{
+		for (unsigned int y = 0; y < m_tilesY; y++)
+			for (unsigned int x = 0; x < m_tilesX; x++)
+				m_clusterLights[(s * m_tilesY + y) * m_tilesX + x].clear();
+
+		float sliceNear = m_sliceDepths[s];
+		float sliceFar = m_sliceDepths[s + 1];
+
+		for (unsigned int l = 0; l < m_lightCount; l++)
+		{
+			float radius = m_lightRadius[l];
+			float depth = -m_lightZ[l];
+			float nearest = glm::max(depth - radius, sliceNear);
+			float furthest = glm::min(depth + radius, sliceFar);
+			if (radius <= 0 || nearest > furthest)
+				continue;
+
+			// Tiles covered by the sphere's bounds over the slice's depth
+			float cx = m_lightX[l], cy = m_lightY[l];
+			float minNdcX = (cx - radius) / ((cx - radius >= 0 ? furthest : nearest) * m_tanHalfX);
+			float maxNdcX = (cx + radius) / ((cx + radius >= 0 ? nearest : furthest) * m_tanHalfX);
+			float minNdcY = (cy - radius) / ((cy - radius >= 0 ? furthest : nearest) * m_tanHalfY);
+			float maxNdcY = (cy + radius) / ((cy + radius >= 0 ? nearest : furthest) * m_tanHalfY);
+			if (minNdcX > 1 || maxNdcX < -1 || minNdcY > 1 || maxNdcY < -1)
+				continue;
+
+			int x0 = glm::clamp((int)std::floor((minNdcX * 0.5f + 0.5f) * m_tilesX), 0, (int)m_tilesX - 1);
+			int x1 = glm::clamp((int)std::floor((maxNdcX * 0.5f + 0.5f) * m_tilesX), 0, (int)m_tilesX - 1);
+			int y0 = glm::clamp((int)std::floor((minNdcY * 0.5f + 0.5f) * m_tilesY), 0, (int)m_tilesY - 1);
+			int y1 = glm::clamp((int)std::floor((maxNdcY * 0.5f + 0.5f) * m_tilesY), 0, (int)m_tilesY - 1);
+
+			float cz = m_lightZ[l];
+			float radiusSq = radius * radius;
+
+#ifdef CLUSTERS_USE_SSE
+			// Test the sphere against four neighbouring clusters at a time
+			__m128 zero = _mm_setzero_ps();
+			__m128 sx = _mm_set1_ps(cx), sy = _mm_set1_ps(cy), sz = _mm_set1_ps(cz);
+			__m128 sr = _mm_set1_ps(radiusSq);
+			for (int y = y0; y <= y1; y++)
+			{
+				size_t row = (s * m_tilesY + y) * m_rowStride;
+				for (int x = x0 & ~3; x <= x1; x += 4)
+				{
+					size_t i = row + x;
+					__m128 dx = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minX[i]), sx), zero),
+						_mm_max_ps(_mm_sub_ps(sx, _mm_loadu_ps(&m_maxX[i])), zero));
+					__m128 dy = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minY[i]), sy), zero),
+						_mm_max_ps(_mm_sub_ps(sy, _mm_loadu_ps(&m_maxY[i])), zero));
+					__m128 dz = _mm_add_ps(_mm_max_ps(_mm_sub_ps(_mm_loadu_ps(&m_minZ[i]), sz), zero),
+						_mm_max_ps(_mm_sub_ps(sz, _mm_loadu_ps(&m_maxZ[i])), zero));
+					__m128 distanceSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), _mm_mul_ps(dz, dz));
+					int hits = _mm_movemask_ps(_mm_cmple_ps(distanceSq, sr));
+
+					for (int lane = 0; hits != 0; lane++, hits >>= 1)
+					{
+						int tile = x + lane;
+						if ((hits & 1) && tile >= x0 && tile <= x1)
+							m_clusterLights[(s * m_tilesY + y) * m_tilesX + tile].push_back(l);
+					}
+				}
+			}
+#else
+			for (int y = y0; y <= y1; y++)
+			{
+				size_t row = (s * m_tilesY + y) * m_rowStride;
+				for (int x = x0; x <= x1; x++)
+				{
+					size_t i = row + x;
+					float dx = glm::max(m_minX[i] - cx, 0.f) + glm::max(cx - m_maxX[i], 0.f);
+					float dy = glm::max(m_minY[i] - cy, 0.f) + glm::max(cy - m_maxY[i], 0.f);
+					float dz = glm::max(m_minZ[i] - cz, 0.f) + glm::max(cz - m_maxZ[i], 0.f);
+					if (dx * dx + dy * dy + dz * dz <= radiusSq)
+						m_clusterLights[(s * m_tilesY + y) * m_tilesX + x].push_back(l);
+				}
+			}
+#endif
+		}
+	}
+}
+
+bool LightClusters::Upload(const std::vector<Light>& a_lights)
+{
+	static int alignment = 0;
+	if (alignment == 0)
+	{
+		glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		alignment = alignment > 0 ? alignment : 256;
+	}
+
+	m_indexCount = 0;
+	for (auto& list : m_clusterLights)
+		m_indexCount += (unsigned int)list.size();
+
+	// Empty buffers still need something to bind
+	unsigned int clusterCount = (unsigned int)m_clusterLights.size();
+	unsigned int lightBytes = glm::max(m_lightCount, 1u) * sizeof(glm::vec4) * 2;
+	unsigned int clusterBytes = clusterCount * sizeof(unsigned int) * 2;
+	unsigned int indexBytes = glm::max(m_indexCount, 1u) * sizeof(unsigned int);
+
+	aie::StreamBuffer* stream = aie::StreamBuffer::getInstance();
+	unsigned int lightOffset = 0, clusterOffset = 0, indexOffset = 0;
+	glm::vec4* lights = (glm::vec4*)stream->allocate(lightBytes, alignment, lightOffset);
+	unsigned int* clusters = (unsigned int*)stream->allocate(clusterBytes, alignment, clusterOffset);
+	unsigned int* indices = (unsigned int*)stream->allocate(indexBytes, alignment, indexOffset);
+	if (lights == nullptr || clusters == nullptr || indices == nullptr)
+	{
+		static bool warned = false;
+		if (warned == false)
+			printf("LightClusters: stream buffer full, point lights are off\n");
+		warned = true;
+		return false;
+	}
+
+	for (unsigned int i = 0; i < m_lightCount; i++)
+	{
+		lights[i * 2 + 0] = glm::vec4(a_lights[i].m_direction, m_lightRadius[i]);
+		lights[i * 2 + 1] = glm::vec4(a_lights[i].m_color, 0);
+	}
+
+	// Each cluster is an offset into the index list and a count
+	unsigned int offset = 0;
+	for (unsigned int c = 0; c < clusterCount; c++)
+	{
+		const std::vector<unsigned int>& list = m_clusterLights[c];
+		clusters[c * 2 + 0] = offset;
+		clusters[c * 2 + 1] = (unsigned int)list.size();
+		if (list.empty() == false)
+			memcpy(indices + offset, list.data(), list.size() * sizeof(unsigned int));
+		offset += (unsigned int)list.size();
+	}
+
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, LIGHT_BINDING, stream->getHandle(), lightOffset, lightBytes);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, CLUSTER_BINDING, stream->getHandle(), clusterOffset, clusterBytes);
+	glBindBufferRange(GL_SHADER_STORAGE_BUFFER, INDEX_BINDING, stream->getHandle(), indexOffset, indexBytes);
+	return true;
+}
+
+void LightClusters::WorkerThread(unsigned int a_index)
+{
+	unsigned int lastJob = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_startWork.wait(lock, [this, lastJob]() { return m_quit || m_job != lastJob; });
+			if (m_quit)
+				return;
+			lastJob = m_job;
+		}
+
+		// The main thread takes the first slice of each set
+		BinSlices(a_index + 1, m_threadCount);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending--;
+		}
+		m_workDone.notify_one();
+	}
+}
@@ -0,0 +1,100 @@
+/*----------------------------------------------
+	File Name: LightClusters.h
+	Purpose: Bin point lights into view clusters
+	Author: Logan Ryan
+	Modified: 8 April 2021
+------------------------------------------------
+	Copyright 2021 Logan Ryan
+----------------------------------------------*/
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+struct Light;
+
+namespace aie
+{
+	class ShaderProgram;
+}
+
+// Splits the view frustum into a grid of clusters, screen tiles sliced
+// exponentially by depth, and lists the point lights that reach each one.
+// The lit shaders find their pixel's cluster and only loop over its lights
+class LightClusters
+{
+public:
+	// Shader storage bindings used by lighting.glsl
+	static const unsigned int LIGHT_BINDING = 0;
+	static const unsigned int CLUSTER_BINDING = 1;
+	static const unsigned int INDEX_BINDING = 2;
+
+	// Constructor
+	LightClusters(unsigned int a_tilesX = 16, unsigned int a_tilesY = 9,
+		unsigned int a_slices = 24);
+	// Destructor
+	~LightClusters();
+
+	// Bin the lights for this frame's camera and upload the lists,
+	// called once a frame before anything lit is drawn
+	void Update(const std::vector<Light>& a_lights, const glm::mat4& a_view,
+		const glm::mat4& a_projection, glm::vec2 a_screenSize);
+
+	// Set the uniforms lighting.glsl uses to find a pixel's cluster
+	void BindUniforms(aie::ShaderProgram* a_shader);
+
+	// Stats from the last update
+	unsigned int GetLightCount() { return m_lightCount; }
+	unsigned int GetIndexCount() { return m_indexCount; }
+	float GetUpdateTime() { return m_updateTime; }
+
+protected:
+	// Rebuild the cluster bounds when the projection changes
+	void BuildClusters(float a_near, float a_far, float a_tanHalfX, float a_tanHalfY);
+	// Transform the lights into view space
+	void TransformLights(const std::vector<Light>& a_lights, const glm::mat4& a_view);
+	// Bin the lights into every a_step'th slice starting at a_first
+	void BinSlices(unsigned int a_first, unsigned int a_step);
+	// Upload the lists and bind them, false if the stream buffer is full
+	bool Upload(const std::vector<Light>& a_lights);
+
+	void WorkerThread(unsigned int a_index);
+
+	unsigned int m_tilesX, m_tilesY, m_slices;
+
+	// Cluster bounds in view space, rows are padded to a multiple of 4
+	// so four neighbouring clusters can be tested at once
+	unsigned int m_rowStride;
+	std::vector<float> m_minX, m_minY, m_minZ;
+	std::vector<float> m_maxX, m_maxY, m_maxZ;
+	std::vector<float> m_sliceDepths;
+
+	// Frustum the clusters were built for
+	float m_near, m_far;
+	float m_tanHalfX, m_tanHalfY;
+	glm::vec2 m_screenSize;
+
+	// View space light spheres, padded to a multiple of 4
+	unsigned int m_lightCount;
+	std::vector<float> m_lightX, m_lightY, m_lightZ, m_lightRadius;
+
+	// Lights reaching each cluster, each list is only written by the thread binning its slice
+	std::vector<std::vector<unsigned int>> m_clusterLights;
+	unsigned int m_indexCount;
+	bool m_valid;
+
+	float m_updateTime;
+
+	// Workers bin slices alongside the main thread
+	std::vector<std::thread> m_workers;
+	unsigned int m_threadCount;
+	std::mutex m_mutex;
+	std::condition_variable m_startWork;
+	std::condition_variable m_workDone;
+	unsigned int m_job;
+	unsigned int m_pending;
+	bool m_quit;
+};
+
@@ -1,17 +1,53 @@
 #include "OBJMesh.h"
 #include "gl_core_4_4.h"
+#include "TextureCache.h"
+#include "ShaderVariants.h"
+#include <algorithm>
+#include <functional>
 #include <glm/geometric.hpp>
+#include <glm/common.hpp>
+#include <cfloat>
 
 #define TINYOBJLOADER_IMPLEMENTATION
 #include "tiny_obj_loader.h"
 
 namespace aie {
 
+// queues a material texture to load in the background, skipping any the material doesn't use.
+// textures are shared with every other material and mesh using the same file
+static void loadMaterialTexture(std::shared_ptr<Texture>& texture, const std::string& folder, const std::string& name) {
+
+	if (name.empty())
+		return;
+
+	if (TextureCache::getInstance() != nullptr) {
+		texture = TextureCache::getInstance()->get(folder + name);
+	}
+	else {
+		texture = std::make_shared<Texture>();
+		if (texture->loadAsync((folder + name).c_str()) == false)
+			texture = nullptr;
+	}
+}
+
+unsigned int OBJMesh::Material::getShaderFeatures() const {
+	unsigned int features = 0;
+	if (diffuseTexture != nullptr)
+		features |= DIFFUSE_MAP;
+	if (specularTexture != nullptr)
+		features |= SPECULAR_MAP;
+	if (normalTexture != nullptr)
+		features |= NORMAL_MAP;
+	return features;
+}
+
 OBJMesh::~OBJMesh() {
 	for (auto& c : m_meshChunks) {
 		glDeleteVertexArrays(1, &c.vao);
 		glDeleteBuffers(1, &c.vbo);
 		glDeleteBuffers(1, &c.ibo);
+		glDeleteVertexArrays(1, &c.positionVao);
+		glDeleteBuffers(1, &c.positionVbo);
 	}
 }
 
@@ -51,22 +87,35 @@ bool OBJMesh::load(const char* filename, bool loadTextures /* = true */, bool fl
 		m_materials[index].specularPower = m.shininess;
 		m_materials[index].opacity = m.dissolve;
 
-		// textures
-		m_materials[index].alphaTexture.load((folder + m.alpha_texname).c_str());
-		m_materials[index].ambientTexture.load((folder + m.ambient_texname).c_str());
-		m_materials[index].diffuseTexture.load((folder + m.diffuse_texname).c_str());
-		m_materials[index].specularTexture.load((folder + m.specular_texname).c_str());
-		m_materials[index].specularHighlightTexture.load((folder + m.specular_highlight_texname).c_str());
-		m_materials[index].normalTexture.load((folder + m.bump_texname).c_str());
-		m_materials[index].displacementTexture.load((folder + m.displacement_texname).c_str());
+		// textures, they load while the rest of the mesh is built
+		if (loadTextures) {
+			loadMaterialTexture(m_materials[index].alphaTexture, folder, m.alpha_texname);
+			loadMaterialTexture(m_materials[index].ambientTexture, folder, m.ambient_texname);
+			loadMaterialTexture(m_materials[index].diffuseTexture, folder, m.diffuse_texname);
+			loadMaterialTexture(m_materials[index].specularTexture, folder, m.specular_texname);
+			loadMaterialTexture(m_materials[index].specularHighlightTexture, folder, m.specular_highlight_texname);
+			loadMaterialTexture(m_materials[index].normalTexture, folder, m.bump_texname);
+			loadMaterialTexture(m_materials[index].displacementTexture, folder, m.displacement_texname);
+		}
 
 		++index;
 	}
 
 	// copy shapes
 	m_meshChunks.reserve(shapes.size());
+	m_boundsMin = glm::vec3(FLT_MAX);
+	m_boundsMax = glm::vec3(-FLT_MAX);
+	std::vector<glm::vec3> occluderPositions;
+	std::vector<unsigned int> occluderIndices;
 	for (auto& s : shapes) {
 
+		// every shape's triangles go into the one occluder
+		unsigned int firstPosition = (unsigned int)occluderPositions.size();
+		for (size_t i = 0; i + 2 < s.mesh.positions.size(); i += 3)
+			occluderPositions.push_back(glm::vec3(s.mesh.positions[i], s.mesh.positions[i + 1], s.mesh.positions[i + 2]));
+		for (auto index : s.mesh.indices)
+			occluderIndices.push_back(firstPosition + index);
+
 		MeshChunk chunk;
 
 		// generate buffers
@@ -96,8 +145,11 @@ bool OBJMesh::load(const char* filename, bool loadTextures /* = true */, bool fl
 		bool hasTexture = s.mesh.texcoords.empty() == false;
 
 		for (size_t i = 0; i < vertCount; ++i) {
-			if (hasPosition)
+			if (hasPosition) {
 				vertices[i].position = glm::vec4(s.mesh.positions[i * 3 + 0], s.mesh.positions[i * 3 + 1], s.mesh.positions[i * 3 + 2], 1);
+				m_boundsMin = glm::min(m_boundsMin, glm::vec3(vertices[i].position));
+				m_boundsMax = glm::max(m_boundsMax, glm::vec3(vertices[i].position));
+			}
 			if (hasNormal)
 				vertices[i].normal = glm::vec4(s.mesh.normals[i * 3 + 0], s.mesh.normals[i * 3 + 1], s.mesh.normals[i * 3 + 2], 0);
 
@@ -132,6 +184,20 @@ bool OBJMesh::load(const char* filename, bool loadTextures /* = true */, bool fl
 		glEnableVertexAttribArray(3);
 		glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)(sizeof(glm::vec4) * 2 + sizeof(glm::vec2)));
 
+		// positions again on their own, a quarter of the size for depth only passes
+		glGenBuffers(1, &chunk.positionVbo);
+		glGenVertexArrays(1, &chunk.positionVao);
+
+		glBindVertexArray(chunk.positionVao);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, chunk.ibo);
+
+		glBindBuffer(GL_ARRAY_BUFFER, chunk.positionVbo);
+		glBufferData(GL_ARRAY_BUFFER, s.mesh.positions.size() * sizeof(float), s.mesh.positions.data(), GL_STATIC_DRAW);
+
+		// w defaults to 1
+		glEnableVertexAttribArray(0);
+		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), 0);
+
 		// bind 0 for safety
 		glBindVertexArray(0);
 		glBindBuffer(GL_ARRAY_BUFFER, 0);
@@ -141,13 +207,20 @@ bool OBJMesh::load(const char* filename, bool loadTextures /* = true */, bool fl
 		chunk.materialID = s.mesh.material_ids.empty() ? -1 : s.mesh.material_ids[0];
 
 		m_meshChunks.push_back(chunk);
+
+		// note which shader variants the mesh needs
+		unsigned int features = chunk.materialID >= 0 ? m_materials[chunk.materialID].getShaderFeatures() : 0;
+		if (std::find(m_shaderFeatures.begin(), m_shaderFeatures.end(), features) == m_shaderFeatures.end())
+			m_shaderFeatures.push_back(features);
 	}
+
+	buildOccluder(occluderPositions, occluderIndices);
 	
 	// load obj
 	return true;
 }
 
-void OBJMesh::draw(bool usePatches /* = false */) {
+void OBJMesh::draw(bool usePatches /* = false */, int features /* = -1 */) {
 
 	int program = -1;
 	glGetIntegerv(GL_CURRENT_PROGRAM, &program);
@@ -165,92 +238,72 @@ void OBJMesh::draw(bool usePatches /* = false */) {
 	int opacityUniform = glGetUniformLocation(program, "opacity");
 	int specPowUniform = glGetUniformLocation(program, "Ns");
 
-	int alphaTexUniform = glGetUniformLocation(program, "alphaTexture");
-	int ambientTexUniform = glGetUniformLocation(program, "ambientTexture");
-	int diffuseTexUniform = glGetUniformLocation(program, "diffuseTexture");
-	int specTexUniform = glGetUniformLocation(program, "specularTexture");
-	int specHighlightTexUniform = glGetUniformLocation(program, "specularHighlightTexture");
-	int normalTexUniform = glGetUniformLocation(program, "normalTexture");
-	int dispTexUniform = glGetUniformLocation(program, "displacementTexture");
+	// textures are only bound to the slots the shader samples
+	const int textureSlots = 7;
+	int textureUniforms[textureSlots] = {
+		glGetUniformLocation(program, "diffuseTexture"),
+		glGetUniformLocation(program, "alphaTexture"),
+		glGetUniformLocation(program, "ambientTexture"),
+		glGetUniformLocation(program, "specularTexture"),
+		glGetUniformLocation(program, "specularHighlightTexture"),
+		glGetUniformLocation(program, "normalTexture"),
+		glGetUniformLocation(program, "displacementTexture"),
+	};
 
 	// set texture slots (these don't change per material)
-	if (diffuseTexUniform >= 0)
-		glUniform1i(diffuseTexUniform, 0);
-	if (alphaTexUniform >= 0)
-		glUniform1i(alphaTexUniform, 1);
-	if (ambientTexUniform >= 0)
-		glUniform1i(ambientTexUniform, 2);
-	if (specTexUniform >= 0)
-		glUniform1i(specTexUniform, 3);
-	if (specHighlightTexUniform >= 0)
-		glUniform1i(specHighlightTexUniform, 4);
-	if (normalTexUniform >= 0)
-		glUniform1i(normalTexUniform, 5);
-	if (dispTexUniform >= 0)
-		glUniform1i(dispTexUniform, 6);
-
-	int currentMaterial = -1;
+	for (int i = 0; i < textureSlots; ++i)
+		if (textureUniforms[i] >= 0)
+			glUniform1i(textureUniforms[i], i);
+
+	// chunks without a material use the defaults
+	static const Material defaultMaterial;
+	int currentMaterial = -2;
 
 	// draw the mesh chunks
 	for (auto& c : m_meshChunks) {
 
+		const Material& material = c.materialID >= 0 ? m_materials[c.materialID] : defaultMaterial;
+		if (features >= 0 &&
+			material.getShaderFeatures() != (unsigned int)features)
+			continue;
+
 		// bind material
 		if (currentMaterial != c.materialID) {
 			currentMaterial = c.materialID;
 			if (kaUniform >= 0)
-				glUniform3fv(kaUniform, 1, &m_materials[currentMaterial].ambient[0]);
+				glUniform3fv(kaUniform, 1, &material.ambient[0]);
 			if (kdUniform >= 0)
-				glUniform3fv(kdUniform, 1, &m_materials[currentMaterial].diffuse[0]);
+				glUniform3fv(kdUniform, 1, &material.diffuse[0]);
 			if (ksUniform >= 0)
-				glUniform3fv(ksUniform, 1, &m_materials[currentMaterial].specular[0]);
+				glUniform3fv(ksUniform, 1, &material.specular[0]);
 			if (keUniform >= 0)
-				glUniform3fv(keUniform, 1, &m_materials[currentMaterial].emissive[0]);
+				glUniform3fv(keUniform, 1, &material.emissive[0]);
 			if (opacityUniform >= 0)
-				glUniform1f(opacityUniform, m_materials[currentMaterial].opacity);
+				glUniform1f(opacityUniform, material.opacity);
 			if (specPowUniform >= 0)
-				glUniform1f(specPowUniform, m_materials[currentMaterial].specularPower);
-
-			glActiveTexture(GL_TEXTURE0);
-			if (m_materials[currentMaterial].diffuseTexture.getHandle() > 0)
-				glBindTexture(GL_TEXTURE_2D, m_materials[currentMaterial].diffuseTexture.getHandle());
-			else if (diffuseTexUniform >= 0)
-				glBindTexture(GL_TEXTURE_2D, 0);
-
-			glActiveTexture(GL_TEXTURE1);
-			if (m_materials[currentMaterial].alphaTexture.getHandle() > 0)
-				glBindTexture(GL_TEXTURE_2D, m_materials[currentMaterial].alphaTexture.getHandle());
-			else if (alphaTexUniform >= 0)
-				glBindTexture(GL_TEXTURE_2D, 0);
-
-			glActiveTexture(GL_TEXTURE2);
-			if (m_materials[currentMaterial].ambientTexture.getHandle() > 0)
-				glBindTexture(GL_TEXTURE_2D, m_materials[currentMaterial].ambientTexture.getHandle());
-			else if (ambientTexUniform >= 0)
-				glBindTexture(GL_TEXTURE_2D, 0);
-
-			glActiveTexture(GL_TEXTURE3);
-			if (m_materials[currentMaterial].specularTexture.getHandle() > 0)
-				glBindTexture(GL_TEXTURE_2D, m_materials[currentMaterial].specularTexture.getHandle());
-			else if (specTexUniform >= 0)
-				glBindTexture(GL_TEXTURE_2D, 0);
-
-			glActiveTexture(GL_TEXTURE4);
-			if (m_materials[currentMaterial].specularHighlightTexture.getHandle() > 0)
-				glBindTexture(GL_TEXTURE_2D, m_materials[currentMaterial].specularHighlightTexture.getHandle());
-			else if (specHighlightTexUniform >= 0)
-				glBindTexture(GL_TEXTURE_2D, 0);
-
-			glActiveTexture(GL_TEXTURE5);
-			if (m_materials[currentMaterial].normalTexture.getHandle() > 0)
-				glBindTexture(GL_TEXTURE_2D, m_materials[currentMaterial].normalTexture.getHandle());
-			else if (normalTexUniform >= 0)
-				glBindTexture(GL_TEXTURE_2D, 0);
-
-			glActiveTexture(GL_TEXTURE6);
-			if (m_materials[currentMaterial].displacementTexture.getHandle() > 0)
-				glBindTexture(GL_TEXTURE_2D, m_materials[currentMaterial].displacementTexture.getHandle());
-			else if (dispTexUniform >= 0)
-				glBindTexture(GL_TEXTURE_2D, 0);
+				glUniform1f(specPowUniform, material.specularPower);
+
+			// in slot order
+			const std::shared_ptr<Texture>* textures[textureSlots] = {
+				&material.diffuseTexture,
+				&material.alphaTexture,
+				&material.ambientTexture,
+				&material.specularTexture,
+				&material.specularHighlightTexture,
+				&material.normalTexture,
+				&material.displacementTexture,
+			};
+
+			for (int i = 0; i < textureSlots; ++i) {
+				if (textureUniforms[i] < 0)
+					continue;
+				glActiveTexture(GL_TEXTURE0 + i);
+				if (*textures[i] != nullptr &&
+					(*textures[i])->getHandle() > 0)
+					glBindTexture(GL_TEXTURE_2D, (*textures[i])->getHandle());
+				else
+					glBindTexture(GL_TEXTURE_2D, 0);
+			}
 		}
 
 		// bind and draw geometry
@@ -262,6 +315,63 @@ void OBJMesh::draw(bool usePatches /* = false */) {
 	}
 }
 
+void OBJMesh::drawPositions() {
+	for (auto& c : m_meshChunks) {
+		glBindVertexArray(c.positionVao);
+		glDrawElements(GL_TRIANGLES, c.indexCount, GL_UNSIGNED_INT, 0);
+	}
+}
+
+void OBJMesh::buildOccluder(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices) {
+
+	m_occluderVertices.clear();
+	m_occluderIndices.clear();
+	if (positions.empty())
+		return;
+
+	// small meshes are kept as they are
+	if (indices.size() / 3 <= MAX_OCCLUDER_TRIANGLES) {
+		m_occluderVertices = positions;
+		m_occluderIndices = indices;
+		return;
+	}
+
+	// otherwise only the largest of its own triangles are kept. merging nearby
+	// vertices keeps more of the outline, but the merged surface can bulge out
+	// across concave parts and hide things the mesh doesn't. a subset of the
+	// triangles never covers more of the screen than the mesh or sits in front
+	// of it, at the cost of holes where the small triangles were, so dense meshes
+	// hide less than they could
+	size_t triangleCount = indices.size() / 3;
+	std::vector<std::pair<float, unsigned int>> areas(triangleCount);
+	for (size_t i = 0; i < triangleCount; ++i) {
+		const glm::vec3& p0 = positions[indices[i * 3]];
+		const glm::vec3& p1 = positions[indices[i * 3 + 1]];
+		const glm::vec3& p2 = positions[indices[i * 3 + 2]];
+		areas[i] = std::make_pair(glm::length(glm::cross(p1 - p0, p2 - p0)), (unsigned int)i);
+	}
+
+	// ties go to the later triangle, so the same mesh always keeps the same ones
+	std::nth_element(areas.begin(), areas.begin() + MAX_OCCLUDER_TRIANGLES, areas.end(),
+		std::greater<std::pair<float, unsigned int>>());
+	std::sort(areas.begin(), areas.begin() + MAX_OCCLUDER_TRIANGLES,
+		[](const std::pair<float, unsigned int>& a, const std::pair<float, unsigned int>& b) { return a.second < b.second; });
+
+	// copy just the vertices the kept triangles use
+	std::vector<int> vertexOf(positions.size(), -1);
+	for (unsigned int i = 0; i < MAX_OCCLUDER_TRIANGLES; ++i) {
+		unsigned int triangle = areas[i].second;
+		for (unsigned int corner = 0; corner < 3; ++corner) {
+			unsigned int index = indices[triangle * 3 + corner];
+			if (vertexOf[index] < 0) {
+				vertexOf[index] = (int)m_occluderVertices.size();
+				m_occluderVertices.push_back(positions[index]);
+			}
+			m_occluderIndices.push_back((unsigned int)vertexOf[index]);
+		}
+	}
+}
+
 void OBJMesh::calculateTangents(std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices) {
 	unsigned int vertexCount = (unsigned int)vertices.size();
 	glm::vec4* tan1 = new glm::vec4[vertexCount * 2];
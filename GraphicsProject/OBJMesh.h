@@ -5,6 +5,7 @@
 #include <glm/vec4.hpp>
 #include <string>
 #include <vector>
+#include <memory>
 #include "Texture.h"
 
 namespace aie {
@@ -30,6 +31,9 @@ public:
 		Material() : ambient(1), diffuse(1), specular(0), emissive(0), specularPower(1), opacity(1) {}
 		~Material() {}
 
+		// the eShaderFeature bits a shader needs to use this material's textures
+		unsigned int getShaderFeatures() const;
+
 		glm::vec3 ambient;
 		glm::vec3 diffuse;
 		glm::vec3 specular;
@@ -38,13 +42,14 @@ public:
 		float specularPower;
 		float opacity;
 
-		Texture diffuseTexture;				// bound slot 0
-		Texture alphaTexture;				// bound slot 1
-		Texture ambientTexture;				// bound slot 2
-		Texture specularTexture;			// bound slot 3
-		Texture specularHighlightTexture;	// bound slot 4
-		Texture normalTexture;				// bound slot 5
-		Texture displacementTexture;		// bound slot 6
+		// shared with any other material using the same file, nullptr if unused
+		std::shared_ptr<Texture> diffuseTexture;			// bound slot 0
+		std::shared_ptr<Texture> alphaTexture;				// bound slot 1
+		std::shared_ptr<Texture> ambientTexture;			// bound slot 2
+		std::shared_ptr<Texture> specularTexture;			// bound slot 3
+		std::shared_ptr<Texture> specularHighlightTexture;	// bound slot 4
+		std::shared_ptr<Texture> normalTexture;				// bound slot 5
+		std::shared_ptr<Texture> displacementTexture;		// bound slot 6
 	};
 
 	OBJMesh() {}
@@ -53,8 +58,28 @@ public:
 	// will fail if a mesh has already been loaded in to this instance
 	bool load(const char* filename, bool loadTextures = true, bool flipTextureV = false);
 
-	// allow option to draw as patches for tessellation
-	void draw(bool usePatches = false);
+	// allow option to draw as patches for tessellation. if features isn't -1 only
+	// chunks whose material has exactly those shader features are drawn, so each
+	// can be drawn with the shader variant it needs
+	void draw(bool usePatches = false, int features = -1);
+
+	// draws every chunk from a stream holding only positions, for depth only
+	// passes that don't need the rest of the vertex. no material is bound
+	void drawPositions();
+
+	// the distinct shader features of the materials used by the mesh's chunks
+	const std::vector<unsigned int>& getShaderFeatures() const { return m_shaderFeatures; }
+
+	// bounds of the mesh's vertices in model space
+	const glm::vec3& getBoundsMin() const { return m_boundsMin; }
+	const glm::vec3& getBoundsMax() const { return m_boundsMax; }
+
+	// a copy of the mesh's triangles kept on the cpu, for software occlusion
+	// culling. larger meshes keep only their MAX_OCCLUDER_TRIANGLES largest
+	// triangles, so the occluder never hides anything the mesh wouldn't
+	static const unsigned int MAX_OCCLUDER_TRIANGLES = 2048;
+	const std::vector<glm::vec3>& getOccluderVertices() const { return m_occluderVertices; }
+	const std::vector<unsigned int>& getOccluderIndices() const { return m_occluderIndices; }
 
 	// access to the filename that was loaded
 	const std::string& getFilename() const { return m_filename; }
@@ -67,8 +92,13 @@ private:
 
 	void calculateTangents(std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices);
 
+	// keeps the largest triangles of meshes with more than the budget
+	void buildOccluder(const std::vector<glm::vec3>& positions, const std::vector<unsigned int>& indices);
+
 	struct MeshChunk {
 		unsigned int	vao, vbo, ibo;
+		// position-only stream sharing the index buffer
+		unsigned int	positionVao, positionVbo;
 		unsigned int	indexCount;
 		int				materialID;
 	};
@@ -76,6 +106,10 @@ private:
 	std::string				m_filename;
 	std::vector<MeshChunk>	m_meshChunks;
 	std::vector<Material>	m_materials;
+	std::vector<unsigned int>	m_shaderFeatures;
+	glm::vec3				m_boundsMin, m_boundsMax;
+	std::vector<glm::vec3>	m_occluderVertices;
+	std::vector<unsigned int>	m_occluderIndices;
 };
 
 } // namespace aie
\ No newline at end of file
@@ -0,0 +1,397 @@
+/*----------------------------------------------
+	File Name: OcclusionCuller.cpp
+	Purpose: Skip instances hidden behind others
+	Author: Logan Ryan
+	Modified: 8 April 2021
+------------------------------------------------
+	Copyright 2021 Logan Ryan
+----------------------------------------------*/
+#include "OcclusionCuller.h"
+#include "Scene.h"
+#include "Instance.h"
+#include "Camera.h"
+#include "OBJMesh.h"
+
+#include <gl_core_4_4.h>
+#include <algorithm>
+#include <cstdio>
+
+OcclusionCuller::OcclusionCuller()
+	: m_enabled(true), m_depthPrepass(true), m_mode(GPU_HIZ), m_occluderSize(0.25f), m_width(0), m_height(0),
+	m_depthFramebuffer(0), m_depthTexture(0), m_hizFramebuffer(0), m_hizTexture(0),
+	m_levelCount(0), m_readbackBuffer(0), m_readbackFence(nullptr),
+	m_hizValid(false), m_vao(0), m_tested(0), m_occluded(0)
+{
+
+}
+
+OcclusionCuller::~OcclusionCuller()
+{
+	Destroy();
+	if (m_vao != 0)
+		glDeleteVertexArrays(1, &m_vao);
+}
+
+bool OcclusionCuller::LoadShaders()
+{
+	if (m_depthShader.loadShader(aie::eShaderStage::VERTEX, "./bin/shaders/depth.vert") == false ||
+		m_depthShader.loadShader(aie::eShaderStage::FRAGMENT, "./bin/shaders/depth.frag") == false ||
+		m_depthShader.beginLink() == false)
+	{
+		printf("Depth Shader had an error: %s\n", m_depthShader.getLastError());
+		return false;
+	}
+
+	if (m_hizShader.loadShader(aie::eShaderStage::VERTEX, "./bin/shaders/deferred.vert") == false ||
+		m_hizShader.loadShader(aie::eShaderStage::FRAGMENT, "./bin/shaders/hiz.frag") == false ||
+		m_hizShader.beginLink() == false)
+	{
+		printf("Hi-Z Shader had an error: %s\n", m_hizShader.getLastError());
+		return false;
+	}
+	return true;
+}
+
+void OcclusionCuller::Cull(Scene* a_scene, std::vector<Instance*>& a_visible)
+{
+	// Take the last readback once the GPU has written it
+	if (m_readbackFence != nullptr)
+	{
+		GLenum result = glClientWaitSync((GLsync)m_readbackFence, 0, 0);
+		if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED)
+		{
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readbackBuffer);
+			glGetBufferSubData(GL_PIXEL_PACK_BUFFER, 0, m_depths.size() * sizeof(float), m_depths.data());
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+			glDeleteSync((GLsync)m_readbackFence);
+			m_readbackFence = nullptr;
+			m_hizProjectionView = m_readbackProjectionView;
+			m_hizValid = true;
+		}
+	}
+
+	m_occluders.clear();
+	m_tested = 0;
+	m_occluded = 0;
+
+	bool software = m_enabled && m_mode == CPU_RASTER;
+	bool hiz = m_enabled && m_mode == GPU_HIZ && m_hizValid && m_levels.empty() == false;
+
+	// The software buffer is drawn for this frame's camera
+	Camera* camera = a_scene->GetCamera();
+	const glm::mat4& projectionView = camera->GetProjectionView();
+	if (software)
+		RasterizeOccluders(camera, a_visible);
+
+	// Visible instances are kept in order at the front of the list
+	size_t visibleCount = 0;
+	for (auto instance : a_visible)
+	{
+		bool occluded = false;
+		if (software)
+		{
+			if (std::find(m_occluders.begin(), m_occluders.end(), instance) == m_occluders.end())
+			{
+				m_tested++;
+				occluded = m_software.IsOccluded(projectionView * instance->GetTransform(),
+					instance->GetMesh()->getBoundsMin(), instance->GetMesh()->getBoundsMax());
+			}
+		}
+		else if (hiz)
+		{
+			m_tested++;
+			occluded = IsOccluded(instance);
+		}
+
+		if (occluded)
+			m_occluded++;
+		else
+			a_visible[visibleCount++] = instance;
+	}
+	a_visible.resize(visibleCount);
+}
+
+void OcclusionCuller::RasterizeOccluders(Camera* a_camera, const std::vector<Instance*>& a_instances)
+{
+	m_software.Clear();
+
+	const glm::mat4& projection = a_camera->GetProjectionMatrix();
+	const glm::mat4& view = a_camera->GetViewMatrix();
+	const glm::mat4& projectionView = a_camera->GetProjectionView();
+
+	for (auto instance : a_instances)
+	{
+		glm::vec3 center;
+		float radius;
+		instance->GetBounds(center, radius);
+
+		// Only instances in front of the camera and covering enough of the
+		// screen are worth drawing, any around the camera always count
+		float distance = -(view * glm::vec4(center, 1)).z;
+		if (distance < -radius ||
+			(distance > radius && radius * projection[1][1] / distance < m_occluderSize))
+			continue;
+
+		aie::OBJMesh* mesh = instance->GetMesh();
+		m_software.AddOccluder(projectionView * instance->GetTransform(),
+			mesh->getOccluderVertices(), mesh->getOccluderIndices());
+		m_occluders.push_back(instance);
+	}
+
+	m_software.Rasterize();
+}
+
+bool OcclusionCuller::IsOccluded(Instance* a_instance)
+{
+	glm::vec3 boundsMin = a_instance->GetMesh()->getBoundsMin();
+	glm::vec3 boundsMax = a_instance->GetMesh()->getBoundsMax();
+	glm::mat4 pvm = m_hizProjectionView * a_instance->GetTransform();
+
+	// Screen rectangle and nearest depth of the bounding box's corners
+	glm::vec2 rectMin(1), rectMax(-1);
+	float nearest = 1;
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec4 corner = pvm * glm::vec4(i & 1 ? boundsMax.x : boundsMin.x,
+			i & 2 ? boundsMax.y : boundsMin.y, i & 4 ? boundsMax.z : boundsMin.z, 1);
+
+		// Crossing the near plane, the camera could be inside it
+		if (corner.z < -corner.w)
+			return false;
+
+		glm::vec3 ndc = glm::vec3(corner) / corner.w;
+		rectMin = glm::min(rectMin, glm::vec2(ndc));
+		rectMax = glm::max(rectMax, glm::vec2(ndc));
+		nearest = glm::min(nearest, ndc.z * 0.5f + 0.5f);
+	}
+
+	// Off screen is for the view frustum to deal with
+	if (rectMax.x < -1 || rectMax.y < -1 || rectMin.x > 1 || rectMin.y > 1)
+		return false;
+
+	rectMin = (glm::clamp(rectMin, -1.f, 1.f) * 0.5f + 0.5f) * glm::vec2(m_width, m_height);
+	rectMax = (glm::clamp(rectMax, -1.f, 1.f) * 0.5f + 0.5f) * glm::vec2(m_width, m_height);
+	int x0 = glm::min((int)rectMin.x, m_width - 1), x1 = glm::min((int)rectMax.x, m_width - 1);
+	int y0 = glm::min((int)rectMin.y, m_height - 1), y1 = glm::min((int)rectMax.y, m_height - 1);
+
+	// The first level where the rectangle covers at most a couple of texels
+	// each way, level n's texels cover 2^(n+1) pixels
+	unsigned int level = 0;
+	while (level + 1 < m_levels.size() &&
+		((x1 >> (level + FIRST_READBACK_LEVEL + 1)) - (x0 >> (level + FIRST_READBACK_LEVEL + 1)) > 1 ||
+		(y1 >> (level + FIRST_READBACK_LEVEL + 1)) - (y0 >> (level + FIRST_READBACK_LEVEL + 1)) > 1))
+		level++;
+
+	// Odd sizes fold into the last texel, so clamping the shift is exact
+	const Level& hiz = m_levels[level];
+	int shift = level + FIRST_READBACK_LEVEL + 1;
+	int tx0 = glm::min(x0 >> shift, hiz.width - 1), tx1 = glm::min(x1 >> shift, hiz.width - 1);
+	int ty0 = glm::min(y0 >> shift, hiz.height - 1), ty1 = glm::min(y1 >> shift, hiz.height - 1);
+
+	float furthest = 0;
+	for (int y = ty0; y <= ty1; y++)
+		for (int x = tx0; x <= tx1; x++)
+			furthest = glm::max(furthest, m_depths[hiz.offset + y * hiz.width + x]);
+
+	return nearest > furthest;
+}
+
+void OcclusionCuller::DrawDepthPrepass(Scene* a_scene, const std::vector<Instance*>& a_visible)
+{
+	if (m_depthPrepass == false ||
+		m_depthShader.isReady() == false)
+		return;
+
+	const glm::mat4& projectionView = a_scene->GetCamera()->GetProjectionView();
+
+	glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+	m_depthShader.bind();
+	for (auto instance : a_visible)
+		instance->DrawDepth(projectionView, &m_depthShader);
+	glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+}
+
+void OcclusionCuller::BuildHiZ(Scene* a_scene)
+{
+	// A pyramid from before culling was turned off is out of date
+	if (m_enabled == false || m_mode != GPU_HIZ)
+	{
+		m_hizValid = false;
+		return;
+	}
+
+	// Wait for the last readback before starting another
+	if (m_readbackFence != nullptr ||
+		m_hizShader.isReady() == false)
+		return;
+
+	int width = (int)a_scene->GetWindowSize().x;
+	int height = (int)a_scene->GetWindowSize().y;
+	if (width != m_width || height != m_height)
+	{
+		m_hizValid = false;
+		Create(width, height);
+	}
+	if (m_hizFramebuffer == 0)
+		return;
+
+	m_readbackProjectionView = a_scene->GetCamera()->GetProjectionView();
+
+	// The screen's depth can't be sampled, copy it into a texture
+	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	glBindFramebuffer(GL_DRAW_FRAMEBUFFER, m_depthFramebuffer);
+	glBlitFramebuffer(0, 0, m_width, m_height, 0, 0, m_width, m_height,
+		GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+	// === Pyramid ===
+	// Each level is built from the one above, which is the only level the
+	// pass can read so it isn't reading what it writes
+	glDisable(GL_DEPTH_TEST);
+	glDepthMask(GL_FALSE);
+	glDisable(GL_BLEND);
+
+	m_hizShader.bind();
+	m_hizShader.bindUniform("Source", 0);
+	glActiveTexture(GL_TEXTURE0);
+	glBindVertexArray(m_vao);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_hizFramebuffer);
+
+	for (unsigned int level = 0; level < m_levelCount; level++)
+	{
+		// Fetches are relative to the base level
+		if (level == 0)
+		{
+			glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+		}
+		else
+		{
+			glBindTexture(GL_TEXTURE_2D, m_hizTexture);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, level - 1);
+			glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, level - 1);
+		}
+
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_hizTexture, level);
+		glViewport(0, 0, glm::max(m_width / 2 >> level, 1), glm::max(m_height / 2 >> level, 1));
+		glDrawArrays(GL_TRIANGLES, 0, 3);
+	}
+
+	glBindTexture(GL_TEXTURE_2D, m_hizTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_levelCount - 1);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	glBindVertexArray(0);
+
+	// === Readback ===
+	// Copied into a buffer now, and onto the CPU once the fence has passed
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readbackBuffer);
+	glReadBuffer(GL_COLOR_ATTACHMENT0);
+	for (unsigned int i = 0; i < m_levels.size(); i++)
+	{
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_hizTexture,
+			i + FIRST_READBACK_LEVEL);
+		glReadPixels(0, 0, m_levels[i].width, m_levels[i].height, GL_RED, GL_FLOAT,
+			(void*)(m_levels[i].offset * sizeof(float)));
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	m_readbackFence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, m_width, m_height);
+	glDepthMask(GL_TRUE);
+	glEnable(GL_DEPTH_TEST);
+	glEnable(GL_BLEND);
+}
+
+bool OcclusionCuller::Create(int a_width, int a_height)
+{
+	Destroy();
+
+	if (m_vao == 0)
+		glGenVertexArrays(1, &m_vao);
+
+	m_width = a_width;
+	m_height = a_height;
+
+	// Matches the window's depth format so it can be blitted from the screen
+	glGenTextures(1, &m_depthTexture);
+	glBindTexture(GL_TEXTURE_2D, m_depthTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH24_STENCIL8, m_width, m_height);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+	glGenFramebuffers(1, &m_depthFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_depthFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_TEXTURE_2D, m_depthTexture, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	GLenum depthStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+
+	// The pyramid starts at half the screen's size
+	int hizWidth = glm::max(m_width / 2, 1);
+	int hizHeight = glm::max(m_height / 2, 1);
+	m_levelCount = 1;
+	while ((hizWidth >> m_levelCount) > 0 || (hizHeight >> m_levelCount) > 0)
+		m_levelCount++;
+
+	glGenTextures(1, &m_hizTexture);
+	glBindTexture(GL_TEXTURE_2D, m_hizTexture);
+	glTexStorage2D(GL_TEXTURE_2D, m_levelCount, GL_R32F, hizWidth, hizHeight);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glGenFramebuffers(1, &m_hizFramebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_hizFramebuffer);
+	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_hizTexture, 0);
+	GLenum hizStatus = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	if (depthStatus != GL_FRAMEBUFFER_COMPLETE ||
+		hizStatus != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("Hi-Z framebuffers are incomplete (0x%x, 0x%x)\n", depthStatus, hizStatus);
+		Destroy();
+		return false;
+	}
+
+	// Room for every level read back
+	m_levels.clear();
+	size_t size = 0;
+	for (unsigned int level = FIRST_READBACK_LEVEL; level < m_levelCount; level++)
+	{
+		Level readback = { glm::max(hizWidth >> level, 1), glm::max(hizHeight >> level, 1), size };
+		m_levels.push_back(readback);
+		size += readback.width * readback.height;
+	}
+	m_depths.resize(size);
+
+	glGenBuffers(1, &m_readbackBuffer);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, m_readbackBuffer);
+	glBufferData(GL_PIXEL_PACK_BUFFER, size * sizeof(float), nullptr, GL_STREAM_READ);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	return true;
+}
+
+void OcclusionCuller::Destroy()
+{
+	if (m_readbackFence != nullptr)
+		glDeleteSync((GLsync)m_readbackFence);
+	if (m_readbackBuffer != 0)
+		glDeleteBuffers(1, &m_readbackBuffer);
+	if (m_depthFramebuffer != 0)
+		glDeleteFramebuffers(1, &m_depthFramebuffer);
+	if (m_hizFramebuffer != 0)
+		glDeleteFramebuffers(1, &m_hizFramebuffer);
+	if (m_depthTexture != 0)
+		glDeleteTextures(1, &m_depthTexture);
+	if (m_hizTexture != 0)
+		glDeleteTextures(1, &m_hizTexture);
+
+	m_readbackFence = nullptr;
+	m_readbackBuffer = 0;
+	m_depthFramebuffer = m_hizFramebuffer = 0;
+	m_depthTexture = m_hizTexture = 0;
+	m_levels.clear();
+	m_hizValid = false;
+}
@@ -0,0 +1,135 @@
+/*----------------------------------------------
+	File Name: OcclusionCuller.h
+	Purpose: Skip instances hidden behind others
+	Author: Logan Ryan
+	Modified: 8 April 2021
+------------------------------------------------
+	Copyright 2021 Logan Ryan
+----------------------------------------------*/
+#pragma once
+#include "Shader.h"
+#include "SoftwareOcclusion.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+class Scene;
+class Instance;
+class Camera;
+
+// Where the depth instances are tested against comes from
+enum eOcclusionMode : unsigned int
+{
+	GPU_HIZ = 0,	// The last frames' depth, read back from the GPU
+	CPU_RASTER,		// The large instances drawn on the CPU this frame
+
+	OCCLUSION_MODE_Count
+};
+
+// Builds a hi-z pyramid, each level keeping the furthest depth under its
+// texels, from the depth the scene leaves on screen. The smaller levels are
+// read back without stalling and the next frames test each instance's
+// bounds against them before drawing it. The pyramid is a frame or two old,
+// so it is tested with the camera it was built with, and something coming
+// into view from behind an occluder can appear a frame late.
+// In CPU_RASTER mode the instances covering much of the screen are drawn
+// into a SoftwareOcclusion buffer instead, and the rest tested against it
+// the same frame without waiting on the GPU
+class OcclusionCuller
+{
+public:
+	// Levels above this are too big to be worth reading back
+	static const unsigned int FIRST_READBACK_LEVEL = 1;
+
+	// Constructor
+	OcclusionCuller();
+	// Destructor
+	~OcclusionCuller();
+
+	// Start the depth and pyramid shaders compiling
+	bool LoadShaders();
+
+	// Pick up a finished readback and take the instances that are hidden
+	// out of a list of those in view
+	void Cull(Scene* a_scene, std::vector<Instance*>& a_visible);
+
+	// Draw the visible instances' depth only, so the lit pass only shades
+	// the surfaces that end up on screen
+	void DrawDepthPrepass(Scene* a_scene, const std::vector<Instance*>& a_visible);
+
+	// Build the pyramid from the screen's depth and start reading it back,
+	// called after the scene has drawn
+	void BuildHiZ(Scene* a_scene);
+
+	// Settings
+	void SetEnabled(bool a_enabled) { m_enabled = a_enabled; }
+	bool IsEnabled() { return m_enabled; }
+	void SetDepthPrepass(bool a_prepass) { m_depthPrepass = a_prepass; }
+	bool IsDepthPrepassEnabled() { return m_depthPrepass; }
+	void SetMode(eOcclusionMode a_mode) { m_mode = a_mode; }
+	eOcclusionMode GetMode() { return m_mode; }
+	// How much of the screen's height an instance's bounds must cover to be
+	// drawn as an occluder in CPU_RASTER mode
+	void SetOccluderSize(float a_size) { m_occluderSize = a_size; }
+	float GetOccluderSize() { return m_occluderSize; }
+
+	// Getters
+	aie::ShaderProgram& GetDepthShader() { return m_depthShader; }
+	aie::ShaderProgram& GetHiZShader() { return m_hizShader; }
+
+	// Stats from the last cull
+	unsigned int GetTestedCount() { return m_tested; }
+	unsigned int GetOccludedCount() { return m_occluded; }
+	unsigned int GetOccluderCount() { return (unsigned int)m_occluders.size(); }
+	SoftwareOcclusion& GetSoftwareOcclusion() { return m_software; }
+
+protected:
+	// Whether an instance's bounds are behind the pyramid's depth
+	bool IsOccluded(Instance* a_instance);
+
+	// Draw the instances large enough to hide others into the software buffer
+	void RasterizeOccluders(Camera* a_camera, const std::vector<Instance*>& a_instances);
+
+	// Create the pyramid and readback buffer for a screen size
+	bool Create(int a_width, int a_height);
+	void Destroy();
+
+	aie::ShaderProgram	m_depthShader;
+	aie::ShaderProgram	m_hizShader;
+
+	bool				m_enabled;
+	bool				m_depthPrepass;
+	eOcclusionMode		m_mode;
+	float				m_occluderSize;
+
+	// Screen depth copied into a texture, and the pyramid built from it
+	int					m_width, m_height;
+	unsigned int		m_depthFramebuffer, m_depthTexture;
+	unsigned int		m_hizFramebuffer, m_hizTexture;
+	unsigned int		m_levelCount;
+
+	// Readback of the smaller levels, in flight until the fence passes
+	unsigned int		m_readbackBuffer;
+	void*				m_readbackFence;
+	glm::mat4			m_readbackProjectionView;
+
+	// The last pyramid read back, every level from FIRST_READBACK_LEVEL down
+	struct Level
+	{
+		int width, height;
+		size_t offset;
+	};
+	std::vector<Level>	m_levels;
+	std::vector<float>	m_depths;
+	glm::mat4			m_hizProjectionView;
+	bool				m_hizValid;
+
+	// The full screen triangle has no vertex buffers but still needs a vertex array
+	unsigned int		m_vao;
+
+	// Drawn on the CPU in CPU_RASTER mode, occluders aren't tested themselves
+	SoftwareOcclusion	m_software;
+	std::vector<Instance*>	m_occluders;
+
+	unsigned int		m_tested;
+	unsigned int		m_occluded;
+};
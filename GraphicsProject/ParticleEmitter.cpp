@@ -8,8 +8,12 @@
 ----------------------------------*/
 #include "ParticleEmitter.h"
 #include <gl_core_4_4.h>
+#include <StreamBuffer.h>
+#include <algorithm>
 
-ParticleEmitter::ParticleEmitter() : m_particles(nullptr), m_firstDead(0), m_maxParticles(0), m_position(0, 0, 0), m_vao(0), m_vbo(0), m_ibo(0), m_vertexData(nullptr) 
+ParticleEmitter::ParticleEmitter() : m_particles(nullptr), m_firstDead(0), m_maxParticles(0), m_position(0, 0, 0), m_vao(0), m_ibo(0), m_vertexData(nullptr),
+	m_quadCount(0), m_streamOffset(0), m_streamValid(false), m_sortMode(PARTICLE_SORT_NONE), m_depths(nullptr), m_depthKeys(nullptr), m_sortedIndices(nullptr), 
+	m_sortScratch(nullptr), m_sortedCount(0)
 {
 }
 
@@ -17,9 +21,12 @@ ParticleEmitter::~ParticleEmitter()
 { 
 	delete[] m_particles; 
 	delete[] m_vertexData; 
+	delete[] m_depths;
+	delete[] m_depthKeys;
+	delete[] m_sortedIndices;
+	delete[] m_sortScratch;
 	
 	glDeleteVertexArrays(1, &m_vao); 
-	glDeleteBuffers(1, &m_vbo); 
 	glDeleteBuffers(1, &m_ibo); 
 }
 
@@ -48,8 +55,17 @@ void ParticleEmitter::initalise(unsigned int a_maxParticles, unsigned int a_emit
 	m_firstDead = 0;
 	// create the array of vertices for the particles
 	// 4 vertices per particle for a quad.
-	// will be filled during update
+	// only used to build quads that are going to be sorted,
+	// unsorted quads are built straight into the stream buffer
 	m_vertexData = new ParticleVertex[m_maxParticles * 4];
+	m_quadCount = 0;
+
+	// create the depth sorting data
+	m_depths = new float[m_maxParticles];
+	m_depthKeys = new unsigned short[m_maxParticles];
+	m_sortedIndices = new unsigned int[m_maxParticles];
+	m_sortScratch = new unsigned int[m_maxParticles];
+	m_sortedCount = 0;
 
 	// create the index buffeer data for the particles
 	// 6 indices per quad of 2 triangles
@@ -65,17 +81,14 @@ void ParticleEmitter::initalise(unsigned int a_maxParticles, unsigned int a_emit
 		indexData[i* 6 + 5] = i* 4 + 3;
 	}
 	
-	// create opengl buffers
+	// create opengl buffers, the vertices come from the shared
+	// stream buffer and are offset with a base vertex when drawn
 	glGenVertexArrays(1, &m_vao);
 	glBindVertexArray(m_vao);
 
-	glGenBuffers(1, &m_vbo);
 	glGenBuffers(1, &m_ibo);
 
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-	glBufferData(GL_ARRAY_BUFFER, m_maxParticles * 4 * 
-		sizeof(ParticleVertex), m_vertexData, 
-		GL_DYNAMIC_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, aie::StreamBuffer::getInstance()->getHandle());
 	
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
 	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_maxParticles * 6 * 
@@ -138,6 +151,25 @@ void ParticleEmitter::update(float a_deltaTime, const glm::mat4& a_cameraTransfo
 	}
 	
 	unsigned int quad= 0;
+	vec3 cameraPosition = vec3(a_cameraTransform[3]);
+
+	// unsorted quads are written straight into this frame's stream memory,
+	// quads that are going to be sorted are built locally then gathered in order
+	bool sorted = m_sortMode == PARTICLE_SORT_BACK_TO_FRONT ||
+		m_sortMode == PARTICLE_SORT_INCREMENTAL;
+	aie::StreamBuffer* stream = aie::StreamBuffer::getInstance();
+	ParticleVertex* vertices = m_vertexData;
+	m_streamValid = false;
+	if (sorted == false)
+	{
+		ParticleVertex* streamVertices = (ParticleVertex*)stream->reserve(m_firstDead * 4 * sizeof(ParticleVertex),
+			sizeof(ParticleVertex), m_streamOffset);
+		if (streamVertices != nullptr)
+		{
+			vertices = streamVertices;
+			m_streamValid = true;
+		}
+	}
 	
 	// update particles and turn live particles into billboard quads
 	for (unsigned int i= 0; i < m_firstDead; i++) 
@@ -165,15 +197,6 @@ void ParticleEmitter::update(float a_deltaTime, const glm::mat4& a_cameraTransfo
 			// make a quad the correct size and colour
 			float halfSize= particle->size * 0.5f;
 			
-			m_vertexData[quad * 4 + 0].position = vec4(halfSize, halfSize, 0, 1);
-			m_vertexData[quad * 4 + 0].colour = particle->colour;
-			m_vertexData[quad * 4 + 1].position = vec4(-halfSize, halfSize, 0, 1);
-			m_vertexData[quad * 4 + 1].colour = particle->colour;
-			m_vertexData[quad * 4 + 2].position = vec4(-halfSize, -halfSize, 0, 1);
-			m_vertexData[quad * 4 + 2].colour = particle->colour;
-			m_vertexData[quad * 4 + 3].position = vec4(halfSize, -halfSize, 0, 1);
-			m_vertexData[quad * 4 + 3].colour = particle->colour;
-			
 			// create billboard transform
 			vec3 zAxis = glm::normalize(vec3(a_cameraTransform[3]) - particle->position);
 			vec3 xAxis = glm::cross(vec3(a_cameraTransform[1]), zAxis);
@@ -183,32 +206,179 @@ void ParticleEmitter::update(float a_deltaTime, const glm::mat4& a_cameraTransfo
 				vec4(zAxis,0),
 				vec4(0,0,0,1));
 
-			m_vertexData[quad * 4 + 0].position = billboard * 
-				m_vertexData[quad * 4 + 0].position + 
+			// the stream buffer is write-only memory, so each
+			// vertex is finished locally and written once
+			vertices[quad * 4 + 0].position = billboard * 
+				vec4(halfSize, halfSize, 0, 1) + 
 				vec4(particle->position,0);
-			m_vertexData[quad * 4 + 1].position = billboard * 
-				m_vertexData[quad * 4 + 1].position + 
+			vertices[quad * 4 + 0].colour = particle->colour;
+			vertices[quad * 4 + 1].position = billboard * 
+				vec4(-halfSize, halfSize, 0, 1) + 
 				vec4(particle->position,0);
-			m_vertexData[quad * 4 + 2].position = billboard * 
-				m_vertexData[quad * 4 + 2].position + 
+			vertices[quad * 4 + 1].colour = particle->colour;
+			vertices[quad * 4 + 2].position = billboard * 
+				vec4(-halfSize, -halfSize, 0, 1) + 
 				vec4(particle->position,0);
-			m_vertexData[quad * 4 + 3].position = billboard * 
-				m_vertexData[quad * 4 + 3].position + 
+			vertices[quad * 4 + 2].colour = particle->colour;
+			vertices[quad * 4 + 3].position = billboard * 
+				vec4(halfSize, -halfSize, 0, 1) + 
 				vec4(particle->position,0);
+			vertices[quad * 4 + 3].colour = particle->colour;
+
+			// store the view depth for sorting
+			m_depths[quad] = glm::length(cameraPosition - particle->position);
 			++quad;
 		}
 	}
+
+	// particles that die swap in a particle from the end that is 
+	// skipped this frame, so only the built quads are valid
+	m_quadCount = quad;
+
+	if (sorted)
+		SortParticles();
+	else if (m_streamValid)
+		stream->commit(m_quadCount * 4 * sizeof(ParticleVertex));
+}
+
+void ParticleEmitter::SortParticles()
+{
+	if (m_quadCount == 0)
+	{
+		m_sortedCount = 0;
+		return;
+	}
+
+	// quantise the depths to 16 bits over this frame's range,
+	// inverted so an ascending sort gives back to front order
+	float maxDepth = *std::max_element(m_depths, m_depths + m_quadCount);
+	float depthScale = maxDepth > 0 ? 65535.0f / maxDepth : 0;
+	for (unsigned int i = 0; i < m_quadCount; i++)
+		m_depthKeys[i] = (unsigned short)(65535 - (unsigned int)(m_depths[i] * depthScale));
+
+	// particles barely move between frames so last frame's order
+	// is nearly sorted, only fall back to the radix sort if the
+	// insertion sort has to do too much work
+	if (m_sortMode != PARTICLE_SORT_INCREMENTAL ||
+		InsertionSortParticles(m_quadCount * 4) == false)
+		RadixSortParticles();
+
+	m_sortedCount = m_quadCount;
+
+	// gather the quads in sorted order straight into the stream buffer
+	ParticleVertex* sortedVertices = (ParticleVertex*)aie::StreamBuffer::getInstance()->allocate(
+		m_quadCount * 4 * sizeof(ParticleVertex), sizeof(ParticleVertex), m_streamOffset);
+	if (sortedVertices == nullptr)
+		return;
+	m_streamValid = true;
+
+	for (unsigned int i = 0; i < m_quadCount; i++)
+	{
+		const ParticleVertex* source = &m_vertexData[m_sortedIndices[i] * 4];
+		ParticleVertex* destination = &sortedVertices[i * 4];
+		destination[0] = source[0];
+		destination[1] = source[1];
+		destination[2] = source[2];
+		destination[3] = source[3];
+	}
+}
+
+void ParticleEmitter::RadixSortParticles()
+{
+	for (unsigned int i = 0; i < m_quadCount; i++)
+		m_sortedIndices[i] = i;
+
+	// two stable counting passes of 8 bits each, lowest byte first
+	unsigned int* source = m_sortedIndices;
+	unsigned int* destination = m_sortScratch;
+	for (unsigned int shift = 0; shift < 16; shift += 8)
+	{
+		unsigned int offsets[256] = {};
+		for (unsigned int i = 0; i < m_quadCount; i++)
+			offsets[(m_depthKeys[source[i]] >> shift) & 0xFF]++;
+
+		unsigned int total = 0;
+		for (unsigned int digit = 0; digit < 256; digit++)
+		{
+			unsigned int count = offsets[digit];
+			offsets[digit] = total;
+			total += count;
+		}
+
+		for (unsigned int i = 0; i < m_quadCount; i++)
+			destination[offsets[(m_depthKeys[source[i]] >> shift) & 0xFF]++] = source[i];
+
+		std::swap(source, destination);
+	}
+
+	// an even number of passes leaves the result in m_sortedIndices
+}
+
+bool ParticleEmitter::InsertionSortParticles(unsigned int a_maxShifts)
+{
+	// rebuild last frame's order for this frame's quads, dropping
+	// quads that no longer exist and appending the new ones
+	unsigned int count = 0;
+	for (unsigned int i = 0; i < m_sortedCount; i++)
+	{
+		if (m_sortedIndices[i] < m_quadCount)
+			m_sortedIndices[count++] = m_sortedIndices[i];
+	}
+	for (unsigned int i = m_sortedCount; i < m_quadCount; i++)
+		m_sortedIndices[count++] = i;
+
+	unsigned int shifts = 0;
+	for (unsigned int i = 1; i < m_quadCount; i++)
+	{
+		unsigned int index = m_sortedIndices[i];
+		unsigned short key = m_depthKeys[index];
+		unsigned int j = i;
+		while (j > 0 && m_depthKeys[m_sortedIndices[j - 1]] > key)
+		{
+			m_sortedIndices[j] = m_sortedIndices[j - 1];
+			j--;
+
+			if (++shifts > a_maxShifts)
+				return false;
+		}
+		m_sortedIndices[j] = index;
+	}
+
+	return true;
 }
 
 void ParticleEmitter::draw()
 {
-	// sync the particle vertex buffer
-	// based on how many alive particles there are
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-	glBufferSubData(GL_ARRAY_BUFFER, 0, m_firstDead * 4 *
-		sizeof(ParticleVertex), m_vertexData);
+	// the quads were written to the stream buffer during update,
+	// nothing to draw if there were none or it ran out of room
+	if (m_streamValid == false ||
+		m_quadCount == 0)
+		return;
+
+	// blended particles test against the scene but don't write depth,
+	// additive blending gives the same result in any order
+	GLboolean depthMask = GL_TRUE;
+	int src = GL_SRC_ALPHA, dst = GL_ONE_MINUS_SRC_ALPHA;
+	if (m_sortMode != PARTICLE_SORT_NONE)
+	{
+		glGetBooleanv(GL_DEPTH_WRITEMASK, &depthMask);
+		glGetIntegerv(GL_BLEND_SRC, &src);
+		glGetIntegerv(GL_BLEND_DST, &dst);
+
+		glDepthMask(GL_FALSE);
+		if (m_sortMode == PARTICLE_SORT_ADDITIVE)
+			glBlendFunc(GL_SRC_ALPHA, GL_ONE);
+	}
 
 	// draw particles
 	glBindVertexArray(m_vao);
-	glDrawElements(GL_TRIANGLES, m_firstDead * 6, GL_UNSIGNED_INT, 0);
+	glDrawElementsBaseVertex(GL_TRIANGLES, m_quadCount * 6, GL_UNSIGNED_INT, 0,
+		m_streamOffset / sizeof(ParticleVertex));
+
+	// reset state
+	if (m_sortMode != PARTICLE_SORT_NONE)
+	{
+		glDepthMask(depthMask);
+		glBlendFunc(src, dst);
+	}
 }
@@ -25,6 +25,17 @@ struct ParticleVertex
 	glm::vec4 colour; 
 };
 
+// How live particles are ordered and blended when drawn
+enum eParticleSortMode : unsigned int
+{
+	PARTICLE_SORT_NONE = 0,			// Pool order with alpha blending
+	PARTICLE_SORT_BACK_TO_FRONT,	// Full radix sort by view depth every frame
+	PARTICLE_SORT_INCREMENTAL,		// Last frame's order fixed up with an insertion sort
+	PARTICLE_SORT_ADDITIVE,			// Order-independent additive blending, no sort
+
+	PARTICLE_SORT_Count,
+};
+
 class ParticleEmitter
 {
 public:
@@ -47,22 +58,47 @@ public:
 	// Set ending color
 	void SetEndColor(glm::vec4 a_endColor) { m_endColour = a_endColor; }
 
+	// Set how particles are ordered and blended
+	void SetSortMode(eParticleSortMode a_sortMode) { m_sortMode = a_sortMode; }
+	// Get how particles are ordered and blended
+	eParticleSortMode GetSortMode() { return m_sortMode; }
+
 	// Emit particle
 	void emit();
 
 	// Update function
 	void update(float a_deltaTime, const glm::mat4& a_cameraTransform);
 
-	// Draw particles
+	// Draw particles, must follow update() in the same frame
 	void draw();
 
 protected:
+	// Order the quads built this frame back to front
+	void SortParticles();
+	// LSD radix sort of every quad on its 16 bit depth key
+	void RadixSortParticles();
+	// Insertion sort of last frame's order, false if it gave up
+	bool InsertionSortParticles(unsigned int a_maxShifts);
+
 	Particle* m_particles;
 	unsigned int m_firstDead;
 	unsigned int m_maxParticles;
 
-	unsigned int m_vao, m_vbo, m_ibo;
+	unsigned int m_vao, m_ibo;
 	ParticleVertex* m_vertexData;
+	unsigned int m_quadCount;
+
+	// Where this frame's quads live in the shared stream buffer
+	unsigned int m_streamOffset;
+	bool m_streamValid;
+
+	// Depth sorting
+	eParticleSortMode m_sortMode;
+	float* m_depths;
+	unsigned short* m_depthKeys;
+	unsigned int* m_sortedIndices;
+	unsigned int* m_sortScratch;
+	unsigned int m_sortedCount;
 
 	glm::vec3 m_position; 
 
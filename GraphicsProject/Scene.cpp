@@ -8,9 +8,20 @@
 -------------------------------------*/
 #include "Scene.h"
 #include "Instance.h"
+#include "Camera.h"
+#include "DeferredRenderer.h"
+#include "ShadowMap.h"
+#include "OcclusionCuller.h"
+#include "Shader.h"
+
+#include <gl_core_4_4.h>
+#include <VirtualTexture.h>
+#include <algorithm>
 
 Scene::Scene(Camera* a_camera, glm::vec2 a_windowSize, Light& a_light, glm::vec3 a_ambientLight)
-	: m_camera(a_camera), m_windowSize(a_windowSize), m_light(a_light), m_ambientLight(a_ambientLight)
+	: m_camera(a_camera), m_windowSize(a_windowSize), m_light(a_light), m_ambientLight(a_ambientLight),
+	m_renderMode(FORWARD), m_deferredRenderer(nullptr), m_shadowMap(nullptr),
+	m_occlusionCuller(nullptr)
 {
 
 }
@@ -30,16 +41,95 @@ void Scene::AddInstances(Instance* a_instances)
 
 void Scene::Draw()
 {
-	// Change light position and color
-	for (int i = 0; i < MAX_LIGHTS && i < m_pointLights.size(); i++)
+	// The camera's matrices are cached, only rebuilt if it moved or the window changed shape
+	m_camera->SetAspectRatio(m_windowSize.x, m_windowSize.y);
+
+	// Sort the point lights into clusters for this frame's view
+	m_lightClusters.Update(m_pointLights, m_camera->GetViewMatrix(),
+		m_camera->GetProjectionMatrix(), m_windowSize);
+
+	// Render the sun's shadows before anything samples them
+	if (m_shadowMap != nullptr)
+		m_shadowMap->Draw(this);
+
+	// Leave out instances outside the view, then any hidden behind others
+	m_visibleInstances.clear();
+	for (auto instance : m_instances)
 	{
-		m_pointLightPositions[i] = m_pointLights[i].m_direction;
-		m_pointLightColors[i] = m_pointLights[i].m_color;
+		glm::vec3 center;
+		float radius;
+		instance->GetBounds(center, radius);
+		if (m_camera->IsSphereVisible(center, radius))
+			m_visibleInstances.push_back(instance);
 	}
-	
-	for (auto i = m_instances.begin(); i != m_instances.end(); i++)
+
+	if (m_occlusionCuller != nullptr)
+		m_occlusionCuller->Cull(this, m_visibleInstances);
+
+	UpdateVirtualTextures();
+
+	// Forward lighting is the fallback if the g-buffer can't be used
+	if (m_renderMode != DEFERRED || m_deferredRenderer == nullptr ||
+		m_deferredRenderer->Draw(this) == false)
 	{
-		Instance* instance = *i;
-		instance->Draw(this);
+		// With the depth laid down first only the surfaces on screen are lit
+		if (m_occlusionCuller != nullptr)
+			m_occlusionCuller->DrawDepthPrepass(this, m_visibleInstances);
+		glDepthFunc(GL_LEQUAL);
+
+		for (auto i = m_visibleInstances.begin(); i != m_visibleInstances.end(); i++)
+		{
+			Instance* instance = *i;
+			instance->Draw(this);
+		}
+
+		glDepthFunc(GL_LESS);
 	}
+
+	// The next frames are culled against this one's depth
+	if (m_occlusionCuller != nullptr)
+		m_occlusionCuller->BuildHiZ(this);
+}
+
+void Scene::UpdateVirtualTextures()
+{
+	m_virtualTextures.clear();
+	for (auto instance : m_visibleInstances)
+	{
+		aie::VirtualTexture* texture = instance->GetVirtualTexture();
+		if (texture != nullptr &&
+			std::find(m_virtualTextures.begin(), m_virtualTextures.end(), texture) == m_virtualTextures.end())
+			m_virtualTextures.push_back(texture);
+	}
+
+	// Only instances using the texture are drawn into its feedback, so tiles behind
+	// anything else are still asked for. That streams in more than is seen, never less
+	for (auto texture : m_virtualTextures)
+	{
+		texture->update();
+
+		texture->beginFeedback((unsigned int)m_windowSize.x, (unsigned int)m_windowSize.y);
+		for (auto instance : m_visibleInstances)
+		{
+			if (instance->GetVirtualTexture() == texture)
+				instance->DrawFeedback(this);
+		}
+		texture->endFeedback();
+	}
+}
+
+void Scene::BindLighting(aie::ShaderProgram* a_shader)
+{
+	a_shader->bindUniform("CameraPosition", m_camera->GetPosition());
+	a_shader->bindUniform("AmbientColor", m_ambientLight);
+	a_shader->bindUniform("LightColor", m_light.m_color);
+	a_shader->bindUniform("LightDirection", m_light.m_direction);
+
+	if (m_shadowMap != nullptr)
+		m_shadowMap->BindUniforms(a_shader);
+	else
+		ShadowMap::BindDisabled(a_shader);
+
+	// Point lights come from the light clusters
+	m_lightClusters.BindUniforms(a_shader);
 }
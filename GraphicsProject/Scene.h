@@ -10,11 +10,31 @@
 #include <list>
 #include <vector>
 #include <glm/glm.hpp>
+#include "LightClusters.h"
 
 class Camera;
 class Instance;
+class DeferredRenderer;
+class ShadowMap;
+class OcclusionCuller;
 
-const int MAX_LIGHTS = 4;
+namespace aie
+{
+	class ShaderProgram;
+	class VirtualTexture;
+}
+
+// Brightness a point light is considered to have faded out at
+const float LIGHT_CUTOFF = 0.05f;
+
+// How the scene's instances are lit
+enum eRenderMode : unsigned int
+{
+	FORWARD = 0,	// Each instance is lit as it is drawn
+	DEFERRED,		// Instances fill a g-buffer that is lit afterwards
+
+	RENDER_MODE_Count
+};
 
 struct Light 
 {
@@ -29,6 +49,12 @@ struct Light
 		m_color = a_color * a_intensity;
 	}
 
+	// Distance the light reaches before fading below LIGHT_CUTOFF
+	float GetRadius() const
+	{
+		return glm::sqrt(glm::max(m_color.x, glm::max(m_color.y, m_color.z)) / LIGHT_CUTOFF);
+	}
+
 	glm::vec3 m_direction;
 	glm::vec3 m_color;
 };
@@ -47,28 +73,54 @@ public:
 	// Draw objects in scene
 	void Draw();
 
+	// Bind the camera, sun, ambient and point light uniforms
+	void BindLighting(aie::ShaderProgram* a_shader);
+
 	// Getters
 	Camera* GetCamera()			{ return m_camera; }
 	glm::vec2 GetWindowSize()	{ return m_windowSize; }
 	Light& GetLight()			{ return m_light; }
 	glm::vec3& GetAmbientLight() { return m_ambientLight; }
 	std::vector<Instance*>& GetInstances() { return m_instances; }
-
-	int GetNumLights() { return (int)m_pointLights.size(); }
-	glm::vec3* GetPointLightPositions() { return &m_pointLightPositions[0]; }
-	glm::vec3* GetPointLightColor() { return &m_pointLightColors[0]; }
+	// Instances in view and not hidden behind others this frame
+	std::vector<Instance*>& GetVisibleInstances() { return m_visibleInstances; }
 
 	std::vector<Light>& GetPointLights() { return m_pointLights; }
+	LightClusters& GetLightClusters() { return m_lightClusters; }
+
+	// Deferred mode falls back to forward until a renderer is set
+	void SetRenderMode(eRenderMode a_mode) { m_renderMode = a_mode; }
+	eRenderMode GetRenderMode() { return m_renderMode; }
+	void SetDeferredRenderer(DeferredRenderer* a_renderer) { m_deferredRenderer = a_renderer; }
+	DeferredRenderer* GetDeferredRenderer() { return m_deferredRenderer; }
+
+	// The sun casts no shadows until a shadow map is set
+	void SetShadowMap(ShadowMap* a_shadowMap) { m_shadowMap = a_shadowMap; }
+	ShadowMap* GetShadowMap() { return m_shadowMap; }
+
+	// Every instance is drawn until an occlusion culler is set
+	void SetOcclusionCuller(OcclusionCuller* a_culler) { m_occlusionCuller = a_culler; }
+	OcclusionCuller* GetOcclusionCuller() { return m_occlusionCuller; }
 
 protected:
+	// Let each virtual texture the visible instances use stream in the tiles
+	// they asked for, then draw the tiles they need now into its feedback
+	void UpdateVirtualTextures();
+
 	Camera*					m_camera;
 	glm::vec2				m_windowSize;
 	Light					m_light;
 	std::vector<Light>		m_pointLights;
 	glm::vec3				m_ambientLight;
 	std::vector<Instance*>	m_instances;
+	LightClusters			m_lightClusters;
 
-	glm::vec3				m_pointLightPositions[MAX_LIGHTS];
-	glm::vec3				m_pointLightColors[MAX_LIGHTS];
+	eRenderMode				m_renderMode;
+	DeferredRenderer*		m_deferredRenderer;
+	ShadowMap*				m_shadowMap;
+	OcclusionCuller*		m_occlusionCuller;
+	std::vector<Instance*>	m_visibleInstances;
+	// Virtual textures used by this frame's visible instances
+	std::vector<aie::VirtualTexture*> m_virtualTextures;
 };
 
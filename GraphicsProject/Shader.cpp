@@ -1,65 +1,123 @@
 #include "Shader.h"
 #include <cstdio>
+#include <cstring>
 #include <cassert>
+#include <vector>
+#include <fstream>
+#include <iterator>
 #include "gl_core_4_4.h"
 
+// GL_KHR_parallel_shader_compile, which gl_core_4_4 doesn't include
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
 namespace aie {
 
+// program binaries are written with this header so a stale or foreign file is ignored
+struct ProgramBinaryHeader {
+	char				magic[4];
+	unsigned int		version;
+	unsigned long long	key;
+	unsigned int		format;
+	unsigned int		length;
+};
+
+static const char PROGRAM_BINARY_MAGIC[4] = { 'A', 'I', 'E', 'P' };
+static const unsigned int PROGRAM_BINARY_VERSION = 1;
+
+std::string ShaderProgram::sm_binaryCacheFolder = "./bin/shadercache/";
+bool ShaderProgram::sm_binaryCacheEnabled = true;
+
+static void setError(char*& error, const char* message) {
+	size_t length = strlen(message) + 1;
+	delete[] error;
+	error = new char[length];
+	memcpy(error, message, length);
+}
+
+static void makeFolder(const char* path) {
+#ifdef _WIN32
+	_mkdir(path);
+#else
+	mkdir(path, 0755);
+#endif
+}
+
+// 64-bit FNV-1a
+static unsigned long long hashBytes(unsigned long long hash, const void* data, size_t size) {
+	const unsigned char* bytes = (const unsigned char*)data;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+	return hash;
+}
+
 Shader::~Shader() {
+	delete[] m_lastError;
 	glDeleteShader(m_handle);
 }
 
 bool Shader::loadShader(unsigned int stage, const char* filename) {
-	assert(stage > 0 && stage < eShaderStage::SHADER_STAGE_Count);
+	return loadSource(stage, filename) && compile();
+}
 
-	m_stage = stage;
+bool Shader::createShader(unsigned int stage, const char* string) {
+	setSource(stage, string);
+	return compile();
+}
 
-	switch (stage) {
-	case eShaderStage::VERTEX:	m_handle = glCreateShader(GL_VERTEX_SHADER);	break;
-	case eShaderStage::TESSELLATION_EVALUATION:	m_handle = glCreateShader(GL_TESS_EVALUATION_SHADER);	break;
-	case eShaderStage::TESSELLATION_CONTROL:	m_handle = glCreateShader(GL_TESS_CONTROL_SHADER);	break;
-	case eShaderStage::GEOMETRY:	m_handle = glCreateShader(GL_GEOMETRY_SHADER);	break;
-	case eShaderStage::FRAGMENT:	m_handle = glCreateShader(GL_FRAGMENT_SHADER);	break;
-	default:	break;
-	};
-	
-	// open file
-	FILE* file = nullptr;
-	fopen_s(&file, filename, "rb");
-	fseek(file, 0, SEEK_END);
-	unsigned int size = ftell(file);
-	char* source = new char[size + 1];
-	fseek(file, 0, SEEK_SET);
-	fread_s(source, size + 1, sizeof(char), size, file);
-	fclose(file);
-	source[size] = 0;
-
-	glShaderSource(m_handle, 1, (const char**)&source, 0);
-	glCompileShader(m_handle);
+bool Shader::readFile(const char* filename, std::string& text) {
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+	if (file.is_open() == false)
+		return false;
 
-	delete[] source;
+	text.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return true;
+}
 
-	int success = GL_TRUE;
-	glGetShaderiv(m_handle, GL_LINK_STATUS, &success);
-	if (success == GL_FALSE) {
-		int infoLogLength = 0;
-		glGetShaderiv(m_handle, GL_INFO_LOG_LENGTH, &infoLogLength);
+bool Shader::loadSource(unsigned int stage, const char* filename) {
+	assert(stage > 0 && stage < eShaderStage::SHADER_STAGE_Count);
 
-		delete[] m_lastError;
-		m_lastError = new char[infoLogLength];
-		glGetShaderInfoLog(m_handle, infoLogLength, 0, m_lastError);
+	std::string source;
+	if (readFile(filename, source) == false) {
+		std::string error = std::string("Unable to open ") + filename;
+		setError(m_lastError, error.c_str());
 		return false;
 	}
 
+	setSource(stage, source.c_str());
 	return true;
 }
 
-bool Shader::createShader(unsigned int stage, const char* string) {
+void Shader::setSource(unsigned int stage, const char* string) {
 	assert(stage > 0 && stage < eShaderStage::SHADER_STAGE_Count);
 
 	m_stage = stage;
+	m_source = string;
+
+	// the old source's shader no longer applies
+	glDeleteShader(m_handle);
+	m_handle = 0;
+}
 
-	switch (stage) {
+bool Shader::compile() {
+	beginCompile();
+	return finishCompile();
+}
+
+void Shader::beginCompile() {
+	if (m_handle != 0)
+		return;
+
+	switch (m_stage) {
 	case eShaderStage::VERTEX:	m_handle = glCreateShader(GL_VERTEX_SHADER);	break;
 	case eShaderStage::TESSELLATION_EVALUATION:	m_handle = glCreateShader(GL_TESS_EVALUATION_SHADER);	break;
 	case eShaderStage::TESSELLATION_CONTROL:	m_handle = glCreateShader(GL_TESS_CONTROL_SHADER);	break;
@@ -68,18 +126,29 @@ bool Shader::createShader(unsigned int stage, const char* string) {
 	default:	break;
 	};
 
-	glShaderSource(m_handle, 1, (const char**)&string, 0);
+	const char* source = m_source.c_str();
+	glShaderSource(m_handle, 1, &source, 0);
 	glCompileShader(m_handle);
-	
+}
+
+bool Shader::finishCompile() {
+	if (m_handle == 0)
+		return false;
+
 	int success = GL_TRUE;
-	glGetShaderiv(m_handle, GL_LINK_STATUS, &success);
+	glGetShaderiv(m_handle, GL_COMPILE_STATUS, &success);
 	if (success == GL_FALSE) {
 		int infoLogLength = 0;
 		glGetShaderiv(m_handle, GL_INFO_LOG_LENGTH, &infoLogLength);
 
 		delete[] m_lastError;
-		m_lastError = new char[infoLogLength];
+		m_lastError = new char[infoLogLength + 1];
+		m_lastError[0] = 0;
 		glGetShaderInfoLog(m_handle, infoLogLength, 0, m_lastError);
+
+		// compile again next time rather than linking a broken shader
+		glDeleteShader(m_handle);
+		m_handle = 0;
 		return false;
 	}
 
@@ -94,53 +163,332 @@ ShaderProgram::~ShaderProgram() {
 bool ShaderProgram::loadShader(unsigned int stage, const char* filename) {
 	assert(stage > 0 && stage < eShaderStage::SHADER_STAGE_Count);
 	m_shaders[stage] = std::make_shared<Shader>();
-	return m_shaders[stage]->loadShader(stage, filename);
+	m_filenames[stage] = filename;
+
+	// compiled when linking, if the program isn't in the binary cache
+	if (m_shaders[stage]->loadSource(stage, filename) == false) {
+		setError(m_lastError, m_shaders[stage]->getLastError());
+		return false;
+	}
+	return true;
 }
 
 bool ShaderProgram::createShader(unsigned int stage, const char* string) {
 	assert(stage > 0 && stage < eShaderStage::SHADER_STAGE_Count);
 	m_shaders[stage] = std::make_shared<Shader>();
-	return m_shaders[stage]->createShader(stage, string);
+	m_filenames[stage].clear();
+	m_shaders[stage]->setSource(stage, string);
+	return true;
 }
 
 void ShaderProgram::attachShader(const std::shared_ptr<Shader>& shader) {
 	assert(shader != nullptr);
 	m_shaders[shader->getStage()] = shader;
+	m_filenames[shader->getStage()].clear();
+}
+
+void ShaderProgram::setBinaryCacheFolder(const char* folder) {
+	sm_binaryCacheEnabled = folder != nullptr;
+	sm_binaryCacheFolder = folder != nullptr ? folder : "";
+	if (sm_binaryCacheFolder.empty() == false &&
+		sm_binaryCacheFolder.back() != '/' &&
+		sm_binaryCacheFolder.back() != '\\')
+		sm_binaryCacheFolder += '/';
 }
 
 bool ShaderProgram::link() {
+	return beginLink() && finishLink();
+}
+
+bool ShaderProgram::beginLink() {
+	glDeleteProgram(m_program);
+	m_program = 0;
+	m_linkStatus = UNLINKED;
+	m_fromBinaryCache = false;
+
+	// locations belong to the old program
+	m_uniforms.clear();
+
+	if (sm_binaryCacheEnabled) {
+		m_binaryKey = getBinaryKey();
+		if (loadBinary(m_binaryKey)) {
+			m_fromBinaryCache = true;
+			m_linkStatus = LINKED;
+			applyUniformBlocks();
+			return true;
+		}
+	}
+
+	// nothing here reads back from the driver, so it can compile every
+	// stage of every program that is started before one is waited on
+	for (auto& s : m_shaders)
+		if (s != nullptr)
+			s->beginCompile();
+
 	m_program = glCreateProgram();
 	for (auto& s : m_shaders)
 		if (s != nullptr)
 			glAttachShader(m_program, s->getHandle());
+	if (sm_binaryCacheEnabled)
+		glProgramParameteri(m_program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(m_program);
 
+	m_linkStatus = LINKING;
+	return true;
+}
+
+bool ShaderProgram::finishLink() {
+	if (m_linkStatus != LINKING)
+		return m_linkStatus == LINKED;
+
 	int success = GL_TRUE;
 	glGetProgramiv(m_program, GL_LINK_STATUS, &success);
 	if (success == GL_FALSE) {
+		m_linkStatus = LINK_FAILED;
+
+		// a stage that didn't compile explains more than the link log
+		for (auto& s : m_shaders) {
+			if (s != nullptr &&
+				s->finishCompile() == false) {
+				setError(m_lastError, s->getLastError());
+				return false;
+			}
+		}
+
 		int infoLogLength = 0;
 		glGetProgramiv(m_program, GL_INFO_LOG_LENGTH, &infoLogLength);
 
 		delete[] m_lastError;
 		m_lastError = new char[infoLogLength + 1];
+		m_lastError[0] = 0;
 		glGetProgramInfoLog(m_program, infoLogLength, 0, m_lastError);
 		return false;
 	}
+
+	m_linkStatus = LINKED;
+	applyUniformBlocks();
+	if (sm_binaryCacheEnabled)
+		saveBinary(m_binaryKey);
+	return true;
+}
+
+bool ShaderProgram::replaceShaders(const std::shared_ptr<Shader> shaders[eShaderStage::SHADER_STAGE_Count]) {
+
+	// keep the current program until the new one has linked
+	finishLink();
+	unsigned int program = m_program;
+	eLinkStatus linkStatus = m_linkStatus;
+	bool fromBinaryCache = m_fromBinaryCache;
+	std::shared_ptr<Shader> previous[eShaderStage::SHADER_STAGE_Count];
+	for (unsigned int stage = 0; stage < eShaderStage::SHADER_STAGE_Count; ++stage) {
+		previous[stage] = m_shaders[stage];
+		m_shaders[stage] = shaders[stage];
+	}
+
+	m_program = 0;
+	if (link() == false) {
+		glDeleteProgram(m_program);
+		m_program = program;
+		m_linkStatus = linkStatus;
+		m_fromBinaryCache = fromBinaryCache;
+		m_uniforms.clear();
+		for (unsigned int stage = 0; stage < eShaderStage::SHADER_STAGE_Count; ++stage)
+			m_shaders[stage] = previous[stage];
+		return false;
+	}
+
+	glDeleteProgram(program);
 	return true;
 }
 
+bool ShaderProgram::reload() {
+	std::shared_ptr<Shader> shaders[eShaderStage::SHADER_STAGE_Count];
+	for (unsigned int stage = 0; stage < eShaderStage::SHADER_STAGE_Count; ++stage) {
+		shaders[stage] = m_shaders[stage];
+
+		// stages that weren't loaded from a file stay as they are
+		if (m_filenames[stage].empty())
+			continue;
+
+		shaders[stage] = std::make_shared<Shader>();
+		if (shaders[stage]->loadSource(stage, m_filenames[stage].c_str()) == false) {
+			setError(m_lastError, shaders[stage]->getLastError());
+			return false;
+		}
+	}
+	return replaceShaders(shaders);
+}
+
+eLinkStatus ShaderProgram::getLinkStatus() {
+	if (m_linkStatus == LINKING) {
+
+		// without the extension there is no way to ask, so wait for it
+		int complete = GL_TRUE;
+		if (hasParallelCompile())
+			glGetProgramiv(m_program, GL_COMPLETION_STATUS_KHR, &complete);
+		if (complete != GL_FALSE)
+			finishLink();
+	}
+	return m_linkStatus;
+}
+
+bool ShaderProgram::hasParallelCompile() {
+	static int supported = -1;
+	if (supported < 0) {
+		supported = 0;
+		int count = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+		for (int i = 0; i < count; ++i) {
+			const char* name = (const char*)glGetStringi(GL_EXTENSIONS, i);
+			if (name != nullptr &&
+				(strcmp(name, "GL_KHR_parallel_shader_compile") == 0 ||
+				 strcmp(name, "GL_ARB_parallel_shader_compile") == 0))
+				supported = 1;
+		}
+	}
+	return supported == 1;
+}
+
+unsigned long long ShaderProgram::getBinaryKey() const {
+	unsigned long long hash = 14695981039346656037ull;
+
+	// binaries only load on the driver that made them
+	GLenum strings[] = { GL_VENDOR, GL_RENDERER, GL_VERSION };
+	for (auto name : strings) {
+		const char* string = (const char*)glGetString(name);
+		if (string != nullptr)
+			hash = hashBytes(hash, string, strlen(string) + 1);
+	}
+
+	// defines are part of the source, so they are covered too
+	for (unsigned int stage = 0; stage < eShaderStage::SHADER_STAGE_Count; ++stage) {
+		if (m_shaders[stage] != nullptr) {
+			const std::string& source = m_shaders[stage]->getSource();
+			hash = hashBytes(hash, &stage, sizeof(stage));
+			hash = hashBytes(hash, source.c_str(), source.size() + 1);
+		}
+	}
+	return hash;
+}
+
+std::string ShaderProgram::getBinaryFilename(unsigned long long key) const {
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", key);
+	return sm_binaryCacheFolder + name;
+}
+
+bool ShaderProgram::loadBinary(unsigned long long key) {
+	std::ifstream file(getBinaryFilename(key), std::ios::in | std::ios::binary);
+	if (file.is_open() == false)
+		return false;
+
+	ProgramBinaryHeader header = {};
+	std::vector<char> binary;
+	bool valid = file.read((char*)&header, sizeof(header)) &&
+		memcmp(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic)) == 0 &&
+		header.version == PROGRAM_BINARY_VERSION &&
+		header.key == key &&
+		header.length > 0;
+	if (valid) {
+		binary.resize(header.length);
+		valid = (bool)file.read(binary.data(), header.length);
+	}
+
+	if (valid == false)
+		return false;
+
+	// clear any earlier error so a rejected format doesn't linger
+	while (glGetError() != GL_NO_ERROR) {}
+
+	m_program = glCreateProgram();
+	glProgramBinary(m_program, header.format, binary.data(), header.length);
+
+	int success = GL_FALSE;
+	glGetProgramiv(m_program, GL_LINK_STATUS, &success);
+	if (success == GL_FALSE) {
+		// the driver no longer accepts it, it is replaced once linked from source
+		while (glGetError() != GL_NO_ERROR) {}
+		glDeleteProgram(m_program);
+		m_program = 0;
+		return false;
+	}
+	return true;
+}
+
+void ShaderProgram::saveBinary(unsigned long long key) {
+	int length = 0;
+	glGetProgramiv(m_program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0)
+		return;
+
+	ProgramBinaryHeader header = {};
+	memcpy(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic));
+	header.version = PROGRAM_BINARY_VERSION;
+	header.key = key;
+
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(m_program, length, &length, &format, binary.data());
+	header.format = format;
+	header.length = (unsigned int)length;
+
+	// make the folder in case this is the first run
+	std::string folder = sm_binaryCacheFolder.substr(0, sm_binaryCacheFolder.size() - 1);
+	if (folder.empty() == false)
+		makeFolder(folder.c_str());
+
+	std::string filename = getBinaryFilename(key);
+	std::ofstream file(filename, std::ios::out | std::ios::binary | std::ios::trunc);
+	if (file.is_open() == false) {
+		printf("Unable to write program binary %s\n", filename.c_str());
+		return;
+	}
+	file.write((const char*)&header, sizeof(header));
+	file.write(binary.data(), header.length);
+}
+
 void ShaderProgram::bind() {
+	finishLink();
 	assert(m_program > 0 && "Invalid shader program");
 	glUseProgram(m_program);
 }
 
 int ShaderProgram::getUniform(const char* name) {
-	return glGetUniformLocation(m_program, name);
+	auto iter = m_uniforms.find(name);
+	if (iter != m_uniforms.end())
+		return iter->second;
+
+	int location = glGetUniformLocation(m_program, name);
+	m_uniforms[name] = location;
+	return location;
+}
+
+void ShaderProgram::bindUniformBlock(const char* name, unsigned int binding) {
+	for (auto& block : m_uniformBlocks) {
+		if (block.first == name) {
+			block.second = binding;
+			applyUniformBlocks();
+			return;
+		}
+	}
+	m_uniformBlocks.push_back(std::make_pair(std::string(name), binding));
+	applyUniformBlocks();
+}
+
+void ShaderProgram::applyUniformBlocks() {
+	if (m_linkStatus != LINKED)
+		return;
+
+	for (auto& block : m_uniformBlocks) {
+		unsigned int index = glGetUniformBlockIndex(m_program, block.first.c_str());
+		if (index != GL_INVALID_INDEX)
+			glUniformBlockBinding(m_program, index, block.second);
+	}
 }
 
 bool ShaderProgram::bindUniform(const char* name, int value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
@@ -151,7 +499,7 @@ bool ShaderProgram::bindUniform(const char* name, int value) {
 
 bool ShaderProgram::bindUniform(const char* name, float value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
@@ -162,7 +510,7 @@ bool ShaderProgram::bindUniform(const char* name, float value) {
 
 bool ShaderProgram::bindUniform(const char* name, const glm::vec2& value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
@@ -173,7 +521,7 @@ bool ShaderProgram::bindUniform(const char* name, const glm::vec2& value) {
 
 bool ShaderProgram::bindUniform(const char* name, const glm::vec3& value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
@@ -184,7 +532,7 @@ bool ShaderProgram::bindUniform(const char* name, const glm::vec3& value) {
 
 bool ShaderProgram::bindUniform(const char* name, const glm::vec4& value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
@@ -195,7 +543,7 @@ bool ShaderProgram::bindUniform(const char* name, const glm::vec4& value) {
 
 bool ShaderProgram::bindUniform(const char* name, const glm::mat2& value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
@@ -206,7 +554,7 @@ bool ShaderProgram::bindUniform(const char* name, const glm::mat2& value) {
 
 bool ShaderProgram::bindUniform(const char* name, const glm::mat3& value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
@@ -217,7 +565,7 @@ bool ShaderProgram::bindUniform(const char* name, const glm::mat3& value) {
 
 bool ShaderProgram::bindUniform(const char* name, const glm::mat4& value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
@@ -228,7 +576,7 @@ bool ShaderProgram::bindUniform(const char* name, const glm::mat4& value) {
 
 bool ShaderProgram::bindUniform(const char* name, int count, int* value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
@@ -239,7 +587,7 @@ bool ShaderProgram::bindUniform(const char* name, int count, int* value) {
 
 bool ShaderProgram::bindUniform(const char* name, int count, float* value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
@@ -250,7 +598,7 @@ bool ShaderProgram::bindUniform(const char* name, int count, float* value) {
 
 bool ShaderProgram::bindUniform(const char* name, int count, const glm::vec2* value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
@@ -261,7 +609,7 @@ bool ShaderProgram::bindUniform(const char* name, int count, const glm::vec2* va
 
 bool ShaderProgram::bindUniform(const char* name, int count, const glm::vec3* value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
@@ -272,7 +620,7 @@ bool ShaderProgram::bindUniform(const char* name, int count, const glm::vec3* va
 
 bool ShaderProgram::bindUniform(const char* name, int count, const glm::vec4* value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
@@ -283,7 +631,7 @@ bool ShaderProgram::bindUniform(const char* name, int count, const glm::vec4* va
 
 bool ShaderProgram::bindUniform(const char* name, int count, const glm::mat2* value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
@@ -294,7 +642,7 @@ bool ShaderProgram::bindUniform(const char* name, int count, const glm::mat2* va
 
 bool ShaderProgram::bindUniform(const char* name, int count, const glm::mat3* value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
@@ -305,7 +653,7 @@ bool ShaderProgram::bindUniform(const char* name, int count, const glm::mat3* va
 
 bool ShaderProgram::bindUniform(const char* name, int count, const glm::mat4* value) {
 	assert(m_program > 0 && "Invalid shader program");
-	int i = glGetUniformLocation(m_program, name);
+	int i = getUniform(name);
 	if (i < 0) {
 		printf("Shader uniform [%s] not found! Is it being used?\n", name);
 		return false;
@@ -7,6 +7,9 @@
 #include <glm/mat3x3.hpp>
 #include <glm/mat4x4.hpp>
 #include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
 
 namespace aie {
 
@@ -23,6 +26,15 @@ enum eShaderStage : unsigned int {
 	SHADER_STAGE_Count,
 };
 
+// progress of a program's link, which may finish on the driver's threads
+enum eLinkStatus : unsigned int {
+	UNLINKED = 0,
+
+	LINKING,
+	LINKED,
+	LINK_FAILED,
+};
+
 // individual sharable shader stages
 class Shader {
 public:
@@ -37,8 +49,25 @@ public:
 	bool loadShader(unsigned int stage, const char* filename);
 	bool createShader(unsigned int stage, const char* string);
 
+	// set the source without compiling it, so a program restored from
+	// its binary cache never has to compile its stages
+	bool loadSource(unsigned int stage, const char* filename);
+	void setSource(unsigned int stage, const char* string);
+
+	// compiles the source if it hasn't been already
+	bool compile();
+
+	// reads a whole file, false if it can't be opened
+	static bool readFile(const char* filename, std::string& text);
+
+	// submits the source to the driver without waiting for it, the
+	// status is only read by finishCompile() or when the program links
+	void beginCompile();
+	bool finishCompile();
+
 	unsigned int getStage() const { return m_stage; }
 	unsigned int getHandle() const { return m_handle; }
+	const std::string& getSource() const { return m_source; }
 
 	const char* getLastError() const { return m_lastError; }
 
@@ -46,6 +75,7 @@ protected:
 
 	unsigned int	m_stage;
 	unsigned int	m_handle;
+	std::string		m_source;
 	char*			m_lastError;
 };
 
@@ -53,7 +83,7 @@ protected:
 class ShaderProgram {
 public:
 
-	ShaderProgram() : m_program(0), m_lastError(nullptr) {
+	ShaderProgram() : m_program(0), m_linkStatus(UNLINKED), m_binaryKey(0), m_fromBinaryCache(false), m_lastError(nullptr) {
 		m_shaders[0] = m_shaders[1] = m_shaders[2] = m_shaders[3] = m_shaders[4] = 0;
 	}
 	~ShaderProgram();
@@ -62,16 +92,54 @@ public:
 	bool createShader(unsigned int stage, const char* string);
 	void attachShader(const std::shared_ptr<Shader>& shader);
 
+	// links the stages, or restores the program from the binary cache if it was
+	// linked from the same sources on the same driver before
 	bool link();
 
+	// link() split in two so many programs can compile at once. beginLink()
+	// submits every stage and the link without reading any status back, and
+	// finishLink() waits for the result
+	bool beginLink();
+	bool finishLink();
+
+	// polls a program started with beginLink() without waiting for it, draws
+	// can be skipped until it is ready
+	eLinkStatus getLinkStatus();
+	bool isReady() { return getLinkStatus() == LINKED; }
+
+	// true if the driver reports when a link finishes without blocking
+	static bool hasParallelCompile();
+
+	// re-reads stages loaded from files and relinks. on failure the previous
+	// program is kept and the error is in getLastError()
+	bool reload();
+
+	// links new stages in place of the current ones, keeping the current
+	// program if they fail. stages that are nullptr are left out
+	bool replaceShaders(const std::shared_ptr<Shader> shaders[eShaderStage::SHADER_STAGE_Count]);
+
+	// the file a stage was loaded from, empty if it wasn't
+	const std::string& getFilename(unsigned int stage) const { return m_filenames[stage]; }
+
+	// true if the last link was restored from the binary cache
+	bool isFromBinaryCache() const { return m_fromBinaryCache; }
+
+	// folder linked program binaries are kept in, nullptr disables the cache
+	static void setBinaryCacheFolder(const char* folder);
+
 	const char* getLastError() const { return m_lastError; }
 
 	void bind();
 
 	unsigned int getHandle() const { return m_program; }
 
+	// locations are cached until the program is relinked
 	int getUniform(const char* name);
 
+	// binds a uniform block to a buffer binding point, the binding is
+	// remembered and set again whenever the program is relinked
+	void bindUniformBlock(const char* name, unsigned int binding);
+
 	void bindUniform(int ID, int value);
 	void bindUniform(int ID, float value);
 	void bindUniform(int ID, const glm::vec2& value);
@@ -109,11 +177,30 @@ public:
 
 private:
 
+	// hash of every stage's source and the driver, identifies a program binary
+	unsigned long long	getBinaryKey() const;
+	std::string			getBinaryFilename(unsigned long long key) const;
+
+	bool	loadBinary(unsigned long long key);
+	void	saveBinary(unsigned long long key);
+
+	void	applyUniformBlocks();
+
 	unsigned int	m_program;
+	eLinkStatus		m_linkStatus;
+	unsigned long long	m_binaryKey;
+	bool			m_fromBinaryCache;
 
 	std::shared_ptr<Shader> m_shaders[eShaderStage::SHADER_STAGE_Count];
+	std::string		m_filenames[eShaderStage::SHADER_STAGE_Count];
+
+	std::unordered_map<std::string, int>	m_uniforms;
+	std::vector<std::pair<std::string, unsigned int>>	m_uniformBlocks;
 
 	char*			m_lastError;
+
+	static std::string	sm_binaryCacheFolder;
+	static bool			sm_binaryCacheEnabled;
 };
 
 }
\ No newline at end of file
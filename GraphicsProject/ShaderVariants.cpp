@@ -0,0 +1,206 @@
+#include "ShaderVariants.h"
+#include <cstdio>
+#include <cassert>
+#include <string>
+#include <algorithm>
+
+namespace aie {
+
+// names #defined for each eShaderFeature bit
+static const char* FEATURE_NAMES[eShaderFeature::SHADER_FEATURE_Count] = {
+	"DIFFUSE_MAP",
+	"SPECULAR_MAP",
+	"NORMAL_MAP",
+	"INSTANCED",
+	"SKINNED",
+	"VIRTUAL_TEXTURE",
+};
+
+// places the defines after the #version line, which has to come first
+static std::string insertDefines(const std::string& source, const std::string& defines) {
+	size_t version = source.find("#version");
+	if (version == std::string::npos)
+		return defines + "#line 1 0\n" + source;
+
+	size_t end = source.find('\n', version);
+	end = end == std::string::npos ? source.size() : end + 1;
+	int line = (int)std::count(source.begin(), source.begin() + end, '\n') + 1;
+
+	return source.substr(0, end) + "\n" + defines +
+		"#line " + std::to_string(line) + " 0\n" + source.substr(end);
+}
+
+bool ShaderVariants::loadShader(unsigned int stage, const char* filename) {
+	assert(stage > 0 && stage < eShaderStage::SHADER_STAGE_Count);
+
+	std::vector<std::string> included;
+	std::string source;
+	if (preprocess(filename, source, included, m_lastError) == false) {
+		m_sources[stage].clear();
+		return false;
+	}
+
+	m_filenames[stage] = filename;
+	m_sources[stage] = source;
+	m_included[stage] = included;
+	return true;
+}
+
+bool ShaderVariants::reload() {
+
+	// nothing changes unless every stage can still be read
+	std::string sources[eShaderStage::SHADER_STAGE_Count];
+	std::vector<std::string> included[eShaderStage::SHADER_STAGE_Count];
+	for (unsigned int stage = 0; stage < eShaderStage::SHADER_STAGE_Count; ++stage) {
+		if (m_filenames[stage].empty() == false &&
+			preprocess(m_filenames[stage].c_str(), sources[stage], included[stage], m_lastError) == false)
+			return false;
+	}
+
+	for (unsigned int stage = 0; stage < eShaderStage::SHADER_STAGE_Count; ++stage) {
+		m_sources[stage] = sources[stage];
+		m_included[stage] = included[stage];
+	}
+
+	// relink every variant, one that fails keeps its previous program
+	bool success = true;
+	for (auto& variant : m_variants) {
+		std::shared_ptr<Shader> shaders[eShaderStage::SHADER_STAGE_Count];
+		createShaders(variant.first, shaders);
+		if (variant.second->replaceShaders(shaders) == false) {
+			char name[32];
+			snprintf(name, sizeof(name), "variant 0x%x: ", variant.first);
+			m_lastError = name;
+			m_lastError += variant.second->getLastError() != nullptr ? variant.second->getLastError() : "";
+			success = false;
+		}
+	}
+	return success;
+}
+
+std::vector<std::string> ShaderVariants::getDependencies() const {
+	std::vector<std::string> files;
+	for (auto& stageFiles : m_included)
+		for (auto& file : stageFiles)
+			if (std::find(files.begin(), files.end(), file) == files.end())
+				files.push_back(file);
+	return files;
+}
+
+void ShaderVariants::createShaders(unsigned int features, std::shared_ptr<Shader> shaders[eShaderStage::SHADER_STAGE_Count]) const {
+	std::string defines = getDefines(features);
+	for (unsigned int stage = 0; stage < eShaderStage::SHADER_STAGE_Count; ++stage) {
+		if (m_sources[stage].empty() == false) {
+			shaders[stage] = std::make_shared<Shader>();
+			shaders[stage]->setSource(stage, insertDefines(m_sources[stage], defines).c_str());
+		}
+	}
+}
+
+bool ShaderVariants::preprocess(const char* filename, std::string& source,
+								std::vector<std::string>& included, std::string& error) {
+
+	std::string text;
+	if (Shader::readFile(filename, text) == false) {
+		error = std::string("Unable to open ") + filename;
+		return false;
+	}
+
+	// #line directives name files by their index in included, so
+	// compile errors can be traced back to the file they came from
+	int fileIndex = (int)included.size();
+	included.push_back(filename);
+
+	std::string name = filename;
+	std::string folder = name.substr(0, name.find_last_of("/\\") + 1);
+
+	int line = 1;
+	size_t start = 0;
+	while (start < text.size()) {
+		size_t end = text.find('\n', start);
+		end = end == std::string::npos ? text.size() : end + 1;
+
+		size_t first = text.find_first_not_of(" \t", start);
+		if (first < end &&
+			text.compare(first, 8, "#include") == 0) {
+
+			size_t open = text.find('"', first + 8);
+			size_t close = open < end ? text.find('"', open + 1) : std::string::npos;
+			if (close >= end) {
+				error = name + "(" + std::to_string(line) + "): expected #include \"file\"";
+				return false;
+			}
+
+			std::string path = folder + text.substr(open + 1, close - open - 1);
+			if (std::find(included.begin(), included.end(), path) == included.end()) {
+				source += "#line 1 " + std::to_string(included.size()) + "\n";
+				if (preprocess(path.c_str(), source, included, error) == false)
+					return false;
+				source += "\n#line " + std::to_string(line + 1) + " " + std::to_string(fileIndex) + "\n";
+			}
+		}
+		else {
+			source.append(text, start, end - start);
+		}
+
+		start = end;
+		++line;
+	}
+
+	return true;
+}
+
+std::string ShaderVariants::getDefines(unsigned int features) const {
+	std::string defines;
+	for (unsigned int i = 0; i < eShaderFeature::SHADER_FEATURE_Count; ++i)
+		if (features & (1 << i))
+			defines += std::string("#define ") + FEATURE_NAMES[i] + "\n";
+	return defines;
+}
+
+ShaderProgram* ShaderVariants::getVariant(unsigned int features) {
+	auto iter = m_variants.find(features);
+	if (iter != m_variants.end())
+		return iter->second.get();
+
+	// defines are part of each stage's source, so every variant
+	// gets its own entry in the program binary cache
+	std::unique_ptr<ShaderProgram> program(new ShaderProgram());
+	std::shared_ptr<Shader> shaders[eShaderStage::SHADER_STAGE_Count];
+	createShaders(features, shaders);
+	for (auto& shader : shaders)
+		if (shader != nullptr)
+			program->attachShader(shader);
+	program->beginLink();
+
+	ShaderProgram* variant = program.get();
+	m_variants[features] = std::move(program);
+	return variant;
+}
+
+eLinkStatus ShaderVariants::getLinkStatus() {
+	eLinkStatus status = LINKED;
+	for (auto& variant : m_variants) {
+		eLinkStatus variantStatus = variant.second->getLinkStatus();
+		if (variantStatus == LINK_FAILED) {
+			char name[32];
+			snprintf(name, sizeof(name), "variant 0x%x: ", variant.first);
+			m_lastError = name;
+			m_lastError += variant.second->getLastError() != nullptr ? variant.second->getLastError() : "";
+			return LINK_FAILED;
+		}
+		if (variantStatus != LINKED)
+			status = LINKING;
+	}
+	return status;
+}
+
+unsigned int ShaderVariants::getCachedVariantCount() const {
+	unsigned int count = 0;
+	for (auto& variant : m_variants)
+		if (variant.second->isFromBinaryCache())
+			count++;
+	return count;
+}
+
+} // namespace aie
@@ -0,0 +1,76 @@
+#pragma once
+
+#include "Shader.h"
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <memory>
+
+namespace aie {
+
+// optional inputs a shader can be built with, each is #defined when set
+enum eShaderFeature : unsigned int {
+	DIFFUSE_MAP		= 1 << 0,
+	SPECULAR_MAP	= 1 << 1,
+	NORMAL_MAP		= 1 << 2,
+	INSTANCED		= 1 << 3,
+	SKINNED			= 1 << 4,
+	VIRTUAL_TEXTURE	= 1 << 5,
+
+	SHADER_FEATURE_Count = 6,
+};
+
+// one set of shader sources written with #ifdef'd features, compiled into a
+// separate program for each combination the first time it is asked for.
+// sources can #include "file" relative to the file including them, each file
+// is only included once
+class ShaderVariants {
+public:
+
+	ShaderVariants() {}
+	~ShaderVariants() {}
+
+	// reads a stage's source and the files it includes
+	bool loadShader(unsigned int stage, const char* filename);
+
+	// reads every stage again and relinks the variants built so far. a variant
+	// that fails to link keeps its previous program
+	bool reload();
+
+	// every file the stages were read from, including #included ones
+	std::vector<std::string>	getDependencies() const;
+
+	// returns the program for a set of eShaderFeature flags, starting it
+	// compiling if it is new. check isReady() on it before drawing
+	ShaderProgram*	getVariant(unsigned int features);
+
+	// LINK_FAILED if any variant failed, LINKING if any are still compiling
+	eLinkStatus		getLinkStatus();
+
+	size_t			getVariantCount() const { return m_variants.size(); }
+	unsigned int	getCachedVariantCount() const;
+
+	// the error from loading, or from the variant that failed to link
+	const char*		getLastError() const { return m_lastError.c_str(); }
+
+	// expands #include lines, files already in included are skipped
+	static bool		preprocess(const char* filename, std::string& source,
+							   std::vector<std::string>& included, std::string& error);
+
+private:
+
+	std::string		getDefines(unsigned int features) const;
+
+	// makes the stages for a variant from the preprocessed sources
+	void			createShaders(unsigned int features, std::shared_ptr<Shader> shaders[eShaderStage::SHADER_STAGE_Count]) const;
+
+	std::string		m_filenames[eShaderStage::SHADER_STAGE_Count];
+	std::string		m_sources[eShaderStage::SHADER_STAGE_Count];
+	std::vector<std::string>	m_included[eShaderStage::SHADER_STAGE_Count];
+
+	std::unordered_map<unsigned int, std::unique_ptr<ShaderProgram>>	m_variants;
+
+	std::string		m_lastError;
+};
+
+} // namespace aie
@@ -0,0 +1,177 @@
+#include "ShaderWatcher.h"
+#include "Shader.h"
+#include "ShaderVariants.h"
+#include <cstdio>
+#include <algorithm>
+#include <chrono>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <unistd.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+namespace aie {
+
+#ifndef __linux__
+// how often modification times are checked, in seconds
+static const double POLL_INTERVAL = 0.5;
+
+static long long getModifiedTime(const std::string& filename) {
+#ifdef _WIN32
+	struct _stat info;
+	if (_stat(filename.c_str(), &info) != 0)
+		return 0;
+#else
+	struct stat info;
+	if (stat(filename.c_str(), &info) != 0)
+		return 0;
+#endif
+	return (long long)info.st_mtime;
+}
+
+static double getSeconds() {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+#endif
+
+ShaderWatcher::ShaderWatcher() {
+#ifdef __linux__
+	m_inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+	if (m_inotify < 0)
+		printf("ShaderWatcher: inotify unavailable, shaders won't reload\n");
+#else
+	m_lastPoll = getSeconds();
+#endif
+}
+
+ShaderWatcher::~ShaderWatcher() {
+#ifdef __linux__
+	// closing the descriptor removes its watches
+	if (m_inotify >= 0)
+		close(m_inotify);
+#endif
+}
+
+void ShaderWatcher::watch(ShaderProgram* program) {
+	Watched watched = { program, nullptr, {} };
+	updateFiles(watched);
+	m_watched.push_back(watched);
+}
+
+void ShaderWatcher::watch(ShaderVariants* variants) {
+	Watched watched = { nullptr, variants, {} };
+	updateFiles(watched);
+	m_watched.push_back(watched);
+}
+
+void ShaderWatcher::unwatch(const void* program) {
+	m_watched.erase(std::remove_if(m_watched.begin(), m_watched.end(),
+		[program](const Watched& watched) {
+			return watched.program == program || watched.variants == program;
+		}), m_watched.end());
+}
+
+void ShaderWatcher::updateFiles(Watched& watched) {
+	watched.files.clear();
+	if (watched.program != nullptr) {
+		for (unsigned int stage = 0; stage < eShaderStage::SHADER_STAGE_Count; ++stage)
+			if (watched.program->getFilename(stage).empty() == false)
+				watched.files.push_back(watched.program->getFilename(stage));
+	}
+	else {
+		watched.files = watched.variants->getDependencies();
+	}
+
+	for (auto& file : watched.files) {
+#ifdef __linux__
+		// folders are watched rather than files, editors often save by
+		// writing a new file and renaming it over the old one
+		if (m_inotify < 0)
+			break;
+		std::string folder = file.substr(0, file.find_last_of('/') + 1);
+		if (m_folderWatches.find(folder) == m_folderWatches.end()) {
+			int watch = inotify_add_watch(m_inotify, folder.empty() ? "." : folder.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+			if (watch < 0) {
+				printf("ShaderWatcher: unable to watch %s\n", folder.c_str());
+				continue;
+			}
+			m_folderWatches[folder] = watch;
+			m_folders[watch] = folder;
+		}
+#else
+		if (m_modifiedTimes.find(file) == m_modifiedTimes.end())
+			m_modifiedTimes[file] = getModifiedTime(file);
+#endif
+	}
+}
+
+void ShaderWatcher::update() {
+
+	std::vector<std::string> changed;
+
+#ifdef __linux__
+	if (m_inotify < 0)
+		return;
+
+	alignas(inotify_event) char buffer[4096];
+	for (;;) {
+		ssize_t length = read(m_inotify, buffer, sizeof(buffer));
+		if (length <= 0)
+			break;
+
+		for (char* next = buffer; next < buffer + length; ) {
+			const inotify_event* event = (const inotify_event*)next;
+			next += sizeof(inotify_event) + event->len;
+
+			auto folder = m_folders.find(event->wd);
+			if (event->len > 0 &&
+				folder != m_folders.end())
+				changed.push_back(folder->second + event->name);
+		}
+	}
+#else
+	double now = getSeconds();
+	if (now - m_lastPoll < POLL_INTERVAL)
+		return;
+	m_lastPoll = now;
+
+	for (auto& file : m_modifiedTimes) {
+		long long modified = getModifiedTime(file.first);
+		if (modified != 0 &&
+			modified != file.second) {
+			file.second = modified;
+			changed.push_back(file.first);
+		}
+	}
+#endif
+
+	if (changed.empty())
+		return;
+
+	// each program reloads once however many of its files changed
+	for (auto& watched : m_watched) {
+		for (auto& file : watched.files) {
+			if (std::find(changed.begin(), changed.end(), file) != changed.end()) {
+				reload(watched);
+				break;
+			}
+		}
+	}
+}
+
+void ShaderWatcher::reload(Watched& watched) {
+	bool success = watched.program != nullptr ? watched.program->reload() : watched.variants->reload();
+	const char* error = watched.program != nullptr ? watched.program->getLastError() : watched.variants->getLastError();
+
+	if (success)
+		printf("Reloaded shaders from %s\n", watched.files.empty() ? "" : watched.files[0].c_str());
+	else
+		printf("Shader reload failed, keeping the previous program: %s\n", error != nullptr ? error : "");
+
+	updateFiles(watched);
+}
+
+} // namespace aie
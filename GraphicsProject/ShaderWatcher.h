@@ -0,0 +1,54 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+namespace aie {
+
+class ShaderProgram;
+class ShaderVariants;
+
+// reloads shader programs in place when the files they were read from change.
+// on linux inotify reports changes to the folders holding them, elsewhere the
+// files' modification times are polled. a program that fails to rebuild keeps
+// running the one it had
+class ShaderWatcher {
+public:
+
+	ShaderWatcher();
+	~ShaderWatcher();
+
+	// programs must outlive the watcher, or be unwatched first
+	void	watch(ShaderProgram* program);
+	void	watch(ShaderVariants* variants);
+	void	unwatch(const void* program);
+
+	// reloads programs using files that have changed, call once a frame
+	void	update();
+
+private:
+
+	struct Watched {
+		ShaderProgram*				program;
+		ShaderVariants*				variants;
+		std::vector<std::string>	files;
+	};
+
+	// refreshes the files a program depends on, includes can change on reload
+	void	updateFiles(Watched& watched);
+	void	reload(Watched& watched);
+
+	std::vector<Watched>	m_watched;
+
+#ifdef __linux__
+	int										m_inotify;
+	std::unordered_map<int, std::string>	m_folders;
+	std::unordered_map<std::string, int>	m_folderWatches;
+#else
+	std::unordered_map<std::string, long long>	m_modifiedTimes;
+	double										m_lastPoll;
+#endif
+};
+
+} // namespace aie
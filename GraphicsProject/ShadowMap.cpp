@@ -0,0 +1,289 @@
+/*----------------------------------------------
+	File Name: ShadowMap.cpp
+	Purpose: Cascaded shadows for the sun
+	Author: Logan Ryan
+	Modified: 8 April 2021
+------------------------------------------------
+	Copyright 2021 Logan Ryan
+----------------------------------------------*/
+#include "ShadowMap.h"
+#include "Scene.h"
+#include "Instance.h"
+#include "Camera.h"
+
+#include <gl_core_4_4.h>
+#include <glm/ext.hpp>
+#include <chrono>
+#include <cstdio>
+
+ShadowMap::ShadowMap(unsigned int a_cascadeCount, unsigned int a_resolution)
+	: m_cascadeCount(0), m_resolution(0), m_enabled(true), m_shadowDistance(50),
+	m_splitBlend(0.75f), m_framebuffer(0), m_texture(0), m_createdCount(0),
+	m_createdResolution(0), m_ready(false), m_frameCount(0), m_updateTime(0), m_gpuTime(0)
+{
+	SetCascades(a_cascadeCount, a_resolution);
+
+	for (unsigned int i = 0; i < MAX_CASCADES; i++)
+	{
+		m_splits[i] = 0;
+		m_drawn[i] = m_culled[i] = 0;
+	}
+	m_timers[0][0] = m_timers[0][1] = m_timers[1][0] = m_timers[1][1] = 0;
+}
+
+ShadowMap::~ShadowMap()
+{
+	Destroy();
+	if (m_timers[0][0] != 0)
+		glDeleteQueries(4, &m_timers[0][0]);
+}
+
+bool ShadowMap::LoadShaders()
+{
+	if (m_shader.loadShader(aie::eShaderStage::VERTEX, "./bin/shaders/depth.vert") == false ||
+		m_shader.loadShader(aie::eShaderStage::FRAGMENT, "./bin/shaders/depth.frag") == false ||
+		m_shader.beginLink() == false)
+	{
+		printf("Shadow Shader had an error: %s\n", m_shader.getLastError());
+		return false;
+	}
+	return true;
+}
+
+void ShadowMap::SetCascades(unsigned int a_count, unsigned int a_resolution)
+{
+	m_cascadeCount = glm::clamp(a_count, 1u, MAX_CASCADES);
+	m_resolution = glm::max(a_resolution, 1u);
+}
+
+void ShadowMap::Draw(Scene* a_scene)
+{
+	m_ready = false;
+	if (m_enabled == false ||
+		m_shader.isReady() == false)
+		return;
+
+	if (m_cascadeCount != m_createdCount || m_resolution != m_createdResolution)
+		Create();
+	if (m_framebuffer == 0)
+		return;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// Read last frame's pass time if it has finished
+	if (m_timers[0][0] == 0)
+		glGenQueries(4, &m_timers[0][0]);
+	if (m_frameCount > 0)
+	{
+		unsigned int* lastTimers = m_timers[(m_frameCount + 1) % 2];
+		int available = 0;
+		glGetQueryObjectiv(lastTimers[1], GL_QUERY_RESULT_AVAILABLE, &available);
+		if (available != 0)
+		{
+			GLuint64 begin = 0, end = 0;
+			glGetQueryObjectui64v(lastTimers[0], GL_QUERY_RESULT, &begin);
+			glGetQueryObjectui64v(lastTimers[1], GL_QUERY_RESULT, &end);
+			m_gpuTime = (end - begin) / 1000000.f;
+		}
+	}
+
+	// Timestamps rather than an elapsed query so the pass can be timed
+	// inside a timer covering the whole scene
+	unsigned int* timers = m_timers[m_frameCount % 2];
+	glQueryCounter(timers[0], GL_TIMESTAMP);
+
+	// Recover the camera's frustum from its projection
+	Camera* camera = a_scene->GetCamera();
+	const glm::mat4& projection = camera->GetProjectionMatrix();
+	const glm::mat4& inverseView = camera->GetInverseViewMatrix();
+	float tanHalfX = 1.f / projection[0][0];
+	float tanHalfY = 1.f / projection[1][1];
+	float nearPlane = projection[3][2] / (projection[2][2] - 1.f);
+	float farPlane = projection[3][2] / (projection[2][2] + 1.f);
+	float distance = glm::clamp(m_shadowDistance, nearPlane * 2, farPlane);
+
+	// Blend even and logarithmic splits, near cascades get more of the texels
+	for (unsigned int i = 0; i < m_cascadeCount; i++)
+	{
+		float t = (i + 1) / (float)m_cascadeCount;
+		float evenSplit = nearPlane + (distance - nearPlane) * t;
+		float logSplit = nearPlane * glm::pow(distance / nearPlane, t);
+		m_splits[i] = glm::mix(evenSplit, logSplit, m_splitBlend);
+	}
+
+	for (unsigned int i = 0; i < m_cascadeCount; i++)
+		FitCascade(i, a_scene, inverseView, tanHalfX, tanHalfY,
+			i == 0 ? nearPlane : m_splits[i - 1], m_splits[i]);
+
+	// === Depth Pass ===
+	// Depth clamping keeps casters between the sun and the cascade that
+	// are in front of its near plane, and the offset stops shadow acne
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glViewport(0, 0, m_resolution, m_resolution);
+	glEnable(GL_DEPTH_CLAMP);
+	glEnable(GL_POLYGON_OFFSET_FILL);
+	glPolygonOffset(2.f, 4.f);
+
+	m_shader.bind();
+	for (unsigned int i = 0; i < m_cascadeCount; i++)
+	{
+		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_texture, 0, i);
+		glClear(GL_DEPTH_BUFFER_BIT);
+
+		for (auto instance : m_casters[i])
+			instance->DrawDepth(m_projectionViews[i], &m_shader);
+	}
+
+	glDisable(GL_POLYGON_OFFSET_FILL);
+	glDisable(GL_DEPTH_CLAMP);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glViewport(0, 0, (int)a_scene->GetWindowSize().x, (int)a_scene->GetWindowSize().y);
+
+	// Left bound for the lit shaders
+	glActiveTexture(GL_TEXTURE0 + TEXTURE_UNIT);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+	glActiveTexture(GL_TEXTURE0);
+
+	glQueryCounter(timers[1], GL_TIMESTAMP);
+	m_frameCount++;
+	m_ready = true;
+
+	m_updateTime = std::chrono::duration<float, std::milli>(
+		std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void ShadowMap::FitCascade(unsigned int a_cascade, Scene* a_scene, const glm::mat4& a_inverseView,
+	float a_tanHalfX, float a_tanHalfY, float a_sliceNear, float a_sliceFar)
+{
+	// Corners of the slice in world space
+	glm::vec3 corners[8];
+	glm::vec3 center(0);
+	for (int i = 0; i < 8; i++)
+	{
+		float depth = (i & 4) ? a_sliceFar : a_sliceNear;
+		glm::vec4 corner((i & 1 ? 1 : -1) * a_tanHalfX * depth,
+			(i & 2 ? 1 : -1) * a_tanHalfY * depth, -depth, 1);
+		corners[i] = glm::vec3(a_inverseView * corner);
+		center += corners[i] / 8.f;
+	}
+
+	// A sphere keeps the same size however the camera turns, rounded up so
+	// precision doesn't change it either
+	float radius = 0;
+	for (int i = 0; i < 8; i++)
+		radius = glm::max(radius, glm::length(corners[i] - center));
+	radius = glm::ceil(radius * 16.f) / 16.f;
+
+	// Look down the sun's direction
+	glm::vec3 direction = glm::normalize(a_scene->GetLight().m_direction);
+	glm::vec3 up = glm::abs(direction.y) > 0.99f ? glm::vec3(0, 0, 1) : glm::vec3(0, 1, 0);
+	glm::mat4 lightRotation = glm::lookAt(glm::vec3(0), direction, up);
+
+	// Snap the centre to whole texels so the cascade only moves in texel steps
+	glm::vec3 lightCenter = glm::vec3(lightRotation * glm::vec4(center, 1));
+	float texelSize = radius * 2 / m_resolution;
+	lightCenter.x = glm::floor(lightCenter.x / texelSize) * texelSize;
+	lightCenter.y = glm::floor(lightCenter.y / texelSize) * texelSize;
+
+	// The light looks down -z, so the sun is towards +z
+	glm::mat4 projection = glm::ortho(lightCenter.x - radius, lightCenter.x + radius,
+		lightCenter.y - radius, lightCenter.y + radius,
+		-(lightCenter.z + radius), -(lightCenter.z - radius));
+	m_projectionViews[a_cascade] = projection * lightRotation;
+
+	// Anything between the sun and the cascade can cast into it, depth
+	// clamping keeps casters past its near plane
+	m_casters[a_cascade].clear();
+	m_culled[a_cascade] = 0;
+	for (auto instance : a_scene->GetInstances())
+	{
+		glm::vec3 boundsCenter;
+		float boundsRadius;
+		instance->GetBounds(boundsCenter, boundsRadius);
+		glm::vec3 lightBounds = glm::vec3(lightRotation * glm::vec4(boundsCenter, 1));
+
+		if (glm::abs(lightBounds.x - lightCenter.x) > radius + boundsRadius ||
+			glm::abs(lightBounds.y - lightCenter.y) > radius + boundsRadius ||
+			lightBounds.z + boundsRadius < lightCenter.z - radius)
+			m_culled[a_cascade]++;
+		else
+			m_casters[a_cascade].push_back(instance);
+	}
+	m_drawn[a_cascade] = (unsigned int)m_casters[a_cascade].size();
+}
+
+void ShadowMap::BindUniforms(aie::ShaderProgram* a_shader)
+{
+	if (m_ready == false)
+	{
+		BindDisabled(a_shader);
+		return;
+	}
+
+	// Take clip space's -1 to 1 to the texture's 0 to 1
+	glm::mat4 bias = glm::translate(glm::mat4(1), glm::vec3(0.5f)) * glm::scale(glm::mat4(1), glm::vec3(0.5f));
+	glm::mat4 shadowMatrices[MAX_CASCADES];
+	for (unsigned int i = 0; i < m_cascadeCount; i++)
+		shadowMatrices[i] = bias * m_projectionViews[i];
+
+	a_shader->bindUniform("ShadowMap", (int)TEXTURE_UNIT);
+	a_shader->bindUniform("ShadowCascadeCount", (int)m_cascadeCount);
+	a_shader->bindUniform("ShadowMatrices", (int)m_cascadeCount, shadowMatrices);
+	a_shader->bindUniform("ShadowSplits", (int)m_cascadeCount, m_splits);
+}
+
+void ShadowMap::BindDisabled(aie::ShaderProgram* a_shader)
+{
+	// The sampler still needs its own unit, it can't share one with the materials' 2D textures
+	a_shader->bindUniform("ShadowMap", (int)TEXTURE_UNIT);
+	a_shader->bindUniform("ShadowCascadeCount", 0);
+}
+
+bool ShadowMap::Create()
+{
+	Destroy();
+
+	m_createdCount = m_cascadeCount;
+	m_createdResolution = m_resolution;
+
+	// Compared in hardware, linear filtering blends four comparisons
+	glGenTextures(1, &m_texture);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_texture);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT32F, m_resolution, m_resolution, m_cascadeCount);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	glGenFramebuffers(1, &m_framebuffer);
+	glBindFramebuffer(GL_FRAMEBUFFER, m_framebuffer);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_texture, 0, 0);
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+
+	GLenum status = glCheckFramebufferStatus(GL_FRAMEBUFFER);
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+	// The failed settings aren't retried until they change
+	if (status != GL_FRAMEBUFFER_COMPLETE)
+	{
+		printf("Shadow map framebuffer is incomplete (0x%x)\n", status);
+		Destroy();
+		return false;
+	}
+	return true;
+}
+
+void ShadowMap::Destroy()
+{
+	if (m_framebuffer != 0)
+		glDeleteFramebuffers(1, &m_framebuffer);
+	if (m_texture != 0)
+		glDeleteTextures(1, &m_texture);
+
+	m_framebuffer = 0;
+	m_texture = 0;
+}
@@ -0,0 +1,107 @@
+/*----------------------------------------------
+	File Name: ShadowMap.h
+	Purpose: Cascaded shadows for the sun
+	Author: Logan Ryan
+	Modified: 8 April 2021
+------------------------------------------------
+	Copyright 2021 Logan Ryan
+----------------------------------------------*/
+#pragma once
+#include "Shader.h"
+#include <glm/glm.hpp>
+#include <vector>
+
+class Scene;
+class Instance;
+
+// Splits the camera's view into slices by depth and renders the sun's depth
+// over each one into a layer of a texture array. Each cascade is fitted to a
+// sphere around its slice and snapped to whole texels, so the shadows don't
+// swim as the camera moves or turns
+class ShadowMap
+{
+public:
+	static const unsigned int MAX_CASCADES = 4;
+	// Texture unit the lit shaders sample the cascades from, above the mesh materials'
+	static const unsigned int TEXTURE_UNIT = 8;
+
+	// Constructor
+	ShadowMap(unsigned int a_cascadeCount = 3, unsigned int a_resolution = 2048);
+	// Destructor
+	~ShadowMap();
+
+	// Start the depth shader compiling
+	bool LoadShaders();
+
+	// Fit the cascades to the scene's camera and render their depth, called
+	// once a frame before anything lit is drawn
+	void Draw(Scene* a_scene);
+
+	// Set the uniforms lighting.glsl samples the cascades with
+	void BindUniforms(aie::ShaderProgram* a_shader);
+	// Bind the uniforms with shadows turned off
+	static void BindDisabled(aie::ShaderProgram* a_shader);
+
+	// Settings, the texture is recreated on the next draw if they change
+	void SetCascades(unsigned int a_count, unsigned int a_resolution);
+	void SetEnabled(bool a_enabled) { m_enabled = a_enabled; }
+	// How far from the camera shadows reach
+	void SetShadowDistance(float a_distance) { m_shadowDistance = a_distance; }
+	// 0 splits the distance evenly, 1 logarithmically
+	void SetSplitBlend(float a_blend) { m_splitBlend = a_blend; }
+
+	// Getters
+	aie::ShaderProgram& GetShader() { return m_shader; }
+	unsigned int GetCascadeCount() { return m_cascadeCount; }
+	unsigned int GetResolution() { return m_resolution; }
+	bool IsEnabled() { return m_enabled; }
+	float GetShadowDistance() { return m_shadowDistance; }
+	float GetSplitBlend() { return m_splitBlend; }
+
+	// Stats from the last draw, the GPU time is a frame behind
+	float GetUpdateTime() { return m_updateTime; }
+	float GetGPUTime() { return m_gpuTime; }
+	unsigned int GetDrawnCount(unsigned int a_cascade) { return m_drawn[a_cascade]; }
+	unsigned int GetCulledCount(unsigned int a_cascade) { return m_culled[a_cascade]; }
+
+protected:
+	// Create the texture array and framebuffer for the current settings
+	bool Create();
+	void Destroy();
+
+	// Fit a cascade to the slice of the view between two depths and list
+	// the instances that can cast into it
+	void FitCascade(unsigned int a_cascade, Scene* a_scene, const glm::mat4& a_inverseView,
+		float a_tanHalfX, float a_tanHalfY, float a_sliceNear, float a_sliceFar);
+
+	aie::ShaderProgram	m_shader;
+
+	// Settings
+	unsigned int		m_cascadeCount;
+	unsigned int		m_resolution;
+	bool				m_enabled;
+	float				m_shadowDistance;
+	float				m_splitBlend;
+
+	// Texture array with a layer for each cascade
+	unsigned int		m_framebuffer;
+	unsigned int		m_texture;
+	unsigned int		m_createdCount, m_createdResolution;
+
+	// Set when the last draw rendered every cascade
+	bool				m_ready;
+
+	// World to cascade clip space, and the view depth each cascade reaches
+	glm::mat4			m_projectionViews[MAX_CASCADES];
+	float				m_splits[MAX_CASCADES];
+	std::vector<Instance*>	m_casters[MAX_CASCADES];
+
+	// Timestamps either side of the pass, read back a frame later
+	unsigned int		m_timers[2][2];
+	unsigned int		m_frameCount;
+
+	float				m_updateTime;
+	float				m_gpuTime;
+	unsigned int		m_drawn[MAX_CASCADES];
+	unsigned int		m_culled[MAX_CASCADES];
+};
@@ -0,0 +1,377 @@
+/*----------------------------------------------
+	File Name: SoftwareOcclusion.cpp
+	Purpose: Rasterize occluders on the CPU
+	Author: Logan Ryan
+	Modified: 8 April 2021
+------------------------------------------------
+	Copyright 2021 Logan Ryan
+----------------------------------------------*/
+#include "SoftwareOcclusion.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__SSE2__)
+#include <xmmintrin.h>
+#define OCCLUSION_USE_SSE
+#endif
+
+// Every pixel of a tile covered
+const unsigned int FULL_COVERAGE = 0xffffffffu;
+// How far off screen, in screen widths, a vertex can be before its triangles are left out
+const float GUARD_BAND = 4.f;
+
+SoftwareOcclusion::SoftwareOcclusion(unsigned int a_width, unsigned int a_height)
+	: m_setupTime(0), m_rasterTime(0), m_threadCount(1), m_job(0), m_pending(0), m_quit(false)
+{
+	m_tilesX = (a_width + TILE_WIDTH - 1) / TILE_WIDTH;
+	m_tilesY = (a_height + TILE_HEIGHT - 1) / TILE_HEIGHT;
+	m_width = m_tilesX * TILE_WIDTH;
+	m_height = m_tilesY * TILE_HEIGHT;
+	m_rowStride = (m_tilesX + 3) & ~3u;
+
+	m_depthMax0.resize(m_rowStride * m_tilesY);
+	m_depthMax1.resize(m_rowStride * m_tilesY);
+	m_coverage.resize(m_rowStride * m_tilesY);
+	Clear();
+
+	// Leave cores for the main thread and the texture loader
+	unsigned int cores = std::thread::hardware_concurrency();
+	unsigned int workers = cores > 2 ? (cores - 2 < 3 ? cores - 2 : 3) : 0;
+	m_threadCount = workers + 1;
+	for (unsigned int i = 0; i < workers; i++)
+		m_workers.push_back(std::thread(&SoftwareOcclusion::WorkerThread, this, i));
+}
+
+SoftwareOcclusion::~SoftwareOcclusion()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+	}
+	m_startWork.notify_all();
+	for (auto& worker : m_workers)
+		worker.join();
+}
+
+void SoftwareOcclusion::Clear()
+{
+	std::fill(m_depthMax0.begin(), m_depthMax0.end(), 1.f);
+	std::fill(m_depthMax1.begin(), m_depthMax1.end(), 0.f);
+	std::fill(m_coverage.begin(), m_coverage.end(), 0u);
+	m_triangles.clear();
+	m_setupTime = 0;
+}
+
+void SoftwareOcclusion::AddOccluder(const glm::mat4& a_projectionViewModel,
+	const std::vector<glm::vec3>& a_vertices, const std::vector<unsigned int>& a_indices)
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	// === Vertices ===
+	glm::vec2 halfSize(m_width * 0.5f, m_height * 0.5f);
+	m_transformed.resize(a_vertices.size());
+	for (size_t i = 0; i < a_vertices.size(); i++)
+	{
+		glm::vec4 clip = a_projectionViewModel * glm::vec4(a_vertices[i], 1);
+		if (clip.z < -clip.w || clip.w <= 0)
+		{
+			m_transformed[i].w = -1;
+			continue;
+		}
+
+		glm::vec3 ndc = glm::vec3(clip) / clip.w;
+		if (std::abs(ndc.x) > GUARD_BAND || std::abs(ndc.y) > GUARD_BAND)
+		{
+			m_transformed[i].w = -1;
+			continue;
+		}
+		m_transformed[i] = glm::vec4((glm::vec2(ndc) + 1.f) * halfSize, ndc.z * 0.5f + 0.5f, 1);
+	}
+
+	// === Triangles ===
+	for (size_t i = 0; i + 2 < a_indices.size(); i += 3)
+	{
+		const glm::vec4& v0 = m_transformed[a_indices[i]];
+		const glm::vec4& v1 = m_transformed[a_indices[i + 1]];
+		const glm::vec4& v2 = m_transformed[a_indices[i + 2]];
+		if (v0.w < 0 || v1.w < 0 || v2.w < 0)
+			continue;
+
+		// Counter clockwise triangles face the camera
+		float area = (v1.x - v0.x) * (v2.y - v0.y) - (v2.x - v0.x) * (v1.y - v0.y);
+		if (area <= 0)
+			continue;
+
+		Triangle triangle;
+		glm::vec2 boundsMin = glm::min(glm::vec2(v0), glm::min(glm::vec2(v1), glm::vec2(v2)));
+		glm::vec2 boundsMax = glm::max(glm::vec2(v0), glm::max(glm::vec2(v1), glm::vec2(v2)));
+		triangle.tileMinX = std::max((int)std::floor(boundsMin.x) / TILE_WIDTH, 0);
+		triangle.tileMinY = std::max((int)std::floor(boundsMin.y) / TILE_HEIGHT, 0);
+		triangle.tileMaxX = std::min((int)std::floor(boundsMax.x) / TILE_WIDTH, (int)m_tilesX - 1);
+		triangle.tileMaxY = std::min((int)std::floor(boundsMax.y) / TILE_HEIGHT, (int)m_tilesY - 1);
+		if (triangle.tileMinX > triangle.tileMaxX || triangle.tileMinY > triangle.tileMaxY)
+			continue;
+
+		const glm::vec4* corners[3] = { &v0, &v1, &v2 };
+		for (int e = 0; e < 3; e++)
+		{
+			const glm::vec4& from = *corners[e];
+			const glm::vec4& to = *corners[(e + 1) % 3];
+			triangle.edgeA[e] = from.y - to.y;
+			triangle.edgeB[e] = to.x - from.x;
+			triangle.edgeX[e] = from.x;
+			triangle.edgeY[e] = from.y;
+		}
+
+		// Depth is linear across the screen
+		triangle.depthX = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+		triangle.depthY = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+		triangle.depth = v0.z - triangle.depthX * v0.x - triangle.depthY * v0.y;
+		triangle.depthMin = std::min(v0.z, std::min(v1.z, v2.z));
+		triangle.depthMax = std::max(v0.z, std::max(v1.z, v2.z));
+
+		m_triangles.push_back(triangle);
+	}
+
+	m_setupTime += std::chrono::duration<float, std::milli>(
+		std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void SoftwareOcclusion::Rasterize()
+{
+	auto start = std::chrono::high_resolution_clock::now();
+
+	if (m_triangles.empty() == false)
+	{
+		// Rows are interleaved between the threads so the work is shared
+		// however the occluders are spread over the screen
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_job++;
+			m_pending = m_threadCount - 1;
+		}
+		m_startWork.notify_all();
+
+		RasterizeRows(0, m_threadCount);
+
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_workDone.wait(lock, [this]() { return m_pending == 0; });
+		}
+	}
+
+	m_rasterTime = std::chrono::duration<float, std::milli>(
+		std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void SoftwareOcclusion::RasterizeRows(unsigned int a_first, unsigned int a_step)
+{
+	int step = (int)a_step;
+
+#ifdef OCCLUSION_USE_SSE
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 columns = _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f);
+#endif
+
+	// Every thread goes through the triangles in the same order, so the
+	// result doesn't depend on how many there are
+	for (auto& triangle : m_triangles)
+	{
+		int firstRow = triangle.tileMinY + ((int)a_first - triangle.tileMinY % step + step) % step;
+
+#ifdef OCCLUSION_USE_SSE
+		__m128 stepX[3], stepX4[3];
+		for (int e = 0; e < 3; e++)
+		{
+			stepX[e] = _mm_mul_ps(_mm_set1_ps(triangle.edgeA[e]), columns);
+			stepX4[e] = _mm_set1_ps(triangle.edgeA[e] * 4.f);
+		}
+#endif
+
+		for (int ty = firstRow; ty <= triangle.tileMaxY; ty += step)
+		{
+			float pixelY = (float)(ty * TILE_HEIGHT);
+			for (int tx = triangle.tileMinX; tx <= triangle.tileMaxX; tx++)
+			{
+				size_t tile = ty * m_rowStride + tx;
+
+				// Nothing to add behind what already covers the tile
+				if (triangle.depthMin >= m_depthMax0[tile])
+					continue;
+
+				// Skip tiles wholly outside an edge, checking the pixel centre
+				// nearest the inside of it
+				float pixelX = (float)(tx * TILE_WIDTH);
+				float edges[3];
+				bool outside = false;
+				for (int e = 0; e < 3; e++)
+				{
+					edges[e] = triangle.edgeA[e] * (pixelX - triangle.edgeX[e]) +
+						triangle.edgeB[e] * (pixelY + 0.5f - triangle.edgeY[e]);
+					float best = edges[e] +
+						glm::max(triangle.edgeA[e] * (TILE_WIDTH - 0.5f), triangle.edgeA[e] * 0.5f) +
+						glm::max(triangle.edgeB[e] * (TILE_HEIGHT - 1), 0.f);
+					outside = outside || best < 0;
+				}
+				if (outside)
+					continue;
+
+				// One bit for each pixel centre inside all three edges, a row of the tile a byte
+				unsigned int coverage = 0;
+#ifdef OCCLUSION_USE_SSE
+				for (int row = 0; row < TILE_HEIGHT; row++)
+				{
+					__m128 left = _mm_cmpeq_ps(zero, zero);
+					__m128 right = left;
+					for (int e = 0; e < 3; e++)
+					{
+						__m128 start = _mm_add_ps(_mm_set1_ps(edges[e] + triangle.edgeB[e] * row), stepX[e]);
+						left = _mm_and_ps(left, _mm_cmpge_ps(start, zero));
+						right = _mm_and_ps(right, _mm_cmpge_ps(_mm_add_ps(start, stepX4[e]), zero));
+					}
+					coverage |= (unsigned int)(_mm_movemask_ps(left) | (_mm_movemask_ps(right) << 4)) << (row * TILE_WIDTH);
+				}
+#else
+				for (int row = 0; row < TILE_HEIGHT; row++)
+				{
+					for (int column = 0; column < TILE_WIDTH; column++)
+					{
+						bool inside = true;
+						for (int e = 0; e < 3; e++)
+							inside = inside && edges[e] + triangle.edgeA[e] * (column + 0.5f) +
+								triangle.edgeB[e] * row >= 0;
+						if (inside)
+							coverage |= 1u << (row * TILE_WIDTH + column);
+					}
+				}
+#endif
+				if (coverage == 0)
+					continue;
+
+				// Furthest the triangle gets inside the tile, from the plane at
+				// the tile's furthest corner
+				float depth = triangle.depth +
+					triangle.depthX * (triangle.depthX > 0 ? pixelX + TILE_WIDTH : pixelX) +
+					triangle.depthY * (triangle.depthY > 0 ? pixelY + TILE_HEIGHT : pixelY);
+				depth = glm::min(depth, triangle.depthMax);
+
+				float& depthMax0 = m_depthMax0[tile];
+				float& depthMax1 = m_depthMax1[tile];
+				unsigned int& layerCoverage = m_coverage[tile];
+
+				// Covering the tile alone it can be the covering layer straight away
+				if (coverage == FULL_COVERAGE)
+				{
+					depthMax0 = glm::min(depthMax0, depth);
+					continue;
+				}
+
+				// A triangle much nearer than the layer being filled starts it over,
+				// rather than pushing the nearer surface back to the layer's depth
+				if (layerCoverage != 0 && depthMax1 - depth > depthMax0 - depthMax1)
+				{
+					layerCoverage = 0;
+					depthMax1 = 0;
+				}
+
+				depthMax1 = glm::max(depthMax1, depth);
+				layerCoverage |= coverage;
+
+				if (layerCoverage == FULL_COVERAGE)
+				{
+					depthMax0 = glm::min(depthMax0, depthMax1);
+					depthMax1 = 0;
+					layerCoverage = 0;
+				}
+			}
+		}
+	}
+}
+
+bool SoftwareOcclusion::IsOccluded(const glm::mat4& a_projectionViewModel,
+	const glm::vec3& a_boundsMin, const glm::vec3& a_boundsMax)
+{
+	// Screen rectangle and nearest depth of the box's corners
+	glm::vec2 rectMin(1), rectMax(-1);
+	float nearest = 1;
+	for (int i = 0; i < 8; i++)
+	{
+		glm::vec4 corner = a_projectionViewModel * glm::vec4(i & 1 ? a_boundsMax.x : a_boundsMin.x,
+			i & 2 ? a_boundsMax.y : a_boundsMin.y, i & 4 ? a_boundsMax.z : a_boundsMin.z, 1);
+
+		// Crossing the near plane, the camera could be inside it
+		if (corner.z < -corner.w || corner.w <= 0)
+			return false;
+
+		glm::vec3 ndc = glm::vec3(corner) / corner.w;
+		rectMin = glm::min(rectMin, glm::vec2(ndc));
+		rectMax = glm::max(rectMax, glm::vec2(ndc));
+		nearest = glm::min(nearest, ndc.z * 0.5f + 0.5f);
+	}
+
+	// Off screen is for the view frustum to deal with
+	if (rectMax.x < -1 || rectMax.y < -1 || rectMin.x > 1 || rectMin.y > 1)
+		return false;
+
+	glm::vec2 size((float)m_width, (float)m_height);
+	rectMin = (glm::clamp(rectMin, -1.f, 1.f) * 0.5f + 0.5f) * size;
+	rectMax = (glm::clamp(rectMax, -1.f, 1.f) * 0.5f + 0.5f) * size;
+	int x0 = glm::min((int)rectMin.x / TILE_WIDTH, (int)m_tilesX - 1);
+	int x1 = glm::min((int)rectMax.x / TILE_WIDTH, (int)m_tilesX - 1);
+	int y0 = glm::min((int)rectMin.y / TILE_HEIGHT, (int)m_tilesY - 1);
+	int y1 = glm::min((int)rectMax.y / TILE_HEIGHT, (int)m_tilesY - 1);
+
+	// Hidden only if every tile under it is covered by something nearer
+#ifdef OCCLUSION_USE_SSE
+	__m128 depth = _mm_set1_ps(nearest);
+	for (int y = y0; y <= y1; y++)
+	{
+		const float* row = &m_depthMax0[y * m_rowStride];
+		for (int x = x0 & ~3; x <= x1; x += 4)
+		{
+			int visible = _mm_movemask_ps(_mm_cmplt_ps(depth, _mm_loadu_ps(row + x)));
+
+			// Lanes outside the rectangle don't count
+			int lanes = 0xf;
+			if (x < x0)
+				lanes &= 0xf << (x0 - x);
+			if (x + 3 > x1)
+				lanes &= 0xf >> (x + 3 - x1);
+			if ((visible & lanes) != 0)
+				return false;
+		}
+	}
+#else
+	for (int y = y0; y <= y1; y++)
+		for (int x = x0; x <= x1; x++)
+			if (nearest < m_depthMax0[y * m_rowStride + x])
+				return false;
+#endif
+	return true;
+}
+
+void SoftwareOcclusion::WorkerThread(unsigned int a_index)
+{
+	unsigned int lastJob = 0;
+	for (;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_startWork.wait(lock, [this, lastJob]() { return m_quit || m_job != lastJob; });
+			if (m_quit)
+				return;
+			lastJob = m_job;
+		}
+
+		// The main thread takes the first row of each set
+		RasterizeRows(a_index + 1, m_threadCount);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_pending--;
+		}
+		m_workDone.notify_one();
+	}
+}
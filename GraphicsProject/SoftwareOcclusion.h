@@ -0,0 +1,106 @@
+/*----------------------------------------------
+	File Name: SoftwareOcclusion.h
+	Purpose: Rasterize occluders on the CPU
+	Author: Logan Ryan
+	Modified: 8 April 2021
+------------------------------------------------
+	Copyright 2021 Logan Ryan
+----------------------------------------------*/
+#pragma once
+#include <glm/glm.hpp>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+// A small depth buffer drawn on the CPU without any GL, so it works the
+// frame it is drawn and on machines with no GPU. Like masked occlusion
+// culling it doesn't keep a depth per pixel. Each 8x4 pixel tile keeps
+// the furthest depth of a layer known to cover it, and a coverage mask
+// with the furthest depth of the triangles partly covering it since.
+// Once the mask fills the tile that layer replaces the first
+class SoftwareOcclusion
+{
+public:
+	static const int TILE_WIDTH = 8;
+	static const int TILE_HEIGHT = 4;
+
+	// Constructor, the size is rounded up to whole tiles
+	SoftwareOcclusion(unsigned int a_width = 320, unsigned int a_height = 192);
+	// Destructor
+	~SoftwareOcclusion();
+
+	// Start a new frame with nothing drawn
+	void Clear();
+
+	// Transform an occluder's triangles into the buffer and set them up to be
+	// drawn. Triangles facing away, crossing the near plane or far off screen
+	// are left out, which only means less is culled
+	void AddOccluder(const glm::mat4& a_projectionViewModel,
+		const std::vector<glm::vec3>& a_vertices, const std::vector<unsigned int>& a_indices);
+
+	// Draw the triangles added since the last clear, each thread takes
+	// every few rows of tiles so no tile is written by two threads
+	void Rasterize();
+
+	// Whether a model space box is hidden behind what has been drawn
+	bool IsOccluded(const glm::mat4& a_projectionViewModel,
+		const glm::vec3& a_boundsMin, const glm::vec3& a_boundsMax);
+
+	// Stats from the last rasterize
+	unsigned int GetTriangleCount() { return (unsigned int)m_triangles.size(); }
+	float GetSetupTime() { return m_setupTime; }
+	float GetRasterTime() { return m_rasterTime; }
+
+	// Getters
+	unsigned int GetWidth() { return m_width; }
+	unsigned int GetHeight() { return m_height; }
+
+protected:
+	// Draw every triangle into every a_step'th row of tiles starting at a_first
+	void RasterizeRows(unsigned int a_first, unsigned int a_step);
+
+	void WorkerThread(unsigned int a_index);
+
+	// A triangle in pixels, ready to be drawn
+	struct Triangle
+	{
+		// Edge functions, a * (x - x0) + b * (y - y0) is positive inside,
+		// kept relative to a corner so they stay precise off screen
+		float edgeA[3], edgeB[3], edgeX[3], edgeY[3];
+		// Depth across the triangle, and its nearest and furthest
+		float depthX, depthY, depth;
+		float depthMin, depthMax;
+		// Tiles under its bounding box
+		int tileMinX, tileMinY, tileMaxX, tileMaxY;
+	};
+
+	unsigned int m_width, m_height;
+	unsigned int m_tilesX, m_tilesY;
+	// Rows of tiles are padded to a multiple of 4 so four can be tested at once
+	unsigned int m_rowStride;
+
+	// Furthest depth of the layer covering each tile
+	std::vector<float> m_depthMax0;
+	// The layer still being filled, its furthest depth and coverage
+	std::vector<float> m_depthMax1;
+	std::vector<unsigned int> m_coverage;
+
+	std::vector<Triangle> m_triangles;
+	// An occluder's vertices in pixels, w is negative for any that can't be drawn
+	std::vector<glm::vec4> m_transformed;
+
+	float m_setupTime;
+	float m_rasterTime;
+
+	// Workers draw rows of tiles alongside the main thread
+	std::vector<std::thread> m_workers;
+	unsigned int m_threadCount;
+	std::mutex m_mutex;
+	std::condition_variable m_startWork;
+	std::condition_variable m_workDone;
+	unsigned int m_job;
+	unsigned int m_pending;
+	bool m_quit;
+};
+
@@ -0,0 +1,239 @@
+/*----------------------------------------------
+	File Name: SpriteBenchmark.cpp
+	Purpose: Time the 2D renderer on fixed sprite scenes
+	Author: Logan Ryan
+	Modified: 8 April 2021
+------------------------------------------------
+	Copyright 2021 Logan Ryan
+----------------------------------------------*/
+#include "SpriteBenchmark.h"
+#include "Renderer2D.h"
+#include "Texture.h"
+#include "SpriteAtlas.h"
+
+#include <chrono>
+#include <random>
+#include <cstdio>
+
+// Sprites and textures in each scene
+static const unsigned int STRESS_SPRITES = 50000;
+static const unsigned int STRESS_TEXTURES = 32;
+static const unsigned int ATLAS_SPRITES = 10000;
+static const unsigned int ATLAS_TEXTURES = 200;
+// Depths the stress sprites are spread over
+static const unsigned int STRESS_LAYERS = 8;
+// Width and height of the generated textures
+static const unsigned int TEXTURE_SIZE = 16;
+
+SpriteBenchmark::SpriteBenchmark()
+	: m_renderer(nullptr), m_atlas(nullptr), m_scene(SPRITE_STRESS), m_config(-1), m_frames(0),
+	m_cpuTime(0), m_batches(0), m_quads(0)
+{
+	for (unsigned int i = 0; i < SPRITE_SCENE_Count; i++)
+		m_done[i] = false;
+}
+
+SpriteBenchmark::~SpriteBenchmark()
+{
+	Destroy();
+}
+
+void SpriteBenchmark::Destroy()
+{
+	delete m_renderer;
+	m_renderer = nullptr;
+	delete m_atlas;
+	m_atlas = nullptr;
+
+	for (auto texture : m_textures)
+		delete texture;
+	m_textures.clear();
+}
+
+unsigned int SpriteBenchmark::GetConfigCount(eSpriteScene a_scene)
+{
+	switch (a_scene)
+	{
+	case SPRITE_STRESS: return 2;
+	case SPRITE_ATLAS: return 3;
+	default: return 0;
+	}
+}
+
+const char* SpriteBenchmark::GetConfigName(eSpriteScene a_scene, unsigned int a_config)
+{
+	static const char* stressNames[] = { "Unsorted", "Sorted" };
+	static const char* atlasNames[] = { "Texture Stack", "Atlas", "Atlas Instanced" };
+
+	switch (a_scene)
+	{
+	case SPRITE_STRESS: return stressNames[a_config];
+	case SPRITE_ATLAS: return atlasNames[a_config];
+	default: return "";
+	}
+}
+
+const char* SpriteBenchmark::GetSceneName(eSpriteScene a_scene)
+{
+	switch (a_scene)
+	{
+	case SPRITE_STRESS: return "50k sprites, 32 textures";
+	case SPRITE_ATLAS: return "10k sprites, 200 textures";
+	default: return "";
+	}
+}
+
+void SpriteBenchmark::Start(eSpriteScene a_scene)
+{
+	m_scene = a_scene;
+	m_config = 0;
+	m_frames = 0;
+	m_cpuTime = 0;
+	m_batches = 0;
+	m_quads = 0;
+}
+
+void SpriteBenchmark::Create()
+{
+	if (m_renderer != nullptr)
+		return;
+
+	m_renderer = new aie::Renderer2D();
+
+	// A small checker in a different colour for each texture
+	unsigned char pixels[TEXTURE_SIZE * TEXTURE_SIZE * 4];
+	for (unsigned int i = 0; i < ATLAS_TEXTURES; i++)
+	{
+		unsigned char r = (unsigned char)(64 + (i * 37) % 192);
+		unsigned char g = (unsigned char)(64 + (i * 71) % 192);
+		unsigned char b = (unsigned char)(64 + (i * 113) % 192);
+		for (unsigned int y = 0; y < TEXTURE_SIZE; y++)
+		{
+			for (unsigned int x = 0; x < TEXTURE_SIZE; x++)
+			{
+				unsigned char* pixel = pixels + (y * TEXTURE_SIZE + x) * 4;
+				bool dark = ((x / 4) + (y / 4)) % 2 == 1;
+				pixel[0] = dark ? r / 2 : r;
+				pixel[1] = dark ? g / 2 : g;
+				pixel[2] = dark ? b / 2 : b;
+				pixel[3] = 255;
+			}
+		}
+		m_textures.push_back(new aie::Texture(TEXTURE_SIZE, TEXTURE_SIZE, aie::Texture::RGBA, pixels));
+	}
+
+	m_atlas = new aie::SpriteAtlas();
+	for (auto texture : m_textures)
+	{
+		if (m_atlas->add(texture) == false)
+			printf("Sprite benchmark: texture didn't fit in the atlas\n");
+	}
+
+	// The same seed every run so the scene can be compared between builds.
+	// mt19937's output is fixed by the standard, the distributions aren't
+	std::mt19937 random(2021);
+	auto unit = [&random]() { return (random() & 0xffffff) / 16777216.f; };
+
+	std::vector<Sprite>& stress = m_sprites[SPRITE_STRESS];
+	stress.resize(STRESS_SPRITES);
+	for (auto& sprite : stress)
+	{
+		sprite.x = unit();
+		sprite.y = unit();
+		sprite.size = 0.005f + unit() * 0.02f;
+		sprite.rotation = unit() * 6.2831853f;
+		sprite.depth = (float)(random() % STRESS_LAYERS);
+		sprite.texture = random() % STRESS_TEXTURES;
+	}
+
+	// All at one depth so only the textures split batches
+	std::vector<Sprite>& atlas = m_sprites[SPRITE_ATLAS];
+	atlas.resize(ATLAS_SPRITES);
+	for (auto& sprite : atlas)
+	{
+		sprite.x = unit();
+		sprite.y = unit();
+		sprite.size = 0.01f + unit() * 0.03f;
+		sprite.rotation = unit() * 6.2831853f;
+		sprite.depth = 0;
+		sprite.texture = random() % ATLAS_TEXTURES;
+	}
+}
+
+void SpriteBenchmark::Configure()
+{
+	m_renderer->setSortMode(aie::Renderer2D::SORT_NONE);
+	m_renderer->setAtlas(nullptr);
+	m_renderer->setSpriteInstancing(false);
+
+	if (m_scene == SPRITE_STRESS && m_config == 1)
+		m_renderer->setSortMode(aie::Renderer2D::SORT_DEFERRED);
+
+	if (m_scene == SPRITE_ATLAS && m_config >= 1)
+		m_renderer->setAtlas(m_atlas);
+	if (m_scene == SPRITE_ATLAS && m_config == 2)
+		m_renderer->setSpriteInstancing(true);
+}
+
+void SpriteBenchmark::Draw(unsigned int a_width, unsigned int a_height)
+{
+	if (m_config < 0)
+		return;
+
+	Create();
+	Configure();
+
+	float width = (float)a_width;
+	float height = (float)a_height;
+	float scale = width < height ? width : height;
+
+	auto start = std::chrono::high_resolution_clock::now();
+
+	m_renderer->begin();
+	for (auto& sprite : m_sprites[m_scene])
+	{
+		float size = sprite.size * scale;
+		m_renderer->drawSprite(m_textures[sprite.texture], sprite.x * width, sprite.y * height,
+			size, size, sprite.rotation, sprite.depth);
+	}
+	m_renderer->end();
+
+	auto end = std::chrono::high_resolution_clock::now();
+
+	m_frames++;
+	if (m_frames <= WARMUP_FRAMES)
+		return;
+
+	m_cpuTime += std::chrono::duration<double, std::milli>(end - start).count();
+	m_batches += m_renderer->getBatchCount();
+	m_quads += m_renderer->getQuadCount();
+
+	if (m_frames < WARMUP_FRAMES + FRAMES)
+		return;
+
+	Result& result = m_results[m_scene][m_config];
+	result.cpuTime = (float)(m_cpuTime / FRAMES);
+	result.batches = m_batches / FRAMES;
+	result.quads = m_quads / FRAMES;
+
+	m_frames = 0;
+	m_cpuTime = 0;
+	m_batches = 0;
+	m_quads = 0;
+
+	m_config++;
+	if (m_config < (int)GetConfigCount(m_scene))
+		return;
+
+	// Done, print the table so it can be kept
+	printf("Sprite benchmark: %s\n", GetSceneName(m_scene));
+	printf("%-20s %10s %10s %10s\n", "Config", "Batches", "Quads", "CPU ms");
+	for (unsigned int i = 0; i < GetConfigCount(m_scene); i++)
+	{
+		const Result& row = m_results[m_scene][i];
+		printf("%-20s %10u %10u %10.2f\n", GetConfigName(m_scene, i), row.batches, row.quads, row.cpuTime);
+	}
+
+	m_config = -1;
+	m_done[m_scene] = true;
+}
@@ -0,0 +1,107 @@
+/*----------------------------------------------
+	File Name: SpriteBenchmark.h
+	Purpose: Time the 2D renderer on fixed sprite scenes
+	Author: Logan Ryan
+	Modified: 8 April 2021
+------------------------------------------------
+	Copyright 2021 Logan Ryan
+----------------------------------------------*/
+#pragma once
+#include <vector>
+
+namespace aie
+{
+	class Renderer2D;
+	class Texture;
+	class SpriteAtlas;
+}
+
+// The sprite scenes that can be timed
+enum eSpriteScene : unsigned int
+{
+	SPRITE_STRESS = 0,	// 50k sprites over a few textures, unsorted against sorted
+	SPRITE_ATLAS,		// 10k sprites over 200 textures, texture stack against atlas
+
+	SPRITE_SCENE_Count
+};
+
+// Draws a fixed scene of sprites over the screen for a few frames in each
+// of its configurations, and keeps the average batches, quads and CPU time
+// of the begin / end pair for each. The sprites are placed by a seeded
+// generator so every run draws the same frame
+class SpriteBenchmark
+{
+public:
+	// The most configurations a scene is compared in
+	static const unsigned int MAX_CONFIGS = 3;
+	// Frames left to settle after changing, then frames averaged
+	static const int WARMUP_FRAMES = 10;
+	static const int FRAMES = 60;
+
+	// What a configuration averaged
+	struct Result
+	{
+		float cpuTime;
+		unsigned int batches;
+		unsigned int quads;
+	};
+
+	// Constructor
+	SpriteBenchmark();
+	// Destructor
+	~SpriteBenchmark();
+
+	// Free the renderer and textures while there is still a context
+	void Destroy();
+
+	// Start timing each of a scene's configurations in turn
+	void Start(eSpriteScene a_scene);
+
+	// Draw this frame's sprites over a window of this size, if running
+	void Draw(unsigned int a_width, unsigned int a_height);
+
+	// Configurations of a scene and their names
+	static unsigned int GetConfigCount(eSpriteScene a_scene);
+	static const char* GetConfigName(eSpriteScene a_scene, unsigned int a_config);
+	static const char* GetSceneName(eSpriteScene a_scene);
+
+	// Getters
+	bool IsRunning() { return m_config >= 0; }
+	eSpriteScene GetScene() { return m_scene; }
+	int GetConfig() { return m_config; }
+	bool HasResults(eSpriteScene a_scene) { return m_done[a_scene]; }
+	const Result& GetResult(eSpriteScene a_scene, unsigned int a_config) { return m_results[a_scene][a_config]; }
+
+protected:
+	// Create the renderer and textures the first time they are needed
+	void Create();
+	// Set the renderer up for the current configuration
+	void Configure();
+
+	// A sprite in the scene, positions and sizes are fractions of the window
+	struct Sprite
+	{
+		float x, y;
+		float size;
+		float rotation;
+		float depth;
+		unsigned int texture;
+	};
+
+	aie::Renderer2D* m_renderer;
+	std::vector<aie::Texture*> m_textures;
+	// Holds every texture, used by the atlas scene
+	aie::SpriteAtlas* m_atlas;
+	std::vector<Sprite> m_sprites[SPRITE_SCENE_Count];
+
+	eSpriteScene m_scene;
+	// The configuration being timed, -1 when not running
+	int m_config;
+	int m_frames;
+	double m_cpuTime;
+	unsigned int m_batches;
+	unsigned int m_quads;
+
+	Result m_results[SPRITE_SCENE_Count][MAX_CONFIGS];
+	bool m_done[SPRITE_SCENE_Count];
+};
@@ -0,0 +1,47 @@
+// lights the g-buffer, the same lighting lit.frag does while drawing
+#version 430
+
+#include "lighting.glsl"
+
+out vec4 FragColor;
+
+// targets in DeferredRenderer::eTarget order
+uniform sampler2D AlbedoTexture;
+uniform sampler2D NormalTexture;
+uniform sampler2D MaterialTexture;
+uniform sampler2D AmbientTexture;
+uniform sampler2D DepthTexture;
+
+// takes clip space back to world space to find each pixel's position
+uniform mat4 InverseProjectionView;
+
+void main()
+{
+	ivec2 pixel = ivec2(gl_FragCoord.xy);
+
+	// nothing was drawn here, leave the clear colour
+	float depth = texelFetch(DepthTexture, pixel, 0).r;
+	if (depth == 1.0)
+		discard;
+
+	vec2 uv = gl_FragCoord.xy / vec2(textureSize(DepthTexture, 0));
+	vec4 position = InverseProjectionView * vec4(vec3(uv, depth) * 2.0 - 1.0, 1);
+	position /= position.w;
+
+	vec3 albedo = texelFetch(AlbedoTexture, pixel, 0).rgb;
+	vec4 normal = texelFetch(NormalTexture, pixel, 0);
+	vec3 specularColor = texelFetch(MaterialTexture, pixel, 0).rgb;
+	vec3 ambientColor = texelFetch(AmbientTexture, pixel, 0).rgb;
+
+	vec3 V = normalize(CameraPosition - position.xyz);
+
+	vec3 diffuseTotal;
+	vec3 specularTotal;
+	AccumulateLights(position.xyz, normal.xyz, V, normal.w, depth, diffuseTotal, specularTotal);
+
+	vec3 ambient = AmbientColor * ambientColor;
+	vec3 diffuse = albedo * diffuseTotal;
+	vec3 specular = specularColor * specularTotal;
+
+	FragColor = vec4(ambient + diffuse + specular, 1);
+}
@@ -0,0 +1,9 @@
+// a triangle covering the screen, made from the vertex index so no buffers
+// are needed
+#version 430
+
+void main()
+{
+	vec2 corner = vec2((gl_VertexID << 1) & 2, gl_VertexID & 2);
+	gl_Position = vec4(corner * 2.0 - 1.0, 0, 1);
+}
@@ -0,0 +1,6 @@
+// nothing to write, depth only passes keep the depth alone
+#version 430
+
+void main()
+{
+}
@@ -0,0 +1,15 @@
+// depth only, for shadow cascades and the depth pre-pass. reads the
+// position-only stream OBJMesh::drawPositions binds
+#version 430
+
+layout(location = 0) in vec4 Position;
+
+// matches lit.vert's depth exactly so the pre-pass can be tested against
+invariant gl_Position;
+
+uniform mat4 ProjectionViewModel;
+
+void main()
+{
+	gl_Position = ProjectionViewModel * Position;
+}
@@ -0,0 +1,67 @@
+// writes a lit mesh's surface to the g-buffer for deferred lighting, built by
+// ShaderVariants alongside lit.vert with the features its material uses
+#version 430
+
+in vec4 vPosition;
+in vec3 vNormal;
+in vec2 vTexCoord;
+#ifdef NORMAL_MAP
+in vec3 vTangent;
+in vec3 vBiTangent;
+#endif
+
+// targets in DeferredRenderer::eTarget order
+layout(location = 0) out vec4 Albedo;
+layout(location = 1) out vec4 Normal;
+layout(location = 2) out vec4 Material;
+layout(location = 3) out vec4 Ambient;
+
+// material, see OBJMesh::draw
+uniform vec3 Ka;
+uniform vec3 Kd;
+uniform vec3 Ks;
+uniform float Ns;
+
+#ifdef DIFFUSE_MAP
+uniform sampler2D diffuseTexture;
+#endif
+#ifdef SPECULAR_MAP
+uniform sampler2D specularTexture;
+#endif
+#ifdef NORMAL_MAP
+uniform sampler2D normalTexture;
+#endif
+
+// streamed in place of the diffuse map, its feedback is drawn with lit.frag
+#ifdef VIRTUAL_TEXTURE
+#include "virtual.glsl"
+#endif
+
+void main()
+{
+	vec3 N = normalize(vNormal);
+
+#ifdef NORMAL_MAP
+	mat3 TBN = mat3(normalize(vTangent), normalize(vBiTangent), N);
+	N = normalize(TBN * (texture(normalTexture, vTexCoord).rgb * 2.0 - 1.0));
+#endif
+
+	vec3 texDiffuse = vec3(1);
+#ifdef DIFFUSE_MAP
+	texDiffuse = texture(diffuseTexture, vTexCoord).rgb;
+#endif
+#ifdef VIRTUAL_TEXTURE
+	texDiffuse = sampleVirtual(vTexCoord).rgb;
+#endif
+
+	vec3 texSpecular = vec3(1);
+#ifdef SPECULAR_MAP
+	texSpecular = texture(specularTexture, vTexCoord).rgb;
+#endif
+
+	// specular power rides along with the normal in the half float target
+	Albedo = vec4(Kd * texDiffuse, 1);
+	Normal = vec4(N, Ns);
+	Material = vec4(Ks * texSpecular, 1);
+	Ambient = vec4(Ka * texDiffuse, 1);
+}
@@ -0,0 +1,34 @@
+// one level of the hi-z pyramid, each texel keeps the furthest depth of the
+// texels under it in the level above. drawn with deferred.vert, the level
+// above is the source's base level
+#version 430
+
+uniform sampler2D Source;
+
+layout(location = 0) out float MaxDepth;
+
+float Fetch(ivec2 texel, ivec2 size)
+{
+	return texelFetch(Source, min(texel, size - 1), 0).r;
+}
+
+void main()
+{
+	ivec2 size = textureSize(Source, 0);
+	ivec2 texel = ivec2(gl_FragCoord.xy) * 2;
+
+	float depth = max(max(Fetch(texel, size), Fetch(texel + ivec2(1, 0), size)),
+		max(Fetch(texel + ivec2(0, 1), size), Fetch(texel + ivec2(1, 1), size)));
+
+	// odd sizes fold their last row and column into the last texel
+	bool extraX = (size.x & 1) != 0 && texel.x + 3 == size.x;
+	bool extraY = (size.y & 1) != 0 && texel.y + 3 == size.y;
+	if (extraX)
+		depth = max(depth, max(Fetch(texel + ivec2(2, 0), size), Fetch(texel + ivec2(2, 1), size)));
+	if (extraY)
+		depth = max(depth, max(Fetch(texel + ivec2(0, 2), size), Fetch(texel + ivec2(1, 2), size)));
+	if (extraX && extraY)
+		depth = max(depth, Fetch(texel + ivec2(2, 2), size));
+
+	MaxDepth = depth;
+}
@@ -0,0 +1,132 @@
+// directional and point lighting shared by the lit shaders. point lights are
+// binned into clusters by LightClusters, each pixel only loops over its own
+
+uniform vec3 CameraPosition;
+uniform vec3 AmbientColor;
+
+// the sun
+uniform vec3 LightColor;
+uniform vec3 LightDirection;
+
+// the sun's shadow cascades, see ShadowMap
+const int MAX_CASCADES = 4;
+uniform sampler2DArrayShadow ShadowMap;
+uniform int ShadowCascadeCount;
+// world to shadow map space for each cascade
+uniform mat4 ShadowMatrices[MAX_CASCADES];
+// view depth each cascade reaches
+uniform float ShadowSplits[MAX_CASCADES];
+
+// position and radius, then color
+struct PointLight
+{
+	vec4 PositionRadius;
+	vec4 Color;
+};
+
+layout(std430, binding = 0) readonly buffer PointLightBuffer
+{
+	PointLight PointLights[];
+};
+
+// offset into ClusterLightIndices and count, for each cluster
+layout(std430, binding = 1) readonly buffer ClusterBuffer
+{
+	uvec2 Clusters[];
+};
+
+layout(std430, binding = 2) readonly buffer ClusterIndexBuffer
+{
+	uint ClusterLightIndices[];
+};
+
+// tiles x, tiles y, slices, and 0 if the lists weren't uploaded
+uniform vec4 ClusterGrid;
+// size of a tile in pixels
+uniform vec2 ClusterTileSize;
+// near, far, and the scale and bias taking log(depth) to a slice
+uniform vec4 ClusterDepth;
+
+vec3 Diffuse(vec3 direction, vec3 color, vec3 normal)
+{
+	return color * max(0.0, dot(normal, -direction));
+}
+
+vec3 Specular(vec3 direction, vec3 color, vec3 normal, vec3 view, float power)
+{
+	vec3 R = reflect(direction, normal);
+	return color * pow(max(0.0, dot(R, view)), power);
+}
+
+// distance in front of the camera of a window space depth
+float ViewDepth(float windowDepth)
+{
+	float nearPlane = ClusterDepth.x;
+	float farPlane = ClusterDepth.y;
+	return 2.0 * nearPlane * farPlane /
+		(farPlane + nearPlane - (windowDepth * 2.0 - 1.0) * (farPlane - nearPlane));
+}
+
+// how much of the sun reaches a surface, from the first cascade covering it
+float SunShadow(vec3 position, float viewDepth)
+{
+	int cascade = 0;
+	while (cascade < ShadowCascadeCount && viewDepth > ShadowSplits[cascade])
+		++cascade;
+	if (cascade >= ShadowCascadeCount)
+		return 1.0;
+
+	vec4 coord = ShadowMatrices[cascade] * vec4(position, 1);
+
+	// each tap compares four texels, four taps soften the edge further
+	vec2 texel = 1.0 / vec2(textureSize(ShadowMap, 0).xy);
+	float lit = 0.0;
+	for (int y = 0; y < 2; ++y)
+		for (int x = 0; x < 2; ++x)
+			lit += texture(ShadowMap, vec4(coord.xy + (vec2(x, y) - 0.5) * texel, cascade, coord.z));
+	return lit * 0.25;
+}
+
+// the cluster holding a surface at the pixel being shaded, depth is its
+// window space depth
+uint FindCluster(float windowDepth)
+{
+	float depth = ViewDepth(windowDepth);
+
+	uvec3 grid = uvec3(ClusterGrid.xyz);
+	uvec2 tile = min(uvec2(gl_FragCoord.xy / ClusterTileSize), grid.xy - 1u);
+	uint slice = uint(clamp(log(depth) * ClusterDepth.z + ClusterDepth.w, 0.0, ClusterGrid.z - 1.0));
+
+	return (slice * grid.y + tile.y) * grid.x + tile.x;
+}
+
+// sums the sun and the point lights reaching a surface. depth is the
+// surface's window space depth, gl_FragCoord.z when drawn forward
+void AccumulateLights(vec3 position, vec3 normal, vec3 view, float power, float depth,
+	out vec3 diffuse, out vec3 specular)
+{
+	vec3 L = normalize(LightDirection);
+	vec3 sun = LightColor * SunShadow(position, ViewDepth(depth));
+	diffuse = Diffuse(L, sun, normal);
+	specular = Specular(L, sun, normal, view, power);
+
+	if (ClusterGrid.w == 0.0)
+		return;
+
+	uvec2 cluster = Clusters[FindCluster(depth)];
+	for (uint i = 0u; i < cluster.y; ++i)
+	{
+		PointLight light = PointLights[ClusterLightIndices[cluster.x + i]];
+
+		vec3 direction = position - light.PositionRadius.xyz;
+		float distance = length(direction);
+		direction = direction / distance;
+
+		// inverse square falloff, windowed to reach zero at the light's radius
+		float window = clamp(1.0 - pow(distance / light.PositionRadius.w, 4.0), 0.0, 1.0);
+		vec3 color = light.Color.rgb * (window * window / (distance * distance));
+
+		diffuse += Diffuse(direction, color, normal);
+		specular += Specular(direction, color, normal, view, power);
+	}
+}
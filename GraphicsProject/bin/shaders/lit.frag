@@ -0,0 +1,81 @@
+// a lit mesh, built by ShaderVariants with the features its material uses
+#version 430
+
+#include "lighting.glsl"
+
+in vec4 vPosition;
+in vec3 vNormal;
+in vec2 vTexCoord;
+#ifdef NORMAL_MAP
+in vec3 vTangent;
+in vec3 vBiTangent;
+#endif
+
+out vec4 FragColor;
+
+// material, see OBJMesh::draw
+uniform vec3 Ka;
+uniform vec3 Kd;
+uniform vec3 Ks;
+uniform float Ns;
+
+#ifdef DIFFUSE_MAP
+uniform sampler2D diffuseTexture;
+#endif
+#ifdef SPECULAR_MAP
+uniform sampler2D specularTexture;
+#endif
+#ifdef NORMAL_MAP
+uniform sampler2D normalTexture;
+#endif
+
+// streamed in place of the diffuse map, see Instance::SetVirtualTexture
+#ifdef VIRTUAL_TEXTURE
+#include "virtual.glsl"
+// set while drawing into the virtual texture's feedback buffer
+uniform int VirtualFeedbackPass;
+#endif
+
+void main()
+{
+#ifdef VIRTUAL_TEXTURE
+	// write the tile this pixel needs instead of lighting it
+	if (VirtualFeedbackPass != 0)
+	{
+		FragColor = virtualFeedback(vTexCoord);
+		return;
+	}
+#endif
+
+	vec3 N = normalize(vNormal);
+
+#ifdef NORMAL_MAP
+	mat3 TBN = mat3(normalize(vTangent), normalize(vBiTangent), N);
+	N = normalize(TBN * (texture(normalTexture, vTexCoord).rgb * 2.0 - 1.0));
+#endif
+
+	vec3 texDiffuse = vec3(1);
+#ifdef DIFFUSE_MAP
+	texDiffuse = texture(diffuseTexture, vTexCoord).rgb;
+#endif
+#ifdef VIRTUAL_TEXTURE
+	texDiffuse = sampleVirtual(vTexCoord).rgb;
+#endif
+
+	vec3 texSpecular = vec3(1);
+#ifdef SPECULAR_MAP
+	texSpecular = texture(specularTexture, vTexCoord).rgb;
+#endif
+
+	vec3 V = normalize(CameraPosition - vPosition.xyz);
+
+	vec3 diffuseTotal;
+	vec3 specularTotal;
+	AccumulateLights(vPosition.xyz, N, V, Ns, gl_FragCoord.z, diffuseTotal, specularTotal);
+
+	vec3 ambient = AmbientColor * Ka * texDiffuse;
+	vec3 diffuse = Kd * diffuseTotal * texDiffuse;
+	vec3 specular = Ks * specularTotal * texSpecular;
+
+	FragColor = vec4(ambient + diffuse + specular, 1);
+}
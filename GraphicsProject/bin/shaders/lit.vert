@@ -0,0 +1,74 @@
+// a lit mesh, built by ShaderVariants with the features its material uses
+#version 430
+
+layout(location = 0) in vec4 Position;
+layout(location = 1) in vec4 Normal;
+layout(location = 2) in vec2 TexCoord;
+layout(location = 3) in vec4 Tangent;
+
+#ifdef INSTANCED
+// per-instance transform, uses locations 4 to 7
+layout(location = 4) in mat4 InstanceMatrix;
+#endif
+
+#ifdef SKINNED
+layout(location = 8) in vec4 BoneWeights;
+layout(location = 9) in ivec4 BoneIndices;
+#endif
+
+// matches depth.vert's depth exactly so the depth pre-pass can be tested against
+invariant gl_Position;
+
+out vec4 vPosition;
+out vec3 vNormal;
+out vec2 vTexCoord;
+#ifdef NORMAL_MAP
+out vec3 vTangent;
+out vec3 vBiTangent;
+#endif
+
+#ifdef INSTANCED
+uniform mat4 ProjectionView;
+#else
+uniform mat4 ProjectionViewModel;
+uniform mat4 ModelMatrix;
+#endif
+
+#ifdef SKINNED
+const int MAX_BONES = 128;
+uniform mat4 Bones[MAX_BONES];
+#endif
+
+void main()
+{
+	vec4 position = Position;
+	vec4 normal = vec4(Normal.xyz, 0);
+	vec4 tangent = vec4(Tangent.xyz, 0);
+
+#ifdef SKINNED
+	mat4 skin = Bones[BoneIndices.x] * BoneWeights.x +
+		Bones[BoneIndices.y] * BoneWeights.y +
+		Bones[BoneIndices.z] * BoneWeights.z +
+		Bones[BoneIndices.w] * BoneWeights.w;
+	position = skin * position;
+	normal = skin * normal;
+	tangent = skin * tangent;
+#endif
+
+#ifdef INSTANCED
+	mat4 model = InstanceMatrix;
+	gl_Position = ProjectionView * model * position;
+#else
+	mat4 model = ModelMatrix;
+	gl_Position = ProjectionViewModel * position;
+#endif
+
+	vPosition = model * position;
+	vNormal = normalize((model * normal).xyz);
+	vTexCoord = TexCoord;
+
+#ifdef NORMAL_MAP
+	vTangent = normalize((model * tangent).xyz);
+	vBiTangent = cross(vNormal, vTangent) * Tangent.w;
+#endif
+}
@@ -0,0 +1,41 @@
+// sampling a VirtualTexture through its indirection texture, and the feedback
+// telling it which tiles to stream in. uniforms are set by VirtualTexture::bind
+
+uniform sampler2D virtualCache;
+uniform sampler2D virtualIndirection;
+// size, tile size, border, mip count
+uniform vec4 virtualInfo;
+uniform float virtualCacheSize;
+
+// the feedback buffer is VirtualTexture::FEEDBACK_SCALE times smaller than the
+// screen, so its derivatives are that much larger than the main pass's
+const float VIRTUAL_FEEDBACK_BIAS = -3.0;
+
+float virtualMip(vec2 uv, float bias)
+{
+	vec2 dx = dFdx(uv * virtualInfo.x);
+	vec2 dy = dFdy(uv * virtualInfo.x);
+	return clamp(floor(0.5 * log2(max(dot(dx, dx), dot(dy, dy))) + bias), 0.0, virtualInfo.w - 1.0);
+}
+
+// the texel from the finest resident tile covering uv
+vec4 sampleVirtual(vec2 uv)
+{
+	float mip = virtualMip(uv, 0.0);
+	uv = fract(uv);
+	vec4 entry = textureLod(virtualIndirection, uv, mip) * 255.0;
+	float tiles = virtualInfo.x / virtualInfo.y / exp2(entry.z);
+	vec2 inTile = fract(uv * tiles);
+	float padded = virtualInfo.y + 2.0 * virtualInfo.z;
+	vec2 texel = entry.xy * padded + virtualInfo.z + inTile * virtualInfo.y;
+	return textureLod(virtualCache, texel / virtualCacheSize, 0.0);
+}
+
+// the tile sampleVirtual wants at uv, written to the feedback buffer
+vec4 virtualFeedback(vec2 uv)
+{
+	float mip = virtualMip(uv, VIRTUAL_FEEDBACK_BIAS);
+	float tiles = virtualInfo.x / virtualInfo.y / exp2(mip);
+	vec2 tile = min(floor(fract(uv) * tiles), tiles - 1.0);
+	return vec4(tile, mip, 255.0) / 255.0;
+}
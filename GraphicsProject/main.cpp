@@ -1,6 +1,153 @@
 #include "GraphicsProjectApp.h"
+#include "TextureCooker.h"
+#include "VirtualTexture.h"
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <deque>
+#include <vector>
+#include <algorithm>
 
-int main() {
+// GraphicsProject -cook <source image> <output .tex> <rgba8 | bc1 | bc3 | bc5>
+// or GraphicsProject -cook <source image> <output .vtex> tiled for a virtual texture
+static int cookTexture(const char* sourceFile, const char* cookedFile, const char* formatName) {
+
+	if (strcmp(formatName, "tiled") == 0)
+		return aie::TextureCooker::cookTiled(sourceFile, cookedFile) ? 0 : 1;
+
+	const char* names[] = { "rgba8", "bc1", "bc3", "bc5" };
+	for (unsigned int i = 0; i < 4; ++i) {
+		if (strcmp(formatName, names[i]) == 0)
+			return aie::TextureCooker::cook(sourceFile, cookedFile, (aie::TextureCooker::Format)i) ? 0 : 1;
+	}
+
+	printf("unknown texture format %s, expected rgba8, bc1, bc3, bc5 or tiled\n", formatName);
+	return 1;
+}
+
+// GraphicsProject -vtsim
+// moves a camera over a plane covered by a virtual texture without a window or
+// any files. its feedback is made on the cpu the way virtual.glsl writes it, and
+// goes through the same tile gathering, requests and cache as VirtualTexture, so
+// the hit rate printed is what those would give for the same views
+static int simulateVirtualTexture() {
+
+	const unsigned int size = 16384, tileSize = 128;
+	const unsigned int mipCount = 8;
+	const unsigned int screenWidth = 1280, screenHeight = 720;
+	const unsigned int feedbackWidth = screenWidth / aie::VirtualTexture::FEEDBACK_SCALE;
+	const unsigned int feedbackHeight = screenHeight / aie::VirtualTexture::FEEDBACK_SCALE;
+	const int frames = 600;
+	// VirtualTexture::update()'s default
+	const unsigned int maxUploads = 8;
+
+	const char* pathNames[] = { "slow pan", "fast pan", "zoom", "teleport" };
+	const unsigned int cacheSizes[] = { 8, 16 };
+
+	printf("%-10s %8s %10s %8s %10s\n", "path", "slots", "requests", "hit %", "evictions");
+
+	for (unsigned int path = 0; path < 4; ++path) {
+		for (unsigned int cacheTiles : cacheSizes) {
+
+			aie::VirtualTexture::TileCache cache(cacheTiles * cacheTiles);
+			unsigned int replaced = 0;
+			cache.insert(aie::VirtualTexture::makeTile(mipCount - 1, 0, 0), replaced, true);
+
+			// feedback is read back two frames after it is drawn, and a tile read
+			// on the worker is ready the frame after it was asked for
+			std::deque<std::vector<unsigned char>> feedback;
+			std::vector<unsigned int> inFlight;
+			std::deque<unsigned int> reads;
+			std::deque<unsigned int> completed;
+			std::vector<unsigned int> tiles;
+
+			unsigned int random = 12345;
+			float centreX = 0.5f, centreY = 0.5f;
+
+			for (int frame = 0; frame < frames; ++frame) {
+
+				// the visible part of the plane in uv, which repeats
+				float width = 0.05f;
+				switch (path) {
+				case 0: centreX = 0.5f + frame * 0.0005f; break;
+				case 1: centreX = 0.5f + frame * 0.0025f; break;
+				case 2: width = powf(0.02f, 0.5f - 0.5f * cosf(frame * 6.2831853f / 300)); break;
+				case 3:
+					if (frame % 120 == 0) {
+						random = random * 1103515245 + 12345;
+						centreX = (random >> 8) / 16777216.f;
+						random = random * 1103515245 + 12345;
+						centreY = (random >> 8) / 16777216.f;
+					}
+					break;
+				}
+				float height = width * screenHeight / screenWidth;
+
+				// the mip sampleVirtual() picks for a screen pixel, the feedback
+				// derivatives are FEEDBACK_SCALE times larger and biased back
+				float texelsPerPixel = width * size / screenWidth;
+				int mip = (int)floorf(log2f(texelsPerPixel));
+				mip = mip < 0 ? 0 : (mip > (int)mipCount - 1 ? (int)mipCount - 1 : mip);
+				unsigned int mipTiles = (size >> mip) / tileSize;
+
+				std::vector<unsigned char> texels(feedbackWidth * feedbackHeight * 4);
+				for (unsigned int y = 0; y < feedbackHeight; ++y) {
+					for (unsigned int x = 0; x < feedbackWidth; ++x) {
+						float u = centreX + ((x + 0.5f) / feedbackWidth - 0.5f) * width;
+						float v = centreY + ((y + 0.5f) / feedbackHeight - 0.5f) * height;
+						unsigned int tileX = (unsigned int)((u - floorf(u)) * mipTiles);
+						unsigned int tileY = (unsigned int)((v - floorf(v)) * mipTiles);
+						unsigned char* texel = &texels[(y * feedbackWidth + x) * 4];
+						texel[0] = (unsigned char)(tileX < mipTiles ? tileX : mipTiles - 1);
+						texel[1] = (unsigned char)(tileY < mipTiles ? tileY : mipTiles - 1);
+						texel[2] = (unsigned char)mip;
+						texel[3] = 255;
+					}
+				}
+				feedback.push_back(texels);
+
+				// the worker finished everything asked for last frame
+				completed.insert(completed.end(), reads.begin(), reads.end());
+				reads.clear();
+
+				// update(), reading the feedback from two frames ago
+				if (feedback.size() > 2) {
+					tiles.clear();
+					aie::VirtualTexture::gatherTiles(feedback.front().data(), feedbackWidth * feedbackHeight, mipCount, tiles);
+					aie::VirtualTexture::requestTiles(cache, tiles, inFlight, reads);
+					feedback.pop_front();
+				}
+
+				for (unsigned int i = 0; i < maxUploads && completed.empty() == false; ++i) {
+					unsigned int tile = completed.front();
+					completed.pop_front();
+					inFlight.erase(std::find(inFlight.begin(), inFlight.end(), tile));
+					cache.insert(tile, replaced);
+				}
+
+				cache.nextFrame();
+			}
+
+			unsigned int requests = cache.getHitCount() + cache.getMissCount();
+			printf("%-10s %8u %10u %7.1f%% %10u\n", pathNames[path], cache.getSlotCount(), requests,
+				requests > 0 ? 100.f * cache.getHitCount() / requests : 0.f, cache.getEvictionCount());
+		}
+	}
+
+	return 0;
+}
+
+int main(int argc, char* argv[]) {
+
+	// cook a texture instead of running
+	if (argc == 5 &&
+		strcmp(argv[1], "-cook") == 0)
+		return cookTexture(argv[2], argv[3], argv[4]);
+
+	// print virtual texture hit rates instead of running
+	if (argc == 2 &&
+		strcmp(argv[1], "-vtsim") == 0)
+		return simulateVirtualTexture();
 	
 	// allocation
 	auto app = new GraphicsProjectApp();
@@ -12,4 +159,4 @@ int main() {
 	delete app;
 
 	return 0;
-}
\ No newline at end of file
+}
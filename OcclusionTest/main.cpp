@@ -0,0 +1,159 @@
+/*----------------------------------------------
+	File Name: main.cpp
+	Purpose: Check and time the software occlusion
+			 buffer without a window
+	Author: Logan Ryan
+	Modified: 8 April 2021
+------------------------------------------------
+	Copyright 2021 Logan Ryan
+----------------------------------------------*/
+#include "SoftwareOcclusion.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cstdio>
+#include <vector>
+
+// Times each timed pass is repeated
+static const int TIMING_PASSES = 20;
+// Quads along each side of the tessellated wall that is timed
+static const int TIMING_GRID = 100;
+
+// A box the buffer is asked about, and whether it should be hidden
+struct TestBox
+{
+	const char* name;
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	bool occluded;
+};
+
+// Add a rectangle facing +z, split into a_divisions by a_divisions quads
+void AddWall(std::vector<glm::vec3>& a_vertices, std::vector<unsigned int>& a_indices,
+	glm::vec2 a_min, glm::vec2 a_max, float a_z, int a_divisions)
+{
+	unsigned int first = (unsigned int)a_vertices.size();
+	for (int y = 0; y <= a_divisions; y++)
+	{
+		for (int x = 0; x <= a_divisions; x++)
+		{
+			glm::vec2 t = glm::vec2((float)x, (float)y) / (float)a_divisions;
+			a_vertices.push_back(glm::vec3(glm::mix(a_min, a_max, t), a_z));
+		}
+	}
+
+	// Counter-clockwise seen from the camera, so they aren't culled as back faces
+	unsigned int row = a_divisions + 1;
+	for (int y = 0; y < a_divisions; y++)
+	{
+		for (int x = 0; x < a_divisions; x++)
+		{
+			unsigned int corner = first + y * row + x;
+			a_indices.push_back(corner);
+			a_indices.push_back(corner + 1);
+			a_indices.push_back(corner + row + 1);
+			a_indices.push_back(corner);
+			a_indices.push_back(corner + row + 1);
+			a_indices.push_back(corner + row);
+		}
+	}
+}
+
+// Ask the buffer about each box, printing any it gets wrong
+int CheckBoxes(SoftwareOcclusion& a_occlusion, const glm::mat4& a_projectionView,
+	const char* a_scene, const TestBox* a_boxes, int a_count)
+{
+	int failures = 0;
+	for (int i = 0; i < a_count; i++)
+	{
+		bool occluded = a_occlusion.IsOccluded(a_projectionView, a_boxes[i].boundsMin, a_boxes[i].boundsMax);
+		bool passed = occluded == a_boxes[i].occluded;
+		printf("%-6s %-12s %-36s %s\n", passed ? "PASS" : "FAIL", a_scene, a_boxes[i].name,
+			occluded ? "occluded" : "visible");
+		if (passed == false)
+			failures++;
+	}
+	return failures;
+}
+
+int main()
+{
+	// The camera sits 10 units back from the origin looking down -z,
+	// with the buffer's own aspect ratio
+	SoftwareOcclusion occlusion;
+	float aspect = occlusion.GetWidth() / (float)occlusion.GetHeight();
+	glm::mat4 projection = glm::perspective(glm::radians(45.f), aspect, 0.1f, 100.f);
+	glm::mat4 view = glm::lookAt(glm::vec3(0, 0, 10), glm::vec3(0), glm::vec3(0, 1, 0));
+	glm::mat4 projectionView = projection * view;
+
+	int failures = 0;
+
+	// === One wall ===
+	// An 8 by 6 wall through the origin
+	std::vector<glm::vec3> vertices;
+	std::vector<unsigned int> indices;
+	AddWall(vertices, indices, glm::vec2(-4, -3), glm::vec2(4, 3), 0, 1);
+
+	occlusion.Clear();
+	occlusion.AddOccluder(projectionView, vertices, indices);
+	occlusion.Rasterize();
+
+	const TestBox wallBoxes[] =
+	{
+		{ "behind the middle", glm::vec3(-1, -1, -6), glm::vec3(1, 1, -4), true },
+		{ "behind a corner", glm::vec3(2.5f, 1.5f, -3), glm::vec3(3, 2, -2), true },
+		{ "in front", glm::vec3(-1, -1, 2), glm::vec3(1, 1, 4), false },
+		{ "through the wall", glm::vec3(-1, -1, -1), glm::vec3(1, 1, 1), false },
+		{ "behind, past the edge", glm::vec3(6, -1, -6), glm::vec3(8, 1, -4), false },
+		{ "behind, across the edge", glm::vec3(3, -1, -3), glm::vec3(5, 1, -2), false },
+		{ "around the camera", glm::vec3(-1, -1, 9), glm::vec3(1, 1, 11), false },
+	};
+	failures += CheckBoxes(occlusion, projectionView, "wall", wallBoxes, sizeof(wallBoxes) / sizeof(TestBox));
+
+	// === Two halves ===
+	// The same wall in two halves with a third far behind, neither half
+	// covers the tiles along the seam but together they do
+	vertices.clear();
+	indices.clear();
+	AddWall(vertices, indices, glm::vec2(-4, -3), glm::vec2(0, 3), 0, 1);
+	AddWall(vertices, indices, glm::vec2(0, -3), glm::vec2(4, 3), 0, 1);
+	AddWall(vertices, indices, glm::vec2(-20, -20), glm::vec2(20, 20), -30, 1);
+
+	occlusion.Clear();
+	occlusion.AddOccluder(projectionView, vertices, indices);
+	occlusion.Rasterize();
+
+	const TestBox halfBoxes[] =
+	{
+		{ "behind the seam", glm::vec3(-1, -1, -6), glm::vec3(1, 1, -4), true },
+		{ "between the walls, off to the side", glm::vec3(6, -1, -12), glm::vec3(8, 1, -10), false },
+		{ "behind the far wall", glm::vec3(6, -1, -42), glm::vec3(8, 1, -40), true },
+	};
+	failures += CheckBoxes(occlusion, projectionView, "two halves", halfBoxes, sizeof(halfBoxes) / sizeof(TestBox));
+
+	// === Timing ===
+	// A wall split into many small triangles covering most of the screen
+	vertices.clear();
+	indices.clear();
+	AddWall(vertices, indices, glm::vec2(-5, -3), glm::vec2(5, 3), 0, TIMING_GRID);
+
+	float setupTime = 0;
+	float rasterTime = 0;
+	unsigned int triangles = 0;
+	for (int i = 0; i < TIMING_PASSES; i++)
+	{
+		occlusion.Clear();
+		occlusion.AddOccluder(projectionView, vertices, indices);
+		occlusion.Rasterize();
+		setupTime += occlusion.GetSetupTime();
+		rasterTime += occlusion.GetRasterTime();
+		triangles = occlusion.GetTriangleCount();
+	}
+	setupTime /= TIMING_PASSES;
+	rasterTime /= TIMING_PASSES;
+
+	printf("\n%u triangles into %ux%u: setup %.3fms, raster %.3fms, %.0f triangles/ms\n",
+		triangles, occlusion.GetWidth(), occlusion.GetHeight(), setupTime, rasterTime,
+		triangles / (setupTime + rasterTime));
+
+	printf("%d failed\n", failures);
+	return failures == 0 ? 0 : 1;
+}
@@ -4,6 +4,10 @@
 #include <glm/glm.hpp>
 #include <iostream>
 #include "Input.h"
+#include "StreamBuffer.h"
+#include "TextureLoader.h"
+#include "TextureCache.h"
+#include <thread>
 #include "imgui_glfw3.h"
 
 namespace aie {
@@ -36,6 +40,16 @@ bool Application::createWindow(const char* title, int width, int height, bool fu
 		return false;
 	}
 
+	// let the driver compile shaders on as many of its own threads as it likes
+	typedef void (CODEGEN_FUNCPTR* MaxShaderCompilerThreadsFunc)(GLuint);
+	MaxShaderCompilerThreadsFunc maxShaderCompilerThreads = nullptr;
+	if (glfwExtensionSupported("GL_KHR_parallel_shader_compile"))
+		maxShaderCompilerThreads = (MaxShaderCompilerThreadsFunc)glfwGetProcAddress("glMaxShaderCompilerThreadsKHR");
+	else if (glfwExtensionSupported("GL_ARB_parallel_shader_compile"))
+		maxShaderCompilerThreads = (MaxShaderCompilerThreadsFunc)glfwGetProcAddress("glMaxShaderCompilerThreadsARB");
+	if (maxShaderCompilerThreads != nullptr)
+		maxShaderCompilerThreads(0xffffffff);
+
 	glfwSetWindowSizeCallback(m_window, [](GLFWwindow*, int w, int h){ glViewport(0, 0, w, h); });
 
 	glClearColor(0, 0, 0, 1);
@@ -49,6 +63,19 @@ bool Application::createWindow(const char* title, int width, int height, bool fu
 	// start input manager
 	Input::create();
 
+	// shared streaming memory for per-frame vertex data, 3 frames in flight
+	if (StreamBuffer::create(32 * 1024 * 1024, 3) == false) {
+		Input::destroy();
+		glfwDestroyWindow(m_window);
+		glfwTerminate();
+		return false;
+	}
+
+	// background texture loading, leaving a core for the main thread
+	unsigned int cores = std::thread::hardware_concurrency();
+	TextureLoader::create(cores > 2 ? (cores - 1 < 4 ? cores - 1 : 4) : 1);
+	TextureCache::create();
+
 	// imgui
 	ImGui_Init(m_window, true);
 	
@@ -58,6 +85,9 @@ bool Application::createWindow(const char* title, int width, int height, bool fu
 void Application::destroyWindow() {
 
 	ImGui_Shutdown();
+	TextureCache::destroy();
+	TextureLoader::destroy();
+	StreamBuffer::destroy();
 	Input::destroy();
 
 	glfwDestroyWindow(m_window);
@@ -107,6 +137,12 @@ void Application::run(const char* title, int width, int height, bool fullscreen)
 				fpsInterval -= 1.0f;
 			}
 
+			// start a new region of streaming memory
+			StreamBuffer::getInstance()->beginFrame();
+
+			// upload textures that have finished loading
+			TextureLoader::getInstance()->update();
+
 			// clear imgui
 			ImGui_NewFrame();
 
@@ -117,6 +153,9 @@ void Application::run(const char* title, int width, int height, bool fullscreen)
 			// draw IMGUI last
 			ImGui::Render();
 
+			// fence everything streamed this frame
+			StreamBuffer::getInstance()->endFrame();
+
 			//present backbuffer to the monitor
 			glfwSwapBuffers(m_window);
 
@@ -1,171 +1,487 @@
 #include "gl_core_4_4.h"
 #include "Font.h"
 #include <stdio.h>
+#include <math.h>
+#include <string.h>
+#include <fstream>
 
 #define STB_TRUETYPE_IMPLEMENTATION
 #include <stb_truetype.h>
 
 namespace aie {
 
-Font::Font(const char* trueTypeFontFile, unsigned short fontHeight) 
-	: m_glyphData(nullptr),
-	m_glHandle(0),
-	m_pixelBufferHandle(0),
-	m_textureWidth(0),
-	m_textureHeight(0) {
-	
-	FILE* file = nullptr;
-	fopen_s(&file, trueTypeFontFile, "rb");
-	if (file != nullptr) {
-		
-		unsigned char* ttf_buffer = new unsigned char[4096 * 1024];
-
-		fread(ttf_buffer, 1, 4096 * 1024, file);
-		fclose(file);
-
-		// determine size of texture image
-		m_textureWidth = fontHeight / 16 * 256;
-		m_textureHeight = fontHeight / 16 * 256;
-
-		if (fontHeight <= 16) {
-			m_textureWidth = 256;
-			m_textureHeight = 256;
+// the number of cached string layouts kept per font before the oldest is dropped
+static const unsigned int MAX_CACHED_LAYOUTS = 256;
+
+// distance fields cover this many texels either side of a glyph's edge, and are
+// built from a coverage bitmap this many times larger. the Renderer2D text shader
+// uses the same spread
+static const unsigned short SDF_SPREAD = 4;
+static const int SDF_UPSCALE = 4;
+static const float SDF_INFINITY = 1e20f;
+
+// reads one codepoint from a UTF-8 string and moves past it,
+// invalid sequences come back as the replacement character
+static int decodeUTF8(const char*& str) {
+
+	const unsigned char* s = (const unsigned char*)str;
+
+	int codepoint = 0xFFFD;
+	int length = 1;
+
+	if (s[0] < 0x80) {
+		codepoint = s[0];
+	}
+	else if ((s[0] & 0xE0) == 0xC0 &&
+			 (s[1] & 0xC0) == 0x80) {
+		codepoint = ((s[0] & 0x1F) << 6) | (s[1] & 0x3F);
+		length = 2;
+	}
+	else if ((s[0] & 0xF0) == 0xE0 &&
+			 (s[1] & 0xC0) == 0x80 &&
+			 (s[2] & 0xC0) == 0x80) {
+		codepoint = ((s[0] & 0x0F) << 12) | ((s[1] & 0x3F) << 6) | (s[2] & 0x3F);
+		length = 3;
+	}
+	else if ((s[0] & 0xF8) == 0xF0 &&
+			 (s[1] & 0xC0) == 0x80 &&
+			 (s[2] & 0xC0) == 0x80 &&
+			 (s[3] & 0xC0) == 0x80) {
+		codepoint = ((s[0] & 0x07) << 18) | ((s[1] & 0x3F) << 12) | ((s[2] & 0x3F) << 6) | (s[3] & 0x3F);
+		length = 4;
+	}
+
+	str += length;
+	return codepoint;
+}
+
+// FNV-1a
+static unsigned long long hashString(const char* str) {
+	unsigned long long hash = 14695981039346656037ULL;
+	while (*str != 0) {
+		hash ^= (unsigned char)*str++;
+		hash *= 1099511628211ULL;
+	}
+	return hash;
+}
+
+// squared euclidean distance transform of a sampled function in one dimension,
+// from Felzenszwalb and Huttenlocher. v and z need room for n and n + 1 entries
+static void distanceTransform1D(const float* f, float* d, int n, int* v, float* z) {
+
+	int k = 0;
+	v[0] = 0;
+	z[0] = -SDF_INFINITY;
+	z[1] = SDF_INFINITY;
+
+	for (int q = 1; q < n; ++q) {
+		float s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
+		while (s <= z[k]) {
+			k--;
+			s = ((f[q] + q * q) - (f[v[k]] + v[k] * v[k])) / (2 * q - 2 * v[k]);
 		}
-		
-		if (m_textureWidth > 2048)
-			m_textureWidth = 2048;
-		if (m_textureHeight > 2048)
-			m_textureHeight = 2048;
+		k++;
+		v[k] = q;
+		z[k] = s;
+		z[k + 1] = SDF_INFINITY;
+	}
 
-		glGenBuffers(1, &m_pixelBufferHandle);
-		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBufferHandle);
-		glBufferData(GL_PIXEL_UNPACK_BUFFER, m_textureWidth * m_textureHeight, nullptr, GL_STREAM_COPY);
-		unsigned char* tempBitmapData = (GLubyte*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, 
-																   m_textureWidth * m_textureHeight,
-																   GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	k = 0;
+	for (int q = 0; q < n; ++q) {
+		while (z[k + 1] < q)
+			k++;
+		d[q] = (q - v[k]) * (q - v[k]) + f[v[k]];
+	}
+}
 
-		m_glyphData = new stbtt_bakedchar[256];
-		memset(m_glyphData, 0, sizeof(stbtt_bakedchar) * 256);
-		stbtt_BakeFontBitmap(ttf_buffer, 0, fontHeight, tempBitmapData, m_textureWidth, m_textureHeight, 0, 256, (stbtt_bakedchar*)m_glyphData);
+// grid holds 0 for the pixels to measure from and SDF_INFINITY elsewhere,
+// and is replaced with the squared distance to the nearest of them
+static void distanceTransform2D(std::vector<float>& grid, int width, int height) {
 
-		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	int size = width > height ? width : height;
+	std::vector<float> f(size), d(size), z(size + 1);
+	std::vector<int> v(size);
 
-		glGenTextures(1, &m_glHandle);
-		glBindTexture(GL_TEXTURE_2D, m_glHandle);
+	for (int x = 0; x < width; ++x) {
+		for (int y = 0; y < height; ++y)
+			f[y] = grid[y * width + x];
+		distanceTransform1D(f.data(), d.data(), height, v.data(), z.data());
+		for (int y = 0; y < height; ++y)
+			grid[y * width + x] = d[y];
+	}
 
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, m_textureWidth, m_textureHeight, 0, GL_RED, GL_UNSIGNED_BYTE, nullptr);
+	for (int y = 0; y < height; ++y) {
+		distanceTransform1D(&grid[y * width], d.data(), width, v.data(), z.data());
+		memcpy(&grid[y * width], d.data(), width * sizeof(float));
+	}
+}
 
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+Font::Font(const char* trueTypeFontFile, unsigned short fontHeight, bool distanceField)
+	: m_fontInfo(nullptr),
+	m_fontData(nullptr),
+	m_scale(0),
+	m_height(fontHeight),
+	m_distanceField(distanceField),
+	m_padding(distanceField ? SDF_SPREAD : 0),
+	m_glHandle(0),
+	m_textureWidth(0),
+	m_textureHeight(0),
+	m_cellWidth(0),
+	m_cellHeight(0),
+	m_cellsPerRow(0),
+	m_evictions(0),
+	m_useTick(1) {
+
+	std::ifstream file(trueTypeFontFile, std::ios::in | std::ios::binary);
+	if (file.is_open() == false) {
+		printf("Font: failed to open %s\n", trueTypeFontFile);
+		return;
+	}
 
-		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	// the font data has to stay around to rasterise glyphs later
+	file.seekg(0, std::ios::end);
+	long long size = (long long)file.tellg();
+	file.seekg(0, std::ios::beg);
+
+	m_fontData = new unsigned char[size > 0 ? (size_t)size : 1];
+	if (size > 0)
+		file.read((char*)m_fontData, size);
+	bool read = size > 0 && file.good();
+	file.close();
+
+	stbtt_fontinfo* info = new stbtt_fontinfo();
+	if (read == false ||
+		stbtt_InitFont(info, m_fontData, stbtt_GetFontOffsetForIndex(m_fontData, 0)) == 0) {
+		printf("Font: failed to load %s\n", trueTypeFontFile);
+		delete info;
+		delete[] m_fontData;
+		m_fontData = nullptr;
+		return;
+	}
 
-		delete[] ttf_buffer;
+	m_fontInfo = info;
+	m_scale = stbtt_ScaleForPixelHeight(info, fontHeight);
+
+	// every cell fits the largest glyph and its padding plus a 1 pixel border
+	int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+	stbtt_GetFontBoundingBox(info, &x0, &y0, &x1, &y1);
+	m_cellWidth = (unsigned short)ceilf((x1 - x0) * m_scale) + m_padding * 2 + 2;
+	m_cellHeight = (unsigned short)ceilf((y1 - y0) * m_scale) + m_padding * 2 + 2;
+
+	// room for 256 glyphs, or as many as fit in 2048 x 2048
+	m_cellsPerRow = 2048 / m_cellWidth < 16 ? 2048 / m_cellWidth : 16;
+	unsigned short rows = 2048 / m_cellHeight < 16 ? 2048 / m_cellHeight : 16;
+	if (m_cellsPerRow == 0 || rows == 0) {
+		printf("Font: %s is too large at height %u\n", trueTypeFontFile, fontHeight);
+		return;
 	}
+
+	m_textureWidth = m_cellsPerRow * m_cellWidth;
+	m_textureHeight = rows * m_cellHeight;
+
+	Glyph empty = {};
+	empty.codepoint = -1;
+	m_cells.resize(m_cellsPerRow * rows, empty);
+	m_cellPixels.resize(m_cellWidth * m_cellHeight);
+
+	std::vector<unsigned char> clear(m_textureWidth * m_textureHeight, 0);
+
+	glGenTextures(1, &m_glHandle);
+	glBindTexture(GL_TEXTURE_2D, m_glHandle);
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_R8, m_textureWidth, m_textureHeight, 0, GL_RED, GL_UNSIGNED_BYTE, clear.data());
+
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// latin-1 is almost always going to be needed
+	for (int i = 32; i < 256; ++i)
+		getGlyph(i);
+	m_useTick++;
 }
 
 Font::~Font() {
-	delete[] (stbtt_bakedchar*)m_glyphData;
+	delete (stbtt_fontinfo*)m_fontInfo;
+	delete[] m_fontData;
 
 	glDeleteTextures(1, &m_glHandle);
-	glDeleteBuffers(1, &m_pixelBufferHandle);
 }
 
-float Font::getStringWidth(const char* str) {
+int Font::getGlyph(int codepoint) {
 
-	stbtt_aligned_quad Q = {};
-	float xPos = 0.0f;
-	float yPos = 0.0f;
+	auto iter = m_cellLookup.find(codepoint);
+	if (iter != m_cellLookup.end()) {
+		m_cells[iter->second].lastUsed = m_useTick;
+		return (int)iter->second;
+	}
 
-	while (*str != 0) {
-		stbtt_GetBakedQuad(
-			(stbtt_bakedchar*)m_glyphData,
-			m_textureWidth,
-			m_textureHeight,
-			(unsigned char)*str, &xPos, &yPos, &Q, 1);
+	// take an empty cell, or the least recently used one that no waiting batch
+	// needs. cells used this tick belong to the string being laid out
+	int cell = -1;
+	for (unsigned int i = 0; i < m_cells.size(); ++i) {
+		if (m_cells[i].codepoint == -1) {
+			cell = i;
+			break;
+		}
+		if (m_cells[i].pinned == false &&
+			m_cells[i].lastUsed < m_useTick &&
+			(cell == -1 || m_cells[i].lastUsed < m_cells[cell].lastUsed))
+			cell = i;
+	}
 
-		str++;
+	if (cell == -1)
+		return -1;
+
+	Glyph& glyph = m_cells[cell];
+	if (glyph.codepoint != -1) {
+		m_cellLookup.erase(glyph.codepoint);
+		m_evictions++;
 	}
 
-	// get the position of the last vert for the last character rendered
-	return Q.x1;
+	stbtt_fontinfo* info = (stbtt_fontinfo*)m_fontInfo;
+
+	int advance = 0, bearing = 0;
+	stbtt_GetCodepointHMetrics(info, codepoint, &advance, &bearing);
+
+	int x0 = 0, y0 = 0, x1 = 0, y1 = 0;
+	stbtt_GetCodepointBitmapBox(info, codepoint, m_scale, m_scale, &x0, &y0, &x1, &y1);
+
+	int width = x1 - x0;
+	int height = y1 - y0;
+	if (width > m_cellWidth - m_padding * 2 - 2)
+		width = m_cellWidth - m_padding * 2 - 2;
+	if (height > m_cellHeight - m_padding * 2 - 2)
+		height = m_cellHeight - m_padding * 2 - 2;
+
+	// the whole cell is uploaded so nothing of the previous glyph is left around it
+	memset(m_cellPixels.data(), 0, m_cellPixels.size());
+	if (width > 0 && height > 0) {
+		if (m_distanceField)
+			makeDistanceField(codepoint, x0, y0, width, height);
+		else
+			stbtt_MakeCodepointBitmap(info, m_cellPixels.data() + m_cellWidth + 1, width, height, m_cellWidth, m_scale, m_scale, codepoint);
+	}
+
+	unsigned int cellX = (cell % m_cellsPerRow) * m_cellWidth;
+	unsigned int cellY = (cell / m_cellsPerRow) * m_cellHeight;
+
+	glBindTexture(GL_TEXTURE_2D, m_glHandle);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, cellX, cellY, m_cellWidth, m_cellHeight, GL_RED, GL_UNSIGNED_BYTE, m_cellPixels.data());
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	glyph.codepoint = codepoint;
+	glyph.xOffset = (float)x0;
+	glyph.yOffset = (float)y0;
+	glyph.width = (float)width;
+	glyph.height = (float)height;
+	glyph.xAdvance = advance * m_scale;
+	glyph.s0 = (float)(cellX + 1) / m_textureWidth;
+	glyph.t0 = (float)(cellY + 1) / m_textureHeight;
+	glyph.s1 = (float)(cellX + 1 + width + m_padding * 2) / m_textureWidth;
+	glyph.t1 = (float)(cellY + 1 + height + m_padding * 2) / m_textureHeight;
+	glyph.lastUsed = m_useTick;
+	glyph.pinned = false;
+
+	m_cellLookup[codepoint] = cell;
+	return cell;
 }
 
-float Font::getStringHeight(const char* str) {
+void Font::pinGlyph(unsigned int cell) {
 
-	stbtt_aligned_quad Q = {};
-	float low = 9999999, high = -9999999;
-	float xPos = 0.0f;
-	float yPos = 0.0f;
+	if (m_cells[cell].pinned)
+		return;
 
-	while (*str != 0) {
-		stbtt_GetBakedQuad(
-			(stbtt_bakedchar*)m_glyphData,
-			m_textureWidth,
-			m_textureHeight,
-			(unsigned char)*str, &xPos, &yPos, &Q, 1);
+	m_cells[cell].pinned = true;
+	m_pinnedCells.push_back(cell);
+}
 
-		low = low > Q.y0 ? Q.y0 : low;
-		high = high < Q.y1 ? Q.y1 : high;
+void Font::releaseGlyphs() {
 
-		str++;
-	}
+	for (auto cell : m_pinnedCells)
+		m_cells[cell].pinned = false;
+	m_pinnedCells.clear();
+}
 
-	return high - low;
+void Font::makeDistanceField(int codepoint, int x0, int y0, int width, int height) {
+
+	stbtt_fontinfo* info = (stbtt_fontinfo*)m_fontInfo;
+
+	// rasterise large enough that each texel of the field covers a block of pixels
+	int fieldWidth = width + m_padding * 2;
+	int fieldHeight = height + m_padding * 2;
+	int largeWidth = fieldWidth * SDF_UPSCALE;
+	int largeHeight = fieldHeight * SDF_UPSCALE;
+	float largeScale = m_scale * SDF_UPSCALE;
+
+	// the large bitmap can start a few pixels in from the scaled up small one
+	int lx0 = 0, ly0 = 0, lx1 = 0, ly1 = 0;
+	stbtt_GetCodepointBitmapBox(info, codepoint, largeScale, largeScale, &lx0, &ly0, &lx1, &ly1);
+	int offsetX = lx0 - x0 * SDF_UPSCALE + m_padding * SDF_UPSCALE;
+	int offsetY = ly0 - y0 * SDF_UPSCALE + m_padding * SDF_UPSCALE;
+	int bitmapWidth = lx1 - lx0 < largeWidth - offsetX ? lx1 - lx0 : largeWidth - offsetX;
+	int bitmapHeight = ly1 - ly0 < largeHeight - offsetY ? ly1 - ly0 : largeHeight - offsetY;
+
+	std::vector<unsigned char> coverage(largeWidth * largeHeight, 0);
+	if (bitmapWidth > 0 && bitmapHeight > 0)
+		stbtt_MakeCodepointBitmap(info, coverage.data() + offsetY * largeWidth + offsetX,
+								  bitmapWidth, bitmapHeight, largeWidth, largeScale, largeScale, codepoint);
+
+	// distance from outside pixels to the glyph, and from inside pixels to the outside
+	std::vector<float> outside(coverage.size()), inside(coverage.size());
+	for (size_t i = 0; i < coverage.size(); ++i) {
+		outside[i] = coverage[i] >= 128 ? 0 : SDF_INFINITY;
+		inside[i] = coverage[i] >= 128 ? SDF_INFINITY : 0;
+	}
+	distanceTransform2D(outside, largeWidth, largeHeight);
+	distanceTransform2D(inside, largeWidth, largeHeight);
+
+	// each texel averages the signed distance of the four pixels around its centre,
+	// the edge is half way between an inside and outside pixel
+	int centre = SDF_UPSCALE / 2 - 1;
+	for (int y = 0; y < fieldHeight; ++y) {
+		for (int x = 0; x < fieldWidth; ++x) {
+			float distance = 0;
+			for (int i = 0; i < 4; ++i) {
+				int index = (y * SDF_UPSCALE + centre + i / 2) * largeWidth + x * SDF_UPSCALE + centre + i % 2;
+				if (inside[index] > 0)
+					distance += sqrtf(inside[index]) - 0.5f;
+				else
+					distance -= sqrtf(outside[index]) - 0.5f;
+			}
+			distance /= 4.0f * SDF_UPSCALE;
+
+			// 0.5 is the edge, increasing inwards
+			float value = 0.5f + distance / (2.0f * m_padding);
+			value = value < 0 ? 0 : (value > 1 ? 1 : value);
+			m_cellPixels[(y + 1) * m_cellWidth + x + 1] = (unsigned char)(value * 255.0f + 0.5f);
+		}
+	}
 }
 
-void Font::getStringSize(const char* str, float& width, float& height) {
+const Font::Layout* Font::getLayout(const char* str) {
 
-	stbtt_aligned_quad Q = {};
-	float low = 9999999, high = -9999999;
-	float xPos = 0.0f;
-	float yPos = 0.0f;
+	if (m_glHandle == 0)
+		return nullptr;
 
-	while (*str != 0) {
-		stbtt_GetBakedQuad(
-			(stbtt_bakedchar*)m_glyphData,
-			m_textureWidth,
-			m_textureHeight,
-			(unsigned char)*str, &xPos, &yPos, &Q, 1);
+	unsigned long long hash = hashString(str);
+	m_useTick++;
 
-		low = low > Q.y0 ? Q.y0 : low;
-		high = high < Q.y1 ? Q.y1 : high;
+	// a string is laid out again if any glyph was replaced since, or on a hash collision
+	auto iter = m_layouts.find(hash);
+	if (iter != m_layouts.end() &&
+		iter->second.evictions == m_evictions &&
+		iter->second.text == str) {
+		iter->second.lastUsed = m_useTick;
+		for (auto& quad : iter->second.quads)
+			m_cells[quad.cell].lastUsed = m_useTick;
+		return &iter->second;
+	}
 
-		str++;
+	if (iter == m_layouts.end() &&
+		m_layouts.size() >= MAX_CACHED_LAYOUTS) {
+		auto oldest = m_layouts.begin();
+		for (auto i = m_layouts.begin(); i != m_layouts.end(); ++i) {
+			if (i->second.lastUsed < oldest->second.lastUsed)
+				oldest = i;
+		}
+		m_layouts.erase(oldest);
 	}
 
-	height = high - low;
-	width = Q.x1;
+	Layout& layout = m_layouts[hash];
+	layout.text = str;
+	layout.quads.clear();
+	layout.minX = 9999999;
+	layout.maxX = -9999999;
+	layout.minY = 9999999;
+	layout.maxY = -9999999;
+	layout.width = 0;
+	layout.lastUsed = m_useTick;
+
+	float pen = 0;
+	while (*str != 0) {
+		int cell = getGlyph(decodeUTF8(str));
+		if (cell == -1) {
+			m_layouts.erase(hash);
+			return nullptr;
+		}
+
+		// snapped to whole pixels the same as stbtt_GetBakedQuad
+		const Glyph& glyph = m_cells[cell];
+		LayoutQuad quad;
+		quad.x0 = floorf(pen + glyph.xOffset + 0.5f);
+		quad.y0 = floorf(glyph.yOffset + 0.5f);
+		quad.x1 = quad.x0 + glyph.width;
+		quad.y1 = quad.y0 + glyph.height;
+		quad.cell = cell;
+		layout.quads.push_back(quad);
+
+		layout.minX = layout.minX > quad.x0 ? quad.x0 : layout.minX;
+		layout.maxX = layout.maxX < quad.x1 ? quad.x1 : layout.maxX;
+		layout.minY = layout.minY > quad.y0 ? quad.y0 : layout.minY;
+		layout.maxY = layout.maxY < quad.y1 ? quad.y1 : layout.maxY;
+		layout.width = quad.x1;
+
+		pen += glyph.xAdvance;
+	}
+
+	// glyphs used in this string can't replace each other as they share a tick
+	layout.evictions = m_evictions;
+	return &layout;
 }
 
-void Font::getStringRectangle(const char* str, float& x0, float& y0, float& x1, float& y1) {
+float Font::getStringWidth(const char* str) {
 
-	stbtt_aligned_quad Q = {};
-	y1 = 9999999, y0 = -9999999;
-	x0 = 9999999, x1 = -9999999;
-	float xPos = 0.0f;
-	float yPos = 0.0f;
+	const Layout* layout = getLayout(str);
+	if (layout == nullptr)
+		return 0;
 
-	while (*str != 0) {
-		stbtt_GetBakedQuad(
-			(stbtt_bakedchar*)m_glyphData,
-			m_textureWidth,
-			m_textureHeight,
-			(unsigned char)*str, &xPos, &yPos, &Q, 1);
+	// get the position of the last vert for the last character rendered
+	return layout->width;
+}
 
-		y1 = y1 > Q.y0 ? Q.y0 : y1;
-		y0 = y0 < Q.y1 ? Q.y1 : y0;
+float Font::getStringHeight(const char* str) {
 
-		x1 = x1 < Q.x1 ? Q.x1 : x1;
-		x0 = x0 > Q.x0 ? Q.x0 : x0;
+	const Layout* layout = getLayout(str);
+	if (layout == nullptr ||
+		layout->quads.empty())
+		return 0;
 
-		str++;
-	}
+	return layout->maxY - layout->minY;
+}
+
+void Font::getStringSize(const char* str, float& width, float& height) {
+
+	width = 0;
+	height = 0;
+
+	const Layout* layout = getLayout(str);
+	if (layout == nullptr ||
+		layout->quads.empty())
+		return;
+
+	height = layout->maxY - layout->minY;
+	width = layout->width;
+}
+
+void Font::getStringRectangle(const char* str, float& x0, float& y0, float& x1, float& y1) {
+
+	x0 = y0 = x1 = y1 = 0;
+
+	const Layout* layout = getLayout(str);
+	if (layout == nullptr ||
+		layout->quads.empty())
+		return;
 
-	y0 *= -1;
-	y1 *= -1;
+	x0 = layout->minX;
+	x1 = layout->maxX;
+	y0 = -layout->maxY;
+	y1 = -layout->minY;
 }
 
-} // namepace aie
\ No newline at end of file
+} // namepace aie
@@ -1,21 +1,35 @@
 #pragma once
 
+#include <string>
+#include <vector>
+#include <unordered_map>
+
 namespace aie {
 
-// a class that wraps up a True Type Font within an OpenGL texture
+// a class that wraps up a True Type Font within an OpenGL texture.
+// glyphs are rasterised into the texture the first time they are used, and
+// the least recently used glyphs are replaced once it is full. strings are UTF-8.
+// a distance field font stores how far each texel is from the glyph's edge rather
+// than its coverage, so one font can be drawn crisply at any size
 class Font {
 
 	friend class Renderer2D;
 
 public:
 
-	Font(const char* trueTypeFontFile, unsigned short fontHeight);
+	// for distance fields fontHeight is the size glyphs are stored at, 32 - 64 works well
+	Font(const char* trueTypeFontFile, unsigned short fontHeight, bool distanceField = false);
 	~Font();
 
 	// returns the OpenGL texture handle
 	unsigned int	getTextureHandle() const { return m_glHandle; }
 
-	// returns size of string using this font
+	// the height the font was created with
+	unsigned short	getHeight() const { return m_height; }
+
+	bool			isDistanceField() const { return m_distanceField; }
+
+	// returns size of string using this font, at the height it was created with
 	float getStringWidth(const char* str);
 
 	// height includes characters that go below starting height
@@ -27,9 +41,77 @@ public:
 
 private:
 
-	void*			m_glyphData;
-	unsigned int	m_glHandle, m_pixelBufferHandle;
+	// a cell of the texture and the glyph currently in it, offsets are from the pen position.
+	// texture coordinates include the distance field's padding around the glyph
+	struct Glyph {
+		int				codepoint;
+		float			xOffset, yOffset;
+		float			width, height;
+		float			xAdvance;
+		float			s0, t0, s1, t1;
+		unsigned int	lastUsed;
+		bool			pinned;
+	};
+
+	// a glyph within a laid out string, y increases downwards from the baseline
+	struct LayoutQuad {
+		float			x0, y0, x1, y1;
+		unsigned int	cell;
+	};
+
+	// a cached string layout, only valid while none of its glyphs have been replaced
+	struct Layout {
+		std::string				text;
+		std::vector<LayoutQuad>	quads;
+		float					minX, maxX;
+		float					minY, maxY;
+		float					width;
+		unsigned int			evictions;
+		unsigned int			lastUsed;
+	};
+
+	// returns the cell holding a codepoint, rasterising it if needed. returns -1
+	// if every cell is pinned or holds another glyph of the string being laid out
+	int				getGlyph(int codepoint);
+
+	// returns the layout for a string, or nullptr if its glyphs couldn't all be cached.
+	// looking a string up (to measure or draw it) doesn't pin its glyphs
+	const Layout*	getLayout(const char* str);
+
+	// pins a cell used by a batch that is waiting to be drawn, so it can't be replaced
+	void			pinGlyph(unsigned int cell);
+
+	// called by the renderer once batches using this font have been drawn,
+	// the glyphs they pinned can then be replaced
+	void			releaseGlyphs();
+
+	// fills m_cellPixels with the distance field for a codepoint
+	void			makeDistanceField(int codepoint, int x0, int y0, int width, int height);
+
+	void*			m_fontInfo;
+	unsigned char*	m_fontData;
+	float			m_scale;
+	unsigned short	m_height;
+
+	// distance fields are padded by the distance they cover outside the glyph
+	bool			m_distanceField;
+	unsigned short	m_padding;
+
+	unsigned int	m_glHandle;
 	unsigned short	m_textureWidth, m_textureHeight;
+	unsigned short	m_cellWidth, m_cellHeight;
+	unsigned short	m_cellsPerRow;
+
+	std::vector<Glyph>						m_cells;
+	std::unordered_map<int, unsigned int>	m_cellLookup;
+	std::vector<unsigned char>				m_cellPixels;
+	unsigned int							m_evictions;
+	std::vector<unsigned int>				m_pinnedCells;
+
+	// bumped by every layout, cells are replaced least recently used first
+	unsigned int							m_useTick;
+
+	std::unordered_map<unsigned long long, Layout>	m_layouts;
 };
 
-} // namespace aie
\ No newline at end of file
+} // namespace aie
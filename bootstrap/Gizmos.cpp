@@ -1,44 +1,29 @@
 #include "Gizmos.h"
 #include "gl_core_4_4.h"
+#include "StreamBuffer.h"
 #include <glm/glm.hpp>
 #include <glm/ext.hpp>
 #include <iostream>
+#include <cstring>
+#include <cstdint>
+#include <cassert>
+#include <tuple>
+#include <algorithm>
 
 namespace aie {
 
 Gizmos* Gizmos::sm_singleton = nullptr;
+unsigned int Gizmos::sm_generation = 0;
 
-Gizmos::Gizmos(unsigned int maxLines, unsigned int maxTris,
-			   unsigned int max2DLines, unsigned int max2DTris)
-	: m_maxLines(maxLines),
-	m_lineCount(0),
-	m_lines(new GizmoLine[maxLines]),
-	m_maxTris(maxTris),
-	m_triCount(0),
-	m_tris(new GizmoTri[maxTris]),
-	m_transparentTriCount(0),
-	m_transparentTris(new GizmoTri[maxTris]),
-	m_max2DLines(max2DLines),
-	m_2DlineCount(0),
-	m_2Dlines(new GizmoLine[max2DLines]),
-	m_max2DTris(max2DTris),
-	m_2DtriCount(0),
-	m_2Dtris(new GizmoTri[max2DTris]) {
+// each thread other than the main thread appends to its own lists, found through
+// these without locking. the generation catches lists from a destroyed instance
+static thread_local void* t_threadLists = nullptr;
+static thread_local unsigned int t_threadGeneration = 0;
 
-	// create shaders
-	const char* vsSource = "#version 150\n \
-					 in vec4 Position; \
-					 in vec4 Colour; \
-					 out vec4 vColour; \
-					 uniform mat4 ProjectionView; \
-					 void main() { vColour = Colour; gl_Position = ProjectionView * Position; }";
+// builds a gizmo shader program, attribute names are bound to their index in the array
+static unsigned int createGizmoProgram(const char* vsSource, const char* fsSource,
+									   const char* const* attributes, unsigned int attributeCount) {
 
-	const char* fsSource = "#version 150\n \
-					 in vec4 vColour; \
-                     out vec4 FragColor; \
-					 void main()	{ FragColor = vColour; }";
-    
-    
 	unsigned int vs = glCreateShader(GL_VERTEX_SHADER);
 	unsigned int fs = glCreateShader(GL_FRAGMENT_SHADER);
 
@@ -48,116 +33,161 @@ Gizmos::Gizmos(unsigned int maxLines, unsigned int maxTris,
 	glShaderSource(fs, 1, (const char**)&fsSource, 0);
 	glCompileShader(fs);
 
-	m_shader = glCreateProgram();
-	glAttachShader(m_shader, vs);
-	glAttachShader(m_shader, fs);
-	glBindAttribLocation(m_shader, 0, "Position");
-	glBindAttribLocation(m_shader, 1, "Colour");
-	glLinkProgram(m_shader);
+	unsigned int program = glCreateProgram();
+	glAttachShader(program, vs);
+	glAttachShader(program, fs);
+	for (unsigned int i = 0; i < attributeCount; ++i) {
+		if (attributes[i] != nullptr)
+			glBindAttribLocation(program, i, attributes[i]);
+	}
+	glLinkProgram(program);
     
 	int success = GL_FALSE;
-    glGetProgramiv(m_shader, GL_LINK_STATUS, &success);
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
 	if (success == GL_FALSE) {
 		int infoLogLength = 0;
-		glGetProgramiv(m_shader, GL_INFO_LOG_LENGTH, &infoLogLength);
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLogLength);
 		char* infoLog = new char[infoLogLength + 1];
         
-		glGetProgramInfoLog(m_shader, infoLogLength, 0, infoLog);
+		glGetProgramInfoLog(program, infoLogLength, 0, infoLog);
 		printf("Error: Failed to link Gizmo shader program!\n%s\n", infoLog);
 		delete[] infoLog;
 	}
 
 	glDeleteShader(vs);
 	glDeleteShader(fs);
-    
-    // create VBOs
-	glGenBuffers( 1, &m_lineVBO );
-	glBindBuffer(GL_ARRAY_BUFFER, m_lineVBO);
-	glBufferData(GL_ARRAY_BUFFER, m_maxLines * sizeof(GizmoLine), m_lines, GL_DYNAMIC_DRAW);
-
-	glGenBuffers( 1, &m_triVBO );
-	glBindBuffer(GL_ARRAY_BUFFER, m_triVBO);
-	glBufferData(GL_ARRAY_BUFFER, m_maxTris * sizeof(GizmoTri), m_tris, GL_DYNAMIC_DRAW);
-
-	glGenBuffers( 1, &m_transparentTriVBO );
-	glBindBuffer(GL_ARRAY_BUFFER, m_transparentTriVBO);
-	glBufferData(GL_ARRAY_BUFFER, m_maxTris * sizeof(GizmoTri), m_transparentTris, GL_DYNAMIC_DRAW);
-
-	glGenBuffers( 1, &m_2DlineVBO );
-	glBindBuffer(GL_ARRAY_BUFFER, m_2DlineVBO);
-	glBufferData(GL_ARRAY_BUFFER, m_max2DLines * sizeof(GizmoLine), m_2Dlines, GL_DYNAMIC_DRAW);
-
-	glGenBuffers( 1, &m_2DtriVBO );
-	glBindBuffer(GL_ARRAY_BUFFER, m_2DtriVBO);
-	glBufferData(GL_ARRAY_BUFFER, m_max2DTris * sizeof(GizmoTri), m_2Dtris, GL_DYNAMIC_DRAW);
-
-	glGenVertexArrays(1, &m_lineVAO);
-	glBindVertexArray(m_lineVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_lineVBO);
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), 0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), (void*)16);
 
-	glGenVertexArrays(1, &m_triVAO);
-	glBindVertexArray(m_triVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_triVBO);
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), 0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), (void*)16);
+	return program;
+}
 
-	glGenVertexArrays(1, &m_transparentTriVAO);
-	glBindVertexArray(m_transparentTriVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_transparentTriVBO);
-	glEnableVertexAttribArray(0);
-	glEnableVertexAttribArray(1);
-	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), 0);
-	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), (void*)16);
+// builds the transform for a unit shape. the tessellated shapes only use a
+// transform's rotation and scale for their points and add its translation to the centre
+static glm::mat4 instanceTransform(const glm::vec3& center, const glm::mat4* transform, const glm::vec3& scale) {
+
+	glm::mat4 result = transform != nullptr ? glm::mat4(glm::mat3(*transform)) : glm::mat4(1);
+	result = glm::scale(result, scale);
+
+	glm::vec3 position = transform != nullptr ? glm::vec3((*transform)[3]) + center : center;
+	result[3] = glm::vec4(position, 1);
+	return result;
+}
+
+bool Gizmos::ShapeKey::operator < (const ShapeKey& other) const {
+	return std::tie(type, rows, columns, range[0], range[1], range[2], range[3]) <
+		std::tie(other.type, other.rows, other.columns, other.range[0], other.range[1], other.range[2], other.range[3]);
+}
 
-	glGenVertexArrays(1, &m_2DlineVAO);
-	glBindVertexArray(m_2DlineVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_2DlineVBO);
+Gizmos::Gizmos(unsigned int maxLines, unsigned int maxTris,
+			   unsigned int max2DLines, unsigned int max2DTris)
+	: m_opaqueInstanceCount(0),
+	m_transparentInstanceCount(0),
+	m_mainThread(std::this_thread::get_id()),
+	m_retainedCount(0),
+	m_retainedTransparentCount(0),
+	m_recording(false),
+	m_recordLineStart(0),
+	m_recordTriStart(0),
+	m_recordTransparentTriStart(0) {
+
+	// make room for the expected counts up front
+	m_frame.lines.reserve(maxLines);
+	m_frame.tris.reserve(maxTris);
+	m_frame.transparentTris.reserve(maxTris);
+	m_frame.lines2D.reserve(max2DLines);
+	m_frame.tris2D.reserve(max2DTris);
+
+	// create shaders
+	const char* vsSource = "#version 150\n \
+					 in vec4 Position; \
+					 in vec4 Colour; \
+					 out vec4 vColour; \
+					 uniform mat4 ProjectionView; \
+					 void main() { vColour = Colour; gl_Position = ProjectionView * Position; }";
+
+	const char* fsSource = "#version 150\n \
+					 in vec4 vColour; \
+                     out vec4 FragColor; \
+					 void main()	{ FragColor = vColour; }";
+    
+    
+	const char* attributes[] = { "Position", "Colour" };
+	m_shader = createGizmoProgram(vsSource, fsSource, attributes, 2);
+
+	// instanced shapes take their transform and colours per instance,
+	// lines and triangles of the same instance pick different colours
+	const char* instanceVsSource = "#version 150\n \
+					 in vec4 Position; \
+					 in mat4 Model; \
+					 in vec4 FillColour; \
+					 in vec4 LineColour; \
+					 out vec4 vColour; \
+					 uniform mat4 ProjectionView; \
+					 uniform int DrawLines; \
+					 void main() { vColour = DrawLines != 0 ? LineColour : FillColour; gl_Position = ProjectionView * Model * Position; }";
+
+	// the model matrix uses 4 attribute slots
+	const char* instanceAttributes[] = { "Position", "Model", nullptr, nullptr, nullptr, "FillColour", "LineColour" };
+	m_instanceShader = createGizmoProgram(instanceVsSource, fsSource, instanceAttributes, 7);
+	m_instanceProjectionViewUniform = glGetUniformLocation(m_instanceShader, "ProjectionView");
+	m_instanceDrawLinesUniform = glGetUniformLocation(m_instanceShader, "DrawLines");
+    
+	// vertices are copied into the shared stream buffer when drawn
+	glGenVertexArrays(1, &m_vao);
+	glBindVertexArray(m_vao);
+	glBindBuffer(GL_ARRAY_BUFFER, StreamBuffer::getInstance()->getHandle());
 	glEnableVertexAttribArray(0);
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), 0);
 	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), (void*)16);
 
-	glGenVertexArrays(1, &m_2DtriVAO);
-	glBindVertexArray(m_2DtriVAO);
-	glBindBuffer(GL_ARRAY_BUFFER, m_2DtriVBO);
+	// used instead when the stream buffer has run out of room for the frame
+	glGenBuffers(1, &m_fallbackVbo);
+	glGenVertexArrays(1, &m_fallbackVao);
+	glBindVertexArray(m_fallbackVao);
+	glBindBuffer(GL_ARRAY_BUFFER, m_fallbackVbo);
 	glEnableVertexAttribArray(0);
 	glEnableVertexAttribArray(1);
 	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), 0);
 	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), (void*)16);
 
+	glGenBuffers(1, &m_fallbackInstanceVbo);
+	m_instanceBuffer = StreamBuffer::getInstance()->getHandle();
+
 	glBindVertexArray(0);
 	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 Gizmos::~Gizmos() {
-	delete[] m_lines;
-	delete[] m_tris;
-	delete[] m_transparentTris;
-	glDeleteBuffers( 1, &m_lineVBO );
-	glDeleteBuffers( 1, &m_triVBO );
-	glDeleteBuffers( 1, &m_transparentTriVBO );
-	glDeleteVertexArrays( 1, &m_lineVAO );
-	glDeleteVertexArrays( 1, &m_triVAO );
-	glDeleteVertexArrays( 1, &m_transparentTriVAO );
-	delete[] m_2Dlines;
-	delete[] m_2Dtris;
-	glDeleteBuffers( 1, &m_2DlineVBO );
-	glDeleteBuffers( 1, &m_2DtriVBO );
-	glDeleteVertexArrays( 1, &m_2DlineVAO );
-	glDeleteVertexArrays( 1, &m_2DtriVAO );
+	for (auto& retained : m_retained) {
+		if (retained.alive) {
+			glDeleteBuffers( 1, &retained.vbo );
+			glDeleteVertexArrays( 1, &retained.vao );
+		}
+	}
+	for (auto& shape : m_shapes) {
+		glDeleteBuffers( 1, &shape.second->vbo );
+		glDeleteVertexArrays( 1, &shape.second->vao );
+		delete shape.second;
+	}
+	glDeleteVertexArrays( 1, &m_vao );
+	glDeleteVertexArrays( 1, &m_fallbackVao );
+	glDeleteBuffers( 1, &m_fallbackVbo );
+	glDeleteBuffers( 1, &m_fallbackInstanceVbo );
 	glDeleteProgram(m_shader);
+	glDeleteProgram(m_instanceShader);
+
+	for (auto thread : m_threads)
+		delete thread;
 }
 
 void Gizmos::create(unsigned int maxLines, unsigned int maxTris,
 					unsigned int max2DLines, unsigned int max2DTris) {
-	if (sm_singleton == nullptr)
+	if (sm_singleton == nullptr) {
 		sm_singleton = new Gizmos(maxLines,maxTris,max2DLines,max2DTris);
+
+		// invalidates any thread's lists from a previous instance
+		sm_generation++;
+	}
 }
 
 void Gizmos::destroy() {
@@ -166,11 +196,120 @@ void Gizmos::destroy() {
 }
 
 void Gizmos::clear() {
-	sm_singleton->m_lineCount = 0;
-	sm_singleton->m_triCount = 0;
-	sm_singleton->m_transparentTriCount = 0;
-	sm_singleton->m_2DlineCount = 0;
-	sm_singleton->m_2DtriCount = 0;
+	sm_singleton->m_frame.clear();
+
+	// anything another thread added since the last draw is dropped too
+	{
+		std::lock_guard<std::mutex> lock(sm_singleton->m_threadMutex);
+		for (auto thread : sm_singleton->m_threads)
+			thread->lists.clear();
+	}
+
+	sm_singleton->m_recordLineStart = 0;
+	sm_singleton->m_recordTriStart = 0;
+	sm_singleton->m_recordTransparentTriStart = 0;
+
+	// keep the cached shapes, just drop their instances
+	for (auto& shape : sm_singleton->m_shapes) {
+		shape.second->opaqueInstances.clear();
+		shape.second->transparentInstances.clear();
+	}
+	sm_singleton->m_opaqueInstanceCount = 0;
+	sm_singleton->m_transparentInstanceCount = 0;
+}
+
+void Gizmos::beginRetained() {
+	if (sm_singleton == nullptr ||
+		sm_singleton->m_recording)
+		return;
+
+	sm_singleton->m_recording = true;
+	sm_singleton->m_recordLineStart = sm_singleton->m_frame.lines.size();
+	sm_singleton->m_recordTriStart = sm_singleton->m_frame.tris.size();
+	sm_singleton->m_recordTransparentTriStart = sm_singleton->m_frame.transparentTris.size();
+}
+
+unsigned int Gizmos::endRetained() {
+	if (sm_singleton == nullptr ||
+		sm_singleton->m_recording == false)
+		return 0;
+
+	Gizmos* gizmos = sm_singleton;
+	gizmos->m_recording = false;
+
+	unsigned int lineCount = gizmos->m_frame.lines.size() - gizmos->m_recordLineStart;
+	unsigned int triCount = gizmos->m_frame.tris.size() - gizmos->m_recordTriStart;
+	unsigned int transparentCount = gizmos->m_frame.transparentTris.size() - gizmos->m_recordTransparentTriStart;
+
+	if (lineCount + triCount + transparentCount == 0)
+		return 0;
+
+	// gather lines, then opaque triangles, then transparent triangles into one buffer
+	std::vector<GizmoVertex> vertices(lineCount * 2 + (triCount + transparentCount) * 3);
+	GizmoVertex* destination = vertices.data();
+	gizmos->m_frame.lines.copyTo((GizmoLine*)destination, gizmos->m_recordLineStart, lineCount);
+	destination += lineCount * 2;
+	gizmos->m_frame.tris.copyTo((GizmoTri*)destination, gizmos->m_recordTriStart, triCount);
+	destination += triCount * 3;
+	gizmos->m_frame.transparentTris.copyTo((GizmoTri*)destination, gizmos->m_recordTransparentTriStart, transparentCount);
+
+	// the recorded primitives no longer belong to this frame
+	gizmos->m_frame.lines.truncate(gizmos->m_recordLineStart);
+	gizmos->m_frame.tris.truncate(gizmos->m_recordTriStart);
+	gizmos->m_frame.transparentTris.truncate(gizmos->m_recordTransparentTriStart);
+
+	RetainedGizmo retained;
+	retained.lineVertices = lineCount * 2;
+	retained.triVertices = triCount * 3;
+	retained.transparentVertices = transparentCount * 3;
+	retained.alive = true;
+
+	glGenBuffers(1, &retained.vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, retained.vbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(GizmoVertex), vertices.data(), GL_STATIC_DRAW);
+
+	glGenVertexArrays(1, &retained.vao);
+	glBindVertexArray(retained.vao);
+	glEnableVertexAttribArray(0);
+	glEnableVertexAttribArray(1);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), 0);
+	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoVertex), (void*)16);
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+
+	gizmos->m_retainedCount++;
+	if (retained.transparentVertices > 0)
+		gizmos->m_retainedTransparentCount++;
+
+	// reuse a destroyed slot if there is one
+	for (unsigned int i = 0; i < gizmos->m_retained.size(); ++i) {
+		if (gizmos->m_retained[i].alive == false) {
+			gizmos->m_retained[i] = retained;
+			return i + 1;
+		}
+	}
+
+	gizmos->m_retained.push_back(retained);
+	return (unsigned int)gizmos->m_retained.size();
+}
+
+void Gizmos::destroyRetained(unsigned int handle) {
+	if (sm_singleton == nullptr ||
+		handle == 0 ||
+		handle > sm_singleton->m_retained.size())
+		return;
+
+	RetainedGizmo& retained = sm_singleton->m_retained[handle - 1];
+	if (retained.alive == false)
+		return;
+
+	glDeleteBuffers(1, &retained.vbo);
+	glDeleteVertexArrays(1, &retained.vao);
+	retained.alive = false;
+
+	sm_singleton->m_retainedCount--;
+	if (retained.transparentVertices > 0)
+		sm_singleton->m_retainedTransparentCount--;
 }
 
 // Adds 3 unit-length lines (red,green,blue) representing the 3 axis of a transform, 
@@ -236,7 +375,7 @@ void Gizmos::addAABB(const glm::vec3& center,
 	addLine(vVerts[3], vVerts[7], colour, colour);
 }
 
-void Gizmos::addAABBFilled(const glm::vec3& center, 
+void Gizmos::tessellateAABBFilled(const glm::vec3& center, 
 	const glm::vec3& rvExtents, 
 	const glm::vec4& fillColour, 
 	const glm::mat4* transform) {
@@ -308,7 +447,7 @@ void Gizmos::addAABBFilled(const glm::vec3& center,
 	addTri(vVerts[6], vVerts[2], vVerts[7], fillColour);
 }
 
-void Gizmos::addCylinderFilled(const glm::vec3& center, float radius, float fHalfLength,
+void Gizmos::tessellateCylinderFilled(const glm::vec3& center, float radius, float fHalfLength,
 	unsigned int segments, const glm::vec4& fillColour, const glm::mat4* transform) {
 
 	glm::vec4 white(1,1,1,1);
@@ -385,7 +524,7 @@ void Gizmos::addRing(const glm::vec3& center, float innerRadius, float outerRadi
 	}
 }
 
-void Gizmos::addDisk(const glm::vec3& center, float radius,
+void Gizmos::tessellateDisk(const glm::vec3& center, float radius,
 	unsigned int segments, const glm::vec4& fillColour, const glm::mat4* transform) {
 
 	glm::vec4 vSolid = fillColour;
@@ -517,7 +656,7 @@ void Gizmos::addArcRing(const glm::vec3& center, float rotation,
 	}
 }
 
-void Gizmos::addSphere(const glm::vec3& center, float radius, int rows, int columns, const glm::vec4& fillColour, 
+void Gizmos::tessellateSphere(const glm::vec3& center, float radius, int rows, int columns, const glm::vec4& fillColour, 
 								const glm::mat4* transform, float longMin, float longMax, 
 								float latMin, float latMax) {
 
@@ -580,7 +719,7 @@ void Gizmos::addSphere(const glm::vec3& center, float radius, int rows, int colu
 	delete[] v4Array;	
 }
 
-void Gizmos::addCapsule(const glm::vec3& center, float height, float radius,
+void Gizmos::tessellateCapsule(const glm::vec3& center, float height, float radius,
 						int rows, int cols, const glm::vec4& fillColour, const glm::mat4* rotation) {
 
 	float sphereCenters = (height * 0.5f) - radius;
@@ -681,6 +820,123 @@ void Gizmos::addCapsule(const glm::vec3& center, float height, float radius,
 	}
 }
 
+void Gizmos::addAABBFilled(const glm::vec3& center, const glm::vec3& extents, 
+							const glm::vec4& fillColour, const glm::mat4* transform) {
+
+	if (sm_singleton == nullptr)
+		return;
+
+	// unit meshes are only made on the main thread, and retained
+	// Gizmos are baked into their own buffer, so both still tessellate
+	if (isMainThread() == false ||
+		sm_singleton->m_recording) {
+		tessellateAABBFilled(center, extents, fillColour, transform);
+		return;
+	}
+
+	ShapeKey key = { SHAPE_BOX, 0, 0, { 0, 0, 0, 0 } };
+	addInstance(key, instanceTransform(center, transform, extents), fillColour, glm::vec4(1));
+}
+
+void Gizmos::addCylinderFilled(const glm::vec3& center, float radius, float halfLength,
+							   unsigned int segments, const glm::vec4& fillColour, const glm::mat4* transform) {
+
+	if (sm_singleton == nullptr ||
+		segments == 0)
+		return;
+
+	if (isMainThread() == false ||
+		sm_singleton->m_recording) {
+		tessellateCylinderFilled(center, radius, halfLength, segments, fillColour, transform);
+		return;
+	}
+
+	ShapeKey key = { SHAPE_CYLINDER, (int)segments, 0, { 0, 0, 0, 0 } };
+	addInstance(key, instanceTransform(center, transform, glm::vec3(radius, halfLength, radius)), fillColour, glm::vec4(1));
+}
+
+void Gizmos::addDisk(const glm::vec3& center, float radius,
+					 unsigned int segments, const glm::vec4& fillColour, const glm::mat4* transform) {
+
+	if (sm_singleton == nullptr ||
+		segments == 0)
+		return;
+
+	if (isMainThread() == false ||
+		sm_singleton->m_recording) {
+		tessellateDisk(center, radius, segments, fillColour, transform);
+		return;
+	}
+
+	// a disk is either filled or an outline, so they are different meshes
+	glm::vec4 solid = fillColour;
+	solid.w = 1;
+
+	ShapeKey key = { SHAPE_DISK, (int)segments, fillColour.w != 0 ? 1 : 0, { 0, 0, 0, 0 } };
+	addInstance(key, instanceTransform(center, transform, glm::vec3(radius, 1, radius)), fillColour, solid);
+}
+
+void Gizmos::addSphere(const glm::vec3& center, float radius, int rows, int columns, const glm::vec4& fillColour, 
+					   const glm::mat4* transform, float longMin, float longMax, 
+					   float latMin, float latMax) {
+
+	if (sm_singleton == nullptr)
+		return;
+
+	// only whole spheres are cached as unit meshes. partial ranges are often
+	// animated, and each new range would otherwise keep a mesh forever
+	bool fullRange = longMin == 0 && longMax == 360 && latMin == -90 && latMax == 90;
+
+	if (isMainThread() == false ||
+		sm_singleton->m_recording ||
+		fullRange == false ||
+		rows <= 0 ||
+		columns <= 0) {
+		tessellateSphere(center, radius, rows, columns, fillColour, transform, longMin, longMax, latMin, latMax);
+		return;
+	}
+
+	ShapeKey key = { SHAPE_SPHERE, rows, columns, { 0, 360, -90, 90 } };
+	addInstance(key, instanceTransform(center, transform, glm::vec3(radius)), fillColour, glm::vec4(1));
+}
+
+void Gizmos::addCapsule(const glm::vec3& center, float height, float radius,
+						int rows, int cols, const glm::vec4& fillColour, const glm::mat4* rotation) {
+
+	if (sm_singleton == nullptr)
+		return;
+
+	if (isMainThread() == false ||
+		sm_singleton->m_recording ||
+		rows <= 0 ||
+		cols <= 0) {
+		tessellateCapsule(center, height, radius, rows, cols, fillColour, rotation);
+		return;
+	}
+
+	// a capsule is two hemispheres and an open tube between them, the
+	// hemispheres split the sphere's rows the same way the tessellated one does
+	float sphereCenters = (height * 0.5f) - radius;
+	glm::mat4 orientation = rotation != nullptr ? glm::mat4(glm::mat3(*rotation)) : glm::mat4(1);
+	glm::vec3 base = rotation != nullptr ? center + glm::vec3((*rotation)[3]) : center;
+	glm::vec3 offset = glm::vec3(orientation * glm::vec4(0, sphereCenters, 0, 0));
+	glm::vec4 white(1);
+
+	int bottomRows = rows / 2;
+	float split = -90 + bottomRows * 180.0f / rows;
+
+	if (bottomRows > 0) {
+		ShapeKey bottom = { SHAPE_SPHERE, bottomRows, cols, { 0, 360, -90, split } };
+		addInstance(bottom, instanceTransform(base - offset, &orientation, glm::vec3(radius)), fillColour, white);
+	}
+
+	ShapeKey top = { SHAPE_SPHERE, rows - bottomRows, cols, { 0, 360, split, 90 } };
+	addInstance(top, instanceTransform(base + offset, &orientation, glm::vec3(radius)), fillColour, white);
+
+	ShapeKey tube = { SHAPE_TUBE, cols, 0, { 0, 0, 0, 0 } };
+	addInstance(tube, instanceTransform(base, &orientation, glm::vec3(radius, sphereCenters, radius)), fillColour, white);
+}
+
 void Gizmos::addHermiteSpline(const glm::vec3& start, const glm::vec3& end,
 	const glm::vec3& tangentStart, const glm::vec3& tangentEnd, unsigned int segments, const glm::vec4& colour) {
 
@@ -710,94 +966,102 @@ void Gizmos::addLine(const glm::vec3& v0,  const glm::vec3& v1, const glm::vec4&
 
 void Gizmos::addLine(const glm::vec3& v0, const glm::vec3& v1, const glm::vec4& colour0, const glm::vec4& colour1) {
 
-	if (sm_singleton != nullptr &&
-		sm_singleton->m_lineCount < sm_singleton->m_maxLines) {
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v0.x = v0.x;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v0.y = v0.y;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v0.z = v0.z;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v0.w = 1;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v0.r = colour0.r;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v0.g = colour0.g;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v0.b = colour0.b;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v0.a = colour0.a;
-
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v1.x = v1.x;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v1.y = v1.y;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v1.z = v1.z;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v1.w = 1;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v1.r = colour1.r;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v1.g = colour1.g;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v1.b = colour1.b;
-		sm_singleton->m_lines[sm_singleton->m_lineCount].v1.a = colour1.a;
-
-		sm_singleton->m_lineCount++;
+	if (sm_singleton != nullptr) {
+		GizmoLine& line = getLists().lines.push();
+		line.v0 = makeVertex(v0.x, v0.y, v0.z, colour0);
+		line.v1 = makeVertex(v1.x, v1.y, v1.z, colour1);
+	}
+}
+
+void Gizmos::addLines(const glm::vec3* points, unsigned int pointCount, const glm::vec4& colour) {
+
+	if (sm_singleton == nullptr)
+		return;
+
+	// write straight into the storage a run at a time
+	unsigned int lineCount = pointCount / 2;
+	GizmoLists& lists = getLists();
+	while (lineCount > 0) {
+		unsigned int pushed = 0;
+		GizmoLine* lines = lists.lines.push(lineCount, pushed);
+		for (unsigned int i = 0; i < pushed; ++i) {
+			lines[i].v0 = makeVertex(points[0].x, points[0].y, points[0].z, colour);
+			lines[i].v1 = makeVertex(points[1].x, points[1].y, points[1].z, colour);
+			points += 2;
+		}
+		lineCount -= pushed;
+	}
+}
+
+void Gizmos::addLines(const glm::vec3* points, const glm::vec4* colours, unsigned int pointCount) {
+
+	if (sm_singleton == nullptr)
+		return;
+
+	unsigned int lineCount = pointCount / 2;
+	GizmoLists& lists = getLists();
+	while (lineCount > 0) {
+		unsigned int pushed = 0;
+		GizmoLine* lines = lists.lines.push(lineCount, pushed);
+		for (unsigned int i = 0; i < pushed; ++i) {
+			lines[i].v0 = makeVertex(points[0].x, points[0].y, points[0].z, colours[0]);
+			lines[i].v1 = makeVertex(points[1].x, points[1].y, points[1].z, colours[1]);
+			points += 2;
+			colours += 2;
+		}
+		lineCount -= pushed;
+	}
+}
+
+void Gizmos::addLineStrip(const glm::vec3* points, unsigned int pointCount, const glm::vec4& colour) {
+
+	if (sm_singleton == nullptr ||
+		pointCount < 2)
+		return;
+
+	unsigned int lineCount = pointCount - 1;
+	GizmoLists& lists = getLists();
+	while (lineCount > 0) {
+		unsigned int pushed = 0;
+		GizmoLine* lines = lists.lines.push(lineCount, pushed);
+		for (unsigned int i = 0; i < pushed; ++i) {
+			lines[i].v0 = makeVertex(points[0].x, points[0].y, points[0].z, colour);
+			lines[i].v1 = makeVertex(points[1].x, points[1].y, points[1].z, colour);
+			points++;
+		}
+		lineCount -= pushed;
 	}
 }
 
 void Gizmos::addTri(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const glm::vec4& colour) {
 	if (sm_singleton != nullptr) {
-		if (colour.w == 1) {
-			if (sm_singleton->m_triCount < sm_singleton->m_maxTris) {
-				sm_singleton->m_tris[sm_singleton->m_triCount].v0.x = v0.x;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v0.y = v0.y;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v0.z = v0.z;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v0.w = 1;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v1.x = v1.x;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v1.y = v1.y;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v1.z = v1.z;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v1.w = 1;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v2.x = v2.x;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v2.y = v2.y;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v2.z = v2.z;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v2.w = 1;
-
-				sm_singleton->m_tris[sm_singleton->m_triCount].v0.r = colour.r;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v0.g = colour.g;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v0.b = colour.b;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v0.a = colour.a;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v1.r = colour.r;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v1.g = colour.g;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v1.b = colour.b;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v1.a = colour.a;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v2.r = colour.r;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v2.g = colour.g;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v2.b = colour.b;
-				sm_singleton->m_tris[sm_singleton->m_triCount].v2.a = colour.a;
-
-				sm_singleton->m_triCount++;
-			}
-		}
-		else {
-			if (sm_singleton->m_transparentTriCount < sm_singleton->m_maxTris) {
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v0.x = v0.x;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v0.y = v0.y;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v0.z = v0.z;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v0.w = 1;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v1.x = v1.x;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v1.y = v1.y;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v1.z = v1.z;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v1.w = 1;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v2.x = v2.x;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v2.y = v2.y;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v2.z = v2.z;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v2.w = 1;
-
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v0.r = colour.r;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v0.g = colour.g;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v0.b = colour.b;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v0.a = colour.a;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v1.r = colour.r;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v1.g = colour.g;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v1.b = colour.b;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v1.a = colour.a;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v2.r = colour.r;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v2.g = colour.g;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v2.b = colour.b;
-				sm_singleton->m_transparentTris[sm_singleton->m_transparentTriCount].v2.a = colour.a;
-
-				sm_singleton->m_transparentTriCount++;
-			}
+		GizmoLists& lists = getLists();
+		GizmoTri& tri = colour.w == 1 ? lists.tris.push() : lists.transparentTris.push();
+		tri.v0 = makeVertex(v0.x, v0.y, v0.z, colour);
+		tri.v1 = makeVertex(v1.x, v1.y, v1.z, colour);
+		tri.v2 = makeVertex(v2.x, v2.y, v2.z, colour);
+	}
+}
+
+void Gizmos::addTris(const glm::vec3* points, unsigned int pointCount, const glm::vec4& colour) {
+
+	if (sm_singleton == nullptr)
+		return;
+
+	GizmoLists& lists = getLists();
+	ChunkList<GizmoTri>& list = colour.w == 1 ? lists.tris : lists.transparentTris;
+
+	unsigned int triCount = pointCount / 3;
+	while (triCount > 0) {
+		unsigned int pushed = 0;
+		GizmoTri* tris = list.push(triCount, pushed);
+		for (unsigned int i = 0; i < pushed; ++i) {
+			tris[i].v0 = makeVertex(points[0].x, points[0].y, points[0].z, colour);
+			tris[i].v1 = makeVertex(points[1].x, points[1].y, points[1].z, colour);
+			tris[i].v2 = makeVertex(points[2].x, points[2].y, points[2].z, colour);
+			points += 3;
 		}
+		triCount -= pushed;
 	}
 }
 
@@ -872,26 +1136,10 @@ void Gizmos::add2DLine(const glm::vec2& rv0,  const glm::vec2& rv1, const glm::v
 }
 
 void Gizmos::add2DLine(const glm::vec2& rv0, const glm::vec2& rv1, const glm::vec4& colour0, const glm::vec4& colour1) {
-	if (sm_singleton != nullptr &&
-		sm_singleton->m_2DlineCount < sm_singleton->m_max2DLines) {
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.x = rv0.x;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.y = rv0.y;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.z = 1;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.w = 1;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.r = colour0.r;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.g = colour0.g;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.b = colour0.b;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v0.a = colour0.a;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.x = rv1.x;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.y = rv1.y;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.z = 1;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.w = 1;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.r = colour1.r;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.g = colour1.g;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.b = colour1.b;
-		sm_singleton->m_2Dlines[sm_singleton->m_2DlineCount].v1.a = colour1.a;
-
-		sm_singleton->m_2DlineCount++;
+	if (sm_singleton != nullptr) {
+		GizmoLine& line = getLists().lines2D.push();
+		line.v0 = makeVertex(rv0.x, rv0.y, 1, colour0);
+		line.v1 = makeVertex(rv1.x, rv1.y, 1, colour1);
 	}
 }
 
@@ -901,33 +1149,353 @@ void Gizmos::add2DTri(const glm::vec2& rv0, const glm::vec2& rv1, const glm::vec
 
 void Gizmos::add2DTri(const glm::vec2& rv0, const glm::vec2& rv1, const glm::vec2& rv2, const glm::vec4& colour0, const glm::vec4& colour1, const glm::vec4& colour2) {
 	if (sm_singleton != nullptr) {
-		if (sm_singleton->m_2DtriCount < sm_singleton->m_max2DTris) {
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.x = rv0.x;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.y = rv0.y;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.z = 1;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.w = 1;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.x = rv1.x;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.y = rv1.y;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.z = 1;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.w = 1;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.x = rv2.x;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.y = rv2.y;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.z = 1;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.w = 1;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.r = colour0.r;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.g = colour0.g;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.b = colour0.b;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v0.a = colour0.a;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.r = colour1.r;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.g = colour1.g;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.b = colour1.b;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v1.a = colour1.a;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.r = colour2.r;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.g = colour2.g;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.b = colour2.b;
-			sm_singleton->m_2Dtris[sm_singleton->m_2DtriCount].v2.a = colour2.a;
-
-			sm_singleton->m_2DtriCount++;
+		GizmoTri& tri = getLists().tris2D.push();
+		tri.v0 = makeVertex(rv0.x, rv0.y, 1, colour0);
+		tri.v1 = makeVertex(rv1.x, rv1.y, 1, colour1);
+		tri.v2 = makeVertex(rv2.x, rv2.y, 1, colour2);
+	}
+}
+
+Gizmos::UnitShape* Gizmos::getUnitShape(const ShapeKey& key) {
+
+	auto iter = m_shapes.find(key);
+	if (iter != m_shapes.end())
+		return iter->second;
+
+	// tessellate the shape at unit size through the CPU path,
+	// then take the positions back out of this frame's lists
+	unsigned int lineStart = m_frame.lines.size();
+	unsigned int triStart = m_frame.tris.size();
+	glm::vec3 origin(0);
+	glm::vec4 white(1);
+
+	switch (key.type) {
+	case SHAPE_SPHERE:
+		tessellateSphere(origin, 1, key.rows, key.columns, white, nullptr, key.range[0], key.range[1], key.range[2], key.range[3]);
+		break;
+	case SHAPE_CYLINDER:
+		tessellateCylinderFilled(origin, 1, 1, key.rows, white, nullptr);
+		break;
+	case SHAPE_TUBE: {
+		for (int i = 0; i < key.rows; ++i) {
+			float x = (float)i / (float)key.rows;
+			float x1 = (float)(i+1) / (float)key.rows;
+			x *= 2.0f * glm::pi<float>();
+			x1 *= 2.0f * glm::pi<float>();
+
+			glm::vec3 pos = glm::vec3(cosf(x), 0, sinf(x));
+			glm::vec3 pos1 = glm::vec3(cosf(x1), 0, sinf(x1));
+			glm::vec3 up(0, 1, 0);
+
+			addTri(up + pos1, -up + pos1, -up + pos, white);
+			addTri(up + pos1, -up + pos, up + pos, white);
+
+			addLine(up + pos, up + pos1, white, white);
+			addLine(-up + pos, -up + pos1, white, white);
+			addLine(up + pos, -up + pos, white, white);
+		}
+		break;
+	}
+	case SHAPE_DISK:
+		tessellateDisk(origin, 1, key.rows, key.columns != 0 ? white : glm::vec4(1, 1, 1, 0), nullptr);
+		break;
+	case SHAPE_BOX:
+		tessellateAABBFilled(origin, glm::vec3(1), white, nullptr);
+		break;
+	default:	break;
+	};
+
+	unsigned int lineCount = m_frame.lines.size() - lineStart;
+	unsigned int triCount = m_frame.tris.size() - triStart;
+
+	std::vector<GizmoVertex> vertices(lineCount * 2 + triCount * 3);
+	m_frame.lines.copyTo((GizmoLine*)vertices.data(), lineStart, lineCount);
+	m_frame.tris.copyTo((GizmoTri*)(vertices.data() + lineCount * 2), triStart, triCount);
+	m_frame.lines.truncate(lineStart);
+	m_frame.tris.truncate(triStart);
+
+	std::vector<glm::vec4> positions(vertices.size());
+	for (unsigned int i = 0; i < vertices.size(); ++i)
+		positions[i] = glm::vec4(vertices[i].x, vertices[i].y, vertices[i].z, 1);
+
+	UnitShape* shape = new UnitShape();
+	shape->lineVertices = lineCount * 2;
+	shape->triVertices = triCount * 3;
+	shape->opaqueBase = 0;
+	shape->transparentBase = 0;
+
+	glGenBuffers(1, &shape->vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, shape->vbo);
+	glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(glm::vec4), positions.data(), GL_STATIC_DRAW);
+
+	glGenVertexArrays(1, &shape->vao);
+	glBindVertexArray(shape->vao);
+	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(glm::vec4), 0);
+
+	// instances are streamed each frame and found with a base instance
+	for (unsigned int i = 0; i < 6; ++i) {
+		glEnableVertexAttribArray(1 + i);
+		glVertexAttribDivisor(1 + i, 1);
+	}
+	bindInstanceBuffer(shape, m_instanceBuffer);
+
+	m_shapes[key] = shape;
+	return shape;
+}
+
+void Gizmos::bindInstanceBuffer(UnitShape* shape, unsigned int buffer) {
+
+	glBindVertexArray(shape->vao);
+	glBindBuffer(GL_ARRAY_BUFFER, buffer);
+	for (unsigned int i = 0; i < 6; ++i)
+		glVertexAttribPointer(1 + i, 4, GL_FLOAT, GL_FALSE, sizeof(GizmoInstance), (void*)(uintptr_t)(i * sizeof(glm::vec4)));
+
+	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Gizmos::addInstance(const ShapeKey& key, const glm::mat4& transform, const glm::vec4& fillColour, const glm::vec4& lineColour) {
+
+	UnitShape* shape = sm_singleton->getUnitShape(key);
+
+	GizmoInstance instance;
+	memcpy(instance.transform, glm::value_ptr(transform), sizeof(instance.transform));
+	memcpy(instance.fillColour, glm::value_ptr(fillColour), sizeof(instance.fillColour));
+	memcpy(instance.lineColour, glm::value_ptr(lineColour), sizeof(instance.lineColour));
+
+	// same rule as addTri, only fully opaque fills skip the transparent pass
+	if (fillColour.w == 1 ||
+		shape->triVertices == 0) {
+		shape->opaqueInstances.push_back(instance);
+		sm_singleton->m_opaqueInstanceCount++;
+	}
+	else {
+		shape->transparentInstances.push_back(instance);
+		sm_singleton->m_transparentInstanceCount++;
+	}
+}
+
+void Gizmos::uploadInstances() {
+
+	unsigned int total = m_opaqueInstanceCount + m_transparentInstanceCount;
+
+	unsigned int offset = 0;
+	GizmoInstance* destination = (GizmoInstance*)StreamBuffer::getInstance()->allocate(total * sizeof(GizmoInstance), sizeof(GizmoInstance), offset);
+	unsigned int buffer = StreamBuffer::getInstance()->getHandle();
+
+	// out of stream space, gather them to upload on their own rather than lose them
+	std::vector<GizmoInstance> fallback;
+	if (destination == nullptr) {
+		static bool warned = false;
+		if (warned == false)
+			printf("Gizmos: stream buffer full, uploading instances directly\n");
+		warned = true;
+
+		fallback.resize(total);
+		destination = fallback.data();
+		buffer = m_fallbackInstanceVbo;
+		offset = 0;
+	}
+
+	unsigned int base = offset / sizeof(GizmoInstance);
+
+	for (auto& iter : m_shapes) {
+		UnitShape* shape = iter.second;
+
+		shape->opaqueBase = base;
+		if (shape->opaqueInstances.empty() == false)
+			memcpy(destination, shape->opaqueInstances.data(), shape->opaqueInstances.size() * sizeof(GizmoInstance));
+		destination += shape->opaqueInstances.size();
+		base += (unsigned int)shape->opaqueInstances.size();
+
+		shape->transparentBase = base;
+		if (shape->transparentInstances.empty() == false)
+			memcpy(destination, shape->transparentInstances.data(), shape->transparentInstances.size() * sizeof(GizmoInstance));
+		destination += shape->transparentInstances.size();
+		base += (unsigned int)shape->transparentInstances.size();
+	}
+
+	if (fallback.empty() == false) {
+		glBindBuffer(GL_ARRAY_BUFFER, m_fallbackInstanceVbo);
+		glBufferData(GL_ARRAY_BUFFER, fallback.size() * sizeof(GizmoInstance), fallback.data(), GL_STREAM_DRAW);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
+	// the shapes only need pointing at the other buffer when it changes
+	if (buffer != m_instanceBuffer) {
+		for (auto& iter : m_shapes)
+			bindInstanceBuffer(iter.second, buffer);
+		m_instanceBuffer = buffer;
+	}
+}
+
+void Gizmos::drawInstances(bool transparent) {
+
+	glUseProgram(m_instanceShader);
+
+	for (auto& iter : m_shapes) {
+		UnitShape* shape = iter.second;
+		GLsizei opaqueCount = (GLsizei)shape->opaqueInstances.size();
+		GLsizei transparentCount = (GLsizei)shape->transparentInstances.size();
+
+		if (opaqueCount + transparentCount == 0)
+			continue;
+
+		glBindVertexArray(shape->vao);
+
+		if (transparent == false) {
+			// every instance's outline is drawn with the opaque geometry
+			if (shape->lineVertices > 0) {
+				glUniform1i(m_instanceDrawLinesUniform, 1);
+				if (opaqueCount > 0)
+					glDrawArraysInstancedBaseInstance(GL_LINES, 0, shape->lineVertices, opaqueCount, shape->opaqueBase);
+				if (transparentCount > 0)
+					glDrawArraysInstancedBaseInstance(GL_LINES, 0, shape->lineVertices, transparentCount, shape->transparentBase);
+			}
+
+			if (shape->triVertices > 0 &&
+				opaqueCount > 0) {
+				glUniform1i(m_instanceDrawLinesUniform, 0);
+				glDrawArraysInstancedBaseInstance(GL_TRIANGLES, shape->lineVertices, shape->triVertices, opaqueCount, shape->opaqueBase);
+			}
+		}
+		else if (shape->triVertices > 0 &&
+				 transparentCount > 0) {
+			glUniform1i(m_instanceDrawLinesUniform, 0);
+			glDrawArraysInstancedBaseInstance(GL_TRIANGLES, shape->lineVertices, shape->triVertices, transparentCount, shape->transparentBase);
+		}
+	}
+
+	glUseProgram(m_shader);
+}
+
+void Gizmos::GizmoLists::clear() {
+	lines.clear();
+	tris.clear();
+	transparentTris.clear();
+	lines2D.clear();
+	tris2D.clear();
+}
+
+void Gizmos::GizmoLists::append(const GizmoLists& other) {
+	lines.append(other.lines);
+	tris.append(other.tris);
+	transparentTris.append(other.transparentTris);
+	lines2D.append(other.lines2D);
+	tris2D.append(other.tris2D);
+}
+
+bool Gizmos::isMainThread() {
+	return std::this_thread::get_id() == sm_singleton->m_mainThread;
+}
+
+Gizmos::ThreadLists* Gizmos::getThreadLists() {
+
+	if (t_threadLists != nullptr &&
+		t_threadGeneration == sm_generation)
+		return (ThreadLists*)t_threadLists;
+
+	// first Gizmo from this thread, only registering needs the lock
+	ThreadLists* thread = new ThreadLists();
+
+	std::lock_guard<std::mutex> lock(sm_singleton->m_threadMutex);
+	thread->slot = NO_SLOT;
+	sm_singleton->m_threads.push_back(thread);
+
+	t_threadLists = thread;
+	t_threadGeneration = sm_generation;
+	return thread;
+}
+
+Gizmos::GizmoLists& Gizmos::getLists() {
+	if (isMainThread())
+		return sm_singleton->m_frame;
+
+	ThreadLists* thread = getThreadLists();
+	assert(thread->slot != NO_SLOT && "Gizmos::setThreadSlot() must be called before adding Gizmos from another thread");
+	return thread->lists;
+}
+
+void Gizmos::setThreadSlot(unsigned int slot) {
+	if (sm_singleton != nullptr &&
+		isMainThread() == false)
+		getThreadLists()->slot = slot;
+}
+
+void Gizmos::mergeThreads() {
+
+	std::lock_guard<std::mutex> lock(m_threadMutex);
+
+	if (m_threads.empty())
+		return;
+
+	// slots are stable and unique, so the order never depends on how
+	// the threads' work was interleaved
+	std::vector<ThreadLists*> ordered = m_threads;
+	std::stable_sort(ordered.begin(), ordered.end(), [](const ThreadLists* a, const ThreadLists* b) {
+		return a->slot < b->slot;
+	});
+
+	for (unsigned int i = 1; i < ordered.size(); ++i)
+		assert((ordered[i]->slot != ordered[i - 1]->slot || ordered[i]->slot == NO_SLOT) &&
+			"two threads adding Gizmos share a slot");
+
+	for (auto thread : ordered) {
+		m_frame.append(thread->lists);
+		thread->lists.clear();
+	}
+}
+
+Gizmos::GizmoVertex Gizmos::makeVertex(float x, float y, float z, const glm::vec4& colour) {
+	GizmoVertex vertex = { x, y, z, 1, colour.r, colour.g, colour.b, colour.a };
+	return vertex;
+}
+
+template <typename T>
+void Gizmos::drawStreamed(unsigned int primitive, const ChunkList<T>& list, unsigned int verticesPerElement) {
+
+	unsigned int offset = 0;
+	T* destination = (T*)StreamBuffer::getInstance()->allocate(list.size() * sizeof(T), sizeof(GizmoVertex), offset);
+	if (destination != nullptr) {
+		list.copyTo(destination, 0, list.size());
+		glBindVertexArray(m_vao);
+		glDrawArrays(primitive, offset / sizeof(GizmoVertex), list.size() * verticesPerElement);
+		return;
+	}
+
+	// out of stream space, upload this list on its own rather than lose it
+	static bool warned = false;
+	if (warned == false)
+		printf("Gizmos: stream buffer full, uploading lists directly\n");
+	warned = true;
+
+	std::vector<T> vertices(list.size());
+	list.copyTo(vertices.data(), 0, list.size());
+
+	glBindVertexArray(m_fallbackVao);
+	glBindBuffer(GL_ARRAY_BUFFER, m_fallbackVbo);
+	glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(T), vertices.data(), GL_STREAM_DRAW);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+	glDrawArrays(primitive, 0, list.size() * verticesPerElement);
+}
+
+void Gizmos::drawRetained(bool transparent) {
+
+	for (auto& retained : m_retained) {
+		if (retained.alive == false)
+			continue;
+
+		glBindVertexArray(retained.vao);
+		if (transparent) {
+			if (retained.transparentVertices > 0)
+				glDrawArrays(GL_TRIANGLES, retained.lineVertices + retained.triVertices, retained.transparentVertices);
+		}
+		else {
+			if (retained.lineVertices > 0)
+				glDrawArrays(GL_LINES, 0, retained.lineVertices);
+			if (retained.triVertices > 0)
+				glDrawArrays(GL_TRIANGLES, retained.lineVertices, retained.triVertices);
 		}
 	}
 }
@@ -937,10 +1505,16 @@ void Gizmos::draw(const glm::mat4& projection, const glm::mat4& view) {
 }
 
 void Gizmos::draw(const glm::mat4& projectionView) {
+
+	if (sm_singleton != nullptr)
+		sm_singleton->mergeThreads();
 	if ( sm_singleton != nullptr && 
-		(sm_singleton->m_lineCount > 0 || 
-		 sm_singleton->m_triCount > 0 || 
-		 sm_singleton->m_transparentTriCount > 0)) {
+		(sm_singleton->m_frame.lines.size() > 0 || 
+		 sm_singleton->m_frame.tris.size() > 0 || 
+		 sm_singleton->m_frame.transparentTris.size() > 0 ||
+		 sm_singleton->m_retainedCount > 0 ||
+		 sm_singleton->m_opaqueInstanceCount > 0 ||
+		 sm_singleton->m_transparentInstanceCount > 0)) {
 		int shader = 0;
 		glGetIntegerv(GL_CURRENT_PROGRAM, &shader);
 
@@ -949,23 +1523,31 @@ void Gizmos::draw(const glm::mat4& projectionView) {
 		unsigned int projectionViewUniform = glGetUniformLocation(sm_singleton->m_shader,"ProjectionView");
 		glUniformMatrix4fv(projectionViewUniform, 1, false, glm::value_ptr(projectionView));
 
-		if (sm_singleton->m_lineCount > 0) {
-			glBindBuffer(GL_ARRAY_BUFFER, sm_singleton->m_lineVBO);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sm_singleton->m_lineCount * sizeof(GizmoLine), sm_singleton->m_lines);
-
-			glBindVertexArray(sm_singleton->m_lineVAO);
-			glDrawArrays(GL_LINES, 0, sm_singleton->m_lineCount * 2);
+		bool instances = sm_singleton->m_opaqueInstanceCount > 0 ||
+						 sm_singleton->m_transparentInstanceCount > 0;
+		if (instances) {
+			sm_singleton->uploadInstances();
+			glUseProgram(sm_singleton->m_instanceShader);
+			glUniformMatrix4fv(sm_singleton->m_instanceProjectionViewUniform, 1, false, glm::value_ptr(projectionView));
+			glUseProgram(sm_singleton->m_shader);
 		}
 
-		if (sm_singleton->m_triCount > 0) {
-			glBindBuffer(GL_ARRAY_BUFFER, sm_singleton->m_triVBO);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sm_singleton->m_triCount * sizeof(GizmoTri), sm_singleton->m_tris);
+		sm_singleton->drawRetained(false);
+
+		if (sm_singleton->m_frame.lines.size() > 0) {
+			sm_singleton->drawStreamed(GL_LINES, sm_singleton->m_frame.lines, 2);
+		}
 
-			glBindVertexArray(sm_singleton->m_triVAO);
-			glDrawArrays(GL_TRIANGLES, 0, sm_singleton->m_triCount * 3);
+		if (sm_singleton->m_frame.tris.size() > 0) {
+			sm_singleton->drawStreamed(GL_TRIANGLES, sm_singleton->m_frame.tris, 3);
 		}
+
+		if (instances)
+			sm_singleton->drawInstances(false);
 		
-		if (sm_singleton->m_transparentTriCount > 0) {
+		if (sm_singleton->m_frame.transparentTris.size() > 0 ||
+			sm_singleton->m_retainedTransparentCount > 0 ||
+			(instances && sm_singleton->m_transparentInstanceCount > 0)) {
 			// not ideal to store these, but Gizmos must work stand-alone
 			GLboolean blendEnabled = glIsEnabled(GL_BLEND);
 			GLboolean depthMask = GL_TRUE;
@@ -981,11 +1563,13 @@ void Gizmos::draw(const glm::mat4& projectionView) {
 			glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 			glDepthMask(GL_FALSE);
 
-			glBindBuffer(GL_ARRAY_BUFFER, sm_singleton->m_transparentTriVBO);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sm_singleton->m_transparentTriCount * sizeof(GizmoTri), sm_singleton->m_transparentTris);
+			sm_singleton->drawRetained(true);
 
-			glBindVertexArray(sm_singleton->m_transparentTriVAO);
-			glDrawArrays(GL_TRIANGLES, 0, sm_singleton->m_transparentTriCount * 3);
+			if (instances)
+				sm_singleton->drawInstances(true);
+
+			if (sm_singleton->m_frame.transparentTris.size() > 0)
+				sm_singleton->drawStreamed(GL_TRIANGLES, sm_singleton->m_frame.transparentTris, 3);
 
 			// reset state
 			glDepthMask(depthMask);
@@ -1003,9 +1587,12 @@ void Gizmos::draw2D(float screenWidth, float screenHeight) {
 }
 
 void Gizmos::draw2D(const glm::mat4& projection) {
+
+	if (sm_singleton != nullptr)
+		sm_singleton->mergeThreads();
 	if ( sm_singleton != nullptr && 
-		(sm_singleton->m_2DlineCount > 0 || 
-		 sm_singleton->m_2DtriCount > 0)) {
+		(sm_singleton->m_frame.lines2D.size() > 0 || 
+		 sm_singleton->m_frame.tris2D.size() > 0)) {
 		int shader = 0;
 		glGetIntegerv(GL_CURRENT_PROGRAM, &shader);
 
@@ -1014,15 +1601,11 @@ void Gizmos::draw2D(const glm::mat4& projection) {
 		unsigned int projectionViewUniform = glGetUniformLocation(sm_singleton->m_shader,"ProjectionView");
 		glUniformMatrix4fv(projectionViewUniform, 1, false, glm::value_ptr(projection));
 
-		if (sm_singleton->m_2DlineCount > 0) {
-			glBindBuffer(GL_ARRAY_BUFFER, sm_singleton->m_2DlineVBO);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sm_singleton->m_2DlineCount * sizeof(GizmoLine), sm_singleton->m_2Dlines);
-
-			glBindVertexArray(sm_singleton->m_2DlineVAO);
-			glDrawArrays(GL_LINES, 0, sm_singleton->m_2DlineCount * 2);
+		if (sm_singleton->m_frame.lines2D.size() > 0) {
+			sm_singleton->drawStreamed(GL_LINES, sm_singleton->m_frame.lines2D, 2);
 		}
 
-		if (sm_singleton->m_2DtriCount > 0) {
+		if (sm_singleton->m_frame.tris2D.size() > 0) {
 			GLboolean blendEnabled = glIsEnabled(GL_BLEND);
 
 			GLboolean depthMask = GL_TRUE;
@@ -1039,11 +1622,7 @@ void Gizmos::draw2D(const glm::mat4& projection) {
 
 			glDepthMask(GL_FALSE);
 
-			glBindBuffer(GL_ARRAY_BUFFER, sm_singleton->m_2DtriVBO);
-			glBufferSubData(GL_ARRAY_BUFFER, 0, sm_singleton->m_2DtriCount * sizeof(GizmoTri), sm_singleton->m_2Dtris);
-
-			glBindVertexArray(sm_singleton->m_2DtriVAO);
-			glDrawArrays(GL_TRIANGLES, 0, sm_singleton->m_2DtriCount * 3);
+			sm_singleton->drawStreamed(GL_TRIANGLES, sm_singleton->m_frame.tris2D, 3);
 
 			glDepthMask(depthMask);
 
@@ -1,20 +1,46 @@
 #pragma once
 
 #include <glm/fwd.hpp>
+#include <vector>
+#include <map>
+#include <cstring>
+#include <mutex>
+#include <thread>
 
 namespace aie {
 
-// a singleton class for rendering immediate-mode 3-D primitives
+// a singleton class for rendering immediate-mode 3-D primitives.
+// spheres, capsules, cylinders, disks and filled boxes are drawn instanced
+// from unit meshes that are tessellated once per tessellation level.
+// Gizmos can be added from any thread, each thread appends to its own lists
+// without locking and they are merged into the frame when drawn. other threads
+// must have finished adding before clear() or draw() are called on the main thread
 class Gizmos {
 public:
 
+	// the counts are how many primitives to make room for up front,
+	// storage grows past them as needed
 	static void		create(unsigned int maxLines, unsigned int maxTris,
 						   unsigned int max2DLines, unsigned int max2DTris);
 	static void		destroy();
 
-	// removes all Gizmos
+	// removes all Gizmos, retained Gizmos are kept
 	static void		clear();
 
+	// Gizmos from other threads are drawn after the main thread's, ordered by slot.
+	// any other thread must set a slot that is stable between runs (i.e. a job index)
+	// and unique among the threads adding Gizmos before it adds any, so the draw
+	// order never depends on how the threads were scheduled
+	static void		setThreadSlot(unsigned int slot);
+
+	// retained Gizmos are built once and then drawn by draw() every frame until destroyed.
+	// all 3-D Gizmos added between beginRetained() and endRetained() are uploaded to the
+	// GPU under the returned handle instead of being drawn for just this frame.
+	// only Gizmos added from the main thread are recorded
+	static void			beginRetained();
+	static unsigned int	endRetained();
+	static void			destroyRetained(unsigned int handle);
+
 	// draws current Gizmo buffers, either using a combined (projection * view) matrix, or separate matrices
 	static void		draw(const glm::mat4& projectionView);
 	static void		draw(const glm::mat4& projection, const glm::mat4& view);
@@ -29,9 +55,19 @@ public:
 	// adds a single debug line
 	static void		addLine(const glm::vec3& v0, const glm::vec3& v1, const glm::vec4& colour0, const glm::vec4& colour1);
 
+	// adds a line between each pair of points
+	static void		addLines(const glm::vec3* points, unsigned int pointCount, const glm::vec4& colour);
+	static void		addLines(const glm::vec3* points, const glm::vec4* colours, unsigned int pointCount);
+
+	// adds a connected line through all of the points
+	static void		addLineStrip(const glm::vec3* points, unsigned int pointCount, const glm::vec4& colour);
+
 	// adds a triangle
 	static void		addTri(const glm::vec3& v0, const glm::vec3& v1, const glm::vec3& v2, const glm::vec4& colour);
 
+	// adds a triangle for every 3 points
+	static void		addTris(const glm::vec3* points, unsigned int pointCount, const glm::vec4& colour);
+
 	// adds 3 unit-length lines (red,green,blue) representing the 3 axis of a transform, 
 	// at the transform's translation. Optional scale available
 	static void		addTransform(const glm::mat4& transform, float scale = 1.0f);
@@ -113,47 +149,215 @@ private:
 		GizmoVertex v2;
 	};
 
-	unsigned int	m_shader;
+	static GizmoVertex	makeVertex(float x, float y, float z, const glm::vec4& colour);
+
+	// CPU tessellated versions of the instanced shapes, used to build the unit
+	// meshes and for retained Gizmos which are baked into their own buffer
+	static void		tessellateAABBFilled(const glm::vec3& center, const glm::vec3& extents, 
+										 const glm::vec4& fillColour, const glm::mat4* transform);
+	static void		tessellateCylinderFilled(const glm::vec3& center, float radius, float halfLength,
+											 unsigned int segments, const glm::vec4& fillColour, const glm::mat4* transform);
+	static void		tessellateDisk(const glm::vec3& center, float radius,
+								   unsigned int segments, const glm::vec4& fillColour, const glm::mat4* transform);
+	static void		tessellateSphere(const glm::vec3& center, float radius, int rows, int columns, const glm::vec4& fillColour, 
+									 const glm::mat4* transform, float longMin, float longMax, float latMin, float latMax);
+	static void		tessellateCapsule(const glm::vec3& center, float height, float radius,
+									  int rows, int cols, const glm::vec4& fillColour, const glm::mat4* rotation);
+
+	enum eShapeType : unsigned int {
+		SHAPE_SPHERE = 0,
+		SHAPE_CYLINDER,
+		SHAPE_TUBE,			// open ended cylinder used for capsules
+		SHAPE_DISK,
+		SHAPE_BOX,
+
+		SHAPE_Count,
+	};
 
-	// line data
-	unsigned int	m_maxLines;
-	unsigned int	m_lineCount;
-	GizmoLine*		m_lines;
+	// identifies a unit mesh by its shape and tessellation. the range is only
+	// partial for capsule halves, which split by row count alone, so the cache
+	// can't grow with arbitrary ranges
+	struct ShapeKey {
+		unsigned int	type;
+		int				rows, columns;
+		float			range[4];
 
-	unsigned int	m_lineVAO;
-	unsigned int 	m_lineVBO;
+		bool operator < (const ShapeKey& other) const;
+	};
 
-	// triangle data
-	unsigned int	m_maxTris;
-	unsigned int	m_triCount;
-	GizmoTri*		m_tris;
+	struct GizmoInstance {
+		float	transform[16];
+		float	fillColour[4];
+		float	lineColour[4];
+	};
 
-	unsigned int	m_triVAO;
-	unsigned int 	m_triVBO;
-	
-	unsigned int	m_transparentTriCount;
-	GizmoTri*		m_transparentTris;
+	// a shape tessellated once at unit size, its lines followed by its triangles,
+	// and the instances of it added this frame
+	struct UnitShape {
+		unsigned int	vao, vbo;
+		unsigned int	lineVertices;
+		unsigned int	triVertices;
+		std::vector<GizmoInstance>	opaqueInstances;
+		std::vector<GizmoInstance>	transparentInstances;
+		unsigned int	opaqueBase, transparentBase;
+	};
 
-	unsigned int	m_transparentTriVAO;
-	unsigned int 	m_transparentTriVBO;
-	
-	// 2D line data
-	unsigned int	m_max2DLines;
-	unsigned int	m_2DlineCount;
-	GizmoLine*		m_2Dlines;
+	UnitShape*		getUnitShape(const ShapeKey& key);
+	static void		addInstance(const ShapeKey& key, const glm::mat4& transform, const glm::vec4& fillColour, const glm::vec4& lineColour);
+
+	// copies every instance into the stream buffer, or the fallback buffer if there wasn't room
+	void			uploadInstances();
+	void			drawInstances(bool transparent);
+
+	// points a shape's instance attributes at a buffer
+	void			bindInstanceBuffer(UnitShape* shape, unsigned int buffer);
+
+	// growable storage that hands out runs of elements within fixed size chunks,
+	// so adding never moves what has already been written
+	template <typename T>
+	class ChunkList {
+	public:
+
+		enum { CHUNK_SIZE = 4096 };
+
+		ChunkList() : m_count(0) {}
+		~ChunkList() { for (auto chunk : m_chunks) delete[] chunk; }
+
+		unsigned int	size() const			{ return m_count; }
+		void			clear()					{ m_count = 0; }
+		void			truncate(unsigned int count) { if (count < m_count) m_count = count; }
+
+		// makes sure there is room for count elements without allocating
+		void			reserve(unsigned int count) {
+			while (m_chunks.size() * CHUNK_SIZE < count)
+				m_chunks.push_back(new T[CHUNK_SIZE]);
+		}
+
+		// returns room for up to count contiguous elements, pushed is how many it was
+		T*				push(unsigned int count, unsigned int& pushed) {
+			unsigned int chunk = m_count / CHUNK_SIZE;
+			unsigned int offset = m_count % CHUNK_SIZE;
+			if (chunk >= m_chunks.size())
+				m_chunks.push_back(new T[CHUNK_SIZE]);
+			pushed = count < CHUNK_SIZE - offset ? count : CHUNK_SIZE - offset;
+			m_count += pushed;
+			return m_chunks[chunk] + offset;
+		}
+		T&				push() { unsigned int pushed = 0; return *push(1, pushed); }
+
+		// adds a copy of every element in another list
+		void			append(const ChunkList& other) {
+			unsigned int first = 0;
+			while (first < other.size()) {
+				unsigned int pushed = 0;
+				T* destination = push(other.size() - first, pushed);
+				other.copyTo(destination, first, pushed);
+				first += pushed;
+			}
+		}
+
+		// copies count elements, starting with first, into destination
+		void			copyTo(T* destination, unsigned int first, unsigned int count) const {
+			while (count > 0) {
+				unsigned int offset = first % CHUNK_SIZE;
+				unsigned int run = count < CHUNK_SIZE - offset ? count : CHUNK_SIZE - offset;
+				memcpy(destination, m_chunks[first / CHUNK_SIZE] + offset, run * sizeof(T));
+				destination += run;
+				first += run;
+				count -= run;
+			}
+		}
+
+	private:
+
+		std::vector<T*>	m_chunks;
+		unsigned int	m_count;
+	};
+
+	// all of the primitives added by one thread
+	struct GizmoLists {
+		ChunkList<GizmoLine>	lines;
+		ChunkList<GizmoTri>		tris;
+		ChunkList<GizmoTri>		transparentTris;
+		ChunkList<GizmoLine>	lines2D;
+		ChunkList<GizmoTri>		tris2D;
+
+		void	clear();
+		void	append(const GizmoLists& other);
+	};
+
+	// another thread's lists, the slot is NO_SLOT until setThreadSlot() is called
+	static const unsigned int NO_SLOT = 0xffffffff;
+	struct ThreadLists {
+		GizmoLists		lists;
+		unsigned int	slot;
+	};
 
-	unsigned int	m_2DlineVAO;
-	unsigned int 	m_2DlineVBO;
+	static bool			isMainThread();
+	static ThreadLists*	getThreadLists();
 
-	// 2D triangle data
-	unsigned int	m_max2DTris;
-	unsigned int	m_2DtriCount;
-	GizmoTri*		m_2Dtris;
+	// the lists the calling thread adds to
+	static GizmoLists&	getLists();
 
-	unsigned int	m_2DtriVAO;
-	unsigned int 	m_2DtriVBO;
+	// appends every other thread's Gizmos to the frame
+	void			mergeThreads();
+
+	// geometry uploaded once by endRetained()
+	struct RetainedGizmo {
+		unsigned int	vao, vbo;
+		unsigned int	lineVertices;
+		unsigned int	triVertices;
+		unsigned int	transparentVertices;
+		bool			alive;
+	};
+
+	// copies a list into the shared stream buffer and draws it
+	template <typename T>
+	void			drawStreamed(unsigned int primitive, const ChunkList<T>& list, unsigned int verticesPerElement);
+
+	void			drawRetained(bool transparent);
+
+	unsigned int	m_shader;
 
-	static Gizmos*	sm_singleton;
+	// every gizmo list shares one vertex layout, streamed per frame
+	unsigned int	m_vao;
+
+	// used when the stream buffer is full, uploaded with glBufferData instead
+	unsigned int	m_fallbackVao, m_fallbackVbo;
+	unsigned int	m_fallbackInstanceVbo;
+
+	// the buffer the shapes' instance attributes are reading from
+	unsigned int	m_instanceBuffer;
+
+	// instanced shapes
+	unsigned int	m_instanceShader;
+	int				m_instanceProjectionViewUniform;
+	int				m_instanceDrawLinesUniform;
+	std::map<ShapeKey, UnitShape*>	m_shapes;
+	unsigned int	m_opaqueInstanceCount;
+	unsigned int	m_transparentInstanceCount;
+
+	// line and triangle data for this frame, from the main thread and merged from the others
+	GizmoLists		m_frame;
+
+	// lists registered by other threads, the mutex only guards the array
+	std::thread::id				m_mainThread;
+	std::mutex					m_threadMutex;
+	std::vector<ThreadLists*>	m_threads;
+
+	// retained data, handles are an index + 1
+	std::vector<RetainedGizmo>	m_retained;
+	unsigned int	m_retainedCount;
+	unsigned int	m_retainedTransparentCount;
+
+	// where the lists were when beginRetained() was called
+	bool			m_recording;
+	unsigned int	m_recordLineStart;
+	unsigned int	m_recordTriStart;
+	unsigned int	m_recordTransparentTriStart;
+
+	static Gizmos*		sm_singleton;
+	static unsigned int	sm_generation;
 };
 
 } // namespace aie
\ No newline at end of file
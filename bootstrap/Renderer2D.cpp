@@ -3,11 +3,53 @@
 #include "Renderer2D.h"
 #include "Texture.h"
 #include "Font.h"
+#include "StreamBuffer.h"
+#include "SpriteAtlas.h"
 #include <glm/ext.hpp>
-#include <stb_truetype.h>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
 
 namespace aie {
 
+// builds a sprite shader program, attribute names are bound to their index in the array
+static unsigned int createSpriteProgram(const char* vertexShader, const char* fragmentShader,
+										const char* const* attributes, unsigned int attributeCount) {
+
+	unsigned int vs = glCreateShader(GL_VERTEX_SHADER);
+	unsigned int fs = glCreateShader(GL_FRAGMENT_SHADER);
+
+	glShaderSource(vs, 1, (const char**)&vertexShader, 0);
+	glCompileShader(vs);
+
+	glShaderSource(fs, 1, (const char**)&fragmentShader, 0);
+	glCompileShader(fs);
+
+	unsigned int program = glCreateProgram();
+	glAttachShader(program, vs);
+	glAttachShader(program, fs);
+	for (unsigned int i = 0; i < attributeCount; ++i)
+		glBindAttribLocation(program, i, attributes[i]);
+	glLinkProgram(program);
+
+	int success = GL_FALSE;
+	glGetProgramiv(program, GL_LINK_STATUS, &success);
+	if (success == GL_FALSE) {
+		int infoLogLength = 0;
+		glGetProgramiv(program, GL_INFO_LOG_LENGTH, &infoLogLength);
+		char* infoLog = new char[infoLogLength];
+
+		glGetProgramInfoLog(program, infoLogLength, 0, infoLog);
+		printf("Error: Failed to link SpriteBatch shader program!\n%s\n", infoLog);
+		delete[] infoLog;
+	}
+
+	glDeleteShader(vs);
+	glDeleteShader(fs);
+
+	return program;
+}
+
 Renderer2D::Renderer2D() {
 
 	setRenderColour(1,1,1,1);
@@ -20,20 +62,47 @@ Renderer2D::Renderer2D() {
 	m_nullTexture = new Texture(1, 1, Texture::RGBA, (unsigned char*)pixels);
 
 	m_currentVertex = 0;
-	m_currentIndex = 0;
 	m_renderBegun = false;
 
+	// vertices are written straight into the stream buffer between begin() and end(),
+	// any drawn outside of that (or if the stream buffer is full) land in here instead
+	m_discardVertices = new SBVertex[MAX_SPRITES * 4];
+	m_vertices = m_discardVertices;
+	m_streamOffset = 0;
+	m_streamReserved = false;
+
 	m_vao = -1;
-	m_vbo = -1;
 	m_ibo = -1;
 
 	m_currentTexture = 0;
 
+	// uniforms start at 0 once linked, so that's what has been uploaded
 	for (int i = 0; i < TEXTURE_STACK_SIZE; i++) {
-		m_textureStack[i] = nullptr;
+		m_textureStack[i] = 0;
 		m_fontTexture[i] = 0;
+		m_uploadedFontTexture[i] = 0;
+		m_instanceUploadedFontTexture[i] = 0;
 	}
 
+	m_atlas = nullptr;
+	m_atlasHandle = 0;
+	m_quadRegion = nullptr;
+
+	m_blendMode = BLEND_ALPHA;
+	m_appliedBlendMode = BLEND_ALPHA;
+	m_previousDepthFunc = GL_LESS;
+
+	m_sortMode = SORT_NONE;
+	m_deferring = false;
+
+	m_batchCount = 0;
+	m_quadCount = 0;
+
+	m_spriteInstancing = false;
+	m_batchInstanced = false;
+	m_instances = (SBInstance*)m_discardVertices;
+	m_currentInstance = 0;
+
 	char* vertexShader = "#version 150\n \
 						in vec4 position; \
 						in vec4 colour; \
@@ -50,106 +119,156 @@ Renderer2D::Renderer2D() {
 						in vec2 vTexCoord; \
 						in float vTextureID; \
 						out vec4 fragColour; \
-						const int TEXTURE_STACK_SIZE = 16; \
+						const int TEXTURE_STACK_SIZE = 15; \
+						const int ATLAS_LAYER_BASE = 32; \
+						const float SDF_SPREAD = 4.0f; \
 						uniform sampler2D textureStack[TEXTURE_STACK_SIZE]; \
 						uniform int isFontTexture[TEXTURE_STACK_SIZE]; \
+						uniform sampler2DArray atlas; \
 						void main() { \
 							int id = int(vTextureID); \
-							if (id < TEXTURE_STACK_SIZE) { \
+							vec2 uvPerPixel = fwidth(vTexCoord); \
+							if (id >= ATLAS_LAYER_BASE) { \
+								fragColour = texture(atlas, vec3(vTexCoord, float(id - ATLAS_LAYER_BASE))) * vColour; \
+							} else if (id < TEXTURE_STACK_SIZE) { \
 								vec4 rgba = texture2D(textureStack[id], vTexCoord); \
 								if (isFontTexture[id] == 1) \
 									rgba = rgba.rrrr; \
+								else if (isFontTexture[id] == 2) { \
+									vec2 texelsPerPixel = uvPerPixel * vec2(textureSize(textureStack[id], 0)); \
+									float pixelDistance = 0.5f * (texelsPerPixel.x + texelsPerPixel.y) / (2.0f * SDF_SPREAD); \
+									rgba = vec4(clamp((rgba.r - 0.5f) / max(pixelDistance, 0.0001f) + 0.5f, 0.0f, 1.0f)); \
+								} \
 								fragColour = rgba * vColour; \
 							} else fragColour = vColour; \
 						if (fragColour.a < 0.001f) discard; }";
 	
-	unsigned int vs = glCreateShader(GL_VERTEX_SHADER);
-	unsigned int fs = glCreateShader(GL_FRAGMENT_SHADER);
-
-	glShaderSource(vs, 1, (const char**)&vertexShader, 0);
-	glCompileShader(vs);
-
-	glShaderSource(fs, 1, (const char**)&fragmentShader, 0);
-	glCompileShader(fs);
-
-	m_shader = glCreateProgram();
-	glAttachShader(m_shader, vs);
-	glAttachShader(m_shader, fs);
-	glBindAttribLocation(m_shader, 0, "position");
-	glBindAttribLocation(m_shader, 1, "colour");
-	glBindAttribLocation(m_shader, 2, "texcoord");
-	glLinkProgram(m_shader);
-
-	int success = GL_FALSE;
-	glGetProgramiv(m_shader, GL_LINK_STATUS, &success);
-	if (success == GL_FALSE) {
-		int infoLogLength = 0;
-		glGetProgramiv(m_shader, GL_INFO_LOG_LENGTH, &infoLogLength);
-		char* infoLog = new char[infoLogLength];
-
-		glGetProgramInfoLog(m_shader, infoLogLength, 0, infoLog);
-		printf("Error: Failed to link SpriteBatch shader program!\n%s\n", infoLog);
-		delete[] infoLog;
+	// corners are numbered around the quad from the top left, the same as the
+	// quads written on the CPU, and drawn as a triangle fan
+	char* instanceVertexShader = "#version 150\n \
+						in vec3 position; \
+						in vec2 size; \
+						in float rotation; \
+						in vec2 origin; \
+						in vec4 uvRect; \
+						in vec4 colour; \
+						in float textureID; \
+						out vec4 vColour; \
+						out vec2 vTexCoord; \
+						out float vTextureID; \
+						uniform mat4 projectionMatrix; \
+						void main() { \
+							vec2 corner = vec2(gl_VertexID == 1 || gl_VertexID == 2 ? 1 : 0, gl_VertexID >= 2 ? 1 : 0); \
+							vec2 local = (corner - origin) * size; \
+							float si = sin(rotation); float co = cos(rotation); \
+							vec2 pos = position.xy + vec2(local.x * co - local.y * si, local.x * si + local.y * co); \
+							vColour = colour; \
+							vTexCoord = uvRect.xy + vec2(corner.x, 1 - corner.y) * uvRect.zw; \
+							vTextureID = textureID; \
+							gl_Position = projectionMatrix * vec4(pos, position.z, 1.0f); }";
+
+	const char* attributes[] = { "position", "colour", "texcoord" };
+	m_shader = createSpriteProgram(vertexShader, fragmentShader, attributes, 3);
+
+	const char* instanceAttributes[] = { "position", "size", "rotation", "origin", "uvRect", "colour", "textureID" };
+	m_instanceShader = createSpriteProgram(instanceVertexShader, fragmentShader, instanceAttributes, 7);
+
+	// set texture locations, and look up the rest once rather than every frame / flush
+	unsigned int programs[] = { m_shader, m_instanceShader };
+	for (auto program : programs) {
+		glUseProgram(program);
+
+		char buf[32];
+		for (int i = 0; i < TEXTURE_STACK_SIZE; ++i) {
+			snprintf(buf, sizeof(buf), "textureStack[%i]", i);
+			glUniform1i(glGetUniformLocation(program, buf), i);
+		}
+		glUniform1i(glGetUniformLocation(program, "atlas"), ATLAS_TEXTURE_UNIT);
 	}
 
-	glUseProgram(m_shader);
-
-	// set texture locations
-	char buf[32];
-	for (int i = 0; i < TEXTURE_STACK_SIZE; ++i) {
-		sprintf_s(buf, "textureStack[%i]", i);
-		glUniform1i(glGetUniformLocation(m_shader, buf), i);
-	}
+	m_projectionUniform = glGetUniformLocation(m_shader, "projectionMatrix");
+	m_fontTextureUniform = glGetUniformLocation(m_shader, "isFontTexture");
+	m_instanceProjectionUniform = glGetUniformLocation(m_instanceShader, "projectionMatrix");
+	m_instanceFontTextureUniform = glGetUniformLocation(m_instanceShader, "isFontTexture");
 
 	glUseProgram(0);
-
-	glDeleteShader(vs);
-	glDeleteShader(fs);
 	
 	// pre calculate the indices... they will always be the same
-	int index = 0;
+	unsigned int* indices = new unsigned int[MAX_SPRITES * 6];
+	unsigned int index = 0;
 	for (int i = 0; i<(MAX_SPRITES*6);) {
-		m_indices[i++] = (index + 0);
-		m_indices[i++] = (index + 1);
-		m_indices[i++] = (index + 2);
+		indices[i++] = (index + 0);
+		indices[i++] = (index + 1);
+		indices[i++] = (index + 2);
 
-		m_indices[i++] = (index + 0);
-		m_indices[i++] = (index + 2);
-		m_indices[i++] = (index + 3);
+		indices[i++] = (index + 0);
+		indices[i++] = (index + 2);
+		indices[i++] = (index + 3);
 		index += 4;
 	}
 	
-	// create the vao, vio and vbo
+	// create the vao and vio, vertices come from the shared stream buffer
 	glGenVertexArrays(1, &m_vao);
 	glBindVertexArray(m_vao);
-	glGenBuffers(1, &m_vbo);
 	glGenBuffers(1, &m_ibo);
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
+	glBindBuffer(GL_ARRAY_BUFFER, StreamBuffer::getInstance()->getHandle());
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
-	glBufferData(GL_ELEMENT_ARRAY_BUFFER, (MAX_SPRITES * 6) * sizeof(unsigned short), (void *)(&m_indices[0]), GL_STATIC_DRAW);
-	glBufferData(GL_ARRAY_BUFFER, (MAX_SPRITES * 4) * sizeof(SBVertex), m_vertices, GL_STATIC_DRAW);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, (MAX_SPRITES * 6) * sizeof(unsigned int), indices, GL_STATIC_DRAW);
+	delete[] indices;
 	glEnableVertexAttribArray(0);
 	glEnableVertexAttribArray(1);
 	glEnableVertexAttribArray(2);
 	glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, sizeof(SBVertex), (char *)0);
 	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, sizeof(SBVertex), (char *)16);
 	glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(SBVertex), (char *)32);
+
+	// instances advance once per sprite and are found with a base instance
+	glGenVertexArrays(1, &m_instanceVao);
+	glBindVertexArray(m_instanceVao);
+	glBindBuffer(GL_ARRAY_BUFFER, StreamBuffer::getInstance()->getHandle());
+	for (unsigned int i = 0; i < 7; ++i) {
+		glEnableVertexAttribArray(i);
+		glVertexAttribDivisor(i, 1);
+	}
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(SBInstance), (char *)0);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(SBInstance), (char *)12);
+	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, sizeof(SBInstance), (char *)20);
+	glVertexAttribPointer(3, 2, GL_FLOAT, GL_FALSE, sizeof(SBInstance), (char *)24);
+	glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(SBInstance), (char *)32);
+	glVertexAttribPointer(5, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(SBInstance), (char *)48);
+	glVertexAttribPointer(6, 1, GL_FLOAT, GL_FALSE, sizeof(SBInstance), (char *)52);
 	glBindVertexArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
 }
 
 Renderer2D::~Renderer2D() {
-	glDeleteBuffers(1, &m_vbo);
 	glDeleteBuffers(1, &m_ibo);
-	glDeleteBuffers(1, &m_vao);
+	glDeleteVertexArrays(1, &m_vao);
+	glDeleteVertexArrays(1, &m_instanceVao);
 	glDeleteProgram(m_shader);
+	glDeleteProgram(m_instanceShader);
 	delete m_nullTexture;
+	delete[] m_discardVertices;
 }
 
 void Renderer2D::begin() {
 	m_renderBegun = true;
-	m_currentIndex = 0;
 	m_currentVertex = 0;
 	m_currentTexture = 0;
+	m_batchCount = 0;
+	m_quadCount = 0;
+	m_currentInstance = 0;
+	m_batchInstanced = false;
+
+	// deferred quads are recorded into their own storage until end()
+	m_deferring = m_sortMode == SORT_DEFERRED;
+	if (m_deferring) {
+		m_deferredVertices.clear();
+		m_deferredQuads.clear();
+		m_vertices = m_deferredVertices.data();
+	}
+	else
+		beginBatch();
 
 	int width = 0, height = 0;
 	auto window = glfwGetCurrentContext();
@@ -158,20 +277,52 @@ void Renderer2D::begin() {
 	glUseProgram(m_shader);
 
 	auto projection = glm::ortho(m_cameraX, m_cameraX + (float)width, m_cameraY, m_cameraY + (float)height, 1.0f, -101.0f);
-	glUniformMatrix4fv(glGetUniformLocation(m_shader, "projectionMatrix"), 1, false, &projection[0][0]);
+	glUseProgram(m_instanceShader);
+	glUniformMatrix4fv(m_instanceProjectionUniform, 1, false, &projection[0][0]);
+	glUseProgram(m_shader);
+	glUniformMatrix4fv(m_projectionUniform, 1, false, &projection[0][0]);
 
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+	m_appliedBlendMode = BLEND_ALPHA;
+
+	// the atlas has its own unit, bound for the whole begin / end pair
+	if (m_atlas != nullptr)
+		m_atlas->update();
+	m_atlasHandle = m_atlas != nullptr ? m_atlas->getHandle() : 0;
+	if (m_atlasHandle != 0) {
+		glActiveTexture(GL_TEXTURE0 + ATLAS_TEXTURE_UNIT);
+		glBindTexture(GL_TEXTURE_2D_ARRAY, m_atlasHandle);
+		glActiveTexture(GL_TEXTURE0);
+	}
+
+	// sprites at the same depth draw over each other
+	glGetIntegerv(GL_DEPTH_FUNC, &m_previousDepthFunc);
+	glDepthFunc(GL_LEQUAL);
 
 	setRenderColour(1,1,1,1);
+	m_blendMode = BLEND_ALPHA;
 }
 
 void Renderer2D::end() {
 	if (m_renderBegun == false)
 		return;
 
+	if (m_deferring)
+		drawDeferred();
+
 	flushBatch();
 
+	// hand back the rest of the open batch
+	if (m_streamReserved)
+		StreamBuffer::getInstance()->commit(0);
+	m_streamReserved = false;
+	m_vertices = m_discardVertices;
+	m_instances = (SBInstance*)m_discardVertices;
+
+	glDepthFunc(m_previousDepthFunc);
+	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+
 	glUseProgram(0);
 
 	m_renderBegun = false;
@@ -183,54 +334,39 @@ void Renderer2D::drawBox(float xPos, float yPos, float width, float height, floa
 
 void Renderer2D::drawCircle(float xPos, float yPos, float radius, float depth) {
 
-	if (shouldFlush(33,96))
-		flushBatch();
-	unsigned int textureID = pushTexture(m_nullTexture);
-
-	int startIndex = m_currentVertex;
-
-	// centre vertex
-	m_vertices[m_currentVertex].pos[0] = xPos;
-	m_vertices[m_currentVertex].pos[1] = yPos;
-	m_vertices[m_currentVertex].pos[2] = depth;
-	m_vertices[m_currentVertex].pos[3] = (float)textureID;
-	m_vertices[m_currentVertex].color[0] = m_r;
-	m_vertices[m_currentVertex].color[1] = m_g;
-	m_vertices[m_currentVertex].color[2] = m_b;
-	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = 0;
-	m_vertices[m_currentVertex].texcoord[1] = 0;
-	m_currentVertex++;
+	// each segment is written as a quad with a repeated centre vertex
+	// so that circles can share the static quad index buffer
+	unsigned int textureID = beginQuads(32, m_nullTexture->getHandle(), 0, depth, m_nullTexture);
 
 	float rotDelta = glm::pi<float>() * 2 / 32;
 
 	// 32 segment sphere
 	for (int i = 0; i < 32; ++i) {
 
-		if (shouldFlush())
-			flushBatch();
-
-		m_vertices[m_currentVertex].pos[0] = glm::sin(rotDelta * i) * radius + xPos;
-		m_vertices[m_currentVertex].pos[1] = glm::cos(rotDelta * i) * radius + yPos;
-		m_vertices[m_currentVertex].pos[2] = depth;
-		m_vertices[m_currentVertex].pos[3] = (float)textureID;
-		m_vertices[m_currentVertex].color[0] = m_r;
-		m_vertices[m_currentVertex].color[1] = m_g;
-		m_vertices[m_currentVertex].color[2] = m_b;
-		m_vertices[m_currentVertex].color[3] = m_a;
-		m_vertices[m_currentVertex].texcoord[0] = 0.5f;
-		m_vertices[m_currentVertex].texcoord[1] = 0.5f;
-		m_currentVertex++;
-
-		if (i == (32-1)) {
-			m_indices[m_currentIndex++] = startIndex;
-			m_indices[m_currentIndex++] = startIndex + 1;
-			m_indices[m_currentIndex++] = m_currentVertex - 1;
-		}
-		else {
-			m_indices[m_currentIndex++] = startIndex;
-			m_indices[m_currentIndex++] = m_currentVertex;
-			m_indices[m_currentIndex++] = m_currentVertex - 1;
+		float x0 = glm::sin(rotDelta * i) * radius + xPos;
+		float y0 = glm::cos(rotDelta * i) * radius + yPos;
+		float x1 = glm::sin(rotDelta * (i + 1)) * radius + xPos;
+		float y1 = glm::cos(rotDelta * (i + 1)) * radius + yPos;
+
+		float corners[4][2] = {
+			{ xPos, yPos },
+			{ x1, y1 },
+			{ x0, y0 },
+			{ xPos, yPos },
+		};
+
+		for (int c = 0; c < 4; ++c) {
+			m_vertices[m_currentVertex].pos[0] = corners[c][0];
+			m_vertices[m_currentVertex].pos[1] = corners[c][1];
+			m_vertices[m_currentVertex].pos[2] = depth;
+			m_vertices[m_currentVertex].pos[3] = (float)textureID;
+			m_vertices[m_currentVertex].color[0] = m_r;
+			m_vertices[m_currentVertex].color[1] = m_g;
+			m_vertices[m_currentVertex].color[2] = m_b;
+			m_vertices[m_currentVertex].color[3] = m_a;
+			m_vertices[m_currentVertex].texcoord[0] = 0.5f;
+			m_vertices[m_currentVertex].texcoord[1] = 0.5f;
+			m_currentVertex++;
 		}
 	}
 }
@@ -242,15 +378,43 @@ void Renderer2D::drawSprite(Texture * texture,
 	if (texture == nullptr)
 		texture = m_nullTexture;
 
-	if (shouldFlush())
-		flushBatch();
-	unsigned int textureID = pushTexture(texture);
-
 	if (width == 0.0f)
 		width = (float)texture->getWidth();
 	if (height == 0.0f)
 		height = (float)texture->getHeight();
 
+	float uvX, uvY, uvW, uvH;
+
+	// a single record, the vertex shader makes the corners
+	if (m_spriteInstancing &&
+		m_deferring == false) {
+		unsigned int textureID = beginInstance(texture);
+		getQuadUVRect(uvX, uvY, uvW, uvH);
+
+		SBInstance& instance = m_instances[m_currentInstance++];
+		instance.position[0] = xPos;
+		instance.position[1] = yPos;
+		instance.position[2] = depth;
+		instance.size[0] = width;
+		instance.size[1] = height;
+		instance.rotation = rotation;
+		instance.origin[0] = xOrigin;
+		instance.origin[1] = yOrigin;
+		instance.uvRect[0] = uvX;
+		instance.uvRect[1] = uvY;
+		instance.uvRect[2] = uvW;
+		instance.uvRect[3] = uvH;
+		instance.colour[0] = (unsigned char)(glm::clamp(m_r, 0.0f, 1.0f) * 255 + 0.5f);
+		instance.colour[1] = (unsigned char)(glm::clamp(m_g, 0.0f, 1.0f) * 255 + 0.5f);
+		instance.colour[2] = (unsigned char)(glm::clamp(m_b, 0.0f, 1.0f) * 255 + 0.5f);
+		instance.colour[3] = (unsigned char)(glm::clamp(m_a, 0.0f, 1.0f) * 255 + 0.5f);
+		instance.textureID = (float)textureID;
+		return;
+	}
+
+	unsigned int textureID = beginQuads(1, texture->getHandle(), 0, depth, texture);
+	getQuadUVRect(uvX, uvY, uvW, uvH);
+
 	float tlX = (0.0f - xOrigin) * width;		float tlY = (0.0f - yOrigin) * height;
 	float trX = (1.0f - xOrigin) * width;		float trY = (0.0f - yOrigin) * height;
 	float brX = (1.0f - xOrigin) * width;		float brY = (1.0f - yOrigin) * height;
@@ -264,8 +428,6 @@ void Renderer2D::drawSprite(Texture * texture,
 		rotateAround(blX, blY, blX, blY, si, co);
 	}
 
-	int index = m_currentVertex;
-
 	m_vertices[m_currentVertex].pos[0] = xPos + tlX;
 	m_vertices[m_currentVertex].pos[1] = yPos + tlY;
 	m_vertices[m_currentVertex].pos[2] = depth;
@@ -274,8 +436,8 @@ void Renderer2D::drawSprite(Texture * texture,
 	m_vertices[m_currentVertex].color[1] = m_g;
 	m_vertices[m_currentVertex].color[2] = m_b;
 	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY + m_uvH;
+	m_vertices[m_currentVertex].texcoord[0] = uvX;
+	m_vertices[m_currentVertex].texcoord[1] = uvY + uvH;
 	m_currentVertex++;
 
 	m_vertices[m_currentVertex].pos[0] = xPos + trX;
@@ -286,8 +448,8 @@ void Renderer2D::drawSprite(Texture * texture,
 	m_vertices[m_currentVertex].color[1] = m_g;
 	m_vertices[m_currentVertex].color[2] = m_b;
 	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX + m_uvW;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY + m_uvH;
+	m_vertices[m_currentVertex].texcoord[0] = uvX + uvW;
+	m_vertices[m_currentVertex].texcoord[1] = uvY + uvH;
 	m_currentVertex++;
 
 	m_vertices[m_currentVertex].pos[0] = xPos + brX;
@@ -298,8 +460,8 @@ void Renderer2D::drawSprite(Texture * texture,
 	m_vertices[m_currentVertex].color[1] = m_g;
 	m_vertices[m_currentVertex].color[2] = m_b;
 	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX + m_uvW;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY;
+	m_vertices[m_currentVertex].texcoord[0] = uvX + uvW;
+	m_vertices[m_currentVertex].texcoord[1] = uvY;
 	m_currentVertex++;
 
 	m_vertices[m_currentVertex].pos[0] = xPos + blX;
@@ -310,17 +472,9 @@ void Renderer2D::drawSprite(Texture * texture,
 	m_vertices[m_currentVertex].color[1] = m_g;
 	m_vertices[m_currentVertex].color[2] = m_b;
 	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY;
+	m_vertices[m_currentVertex].texcoord[0] = uvX;
+	m_vertices[m_currentVertex].texcoord[1] = uvY;
 	m_currentVertex++;
-
-	m_indices[m_currentIndex++] = (index + 0);
-	m_indices[m_currentIndex++] = (index + 2);
-	m_indices[m_currentIndex++] = (index + 3);
-
-	m_indices[m_currentIndex++] = (index + 0);
-	m_indices[m_currentIndex++] = (index + 1);
-	m_indices[m_currentIndex++] = (index + 2);
 }
 
 void Renderer2D::drawSpriteTransformed3x3(Texture * texture,
@@ -330,10 +484,10 @@ void Renderer2D::drawSpriteTransformed3x3(Texture * texture,
 	if (texture == nullptr)
 		texture = m_nullTexture;
 
-	if (shouldFlush())
-		flushBatch();
+	unsigned int textureID = beginQuads(1, texture->getHandle(), 0, depth, texture);
 
-	unsigned int textureID = pushTexture(texture);
+	float uvX, uvY, uvW, uvH;
+	getQuadUVRect(uvX, uvY, uvW, uvH);
 
 	if (width == 0.0f)
 		width = (float)texture->getWidth();
@@ -363,8 +517,6 @@ void Renderer2D::drawSpriteTransformed3x3(Texture * texture,
 	blX = x * transformMat3x3[0] + y * transformMat3x3[3] + transformMat3x3[6];
 	blY = x * transformMat3x3[1] + y * transformMat3x3[4] + transformMat3x3[7];	
 
-	int index = m_currentVertex;
-	
 	m_vertices[m_currentVertex].pos[0] = tlX;
 	m_vertices[m_currentVertex].pos[1] = tlY;
 	m_vertices[m_currentVertex].pos[2] = depth;
@@ -373,8 +525,8 @@ void Renderer2D::drawSpriteTransformed3x3(Texture * texture,
 	m_vertices[m_currentVertex].color[1] = m_g;
 	m_vertices[m_currentVertex].color[2] = m_b;
 	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY + m_uvH;
+	m_vertices[m_currentVertex].texcoord[0] = uvX;
+	m_vertices[m_currentVertex].texcoord[1] = uvY + uvH;
 	m_currentVertex++;
 
 	m_vertices[m_currentVertex].pos[0] = trX;
@@ -385,8 +537,8 @@ void Renderer2D::drawSpriteTransformed3x3(Texture * texture,
 	m_vertices[m_currentVertex].color[1] = m_g;
 	m_vertices[m_currentVertex].color[2] = m_b;
 	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX + m_uvW;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY + m_uvH;
+	m_vertices[m_currentVertex].texcoord[0] = uvX + uvW;
+	m_vertices[m_currentVertex].texcoord[1] = uvY + uvH;
 	m_currentVertex++;
 
 	m_vertices[m_currentVertex].pos[0] = brX;
@@ -397,8 +549,8 @@ void Renderer2D::drawSpriteTransformed3x3(Texture * texture,
 	m_vertices[m_currentVertex].color[1] = m_g;
 	m_vertices[m_currentVertex].color[2] = m_b;
 	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX + m_uvW;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY;
+	m_vertices[m_currentVertex].texcoord[0] = uvX + uvW;
+	m_vertices[m_currentVertex].texcoord[1] = uvY;
 	m_currentVertex++;
 
 	m_vertices[m_currentVertex].pos[0] = blX;
@@ -409,17 +561,9 @@ void Renderer2D::drawSpriteTransformed3x3(Texture * texture,
 	m_vertices[m_currentVertex].color[1] = m_g;
 	m_vertices[m_currentVertex].color[2] = m_b;
 	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY;
+	m_vertices[m_currentVertex].texcoord[0] = uvX;
+	m_vertices[m_currentVertex].texcoord[1] = uvY;
 	m_currentVertex++;
-
-	m_indices[m_currentIndex++] = (index + 0);
-	m_indices[m_currentIndex++] = (index + 2);
-	m_indices[m_currentIndex++] = (index + 3);
-
-	m_indices[m_currentIndex++] = (index + 0);
-	m_indices[m_currentIndex++] = (index + 1);
-	m_indices[m_currentIndex++] = (index + 2);
 }
 
 void Renderer2D::drawSpriteTransformed4x4(Texture * texture,
@@ -429,9 +573,10 @@ void Renderer2D::drawSpriteTransformed4x4(Texture * texture,
 	if (texture == nullptr)
 		texture = m_nullTexture;
 
-	if (shouldFlush())
-		flushBatch();
-	unsigned int textureID = pushTexture(texture);
+	unsigned int textureID = beginQuads(1, texture->getHandle(), 0, depth, texture);
+
+	float uvX, uvY, uvW, uvH;
+	getQuadUVRect(uvX, uvY, uvW, uvH);
 
 	if (width == 0.0f)
 		width = (float)texture->getWidth();
@@ -462,8 +607,6 @@ void Renderer2D::drawSpriteTransformed4x4(Texture * texture,
 	blX = x * transformMat4x4[0] + y * transformMat4x4[4] + transformMat4x4[12];
 	blY = x * transformMat4x4[1] + y * transformMat4x4[5] + transformMat4x4[13];
 
-	int index = m_currentVertex;
-
 	m_vertices[m_currentVertex].pos[0] = tlX;
 	m_vertices[m_currentVertex].pos[1] = tlY;
 	m_vertices[m_currentVertex].pos[2] = depth;
@@ -472,8 +615,8 @@ void Renderer2D::drawSpriteTransformed4x4(Texture * texture,
 	m_vertices[m_currentVertex].color[1] = m_g;
 	m_vertices[m_currentVertex].color[2] = m_b;
 	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY + m_uvH;
+	m_vertices[m_currentVertex].texcoord[0] = uvX;
+	m_vertices[m_currentVertex].texcoord[1] = uvY + uvH;
 	m_currentVertex++;
 
 	m_vertices[m_currentVertex].pos[0] = trX;
@@ -484,8 +627,8 @@ void Renderer2D::drawSpriteTransformed4x4(Texture * texture,
 	m_vertices[m_currentVertex].color[1] = m_g;
 	m_vertices[m_currentVertex].color[2] = m_b;
 	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX + m_uvW;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY + m_uvH;
+	m_vertices[m_currentVertex].texcoord[0] = uvX + uvW;
+	m_vertices[m_currentVertex].texcoord[1] = uvY + uvH;
 	m_currentVertex++;
 
 	m_vertices[m_currentVertex].pos[0] = brX;
@@ -496,8 +639,8 @@ void Renderer2D::drawSpriteTransformed4x4(Texture * texture,
 	m_vertices[m_currentVertex].color[1] = m_g;
 	m_vertices[m_currentVertex].color[2] = m_b;
 	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX + m_uvW;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY;
+	m_vertices[m_currentVertex].texcoord[0] = uvX + uvW;
+	m_vertices[m_currentVertex].texcoord[1] = uvY;
 	m_currentVertex++;
 
 	m_vertices[m_currentVertex].pos[0] = blX;
@@ -508,17 +651,9 @@ void Renderer2D::drawSpriteTransformed4x4(Texture * texture,
 	m_vertices[m_currentVertex].color[1] = m_g;
 	m_vertices[m_currentVertex].color[2] = m_b;
 	m_vertices[m_currentVertex].color[3] = m_a;
-	m_vertices[m_currentVertex].texcoord[0] = m_uvX;
-	m_vertices[m_currentVertex].texcoord[1] = m_uvY;
+	m_vertices[m_currentVertex].texcoord[0] = uvX;
+	m_vertices[m_currentVertex].texcoord[1] = uvY;
 	m_currentVertex++;
-	
-	m_indices[m_currentIndex++] = (index + 0);
-	m_indices[m_currentIndex++] = (index + 2);
-	m_indices[m_currentIndex++] = (index + 3);
-
-	m_indices[m_currentIndex++] = (index + 0);
-	m_indices[m_currentIndex++] = (index + 1);
-	m_indices[m_currentIndex++] = (index + 2);
 }
 
 void Renderer2D::drawLine(float x1, float y1, float x2, float y2, float thickness, float depth) {
@@ -543,169 +678,385 @@ void Renderer2D::drawLine(float x1, float y1, float x2, float y2, float thicknes
 	setUVRect(uvX, uvY, uvW, uvH);
 }
 
-void Renderer2D::drawText(Font * font, const char* text, float xPos, float yPos, float depth) {
+void Renderer2D::drawText(Font * font, const char* text, float xPos, float yPos, float depth, float height) {
 
 	if (font == nullptr ||
 		font->m_glHandle == 0)
 		return;
 
-	stbtt_aligned_quad Q = {};
-
-	if (shouldFlush() || m_currentTexture >= TEXTURE_STACK_SIZE - 1)
-		flushBatch();
+	// glyphs waiting in the batch can't be replaced, so if the font has run
+	// out of room draw what we have and try again. when sorting, what has been
+	// recorded so far is sorted and drawn on its own
+	const Font::Layout* layout = font->getLayout(text);
+	if (layout == nullptr) {
+		if (m_deferring) {
+			drawDeferred();
+			restartDeferred();
+		}
+		else
+			flushBatch();
 
-	glActiveTexture(GL_TEXTURE0 + m_currentTexture++);
-	glBindTexture(GL_TEXTURE_2D, font->getTextureHandle());
-	glActiveTexture(GL_TEXTURE0);
-	m_fontTexture[m_currentTexture - 1] = 1;
+		layout = font->getLayout(text);
+		if (layout == nullptr) {
+			static bool warned = false;
+			if (warned == false)
+				printf("Renderer2D: \"%s\" has more glyphs than its font can cache, text was dropped\n", text);
+			warned = true;
+			return;
+		}
+	}
 
-	// font renders top to bottom, so we need to invert it
-	int w = 0, h = 0;
-	glfwGetWindowSize(glfwGetCurrentContext(), &w, &h);
+	// snap to whole pixels so glyphs stay sharp, the layout is y down from the baseline
+	xPos = floorf(xPos + 0.5f);
+	yPos = floorf(yPos + 0.5f);
 
-	yPos = h - yPos;
+	float scale = height > 0 ? height / font->m_height : 1.0f;
+	float padding = font->m_padding;
+	int fontType = font->m_distanceField ? 2 : 1;
 
-	while (*text != 0) {
+	for (auto& quad : layout->quads) {
 
-		if (shouldFlush() || m_currentTexture >= TEXTURE_STACK_SIZE - 1) {
-				flushBatch();
+		unsigned int textureID = beginQuads(1, font->getTextureHandle(), fontType, depth, nullptr);
 
-			glActiveTexture(GL_TEXTURE0 + m_currentTexture++);
-			glBindTexture(GL_TEXTURE_2D, font->getTextureHandle());
-			glActiveTexture(GL_TEXTURE0);
-			m_fontTexture[m_currentTexture - 1] = 1;
-		}
+		// distance fields extend past the glyph by their padding
+		float x0 = xPos + (quad.x0 - padding) * scale;
+		float x1 = xPos + (quad.x1 + padding) * scale;
+		float y0 = yPos - (quad.y0 - padding) * scale;
+		float y1 = yPos - (quad.y1 + padding) * scale;
 
-		stbtt_GetBakedQuad((stbtt_bakedchar*)font->m_glyphData, font->m_textureWidth, font->m_textureHeight, (unsigned char)*text, &xPos, &yPos, &Q, 1);
+		if (std::find(m_batchFonts.begin(), m_batchFonts.end(), font) == m_batchFonts.end())
+			m_batchFonts.push_back(font);
+		font->pinGlyph(quad.cell);
 
-		int index = m_currentVertex;
+		const Font::Glyph& glyph = font->m_cells[quad.cell];
 
-		m_vertices[m_currentVertex].pos[0] = Q.x0;
-		m_vertices[m_currentVertex].pos[1] = h - Q.y1;
+		m_vertices[m_currentVertex].pos[0] = x0;
+		m_vertices[m_currentVertex].pos[1] = y1;
 		m_vertices[m_currentVertex].pos[2] = depth;
-		m_vertices[m_currentVertex].pos[3] = (float)m_currentTexture - 1;
+		m_vertices[m_currentVertex].pos[3] = (float)textureID;
 		m_vertices[m_currentVertex].color[0] = m_r;
 		m_vertices[m_currentVertex].color[1] = m_g;
 		m_vertices[m_currentVertex].color[2] = m_b;
 		m_vertices[m_currentVertex].color[3] = m_a;
-		m_vertices[m_currentVertex].texcoord[0] = Q.s0;
-		m_vertices[m_currentVertex].texcoord[1] = Q.t1;
+		m_vertices[m_currentVertex].texcoord[0] = glyph.s0;
+		m_vertices[m_currentVertex].texcoord[1] = glyph.t1;
 		m_currentVertex++;
-		m_vertices[m_currentVertex].pos[0] = Q.x1;
-		m_vertices[m_currentVertex].pos[1] = h - Q.y1;
+		m_vertices[m_currentVertex].pos[0] = x1;
+		m_vertices[m_currentVertex].pos[1] = y1;
 		m_vertices[m_currentVertex].pos[2] = depth;
-		m_vertices[m_currentVertex].pos[3] = (float)m_currentTexture - 1;
+		m_vertices[m_currentVertex].pos[3] = (float)textureID;
 		m_vertices[m_currentVertex].color[0] = m_r;
 		m_vertices[m_currentVertex].color[1] = m_g;
 		m_vertices[m_currentVertex].color[2] = m_b;
 		m_vertices[m_currentVertex].color[3] = m_a;
-		m_vertices[m_currentVertex].texcoord[0] = Q.s1;
-		m_vertices[m_currentVertex].texcoord[1] = Q.t1;
+		m_vertices[m_currentVertex].texcoord[0] = glyph.s1;
+		m_vertices[m_currentVertex].texcoord[1] = glyph.t1;
 		m_currentVertex++;
-		m_vertices[m_currentVertex].pos[0] = Q.x1;
-		m_vertices[m_currentVertex].pos[1] = h - Q.y0;
+		m_vertices[m_currentVertex].pos[0] = x1;
+		m_vertices[m_currentVertex].pos[1] = y0;
 		m_vertices[m_currentVertex].pos[2] = depth;
-		m_vertices[m_currentVertex].pos[3] = (float)m_currentTexture - 1;
+		m_vertices[m_currentVertex].pos[3] = (float)textureID;
 		m_vertices[m_currentVertex].color[0] = m_r;
 		m_vertices[m_currentVertex].color[1] = m_g;
 		m_vertices[m_currentVertex].color[2] = m_b;
 		m_vertices[m_currentVertex].color[3] = m_a;
-		m_vertices[m_currentVertex].texcoord[0] = Q.s1;
-		m_vertices[m_currentVertex].texcoord[1] = Q.t0;
+		m_vertices[m_currentVertex].texcoord[0] = glyph.s1;
+		m_vertices[m_currentVertex].texcoord[1] = glyph.t0;
 		m_currentVertex++;
-		m_vertices[m_currentVertex].pos[0] = Q.x0;
-		m_vertices[m_currentVertex].pos[1] = h - Q.y0;
+		m_vertices[m_currentVertex].pos[0] = x0;
+		m_vertices[m_currentVertex].pos[1] = y0;
 		m_vertices[m_currentVertex].pos[2] = depth;
-		m_vertices[m_currentVertex].pos[3] = (float)m_currentTexture - 1;
+		m_vertices[m_currentVertex].pos[3] = (float)textureID;
 		m_vertices[m_currentVertex].color[0] = m_r;
 		m_vertices[m_currentVertex].color[1] = m_g;
 		m_vertices[m_currentVertex].color[2] = m_b;
 		m_vertices[m_currentVertex].color[3] = m_a;
-		m_vertices[m_currentVertex].texcoord[0] = Q.s0;
-		m_vertices[m_currentVertex].texcoord[1] = Q.t0;
+		m_vertices[m_currentVertex].texcoord[0] = glyph.s0;
+		m_vertices[m_currentVertex].texcoord[1] = glyph.t0;
 		m_currentVertex++;
-		
-		m_indices[m_currentIndex++] = (index + 0);
-		m_indices[m_currentIndex++] = (index + 2);
-		m_indices[m_currentIndex++] = (index + 3);
+	}
+}
+
+bool Renderer2D::shouldFlush(int additionalVertices) {
+	if (m_batchInstanced)
+		return m_currentInstance >= MAX_SPRITES;
+	return (m_currentVertex + additionalVertices) >= (MAX_SPRITES * 4);
+}
+
+void Renderer2D::beginBatch() {
+
+	// reserve room for a full batch, flushBatch() commits what was used
+	if (m_batchInstanced) {
+		m_instances = (SBInstance*)StreamBuffer::getInstance()->reserve(MAX_SPRITES * sizeof(SBInstance), sizeof(SBInstance), m_streamOffset);
+		m_streamReserved = m_instances != nullptr;
+		if (m_streamReserved == false)
+			m_instances = (SBInstance*)m_discardVertices;
+		return;
+	}
+
+	m_vertices = (SBVertex*)StreamBuffer::getInstance()->reserve(MAX_SPRITES * 4 * sizeof(SBVertex), sizeof(SBVertex), m_streamOffset);
+	m_streamReserved = m_vertices != nullptr;
+	if (m_streamReserved == false)
+		m_vertices = m_discardVertices;
+}
+
+unsigned int Renderer2D::beginQuads(unsigned int quadCount, unsigned int textureHandle, int isFont, float depth, const Texture* texture) {
+
+	// textures in the atlas don't need a slot in the texture stack
+	const SpriteAtlas::Region* region = nullptr;
+	if (m_atlasHandle != 0 &&
+		texture != nullptr)
+		region = m_atlas->find(texture);
+	m_quadRegion = region;
+
+	if (m_deferring == false) {
+		setBatchInstanced(false);
+		if (shouldFlush(quadCount * 4))
+			flushBatch();
+		if (region != nullptr)
+			return ATLAS_LAYER_BASE + region->layer;
+		return pushTexture(textureHandle, isFont);
+	}
+
+	// record the quads, their texture slot is filled in when they are drawn
+	unsigned int firstVertex = (unsigned int)m_currentVertex;
+	m_deferredVertices.resize(firstVertex + quadCount * 4);
+	m_vertices = m_deferredVertices.data();
+
+	for (unsigned int i = 0; i < quadCount; ++i) {
+		DeferredQuad quad = { depth, textureHandle, isFont, m_blendMode, -1, firstVertex + i * 4 };
+		if (region != nullptr) {
+			quad.texture = m_atlasHandle;
+			quad.atlasLayer = (int)region->layer;
+		}
+		m_deferredQuads.push_back(quad);
+	}
+
+	return 0;
+}
+
+unsigned int Renderer2D::beginInstance(const Texture* texture) {
+
+	setBatchInstanced(true);
+	if (shouldFlush())
+		flushBatch();
+
+	const SpriteAtlas::Region* region = nullptr;
+	if (m_atlasHandle != 0)
+		region = m_atlas->find(texture);
+	m_quadRegion = region;
+
+	if (region != nullptr)
+		return ATLAS_LAYER_BASE + region->layer;
+	return pushTexture(texture->getHandle(), 0);
+}
+
+void Renderer2D::setBatchInstanced(bool instanced) {
+
+	if (instanced == m_batchInstanced)
+		return;
+
+	flushBatch();
+
+	// hand back the reservation made for the other kind of batch
+	if (m_streamReserved)
+		StreamBuffer::getInstance()->commit(0);
+
+	m_batchInstanced = instanced;
+	beginBatch();
+}
+
+void Renderer2D::getQuadUVRect(float& uvX, float& uvY, float& uvW, float& uvH) const {
+
+	uvX = m_uvX;
+	uvY = m_uvY;
+	uvW = m_uvW;
+	uvH = m_uvH;
+
+	if (m_quadRegion != nullptr) {
+		const SpriteAtlas::Region* region = (const SpriteAtlas::Region*)m_quadRegion;
+		uvX = region->uvX + uvX * region->uvW;
+		uvY = region->uvY + uvY * region->uvH;
+		uvW *= region->uvW;
+		uvH *= region->uvH;
+	}
+}
+
+void Renderer2D::drawDeferred() {
+
+	m_deferring = false;
 
-		m_indices[m_currentIndex++] = (index + 0);
-		m_indices[m_currentIndex++] = (index + 1);
-		m_indices[m_currentIndex++] = (index + 2);
+	// back to front so blending is correct, then grouped by texture and blend
+	// mode. ties keep the order they were drawn in
+	std::sort(m_deferredQuads.begin(), m_deferredQuads.end(), [](const DeferredQuad& a, const DeferredQuad& b) {
+		if (a.depth != b.depth)
+			return a.depth > b.depth;
+		if (a.texture != b.texture)
+			return a.texture < b.texture;
+		if (a.blendMode != b.blendMode)
+			return a.blendMode < b.blendMode;
+		return a.firstVertex < b.firstVertex;
+	});
 
-		text++;
+	BlendMode blendMode = m_blendMode;
+
+	m_currentVertex = 0;
+	beginBatch();
+
+	for (auto& quad : m_deferredQuads) {
+
+		if (quad.blendMode != m_blendMode) {
+			flushBatch();
+			m_blendMode = (BlendMode)quad.blendMode;
+		}
+
+		if (shouldFlush(4))
+			flushBatch();
+		float textureID = quad.atlasLayer >= 0 ? (float)(ATLAS_LAYER_BASE + quad.atlasLayer) : (float)pushTexture(quad.texture, quad.isFont);
+
+		for (unsigned int i = 0; i < 4; ++i) {
+			m_vertices[m_currentVertex] = m_deferredVertices[quad.firstVertex + i];
+			m_vertices[m_currentVertex].pos[3] = textureID;
+			m_currentVertex++;
+		}
 	}
+
+	// draw what's left with the blend mode it was recorded with
+	flushBatch();
+	m_blendMode = blendMode;
 }
 
-bool Renderer2D::shouldFlush(int additionalVertices, int additionalIndices) {
-	return (m_currentVertex + additionalVertices) >= (MAX_SPRITES * 4) || 
-		(m_currentIndex + additionalIndices) >= (MAX_SPRITES * 6);
+void Renderer2D::restartDeferred() {
+
+	// hand back the batch drawDeferred() left open, recording doesn't use it
+	if (m_streamReserved)
+		StreamBuffer::getInstance()->commit(0);
+	m_streamReserved = false;
+
+	m_deferring = true;
+	m_currentVertex = 0;
+	m_deferredVertices.clear();
+	m_deferredQuads.clear();
+	m_vertices = m_deferredVertices.data();
 }
 
 void Renderer2D::flushBatch() {
 
 	// dont render anything
-	if (m_currentVertex == 0 || m_currentIndex == 0 || m_renderBegun == false)
-		return; char buf[32];
+	if ((m_currentVertex == 0 && m_currentInstance == 0) || m_renderBegun == false || m_deferring)
+		return;
+
+	if (m_batchInstanced)
+		glUseProgram(m_instanceShader);
 
+	// only upload the font flags when a slot has changed type
+	int fontTextureUniform = m_batchInstanced ? m_instanceFontTextureUniform : m_fontTextureUniform;
+	int* uploadedFontTexture = m_batchInstanced ? m_instanceUploadedFontTexture : m_uploadedFontTexture;
 	for (int i = 0; i < TEXTURE_STACK_SIZE; ++i) {
-		sprintf_s(buf, "isFontTexture[%i]", i);
-		glUniform1i(glGetUniformLocation(m_shader, buf), m_fontTexture[i]);
+		if (m_fontTexture[i] != uploadedFontTexture[i]) {
+			glUniform1iv(fontTextureUniform, TEXTURE_STACK_SIZE, m_fontTexture);
+			memcpy(uploadedFontTexture, m_fontTexture, sizeof(m_fontTexture));
+			break;
+		}
 	}
 
-	int depthFunc = GL_LESS;
-	glGetIntegerv(GL_DEPTH_FUNC, &depthFunc);
-	glDepthFunc(GL_LEQUAL);
+	applyBlendMode();
 
-	glBindVertexArray(m_vao);
-	glBindBuffer(GL_ARRAY_BUFFER, m_vbo);
-	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_ibo);
+	if (m_streamReserved &&
+		m_batchInstanced) {
+		StreamBuffer::getInstance()->commit(m_currentInstance * sizeof(SBInstance));
 
-	glBufferSubData(GL_ARRAY_BUFFER, 0, m_currentVertex * sizeof(SBVertex), m_vertices);
-	glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, m_currentIndex * sizeof(unsigned short), m_indices);
+		glBindVertexArray(m_instanceVao);
+		glDrawArraysInstancedBaseInstance(GL_TRIANGLE_FAN, 0, 4, m_currentInstance, m_streamOffset / sizeof(SBInstance));
+		glBindVertexArray(0);
 
-	glDrawElements(GL_TRIANGLES, m_currentIndex, GL_UNSIGNED_SHORT, 0);
+		m_batchCount++;
+		m_quadCount += m_currentInstance;
+	}
+	// the vertices were written in place, every quad shares the static indices
+	else if (m_streamReserved) {
+		StreamBuffer::getInstance()->commit(m_currentVertex * sizeof(SBVertex));
 
-	glBindVertexArray(0);
+		glBindVertexArray(m_vao);
+		glDrawElementsBaseVertex(GL_TRIANGLES, (m_currentVertex / 4) * 6, GL_UNSIGNED_INT, 0, m_streamOffset / sizeof(SBVertex));
+		glBindVertexArray(0);
+
+		m_batchCount++;
+		m_quadCount += m_currentVertex / 4;
+	}
+
+	if (m_batchInstanced)
+		glUseProgram(m_shader);
 
-	glDepthFunc(depthFunc);
+	// glyphs in this batch can be replaced now
+	for (auto font : m_batchFonts)
+		font->releaseGlyphs();
+	m_batchFonts.clear();
 
 	// clear the active textures
 	for (unsigned int i = 0; i < m_currentTexture; i++) {
-		m_textureStack[i] = nullptr;
+		m_textureStack[i] = 0;
 		m_fontTexture[i] = 0;
 	}
 
-	// reset vertex, index and texture count
-	m_currentIndex = 0;
+	// reset vertex and texture count
 	m_currentVertex = 0;
+	m_currentInstance = 0;
 	m_currentTexture = 0;
+
+	beginBatch();
 }
 
-unsigned int Renderer2D::pushTexture(Texture* texture) {
+unsigned int Renderer2D::pushTexture(unsigned int textureHandle, int isFont) {
 
 	// check if the texture is already in use
 	// if so, return as we dont need to add it to our list of active txtures again
-	for (unsigned int i = 0; i <= m_currentTexture; i++) {
-		if (m_textureStack[i] == texture)
+	for (unsigned int i = 0; i < m_currentTexture; i++) {
+		if (m_textureStack[i] == textureHandle)
 			return i;
 	}
 
 	// if we've used all the textures we can, than we need to flush to make room for another texture change
-	if (m_currentTexture >= TEXTURE_STACK_SIZE - 1)
+	if (m_currentTexture >= TEXTURE_STACK_SIZE)
 		flushBatch();
 
 	// add the texture to our active texture list
-	m_textureStack[m_currentTexture] = texture;
+	m_textureStack[m_currentTexture] = textureHandle;
+	m_fontTexture[m_currentTexture] = isFont;
 
 	glActiveTexture(GL_TEXTURE0 + m_currentTexture);
-	glBindTexture(GL_TEXTURE_2D, texture->getHandle());
+	glBindTexture(GL_TEXTURE_2D, textureHandle);
 	glActiveTexture(GL_TEXTURE0);
 
 	// return what the current texture was and increment
 	return m_currentTexture++;
 }
 
+void Renderer2D::setBlendMode(BlendMode mode) {
+
+	// sprites already in the batch keep the old mode
+	if (mode != m_blendMode &&
+		m_deferring == false)
+		flushBatch();
+
+	m_blendMode = mode;
+}
+
+void Renderer2D::applyBlendMode() {
+
+	if (m_blendMode == m_appliedBlendMode)
+		return;
+
+	switch (m_blendMode) {
+	case BLEND_ALPHA:		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);	break;
+	case BLEND_ADDITIVE:	glBlendFunc(GL_SRC_ALPHA, GL_ONE);					break;
+	case BLEND_MULTIPLY:	glBlendFunc(GL_DST_COLOR, GL_ZERO);					break;
+	default:	break;
+	};
+
+	m_appliedBlendMode = m_blendMode;
+}
+
 void Renderer2D::setRenderColour(float r, float g, float b, float a) {
 	m_r = r;
 	m_g = g;
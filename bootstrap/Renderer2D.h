@@ -1,9 +1,12 @@
 #pragma once
 
+#include <vector>
+
 namespace aie {
 
 class Texture;
 class Font;
+class SpriteAtlas;
 
 // a class for rendering 2D sprites and font
 class Renderer2D {
@@ -30,9 +33,11 @@ public:
 	// depth is in the range [0,100] with lower being closer to the viewer
 	virtual void drawLine(float x1, float y1, float x2, float y2, float thickness = 1.0f, float depth = 0.0f );
 
-	// draws simple text on the screen horizontally
+	// draws UTF-8 text on the screen horizontally
 	// depth is in the range [0,100] with lower being closer to the viewer
-	virtual void drawText(Font* font, const char* text, float xPos, float yPos, float depth = 0.0f);
+	// height scales the text from the font's own height if given, which stays
+	// sharp for distance field fonts
+	virtual void drawText(Font* font, const char* text, float xPos, float yPos, float depth = 0.0f, float height = 0.0f);
 
 	// sets the tint colour for all subsequent draw calls
 	void setRenderColour(float r, float g, float b, float a = 1.0f);
@@ -46,12 +51,71 @@ public:
 	void setCameraPos(float x, float y) { m_cameraX = x; m_cameraY = y; }
 	void getCameraPos(float& x, float& y) const { x = m_cameraX; y = m_cameraY; }
 
+	enum BlendMode : unsigned int {
+		BLEND_ALPHA = 0,
+		BLEND_ADDITIVE,
+		BLEND_MULTIPLY,
+	};
+
+	// sets the blend mode for all subsequent draw calls
+	void setBlendMode(BlendMode mode);
+	BlendMode getBlendMode() const { return m_blendMode; }
+
+	enum SortMode : unsigned int {
+		SORT_NONE = 0,	// drawn in the order they are submitted
+		SORT_DEFERRED,	// recorded and drawn in end(), back to front by depth then by texture and blend mode
+	};
+
+	// with deferred sorting, sprites at the same depth are grouped by texture so a frame
+	// is drawn in as few batches as possible, but no longer overlap in submission order.
+	// takes effect at the next begin()
+	void setSortMode(SortMode mode) { m_sortMode = mode; }
+	SortMode getSortMode() const { return m_sortMode; }
+
+	// sprites using a texture that has been added to the atlas are drawn from it, so
+	// any number of them can share a batch. the atlas isn't owned by the renderer
+	// and takes effect at the next begin()
+	void setAtlas(SpriteAtlas* atlas) { m_atlas = atlas; }
+	SpriteAtlas* getAtlas() const { return m_atlas; }
+
+	// when enabled drawSprite() writes a single compact record per sprite and the
+	// vertex shader expands it into a quad. it is ignored when deferred sorting, and
+	// the transformed sprite calls still write quads as they can skew and scale
+	void setSpriteInstancing(bool enabled) { m_spriteInstancing = enabled; }
+	bool getSpriteInstancing() const { return m_spriteInstancing; }
+
+	// the number of draw calls and quads used by the last begin / end pair
+	unsigned int getBatchCount() const { return m_batchCount; }
+	unsigned int getQuadCount() const { return m_quadCount; }
+
 protected:
 
 	// helper methods used during drawing
-	bool shouldFlush(int additionalVertices = 0, int additionalIndices = 0);
+	bool shouldFlush(int additionalVertices = 0);
 	void flushBatch();
-	unsigned int pushTexture(Texture* texture);
+	void beginBatch();
+	unsigned int pushTexture(unsigned int textureHandle, int isFont);
+	void applyBlendMode();
+
+	// makes room at m_vertices[m_currentVertex] for quadCount quads using a texture,
+	// returning the texture's slot in the batch for the vertices. texture is looked
+	// up in the atlas, fonts pass nullptr
+	unsigned int beginQuads(unsigned int quadCount, unsigned int textureHandle, int isFont, float depth, const Texture* texture);
+
+	// makes room at m_instances[m_currentInstance] for a sprite instance
+	unsigned int beginInstance(const Texture* texture);
+
+	// a batch is either quads or sprite instances, switching flushes
+	void setBatchInstanced(bool instanced);
+
+	// the current UV rect, remapped into the atlas if the last quads came from it
+	void getQuadUVRect(float& uvX, float& uvY, float& uvW, float& uvH) const;
+
+	// sorts the recorded quads and draws them
+	void drawDeferred();
+
+	// starts recording quads again after drawDeferred(), part way through a begin / end pair
+	void restartDeferred();
 
 	// indicates in the middle of a begin/end pair
 	bool				m_renderBegun;
@@ -59,35 +123,98 @@ protected:
 	// the camera position
 	float				m_cameraX, m_cameraY;
 
-	// texture handling
-	enum { TEXTURE_STACK_SIZE = 16 };
+	// texture handling, the stack holds OpenGL handles so fonts can share it.
+	// the last of the 16 texture units is kept for the atlas, and atlas vertices
+	// use a texture ID of ATLAS_LAYER_BASE + their layer
+	enum { TEXTURE_STACK_SIZE = 15, ATLAS_TEXTURE_UNIT = 15, ATLAS_LAYER_BASE = 32 };
 	Texture*			m_nullTexture;
-	Texture*			m_textureStack[TEXTURE_STACK_SIZE];
+	unsigned int		m_textureStack[TEXTURE_STACK_SIZE];
 	int					m_fontTexture[TEXTURE_STACK_SIZE];
+	int					m_uploadedFontTexture[TEXTURE_STACK_SIZE];
 	unsigned int		m_currentTexture;
 
+	// fonts with glyphs in the current batch, they are told once it is drawn
+	std::vector<Font*>	m_batchFonts;
+
+	// sprite atlas, and the region used by the quads being written (if any)
+	SpriteAtlas*		m_atlas;
+	unsigned int		m_atlasHandle;
+	const void*			m_quadRegion;
+
 	// texture coordinate information
 	float				m_uvX, m_uvY, m_uvW, m_uvH;
 
 	// represents colour in red, green, blue and alpha 0.0-1.0 range
 	float				m_r, m_g, m_b, m_a;
 
-	// sprite handling
-	enum { MAX_SPRITES = 512 };
+	// blending, the mode in use by the current batch is only set when it changes
+	BlendMode			m_blendMode;
+	BlendMode			m_appliedBlendMode;
+	int					m_previousDepthFunc;
+
+	// sprite handling, indices are 32-bit so a batch can go past 65536 vertices
+	enum { MAX_SPRITES = 16384 };
 	struct SBVertex {
 		float pos[4];
 		float color[4];
 		float texcoord[2];
 	};
 
-	// data used for opengl to draw the sprites (with padding)
-	SBVertex			m_vertices[MAX_SPRITES * 4];
-	unsigned short		m_indices[MAX_SPRITES * 6];
-	int					m_currentVertex, m_currentIndex;
-	unsigned int		m_vao, m_vbo, m_ibo;
+	// the current batch is written straight into the shared stream buffer
+	// and drawn with a static quad index buffer
+	SBVertex*			m_vertices;
+	SBVertex*			m_discardVertices;
+	unsigned int		m_streamOffset;
+	bool				m_streamReserved;
+	int					m_currentVertex;
+	unsigned int		m_vao, m_ibo;
+
+	// an instanced sprite, the corners are made in the vertex shader
+	struct SBInstance {
+		float			position[3];	// x, y, depth
+		float			size[2];
+		float			rotation;
+		float			origin[2];
+		float			uvRect[4];
+		unsigned char	colour[4];
+		float			textureID;
+	};
+
+	bool				m_spriteInstancing;
+	bool				m_batchInstanced;
+	SBInstance*			m_instances;
+	unsigned int		m_currentInstance;
+	unsigned int		m_instanceVao;
+
+	// deferred sorting, the key of each recorded quad and where its vertices are
+	struct DeferredQuad {
+		float			depth;
+		unsigned int	texture;
+		int				isFont;
+		unsigned int	blendMode;
+		int				atlasLayer;
+		unsigned int	firstVertex;
+	};
+
+	SortMode					m_sortMode;
+	bool						m_deferring;
+	std::vector<SBVertex>		m_deferredVertices;
+	std::vector<DeferredQuad>	m_deferredQuads;
+
+	// stats for the last begin / end pair
+	unsigned int		m_batchCount;
+	unsigned int		m_quadCount;
 
-	// shader used to render sprites
+	// shader used to render sprites, and its uniform locations
 	unsigned int		m_shader;
+	int					m_projectionUniform;
+	int					m_fontTextureUniform;
+
+	// shader used to render sprite instances, sharing the fragment shader
+	unsigned int		m_instanceShader;
+	int					m_instanceProjectionUniform;
+	int					m_instanceFontTextureUniform;
+	int					m_instanceUploadedFontTexture[TEXTURE_STACK_SIZE];
 
 	// helper method used to rotate sprites around a pivot
 	void	rotateAround(float inX, float inY, float& outX, float& outY, float sin, float cos);
@@ -0,0 +1,226 @@
+#include "gl_core_4_4.h"
+#include "SpriteAtlas.h"
+#include "Texture.h"
+#include <stdio.h>
+#include <algorithm>
+
+namespace aie {
+
+// textures are packed with a 1 pixel border of their own edge pixels
+// so that linear filtering never samples a neighbour
+static const unsigned int ATLAS_PADDING = 1;
+
+std::vector<SpriteAtlas*> SpriteAtlas::sm_atlases;
+
+SpriteAtlas::SpriteAtlas(unsigned int pageSize, unsigned int maxLayers)
+	: m_glHandle(0),
+	m_pageSize(pageSize),
+	m_maxLayers(maxLayers > 0 ? maxLayers : 1),
+	m_capacity(0) {
+
+	sm_atlases.push_back(this);
+}
+
+SpriteAtlas::~SpriteAtlas() {
+	if (m_glHandle != 0)
+		glDeleteTextures(1, &m_glHandle);
+
+	sm_atlases.erase(std::find(sm_atlases.begin(), sm_atlases.end(), this));
+}
+
+bool SpriteAtlas::add(const Texture* texture) {
+
+	if (texture == nullptr ||
+		texture->getHandle() == 0)
+		return false;
+
+	// already packed or waiting
+	if (m_regions.find(texture) != m_regions.end() ||
+		std::find(m_pending.begin(), m_pending.end(), texture) != m_pending.end())
+		return true;
+
+	// its size and pixels aren't there yet, reading it back now would copy an empty image
+	if (texture->isLoading()) {
+		m_pending.push_back(texture);
+		return true;
+	}
+
+	return pack(texture);
+}
+
+void SpriteAtlas::update() {
+
+	for (unsigned int i = 0; i < m_pending.size();) {
+		const Texture* texture = m_pending[i];
+		if (texture->isLoading()) {
+			++i;
+			continue;
+		}
+
+		m_pending.erase(m_pending.begin() + i);
+		if (texture->getHandle() != 0)
+			pack(texture);
+	}
+}
+
+void SpriteAtlas::removeTexture(const Texture* texture) {
+
+	for (auto atlas : sm_atlases) {
+		atlas->m_regions.erase(texture);
+		atlas->m_pending.erase(std::remove(atlas->m_pending.begin(), atlas->m_pending.end(), texture), atlas->m_pending.end());
+	}
+}
+
+bool SpriteAtlas::pack(const Texture* texture) {
+
+	unsigned int width = texture->getWidth();
+	unsigned int height = texture->getHeight();
+	unsigned int paddedWidth = width + ATLAS_PADDING * 2;
+	unsigned int paddedHeight = height + ATLAS_PADDING * 2;
+
+	unsigned int layer = 0, x = 0, y = 0;
+	if (width == 0 || height == 0 ||
+		allocate(paddedWidth, paddedHeight, layer, x, y) == false) {
+		printf("SpriteAtlas: no room for %s (%u x %u)\n", texture->getFilename().c_str(), width, height);
+		return false;
+	}
+
+	// read back as RGBA so every format samples the same as it would from the
+	// texture stack, this only happens when building the atlas
+	std::vector<unsigned int> pixels(width * height);
+	glBindTexture(GL_TEXTURE_2D, texture->getHandle());
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	glGetTexImage(GL_TEXTURE_2D, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// extrude the edges into the padding
+	std::vector<unsigned int> padded(paddedWidth * paddedHeight);
+	for (unsigned int py = 0; py < paddedHeight; ++py) {
+		unsigned int sy = py < ATLAS_PADDING ? 0 : py - ATLAS_PADDING;
+		if (sy >= height)
+			sy = height - 1;
+		for (unsigned int px = 0; px < paddedWidth; ++px) {
+			unsigned int sx = px < ATLAS_PADDING ? 0 : px - ATLAS_PADDING;
+			if (sx >= width)
+				sx = width - 1;
+			padded[py * paddedWidth + px] = pixels[sy * width + sx];
+		}
+	}
+
+	glBindTexture(GL_TEXTURE_2D_ARRAY, m_glHandle);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, x, y, layer, paddedWidth, paddedHeight, 1, GL_RGBA, GL_UNSIGNED_BYTE, padded.data());
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	Region region;
+	region.layer = layer;
+	region.uvX = (float)(x + ATLAS_PADDING) / m_pageSize;
+	region.uvY = (float)(y + ATLAS_PADDING) / m_pageSize;
+	region.uvW = (float)width / m_pageSize;
+	region.uvH = (float)height / m_pageSize;
+	m_regions[texture] = region;
+
+	return true;
+}
+
+const SpriteAtlas::Region* SpriteAtlas::find(const Texture* texture) const {
+	auto iter = m_regions.find(texture);
+	return iter != m_regions.end() ? &iter->second : nullptr;
+}
+
+bool SpriteAtlas::allocate(unsigned int width, unsigned int height, unsigned int& layer, unsigned int& x, unsigned int& y) {
+
+	if (width > m_pageSize ||
+		height > m_pageSize)
+		return false;
+
+	for (unsigned int i = 0; i < m_layers.size(); ++i) {
+		if (allocateInLayer(m_layers[i], width, height, x, y)) {
+			layer = i;
+			return true;
+		}
+	}
+
+	// start a new layer
+	if (m_layers.size() >= m_maxLayers)
+		return false;
+	if (m_layers.size() >= m_capacity &&
+		grow() == false)
+		return false;
+
+	Layer newLayer;
+	newLayer.top = 0;
+	m_layers.push_back(newLayer);
+
+	layer = (unsigned int)m_layers.size() - 1;
+	return allocateInLayer(m_layers.back(), width, height, x, y);
+}
+
+bool SpriteAtlas::allocateInLayer(Layer& layer, unsigned int width, unsigned int height, unsigned int& x, unsigned int& y) {
+
+	// use the shelf that wastes the least height
+	Shelf* best = nullptr;
+	for (auto& shelf : layer.shelves) {
+		if (shelf.height >= height &&
+			m_pageSize - shelf.x >= width &&
+			(best == nullptr || shelf.height < best->height))
+			best = &shelf;
+	}
+
+	// open a new shelf if none fit, or the best one is much taller than we need
+	if ((best == nullptr || best->height > height + height / 2) &&
+		m_pageSize - layer.top >= height) {
+		Shelf shelf = { layer.top, height, 0 };
+		layer.shelves.push_back(shelf);
+		layer.top += height;
+		best = &layer.shelves.back();
+	}
+
+	if (best == nullptr)
+		return false;
+
+	x = best->x;
+	y = best->y;
+	best->x += width;
+	return true;
+}
+
+bool SpriteAtlas::grow() {
+
+	// double the layer count, copying the existing layers across on the GPU
+	unsigned int capacity = m_capacity == 0 ? 1 : m_capacity * 2;
+	if (capacity > m_maxLayers)
+		capacity = m_maxLayers;
+
+	// clear any earlier error so the check below is only for the allocation
+	while (glGetError() != GL_NO_ERROR) {}
+
+	unsigned int handle = 0;
+	glGenTextures(1, &handle);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, handle);
+	glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_RGBA8, m_pageSize, m_pageSize, capacity);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+	if (glGetError() != GL_NO_ERROR) {
+		printf("SpriteAtlas: failed to allocate %u layers of %u x %u\n", capacity, m_pageSize, m_pageSize);
+		glDeleteTextures(1, &handle);
+		return false;
+	}
+
+	if (m_glHandle != 0) {
+		glCopyImageSubData(m_glHandle, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0,
+						   handle, GL_TEXTURE_2D_ARRAY, 0, 0, 0, 0,
+						   m_pageSize, m_pageSize, m_capacity);
+		glDeleteTextures(1, &m_glHandle);
+	}
+
+	m_glHandle = handle;
+	m_capacity = capacity;
+	return true;
+}
+
+} // namespace aie
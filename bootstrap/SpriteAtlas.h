@@ -0,0 +1,88 @@
+#pragma once
+
+#include <vector>
+#include <map>
+
+namespace aie {
+
+class Texture;
+
+// packs sprite textures into the layers of an OpenGL texture array so that a
+// Renderer2D can draw any number of them in a single batch. each layer is
+// filled with a shelf packer and layers are added as the atlas fills up
+class SpriteAtlas {
+public:
+
+	// pageSize is the width and height of every layer
+	SpriteAtlas(unsigned int pageSize = 2048, unsigned int maxLayers = 16);
+	~SpriteAtlas();
+
+	// copies a texture into the atlas, returns false if it is too big or the atlas is full.
+	// textures that aren't in the atlas are still drawn through the Renderer2D texture stack.
+	// sprites drawn from the atlas can't use texture coordinates outside of [0,1] to repeat.
+	// a texture still loading in the background is added by update() once it has loaded
+	bool add(const Texture* texture);
+
+	// adds textures that have finished loading since they were passed to add(),
+	// called by Renderer2D::begin()
+	void update();
+
+	// where a texture has been packed, with its texture coordinates within the layer
+	struct Region {
+		unsigned int	layer;
+		float			uvX, uvY, uvW, uvH;
+	};
+
+	// returns the region for a texture or nullptr if it isn't in the atlas
+	const Region*	find(const Texture* texture) const;
+
+	// called when a texture's image is released, every atlas forgets it.
+	// the space it used isn't reused
+	static void		removeTexture(const Texture* texture);
+
+	// the texture array handle, this changes if the atlas grows
+	unsigned int	getHandle() const		{ return m_glHandle; }
+
+	unsigned int	getPageSize() const		{ return m_pageSize; }
+	unsigned int	getLayerCount() const	{ return (unsigned int)m_layers.size(); }
+	unsigned int	getTextureCount() const	{ return (unsigned int)m_regions.size(); }
+
+protected:
+
+	// a row of a layer, textures are placed along it left to right
+	struct Shelf {
+		unsigned int	y, height;
+		unsigned int	x;
+	};
+
+	struct Layer {
+		std::vector<Shelf>	shelves;
+		unsigned int		top;
+	};
+
+	// copies a loaded texture in
+	bool	pack(const Texture* texture);
+
+	// finds room for a rectangle, adding a layer if needed
+	bool	allocate(unsigned int width, unsigned int height, unsigned int& layer, unsigned int& x, unsigned int& y);
+	bool	allocateInLayer(Layer& layer, unsigned int width, unsigned int height, unsigned int& x, unsigned int& y);
+	bool	grow();
+
+	unsigned int	m_glHandle;
+	unsigned int	m_pageSize;
+	unsigned int	m_maxLayers;
+
+	// how many layers the texture array has storage for, m_layers may use fewer
+	unsigned int	m_capacity;
+
+	std::vector<Layer>					m_layers;
+	std::map<const Texture*, Region>	m_regions;
+
+	// textures passed to add() while they were still loading
+	std::vector<const Texture*>			m_pending;
+
+	// every atlas that exists, so released textures can be removed
+	static std::vector<SpriteAtlas*>	sm_atlases;
+};
+
+} // namespace aie
@@ -0,0 +1,212 @@
+#include "StreamBuffer.h"
+#include "gl_core_4_4.h"
+#include <assert.h>
+#include <stdio.h>
+
+namespace aie {
+
+StreamBuffer* StreamBuffer::m_instance = nullptr;
+
+static unsigned int alignUp(unsigned int value, unsigned int alignment) {
+	if (alignment <= 1)
+		return value;
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+bool StreamBuffer::create(unsigned int size, unsigned int framesInFlight) {
+
+	if (m_instance != nullptr)
+		return true;
+
+	// persistent mapping is core in 4.4 but the loader can still come back partial
+	if (glBufferStorage == nullptr ||
+		glFenceSync == nullptr) {
+		printf("StreamBuffer: glBufferStorage / glFenceSync unavailable, OpenGL 4.4 is required\n");
+		return false;
+	}
+
+	m_instance = new StreamBuffer(size, framesInFlight);
+
+	if (m_instance->m_mappedData == nullptr) {
+		printf("StreamBuffer: failed to persistently map %u bytes\n", size);
+		destroy();
+		return false;
+	}
+
+	return true;
+}
+
+StreamBuffer::StreamBuffer(unsigned int size, unsigned int framesInFlight)
+	: m_glHandle(0),
+	m_mappedData(nullptr),
+	m_size(size),
+	m_framesInFlight(framesInFlight > 0 ? framesInFlight : 1),
+	m_head(0),
+	m_frameStart(0),
+	m_frameBytes(0),
+	m_frameWrapped(false) {
+
+	GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+
+	// use the copy target so that no VAO's element binding is disturbed
+	glGenBuffers(1, &m_glHandle);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, m_glHandle);
+	glBufferStorage(GL_COPY_WRITE_BUFFER, m_size, nullptr, flags);
+	m_mappedData = (unsigned char*)glMapBufferRange(GL_COPY_WRITE_BUFFER, 0, m_size, flags);
+	glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+}
+
+StreamBuffer::~StreamBuffer() {
+
+	for (auto& frame : m_frames)
+		glDeleteSync((GLsync)frame.fence);
+
+	if (m_mappedData != nullptr) {
+		glBindBuffer(GL_COPY_WRITE_BUFFER, m_glHandle);
+		glUnmapBuffer(GL_COPY_WRITE_BUFFER);
+		glBindBuffer(GL_COPY_WRITE_BUFFER, 0);
+	}
+
+	glDeleteBuffers(1, &m_glHandle);
+}
+
+void* StreamBuffer::allocate(unsigned int size, unsigned int alignment, unsigned int& offset) {
+
+	void* data = reserve(size, alignment, offset);
+	if (data != nullptr)
+		commit(size);
+	return data;
+}
+
+void* StreamBuffer::reserve(unsigned int size, unsigned int alignment, unsigned int& offset) {
+
+	unsigned int start = alignUp(m_head, alignment);
+	bool wrapped = m_frameWrapped;
+
+	// wrap back to the start of the ring if it doesn't fit at the end
+	if (size > m_size - start ||
+		start > m_size) {
+		start = 0;
+		wrapped = true;
+	}
+
+	// a frame can't run into its own data
+	if (size > m_size ||
+		(wrapped && start + size > m_frameStart))
+		return nullptr;
+
+	// make sure the GPU has finished with anything we're about to overwrite
+	waitForRange(start, start + size);
+
+	m_head = start + size;
+	m_frameWrapped = wrapped;
+	m_frameBytes += size;
+
+	Reservation reservation = { start, size };
+	m_reservations.push_back(reservation);
+
+	offset = start;
+	return m_mappedData + start;
+}
+
+void StreamBuffer::commit(unsigned int usedSize) {
+
+	if (m_reservations.empty()) {
+		printf("StreamBuffer: commit() called without a reservation\n");
+		return;
+	}
+
+	Reservation reservation = m_reservations.back();
+	m_reservations.pop_back();
+
+	assert(usedSize <= reservation.size);
+	if (usedSize > reservation.size)
+		usedSize = reservation.size;
+
+	// hand back the unused tail, unless something nested has been allocated after it
+	if (m_head == reservation.offset + reservation.size) {
+		m_head = reservation.offset + usedSize;
+		m_frameBytes -= reservation.size - usedSize;
+	}
+}
+
+void StreamBuffer::beginFrame() {
+
+	// release frames the GPU has already finished with
+	while (m_frames.empty() == false) {
+		GLenum result = glClientWaitSync((GLsync)m_frames.front().fence, 0, 0);
+		if (result != GL_ALREADY_SIGNALED &&
+			result != GL_CONDITION_SATISFIED)
+			break;
+		glDeleteSync((GLsync)m_frames.front().fence);
+		m_frames.pop_front();
+	}
+
+	m_frameStart = m_head;
+	m_frameWrapped = false;
+	m_frameBytes = 0;
+}
+
+void StreamBuffer::endFrame() {
+
+	assert(m_reservations.empty() && "StreamBuffer reservation left open at the end of the frame");
+
+	if (m_head != m_frameStart ||
+		m_frameWrapped) {
+		FrameRange frame;
+		frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+		frame.start = m_frameStart;
+		frame.end = m_head;
+		frame.wrapped = m_frameWrapped;
+		m_frames.push_back(frame);
+	}
+
+	// don't let the CPU run too far ahead of the GPU
+	while (m_frames.size() > m_framesInFlight)
+		waitForOldestFrame();
+}
+
+bool StreamBuffer::overlaps(const FrameRange& frame, unsigned int start, unsigned int end) const {
+
+	if (frame.wrapped)
+		return end > frame.start || start < frame.end;
+	return start < frame.end && end > frame.start;
+}
+
+void StreamBuffer::waitForRange(unsigned int start, unsigned int end) {
+
+	// frames retire in order, so keep waiting on the oldest until nothing overlaps
+	bool overlapping = true;
+	while (overlapping &&
+		   m_frames.empty() == false) {
+		overlapping = false;
+		for (auto& frame : m_frames) {
+			if (overlaps(frame, start, end)) {
+				overlapping = true;
+				break;
+			}
+		}
+		if (overlapping)
+			waitForOldestFrame();
+	}
+}
+
+void StreamBuffer::waitForOldestFrame() {
+
+	GLsync fence = (GLsync)m_frames.front().fence;
+
+	GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+	GLenum result = GL_TIMEOUT_EXPIRED;
+	while (result == GL_TIMEOUT_EXPIRED) {
+		result = glClientWaitSync(fence, flags, 1000000000);
+		flags = 0;
+	}
+
+	if (result == GL_WAIT_FAILED)
+		printf("StreamBuffer: glClientWaitSync failed\n");
+
+	glDeleteSync(fence);
+	m_frames.pop_front();
+}
+
+} // namespace aie
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+
+namespace aie {
+
+// a singleton ring buffer of persistently mapped GPU memory for vertex and
+// index data that is rebuilt every frame. producers bump-allocate from the
+// current frame and write straight into the returned pointer, and the buffer
+// fences each frame so memory is only reused once the GPU has finished with it
+class StreamBuffer {
+public:
+
+	// returns access to the singleton instance
+	static StreamBuffer* getInstance() { return m_instance; }
+
+	// the OpenGL buffer handle, can be bound to any buffer target
+	unsigned int	getHandle() const		{ return m_glHandle; }
+
+	// total size of the ring, and the number of bytes handed out this frame
+	unsigned int	getSize() const			{ return m_size; }
+	unsigned int	getFrameBytes() const	{ return m_frameBytes; }
+
+	// allocates size bytes from the current frame with the start rounded up to
+	// a multiple of alignment (which doesn't need to be a power of two, so a
+	// vertex stride can be passed to keep offset / stride a whole vertex).
+	// returns a write-only pointer and fills in the byte offset into the buffer,
+	// or returns nullptr if the frame has run out of room
+	void*			allocate(unsigned int size, unsigned int alignment, unsigned int& offset);
+
+	// like allocate but for producers that don't know their final size up front.
+	// reserve the most that might be written, then commit what was actually used.
+	// reservations nest: allocations and reservations made while one is open are
+	// placed after its whole span, and commit closes the most recent one
+	void*			reserve(unsigned int size, unsigned int alignment, unsigned int& offset);
+	void			commit(unsigned int usedSize);
+
+protected:
+
+	// just giving the Application class access to the StreamBuffer singleton
+	friend class Application;
+
+	// singleton pointer
+	static StreamBuffer* m_instance;
+
+	// only want the Application class to be able to create / destroy
+	// returns false if the context doesn't support persistent mapping
+	static bool create(unsigned int size, unsigned int framesInFlight);
+	static void destroy()			{ delete m_instance; m_instance = nullptr; }
+
+	// should be called once by the application around all rendering for a frame
+	void beginFrame();
+	void endFrame();
+
+private:
+
+	// constructor private for singleton
+	StreamBuffer(unsigned int size, unsigned int framesInFlight);
+	~StreamBuffer();
+
+	// a region of the ring used by a previous frame, and the fence that
+	// signals when the GPU is done reading from it
+	struct FrameRange {
+		void*			fence;
+		unsigned int	start, end;
+		bool			wrapped;
+	};
+
+	bool	overlaps(const FrameRange& frame, unsigned int start, unsigned int end) const;
+	void	waitForRange(unsigned int start, unsigned int end);
+	void	waitForOldestFrame();
+
+	unsigned int	m_glHandle;
+	unsigned char*	m_mappedData;
+	unsigned int	m_size;
+	unsigned int	m_framesInFlight;
+
+	// current write position and where this frame started
+	unsigned int	m_head;
+	unsigned int	m_frameStart;
+	unsigned int	m_frameBytes;
+	bool			m_frameWrapped;
+
+	// open reservations, innermost last
+	struct Reservation {
+		unsigned int	offset, size;
+	};
+
+	std::vector<Reservation>	m_reservations;
+
+	std::deque<FrameRange>	m_frames;
+};
+
+} // namespace aie
@@ -1,18 +1,40 @@
 #include "gl_core_4_4.h"
 #include "Texture.h"
+#include "TextureLoader.h"
+#include "TextureCooker.h"
+#include "SpriteAtlas.h"
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include <stb_image.h>
 
+// s3tc isn't part of core OpenGL but is supported by every desktop driver
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
 namespace aie {
 
+std::vector<Texture*> Texture::sm_textures;
+
 Texture::Texture() 
 	: m_filename("none"),
 	m_width(0),
 	m_height(0),
 	m_glHandle(0),
 	m_format(0),
-	m_loadedPixels(nullptr) {
+	m_loadedPixels(nullptr),
+	m_memorySize(0),
+	m_loading(false),
+	m_residency(GPU_ONLY),
+	m_evicted(false) {
+
+	sm_textures.push_back(this);
 }
 
 Texture::Texture(const char * filename)
@@ -21,8 +43,13 @@ Texture::Texture(const char * filename)
 	m_height(0),
 	m_glHandle(0),
 	m_format(0),
-	m_loadedPixels(nullptr) {
+	m_loadedPixels(nullptr),
+	m_memorySize(0),
+	m_loading(false),
+	m_residency(GPU_ONLY),
+	m_evicted(false) {
 
+	sm_textures.push_back(this);
 	load(filename);
 }
 
@@ -30,78 +57,275 @@ Texture::Texture(unsigned int width, unsigned int height, Format format, unsigne
 	: m_filename("none"),
 	m_width(width),
 	m_height(height),
+	m_glHandle(0),
 	m_format(format),
-	m_loadedPixels(nullptr) {
+	m_loadedPixels(nullptr),
+	m_memorySize(0),
+	m_loading(false),
+	m_residency(GPU_ONLY),
+	m_evicted(false) {
 
+	sm_textures.push_back(this);
 	create(width, height, format, pixels);
 }
 
 Texture::~Texture() {
-	if (m_glHandle != 0)
-		glDeleteTextures(1, &m_glHandle);
-	if (m_loadedPixels != nullptr)
-		stbi_image_free(m_loadedPixels);
+	release();
+
+	for (auto iter = sm_textures.begin(); iter != sm_textures.end(); ++iter) {
+		if (*iter == this) {
+			sm_textures.erase(iter);
+			break;
+		}
+	}
 }
 
-bool Texture::load(const char* filename) {
+void Texture::release() {
+
+	if (m_loading) {
+		TextureLoader::getInstance()->cancel(this);
+		m_loading = false;
+	}
 
 	if (m_glHandle != 0) {
 		glDeleteTextures(1, &m_glHandle);
 		m_glHandle = 0;
-		m_width = 0;
-		m_height = 0;
-		m_filename = "none";
+	}
+	if (m_loadedPixels != nullptr) {
+		stbi_image_free(m_loadedPixels);
+		m_loadedPixels = nullptr;
+	}
+
+	// atlases keep a copy of the old image
+	SpriteAtlas::removeTexture(this);
+
+	m_width = 0;
+	m_height = 0;
+	m_memorySize = 0;
+	m_evicted = false;
+	m_filename = "none";
+}
+
+void Texture::setResidency(Residency residency) {
+	m_residency = residency;
+	applyResidency();
+}
+
+void Texture::applyResidency() {
+	if (m_residency != CPU_READBACK &&
+		m_loadedPixels != nullptr) {
+		stbi_image_free(m_loadedPixels);
+		m_loadedPixels = nullptr;
+	}
+}
+
+void Texture::evict() {
+
+	if (m_residency != STREAMING ||
+		m_glHandle == 0 ||
+		m_loading)
+		return;
+
+	glDeleteTextures(1, &m_glHandle);
+	m_glHandle = 0;
+	m_memorySize = 0;
+	m_evicted = true;
+}
+
+bool Texture::restore() {
+
+	if (m_evicted == false)
+		return true;
+
+	std::string filename = m_filename;
+	return loadAsync(filename.c_str());
+}
+
+unsigned int Texture::getTotalMemorySize() {
+	unsigned int total = 0;
+	for (auto texture : sm_textures)
+		total += texture->getMemorySize();
+	return total;
+}
+
+unsigned int Texture::getTotalCPUMemorySize() {
+	unsigned int total = 0;
+	for (auto texture : sm_textures)
+		total += texture->getCPUMemorySize();
+	return total;
+}
+
+bool Texture::load(const char* filename) {
+
+	release();
+
+	if (TextureCooker::isCookedFile(filename)) {
+		std::vector<unsigned char> data;
+		if (readFile(filename, data) == false ||
+			uploadCooked(data.data(), (unsigned int)data.size(), false) == false) {
+			release();
+			return false;
+		}
+		m_filename = filename;
+		return true;
 	}
 
 	int x = 0, y = 0, comp = 0;
 	m_loadedPixels = stbi_load(filename, &x, &y, &comp, STBI_default);
 
 	if (m_loadedPixels != nullptr) {
-		glGenTextures(1, &m_glHandle);
-		glBindTexture(GL_TEXTURE_2D, m_glHandle);
-		switch (comp) {
-		case STBI_grey:
-			m_format = RED;
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, x, y,
-						 0, GL_RED, GL_UNSIGNED_BYTE, m_loadedPixels);
-			break;
-		case STBI_grey_alpha:
-			m_format = RG;
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RG, x, y,
-						 0, GL_RG, GL_UNSIGNED_BYTE, m_loadedPixels);
-			break;
-		case STBI_rgb:
-			m_format = RGB;
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, x, y,
-						 0, GL_RGB, GL_UNSIGNED_BYTE, m_loadedPixels);
-			break;
-		case STBI_rgb_alpha:
-			m_format = RGBA;
-			glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, x, y,
-						 0, GL_RGBA, GL_UNSIGNED_BYTE, m_loadedPixels);
-			break;
-		default:	break;
-		};
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glGenerateMipmap(GL_TEXTURE_2D);
-		glBindTexture(GL_TEXTURE_2D, 0);
-		m_width = (unsigned int)x;
-		m_height = (unsigned int)y;
+		upload(m_loadedPixels, x, y, comp);
+		applyResidency();
 		m_filename = filename;
 		return true;
 	}
 	return false;
 }
 
-void Texture::create(unsigned int width, unsigned int height, Format format, unsigned char* pixels) {
+bool Texture::loadAsync(const char* filename) {
 
-	if (m_glHandle != 0) {
-		glDeleteTextures(1, &m_glHandle);
-		m_glHandle = 0;
-		m_filename = "none";
+	if (filename == nullptr ||
+		filename[0] == 0)
+		return false;
+
+	// without a loader (no Application) just load it now
+	if (TextureLoader::getInstance() == nullptr)
+		return load(filename);
+
+	release();
+
+	glGenTextures(1, &m_glHandle);
+	m_filename = filename;
+	m_loading = true;
+
+	return TextureLoader::getInstance()->load(this, filename);
+}
+
+void Texture::upload(const void* pixels, int width, int height, int components) {
+
+	if (m_glHandle == 0)
+		glGenTextures(1, &m_glHandle);
+
+	glBindTexture(GL_TEXTURE_2D, m_glHandle);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	switch (components) {
+	case STBI_grey:
+		m_format = RED;
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RED, width, height,
+					 0, GL_RED, GL_UNSIGNED_BYTE, pixels);
+		break;
+	case STBI_grey_alpha:
+		m_format = RG;
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RG, width, height,
+					 0, GL_RG, GL_UNSIGNED_BYTE, pixels);
+		break;
+	case STBI_rgb:
+		m_format = RGB;
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height,
+					 0, GL_RGB, GL_UNSIGNED_BYTE, pixels);
+		break;
+	case STBI_rgb_alpha:
+		m_format = RGBA;
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, width, height,
+					 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		break;
+	default:	break;
+	};
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glGenerateMipmap(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, 0);
+	m_width = (unsigned int)width;
+	m_height = (unsigned int)height;
+
+	// a full mip chain adds a third
+	m_memorySize = m_width * m_height * m_format * 4 / 3;
+}
+
+bool Texture::readFile(const char* filename, std::vector<unsigned char>& data) {
+
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+	if (file.is_open() == false)
+		return false;
+
+	data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+	return data.empty() == false;
+}
+
+bool Texture::uploadCooked(const unsigned char* data, unsigned int size, bool fromPixelBuffer) {
+
+	const TextureCooker::Header* header = (const TextureCooker::Header*)data;
+	if (size < sizeof(TextureCooker::Header) ||
+		memcmp(header->magic, "AIET", 4) != 0 ||
+		header->version != TextureCooker::VERSION ||
+		header->format > TextureCooker::BC5 ||
+		header->width == 0 || header->height == 0 ||
+		header->mipCount == 0 || header->mipCount > 32) {
+		printf("Texture: not a cooked texture or the wrong version\n");
+		return false;
+	}
+
+	// check every level is there before uploading any
+	unsigned int offset = sizeof(TextureCooker::Header);
+	for (unsigned int mip = 0; mip < header->mipCount; ++mip) {
+		unsigned int width = header->width >> mip > 0 ? header->width >> mip : 1;
+		unsigned int height = header->height >> mip > 0 ? header->height >> mip : 1;
+		offset += TextureCooker::getLevelSize(header->format, width, height);
+	}
+	if (offset > size) {
+		printf("Texture: cooked texture is truncated\n");
+		return false;
+	}
+
+	unsigned int internalFormat = 0;
+	switch (header->format) {
+	case TextureCooker::BC1:	internalFormat = GL_COMPRESSED_RGB_S3TC_DXT1_EXT;	m_format = RGB;	break;
+	case TextureCooker::BC3:	internalFormat = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;	m_format = RGBA;	break;
+	case TextureCooker::BC5:	internalFormat = GL_COMPRESSED_RG_RGTC2;			m_format = RG;	break;
+	case TextureCooker::RGBA8:
+	default:					internalFormat = GL_RGBA8;							m_format = RGBA;	break;
+	};
+
+	if (m_glHandle == 0)
+		glGenTextures(1, &m_glHandle);
+
+	glBindTexture(GL_TEXTURE_2D, m_glHandle);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	offset = sizeof(TextureCooker::Header);
+	m_memorySize = 0;
+	for (unsigned int mip = 0; mip < header->mipCount; ++mip) {
+		unsigned int width = header->width >> mip > 0 ? header->width >> mip : 1;
+		unsigned int height = header->height >> mip > 0 ? header->height >> mip : 1;
+		unsigned int levelSize = TextureCooker::getLevelSize(header->format, width, height);
+
+		// from a pixel buffer the data is an offset into it
+		const void* pixels = fromPixelBuffer ? (const void*)(size_t)offset : data + offset;
+		if (header->format == TextureCooker::RGBA8)
+			glTexImage2D(GL_TEXTURE_2D, mip, internalFormat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
+		else
+			glCompressedTexImage2D(GL_TEXTURE_2D, mip, internalFormat, width, height, 0, levelSize, pixels);
+
+		offset += levelSize;
+		m_memorySize += levelSize;
 	}
 
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, header->mipCount - 1);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	m_width = header->width;
+	m_height = header->height;
+	return true;
+}
+
+void Texture::create(unsigned int width, unsigned int height, Format format, unsigned char* pixels) {
+
+	release();
+
 	m_width = width;
 	m_height = height;
 	m_format = format;
@@ -131,6 +355,8 @@ void Texture::create(unsigned int width, unsigned int height, Format format, uns
 	};
 
 	glBindTexture(GL_TEXTURE_2D, 0);
+
+	m_memorySize = m_width * m_height * (m_format >= RED && m_format <= RGBA ? m_format : 4);
 }
 
 void Texture::bind(unsigned int slot) const {
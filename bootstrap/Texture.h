@@ -1,6 +1,7 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 namespace aie {
 
@@ -15,14 +16,42 @@ public:
 		RGBA
 	};
 
+	// what is kept of a texture loaded from a file
+	enum Residency : unsigned int {
+		GPU_ONLY = 0,	// the decoded pixels are freed once uploaded
+		CPU_READBACK,	// the decoded pixels are kept for getPixels()
+		STREAMING,		// like GPU_ONLY, and the image can be evicted from video memory and restored from its file
+	};
+
 	Texture();
 	Texture(const char* filename);
 	Texture(unsigned int width, unsigned int height, Format format, unsigned char* pixels = nullptr);
 	virtual ~Texture();
 
-	// load a jpg, bmp, png or tga
+	// load a jpg, bmp, png or tga, or a .tex file made by the TextureCooker.
+	// cooked textures have their mip levels uploaded as they are and no pixels
 	bool load(const char* filename);
 
+	// queues a jpg, bmp, png, tga or .tex to be loaded in the background by the TextureLoader,
+	// returns false if the filename is empty. the handle is valid straight away but the
+	// size and pixels are only filled in once it has loaded
+	bool loadAsync(const char* filename);
+
+	// true while a background load hasn't finished
+	bool isLoading() const { return m_loading; }
+
+	// set before loading to keep the pixels, changing to GPU_ONLY or STREAMING frees them
+	void setResidency(Residency residency);
+	Residency getResidency() const { return m_residency; }
+
+	// frees the video memory of a STREAMING texture, its size and filename are kept
+	void evict();
+
+	// loads an evicted texture again in the background
+	bool restore();
+
+	bool isEvicted() const { return m_evicted; }
+
 	// creates a texture that can be filled in with pixels
 	void create(unsigned int width, unsigned int height, Format format, unsigned char* pixels = nullptr);
 
@@ -38,16 +67,51 @@ public:
 	unsigned int getWidth() const { return m_width; }
 	unsigned int getHeight() const { return m_height; }
 	unsigned int getFormat() const { return m_format; }
+	// returns nullptr unless the residency is CPU_READBACK
 	const unsigned char* getPixels() const { return m_loadedPixels; }
 
+	// roughly how much video memory the image uses, including mip levels
+	unsigned int getMemorySize() const { return m_memorySize; }
+
+	// how much system memory is used by the kept pixels
+	unsigned int getCPUMemorySize() const { return m_loadedPixels != nullptr ? m_width * m_height * m_format : 0; }
+
+	// every texture that currently exists, and their combined memory use
+	static const std::vector<Texture*>& getTextures() { return sm_textures; }
+	static unsigned int getTotalMemorySize();
+	static unsigned int getTotalCPUMemorySize();
+
 protected:
 
+	friend class TextureLoader;
+
+	// releases the current image and any load in progress
+	void release();
+
+	// creates the OpenGL image from decoded pixels, which can be an offset into
+	// a bound pixel unpack buffer
+	void upload(const void* pixels, int width, int height, int components);
+
+	// creates the OpenGL image from a cooked texture file's contents, returns false if it isn't valid
+	bool uploadCooked(const unsigned char* data, unsigned int size, bool fromPixelBuffer);
+
+	static bool readFile(const char* filename, std::vector<unsigned char>& data);
+
+	// frees the decoded pixels if the residency doesn't keep them
+	void applyResidency();
+
 	std::string		m_filename;
 	unsigned int	m_width;
 	unsigned int	m_height;
 	unsigned int	m_glHandle;
 	unsigned int	m_format;
 	unsigned char*	m_loadedPixels;
+	unsigned int	m_memorySize;
+	bool			m_loading;
+	Residency		m_residency;
+	bool			m_evicted;
+
+	static std::vector<Texture*>	sm_textures;
 };
 
 } // namespace aie
\ No newline at end of file
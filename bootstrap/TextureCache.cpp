@@ -0,0 +1,115 @@
+#include "TextureCache.h"
+#include "Texture.h"
+#include <vector>
+#include <stdio.h>
+#include <ctype.h>
+
+namespace aie {
+
+TextureCache* TextureCache::m_instance = nullptr;
+
+std::shared_ptr<Texture> TextureCache::get(const std::string& filename, bool async) {
+
+	// materials without a texture ask for folder + ""
+	if (filename.empty() ||
+		filename.back() == '/' ||
+		filename.back() == '\\')
+		return nullptr;
+
+	std::string key = getCanonicalPath(filename);
+
+	auto iter = m_textures.find(key);
+	if (iter != m_textures.end()) {
+		std::shared_ptr<Texture> texture = iter->second.lock();
+		if (texture != nullptr) {
+			m_hits++;
+			return texture;
+		}
+	}
+
+	m_misses++;
+
+	// forget about textures that are no longer used while we're here
+	for (auto i = m_textures.begin(); i != m_textures.end();) {
+		if (i->second.expired())
+			i = m_textures.erase(i);
+		else
+			++i;
+	}
+
+	std::shared_ptr<Texture> texture = std::make_shared<Texture>();
+	bool loaded = async ? texture->loadAsync(filename.c_str()) : texture->load(filename.c_str());
+	if (loaded == false)
+		return nullptr;
+
+	m_textures[key] = texture;
+	return texture;
+}
+
+unsigned int TextureCache::getBytesSaved() const {
+
+	unsigned int saved = 0;
+	for (auto& entry : m_textures) {
+		std::shared_ptr<Texture> texture = entry.second.lock();
+
+		// one less for the pointer just taken
+		if (texture != nullptr &&
+			texture.use_count() > 2)
+			saved += (unsigned int)(texture.use_count() - 2) * texture->getMemorySize();
+	}
+	return saved;
+}
+
+void TextureCache::printReport() const {
+
+	printf("TextureCache: %u hits, %u misses\n", m_hits, m_misses);
+	for (auto& entry : m_textures) {
+		std::shared_ptr<Texture> texture = entry.second.lock();
+		if (texture != nullptr)
+			printf("  %s: %u users, %u KB\n", entry.first.c_str(), (unsigned int)texture.use_count() - 1, texture->getMemorySize() / 1024);
+	}
+	printf("TextureCache: %u KB saved\n", getBytesSaved() / 1024);
+}
+
+std::string TextureCache::getCanonicalPath(const std::string& filename) {
+
+	// windows paths aren't case sensitive
+	std::string path = filename;
+	for (auto& c : path)
+		c = c == '\\' ? '/' : (char)tolower((unsigned char)c);
+
+	bool absolute = path.empty() == false && path[0] == '/';
+
+	std::vector<std::string> parts;
+	size_t start = 0;
+	while (start <= path.size()) {
+		size_t end = path.find('/', start);
+		if (end == std::string::npos)
+			end = path.size();
+
+		std::string part = path.substr(start, end - start);
+		if (part == "..") {
+			if (parts.empty() == false &&
+				parts.back() != ".." &&
+				parts.back().back() != ':')
+				parts.pop_back();
+			else if (absolute == false)
+				parts.push_back(part);
+		}
+		else if (part.empty() == false &&
+				 part != ".")
+			parts.push_back(part);
+
+		start = end + 1;
+	}
+
+	std::string canonical = absolute ? "/" : "";
+	for (size_t i = 0; i < parts.size(); ++i) {
+		if (i > 0)
+			canonical += '/';
+		canonical += parts[i];
+	}
+	return canonical;
+}
+
+} // namespace aie
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <string>
+#include <map>
+#include <memory>
+
+namespace aie {
+
+class Texture;
+
+// a singleton that shares textures loaded from the same file. textures are
+// handed out as shared pointers and unloaded once nothing holds them, the
+// cache only keeps track of the ones still in use
+class TextureCache {
+public:
+
+	// returns access to the singleton instance
+	static TextureCache* getInstance() { return m_instance; }
+
+	// returns the texture for a file, loading it if nothing else is using it.
+	// the same path written differently (./a/../b.png, B.PNG, b\\c.png) finds the same texture.
+	// returns nullptr for an empty filename without touching the file system,
+	// or if the file couldn't be loaded straight away
+	std::shared_ptr<Texture>	get(const std::string& filename, bool async = true);
+
+	// the number of requests that found a texture already loaded
+	unsigned int	getHitCount() const		{ return m_hits; }
+	unsigned int	getMissCount() const	{ return m_misses; }
+
+	// the video memory that would have been used by duplicates of textures that are still shared
+	unsigned int	getBytesSaved() const;
+
+	// prints the textures in use, how many holders each has and the memory saved
+	void			printReport() const;
+
+	// lowercase with forward slashes and any . or .. resolved
+	static std::string	getCanonicalPath(const std::string& filename);
+
+protected:
+
+	// just giving the Application class access to the TextureCache singleton
+	friend class Application;
+
+	// singleton pointer
+	static TextureCache* m_instance;
+
+	// only want the Application class to be able to create / destroy
+	static void create()	{ m_instance = new TextureCache(); }
+	static void destroy()	{ delete m_instance; m_instance = nullptr; }
+
+private:
+
+	// constructor private for singleton
+	TextureCache() : m_hits(0), m_misses(0) {}
+	~TextureCache() {}
+
+	std::map<std::string, std::weak_ptr<Texture>>	m_textures;
+
+	unsigned int	m_hits;
+	unsigned int	m_misses;
+};
+
+} // namespace aie
@@ -0,0 +1,291 @@
+#include "TextureCooker.h"
+#include <stdio.h>
+#include <string.h>
+#include <vector>
+#include <thread>
+#include <fstream>
+
+#include <stb_image.h>
+
+#define STB_IMAGE_RESIZE_IMPLEMENTATION
+#include <stb_image_resize.h>
+
+#define STB_DXT_IMPLEMENTATION
+#include <stb_dxt.h>
+
+namespace aie {
+
+// copies a 4x4 block of RGBA pixels, repeating the edge for levels smaller than a block
+static void readBlock(const unsigned char* pixels, unsigned int width, unsigned int height,
+					  unsigned int blockX, unsigned int blockY, unsigned char* block) {
+
+	for (unsigned int y = 0; y < 4; ++y) {
+		unsigned int py = blockY * 4 + y < height ? blockY * 4 + y : height - 1;
+		for (unsigned int x = 0; x < 4; ++x) {
+			unsigned int px = blockX * 4 + x < width ? blockX * 4 + x : width - 1;
+			memcpy(block + (y * 4 + x) * 4, pixels + (py * width + px) * 4, 4);
+		}
+	}
+}
+
+// BC4, one channel of 16 values as two endpoints and 3 bit indices.
+// uses the 8 value mode, picking the nearest value for each pixel
+static void compressBC4Block(unsigned char* dest, const unsigned char* block, int channel) {
+
+	unsigned char minValue = 255, maxValue = 0;
+	for (int i = 0; i < 16; ++i) {
+		unsigned char value = block[i * 4 + channel];
+		minValue = value < minValue ? value : minValue;
+		maxValue = value > maxValue ? value : maxValue;
+	}
+
+	dest[0] = maxValue;
+	dest[1] = minValue;
+
+	int palette[8];
+	palette[0] = maxValue;
+	palette[1] = minValue;
+	for (int i = 1; i < 7; ++i)
+		palette[i + 1] = ((7 - i) * maxValue + i * minValue + 3) / 7;
+
+	unsigned long long indices = 0;
+	for (int i = 0; i < 16; ++i) {
+		int value = block[i * 4 + channel];
+		int best = 0;
+		int bestError = 256;
+		for (int p = 0; p < 8; ++p) {
+			int error = value > palette[p] ? value - palette[p] : palette[p] - value;
+			if (error < bestError) {
+				bestError = error;
+				best = p;
+			}
+		}
+		indices |= (unsigned long long)best << (i * 3);
+	}
+
+	for (int i = 0; i < 6; ++i)
+		dest[2 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+// compresses rows of blocks from firstRow up to lastRow
+static void compressRows(const unsigned char* pixels, unsigned int width, unsigned int height,
+						 unsigned int format, unsigned char* dest, unsigned int firstRow, unsigned int lastRow) {
+
+	unsigned int blocksWide = (width + 3) / 4;
+	unsigned int blockSize = format == TextureCooker::BC1 ? 8 : 16;
+
+	unsigned char block[64];
+	for (unsigned int by = firstRow; by < lastRow; ++by) {
+		for (unsigned int bx = 0; bx < blocksWide; ++bx) {
+			unsigned char* out = dest + (by * blocksWide + bx) * blockSize;
+			readBlock(pixels, width, height, bx, by, block);
+
+			switch (format) {
+			case TextureCooker::BC1:
+				stb_compress_dxt_block(out, block, 0, STB_DXT_HIGHQUAL);
+				break;
+			case TextureCooker::BC3:
+				stb_compress_dxt_block(out, block, 1, STB_DXT_HIGHQUAL);
+				break;
+			case TextureCooker::BC5:
+				compressBC4Block(out, block, 0);
+				compressBC4Block(out + 8, block, 1);
+				break;
+			default:	break;
+			};
+		}
+	}
+}
+
+// block compresses a level, split across threads by rows of blocks
+static void compressLevel(const unsigned char* pixels, unsigned int width, unsigned int height,
+						  unsigned int format, unsigned char* dest) {
+
+	unsigned int blocksHigh = (height + 3) / 4;
+	unsigned int threadCount = std::thread::hardware_concurrency();
+	if (threadCount == 0)
+		threadCount = 1;
+	if (threadCount > blocksHigh)
+		threadCount = blocksHigh;
+
+	std::vector<std::thread> threads;
+	unsigned int rowsPerThread = (blocksHigh + threadCount - 1) / threadCount;
+	for (unsigned int row = rowsPerThread; row < blocksHigh; row += rowsPerThread) {
+		unsigned int lastRow = row + rowsPerThread < blocksHigh ? row + rowsPerThread : blocksHigh;
+		threads.push_back(std::thread(compressRows, pixels, width, height, format, dest, row, lastRow));
+	}
+
+	// the first rows are done here
+	compressRows(pixels, width, height, format, dest, 0, rowsPerThread < blocksHigh ? rowsPerThread : blocksHigh);
+
+	for (auto& thread : threads)
+		thread.join();
+}
+
+bool TextureCooker::cook(const char* sourceFile, const char* cookedFile, Format format) {
+
+	if (format > BC5) {
+		printf("TextureCooker: unknown format %u\n", format);
+		return false;
+	}
+
+	int width = 0, height = 0, comp = 0;
+	unsigned char* pixels = stbi_load(sourceFile, &width, &height, &comp, STBI_rgb_alpha);
+	if (pixels == nullptr) {
+		printf("TextureCooker: failed to load %s\n", sourceFile);
+		return false;
+	}
+
+	std::ofstream file(cookedFile, std::ios::out | std::ios::binary);
+	if (file.is_open() == false) {
+		printf("TextureCooker: failed to open %s\n", cookedFile);
+		stbi_image_free(pixels);
+		return false;
+	}
+
+	unsigned int mipCount = 1;
+	while ((width >> mipCount) > 0 || (height >> mipCount) > 0)
+		mipCount++;
+
+	Header header = { { 'A', 'I', 'E', 'T' }, VERSION, format, (unsigned int)width, (unsigned int)height, mipCount };
+	file.write((const char*)&header, sizeof(Header));
+	bool success = file.good();
+
+	// stb_dxt builds its tables on first use, so make sure that happens before any threads
+	if (format == BC1 ||
+		format == BC3) {
+		unsigned char block[64] = {}, out[16];
+		stb_compress_dxt_block(out, block, 1, STB_DXT_NORMAL);
+	}
+
+	std::vector<unsigned char> level;
+	std::vector<unsigned char> compressed;
+
+	for (unsigned int mip = 0; mip < mipCount && success; ++mip) {
+
+		unsigned int levelWidth = width >> mip > 0 ? width >> mip : 1;
+		unsigned int levelHeight = height >> mip > 0 ? height >> mip : 1;
+
+		// every level is filtered from the full size image rather than the level above
+		const unsigned char* levelPixels = pixels;
+		if (mip > 0) {
+			level.resize(levelWidth * levelHeight * 4);
+			if (format == BC5)
+				stbir_resize_uint8(pixels, width, height, 0, level.data(), levelWidth, levelHeight, 0, 4);
+			else
+				stbir_resize_uint8_srgb(pixels, width, height, 0, level.data(), levelWidth, levelHeight, 0, 4, 3, 0);
+			levelPixels = level.data();
+		}
+
+		unsigned int size = getLevelSize(format, levelWidth, levelHeight);
+		if (format == RGBA8) {
+			file.write((const char*)levelPixels, size);
+		}
+		else {
+			compressed.resize(size);
+			compressLevel(levelPixels, levelWidth, levelHeight, format, compressed.data());
+			file.write((const char*)compressed.data(), size);
+		}
+		success = file.good();
+	}
+
+	file.close();
+	success = success && file.good();
+	stbi_image_free(pixels);
+
+	if (success == false)
+		printf("TextureCooker: failed to write %s\n", cookedFile);
+	return success;
+}
+
+bool TextureCooker::cookTiled(const char* sourceFile, const char* cookedFile, unsigned int tileSize) {
+
+	if (tileSize == 0 ||
+		(tileSize & (tileSize - 1)) != 0) {
+		printf("TextureCooker: tile size %u isn't a power of two\n", tileSize);
+		return false;
+	}
+
+	int width = 0, height = 0, comp = 0;
+	unsigned char* pixels = stbi_load(sourceFile, &width, &height, &comp, STBI_rgb_alpha);
+	if (pixels == nullptr) {
+		printf("TextureCooker: failed to load %s\n", sourceFile);
+		return false;
+	}
+
+	// the virtual texture is square, a power of two and at least one tile
+	unsigned int size = tileSize;
+	while (size < (unsigned int)width || size < (unsigned int)height)
+		size *= 2;
+
+	std::ofstream file(cookedFile, std::ios::out | std::ios::binary);
+	if (file.is_open() == false) {
+		printf("TextureCooker: failed to open %s\n", cookedFile);
+		stbi_image_free(pixels);
+		return false;
+	}
+
+	// down to a single tile
+	unsigned int mipCount = 1;
+	while ((size >> (mipCount - 1)) > tileSize)
+		mipCount++;
+
+	TiledHeader header = { { 'A', 'I', 'E', 'V' }, VERSION, size, tileSize, TILE_BORDER, mipCount };
+	file.write((const char*)&header, sizeof(TiledHeader));
+	bool success = file.good();
+
+	unsigned int paddedSize = tileSize + TILE_BORDER * 2;
+	std::vector<unsigned char> level;
+	std::vector<unsigned char> tile(paddedSize * paddedSize * 4);
+
+	for (unsigned int mip = 0; mip < mipCount && success; ++mip) {
+
+		unsigned int levelSize = size >> mip;
+		level.resize(levelSize * levelSize * 4);
+		stbir_resize_uint8_srgb(pixels, width, height, 0, level.data(), levelSize, levelSize, 0, 4, 3, 0);
+
+		// borders repeat the level's edge pixels
+		unsigned int tiles = levelSize / tileSize;
+		for (unsigned int ty = 0; ty < tiles && success; ++ty) {
+			for (unsigned int tx = 0; tx < tiles && success; ++tx) {
+				for (unsigned int y = 0; y < paddedSize; ++y) {
+					int sy = (int)(ty * tileSize + y) - (int)TILE_BORDER;
+					sy = sy < 0 ? 0 : (sy >= (int)levelSize ? levelSize - 1 : sy);
+					for (unsigned int x = 0; x < paddedSize; ++x) {
+						int sx = (int)(tx * tileSize + x) - (int)TILE_BORDER;
+						sx = sx < 0 ? 0 : (sx >= (int)levelSize ? levelSize - 1 : sx);
+						memcpy(&tile[(y * paddedSize + x) * 4], &level[(sy * levelSize + sx) * 4], 4);
+					}
+				}
+				file.write((const char*)tile.data(), tile.size());
+				success = file.good();
+			}
+		}
+	}
+
+	file.close();
+	success = success && file.good();
+	stbi_image_free(pixels);
+
+	if (success == false)
+		printf("TextureCooker: failed to write %s\n", cookedFile);
+	return success;
+}
+
+unsigned int TextureCooker::getLevelSize(unsigned int format, unsigned int width, unsigned int height) {
+	switch (format) {
+	case BC1:	return ((width + 3) / 4) * ((height + 3) / 4) * 8;
+	case BC3:
+	case BC5:	return ((width + 3) / 4) * ((height + 3) / 4) * 16;
+	case RGBA8:
+	default:	return width * height * 4;
+	};
+}
+
+bool TextureCooker::isCookedFile(const char* filename) {
+	const char* extension = strrchr(filename, '.');
+	return extension != nullptr &&
+		strcmp(extension, ".tex") == 0;
+}
+
+} // namespace aie
@@ -0,0 +1,59 @@
+#pragma once
+
+namespace aie {
+
+// cooks images into .tex files that Texture::load can upload without decoding.
+// a cooked file holds every mip level, filtered and optionally block compressed
+// ahead of time, so no mipmaps are generated at load time. doesn't need OpenGL
+class TextureCooker {
+public:
+
+	enum Format : unsigned int {
+		RGBA8 = 0,	// uncompressed
+		BC1,		// DXT1, colour with no alpha, 4 bits per pixel
+		BC3,		// DXT5, colour and alpha, 8 bits per pixel
+		BC5,		// two channels, 8 bits per pixel. for normal maps, which are stored as XY
+					// so shaders need to rebuild Z = sqrt(1 - x * x - y * y)
+	};
+
+	// decodes a jpg, bmp, png or tga and writes it to cookedFile.
+	// colour formats are filtered in sRGB space, BC5 is filtered linearly
+	static bool cook(const char* sourceFile, const char* cookedFile, Format format);
+
+	// the file starts with this, followed by each mip level from largest to smallest
+	struct Header {
+		char			magic[4];
+		unsigned int	version;
+		unsigned int	format;
+		unsigned int	width, height;
+		unsigned int	mipCount;
+	};
+
+	static const unsigned int VERSION = 1;
+
+	// the size in bytes of a mip level
+	static unsigned int getLevelSize(unsigned int format, unsigned int width, unsigned int height);
+
+	// returns true if the file has the cooked texture extension (.tex)
+	static bool isCookedFile(const char* filename);
+
+	// cooks an image into tiles for a VirtualTexture (.vtex). the image is resized to
+	// a square power of two if it isn't one, then each mip level is split into RGBA8
+	// tiles of tileSize pixels with a border of their neighbours' pixels for filtering
+	static bool cookTiled(const char* sourceFile, const char* cookedFile, unsigned int tileSize = 128);
+
+	// a tiled file starts with this, followed by the tiles of each mip level from largest
+	// to smallest, in rows. every tile is (tileSize + border * 2) squared RGBA8 pixels
+	struct TiledHeader {
+		char			magic[4];
+		unsigned int	version;
+		unsigned int	size;
+		unsigned int	tileSize;
+		unsigned int	border;
+		unsigned int	mipCount;
+	};
+
+	static const unsigned int TILE_BORDER = 4;
+};
+
+} // namespace aie
@@ -0,0 +1,207 @@
+#include "gl_core_4_4.h"
+#include "TextureLoader.h"
+#include "Texture.h"
+#include "TextureCooker.h"
+#include <GLFW/glfw3.h>
+#include <stb_image.h>
+#include <stdio.h>
+#include <string.h>
+
+namespace aie {
+
+TextureLoader* TextureLoader::m_instance = nullptr;
+
+TextureLoader::TextureLoader(unsigned int workerCount)
+	: m_quit(false),
+	m_nextID(1),
+	m_pixelBuffer(0),
+	m_uploadBudget(2.0f) {
+
+	if (workerCount == 0)
+		workerCount = 1;
+	for (unsigned int i = 0; i < workerCount; ++i)
+		m_workers.push_back(std::thread(&TextureLoader::workerThread, this));
+
+	glGenBuffers(1, &m_pixelBuffer);
+}
+
+TextureLoader::~TextureLoader() {
+
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_quit = true;
+		m_jobs.clear();
+	}
+	m_jobReady.notify_all();
+
+	for (auto& worker : m_workers)
+		worker.join();
+
+	// nothing left to upload them to
+	for (auto& job : m_decoded)
+		stbi_image_free(job.pixels);
+	for (auto& job : m_pending)
+		job.texture->m_loading = false;
+
+	glDeleteBuffers(1, &m_pixelBuffer);
+}
+
+bool TextureLoader::load(Texture* texture, const char* filename) {
+
+	Job job = {};
+	job.texture = texture;
+	job.id = m_nextID++;
+	job.filename = filename;
+	job.cooked = TextureCooker::isCookedFile(filename);
+
+	m_pending.push_back(job);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(job);
+	}
+	m_jobReady.notify_one();
+
+	return true;
+}
+
+void TextureLoader::cancel(Texture* texture) {
+
+	for (auto iter = m_pending.begin(); iter != m_pending.end(); ++iter) {
+		if (iter->texture == texture) {
+			m_pending.erase(iter);
+			break;
+		}
+	}
+
+	// it may still be waiting for a worker, decoded images are freed in upload()
+	std::lock_guard<std::mutex> lock(m_mutex);
+	for (auto iter = m_jobs.begin(); iter != m_jobs.end(); ++iter) {
+		if (iter->texture == texture) {
+			m_jobs.erase(iter);
+			break;
+		}
+	}
+}
+
+void TextureLoader::workerThread() {
+
+	while (true) {
+
+		Job job;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobReady.wait(lock, [this]() { return m_quit || m_jobs.empty() == false; });
+			if (m_quit)
+				return;
+
+			job = std::move(m_jobs.front());
+			m_jobs.pop_front();
+		}
+
+		if (job.cooked) {
+			if (Texture::readFile(job.filename.c_str(), job.data) == false)
+				job.data.clear();
+		}
+		else
+			job.pixels = stbi_load(job.filename.c_str(), &job.width, &job.height, &job.components, STBI_default);
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_decoded.push_back(std::move(job));
+		}
+		m_jobDone.notify_all();
+	}
+}
+
+void TextureLoader::update() {
+
+	double start = glfwGetTime();
+
+	// always make some progress, even if one image takes longer than the budget
+	while (upload() &&
+		   (glfwGetTime() - start) * 1000.0 < m_uploadBudget) {}
+}
+
+void TextureLoader::finish() {
+
+	while (m_pending.empty() == false) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_jobDone.wait(lock, [this]() { return m_decoded.empty() == false; });
+		}
+		while (upload()) {}
+	}
+}
+
+bool TextureLoader::upload() {
+
+	Job job;
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		if (m_decoded.empty())
+			return false;
+		job = std::move(m_decoded.front());
+		m_decoded.pop_front();
+	}
+
+	// skip it if the texture was reloaded or destroyed since it was queued
+	auto iter = m_pending.begin();
+	while (iter != m_pending.end() &&
+		   (iter->texture != job.texture || iter->id != job.id))
+		++iter;
+	if (iter == m_pending.end()) {
+		stbi_image_free(job.pixels);
+		return true;
+	}
+	m_pending.erase(iter);
+
+	Texture* texture = job.texture;
+	texture->m_loading = false;
+
+	bool success = false;
+	if (job.cooked) {
+		if (job.data.empty() == false) {
+			unsigned int size = (unsigned int)job.data.size();
+			bool mapped = fillPixelBuffer(job.data.data(), size);
+			success = texture->uploadCooked(job.data.data(), size, mapped);
+			glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		}
+	}
+	else if (job.pixels != nullptr) {
+		bool mapped = fillPixelBuffer(job.pixels, job.width * job.height * job.components);
+		texture->upload(mapped ? nullptr : job.pixels, job.width, job.height, job.components);
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+		texture->m_loadedPixels = job.pixels;
+		texture->applyResidency();
+		success = true;
+	}
+
+	if (success == false) {
+		printf("TextureLoader: failed to load %s\n", job.filename.c_str());
+		glDeleteTextures(1, &texture->m_glHandle);
+		texture->m_glHandle = 0;
+		texture->m_filename = "none";
+	}
+	return true;
+}
+
+bool TextureLoader::fillPixelBuffer(const void* data, unsigned int size) {
+
+	// copy through a freshly orphaned buffer so the driver can upload it
+	// without stalling on the previous image
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBuffer);
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW);
+
+	void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+	if (mapped == nullptr) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+		return false;
+	}
+
+	memcpy(mapped, data, size);
+	glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	return true;
+}
+
+} // namespace aie
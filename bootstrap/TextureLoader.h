@@ -0,0 +1,100 @@
+#pragma once
+
+#include <deque>
+#include <vector>
+#include <string>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+namespace aie {
+
+class Texture;
+
+// a singleton that loads textures in the background. files are read and decoded
+// on worker threads, and the decoded images are uploaded on the main thread
+// through a pixel buffer, a few each frame within a time budget
+class TextureLoader {
+public:
+
+	// returns access to the singleton instance
+	static TextureLoader* getInstance() { return m_instance; }
+
+	// queues a texture to be loaded, it must stay around until it has loaded or is
+	// loaded again. the texture's handle is created straight away but samples as
+	// black until the image has been uploaded
+	bool	load(Texture* texture, const char* filename);
+
+	// stops a queued load, called by a texture that is being reloaded or destroyed
+	void	cancel(Texture* texture);
+
+	// uploads decoded images until the budget is used, at least one is always uploaded.
+	// called by the Application at the start of each frame
+	void	update();
+
+	// blocks until every queued texture has been decoded and uploaded
+	void	finish();
+
+	// the time update() can spend uploading each frame, in milliseconds
+	void	setUploadBudget(float milliseconds)	{ m_uploadBudget = milliseconds; }
+	float	getUploadBudget() const				{ return m_uploadBudget; }
+
+	// the number of textures waiting to be decoded or uploaded
+	unsigned int	getPendingCount() const		{ return (unsigned int)m_pending.size(); }
+
+protected:
+
+	// just giving the Application class access to the TextureLoader singleton
+	friend class Application;
+
+	// singleton pointer
+	static TextureLoader* m_instance;
+
+	// only want the Application class to be able to create / destroy
+	static void create(unsigned int workerCount)	{ m_instance = new TextureLoader(workerCount); }
+	static void destroy()							{ delete m_instance; m_instance = nullptr; }
+
+private:
+
+	// constructor private for singleton
+	TextureLoader(unsigned int workerCount);
+	~TextureLoader();
+
+	// a file to decode, or a decoded image waiting to be uploaded.
+	// the id tells apart loads of the same texture if it is reloaded.
+	// cooked textures are read into data rather than decoded
+	struct Job {
+		Texture*					texture;
+		unsigned int				id;
+		std::string					filename;
+		unsigned char*				pixels;
+		int							width, height, components;
+		bool						cooked;
+		std::vector<unsigned char>	data;
+	};
+
+	void	workerThread();
+	bool	upload();
+
+	// copies data into the pixel buffer and leaves it bound, returns false if it couldn't be mapped
+	bool	fillPixelBuffer(const void* data, unsigned int size);
+
+	std::vector<std::thread>	m_workers;
+	std::mutex					m_mutex;
+	std::condition_variable		m_jobReady;
+	std::condition_variable		m_jobDone;
+	bool						m_quit;
+
+	// guarded by m_mutex
+	std::deque<Job>				m_jobs;
+	std::deque<Job>				m_decoded;
+
+	// loads that haven't finished, only used on the main thread
+	std::vector<Job>			m_pending;
+	unsigned int				m_nextID;
+
+	unsigned int				m_pixelBuffer;
+	float						m_uploadBudget;
+};
+
+} // namespace aie
@@ -0,0 +1,376 @@
+#include "gl_core_4_4.h"
+#include "VirtualTexture.h"
+#include "TextureCooker.h"
+#include <algorithm>
+#include <stdio.h>
+#include <string.h>
+#include <fstream>
+
+namespace aie {
+
+VirtualTexture::VirtualTexture(unsigned int cacheTiles)
+	: m_size(0),
+	m_tileSize(0),
+	m_border(0),
+	m_mipCount(0),
+	m_cacheTiles(cacheTiles > 255 ? 255 : cacheTiles),
+	m_cacheTexture(0),
+	m_indirectionTexture(0),
+	m_indirectionDirty(false),
+	m_cache(m_cacheTiles * m_cacheTiles),
+	m_feedbackFramebuffer(0),
+	m_feedbackTexture(0),
+	m_feedbackDepth(0),
+	m_feedbackWidth(0),
+	m_feedbackHeight(0),
+	m_feedbackFrame(0),
+	m_previousFramebuffer(0),
+	m_quit(false) {
+
+	m_feedbackBuffers[0] = m_feedbackBuffers[1] = 0;
+	m_feedbackPending[0] = m_feedbackPending[1] = false;
+}
+
+VirtualTexture::~VirtualTexture() {
+
+	if (m_worker.joinable()) {
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			m_quit = true;
+		}
+		m_readReady.notify_all();
+		m_worker.join();
+	}
+
+	glDeleteTextures(1, &m_cacheTexture);
+	glDeleteTextures(1, &m_indirectionTexture);
+	glDeleteTextures(1, &m_feedbackTexture);
+	glDeleteRenderbuffers(1, &m_feedbackDepth);
+	glDeleteFramebuffers(1, &m_feedbackFramebuffer);
+	glDeleteBuffers(2, m_feedbackBuffers);
+}
+
+bool VirtualTexture::load(const char* filename) {
+
+	if (m_cacheTexture != 0) {
+		printf("VirtualTexture: %s is already loaded\n", m_filename.c_str());
+		return false;
+	}
+
+	std::ifstream file(filename, std::ios::in | std::ios::binary);
+	if (file.is_open() == false) {
+		printf("VirtualTexture: failed to open %s\n", filename);
+		return false;
+	}
+
+	TextureCooker::TiledHeader header = {};
+	file.read((char*)&header, sizeof(header));
+	if (file.good() == false ||
+		memcmp(header.magic, "AIEV", 4) != 0 ||
+		header.version != TextureCooker::VERSION ||
+		header.tileSize == 0 ||
+		header.mipCount == 0 ||
+		(header.size >> (header.mipCount - 1)) != header.tileSize ||
+		header.size / header.tileSize > 256) {
+		printf("VirtualTexture: %s isn't a tiled texture or is the wrong version\n", filename);
+		return false;
+	}
+
+	m_filename = filename;
+	m_size = header.size;
+	m_tileSize = header.tileSize;
+	m_border = header.border;
+	m_mipCount = header.mipCount;
+
+	// where each mip's tiles start in the file, counted in tiles
+	unsigned int tileCount = 0;
+	m_mipTileStart.resize(m_mipCount);
+	m_indirection.resize(m_mipCount);
+	for (unsigned int mip = 0; mip < m_mipCount; ++mip) {
+		unsigned int tiles = (m_size >> mip) / m_tileSize;
+		m_mipTileStart[mip] = tileCount;
+		m_indirection[mip].resize(tiles * tiles * 4, 0);
+		tileCount += tiles * tiles;
+	}
+
+	unsigned int paddedSize = m_tileSize + m_border * 2;
+	unsigned int cacheSize = m_cacheTiles * paddedSize;
+
+	glGenTextures(1, &m_cacheTexture);
+	glBindTexture(GL_TEXTURE_2D, m_cacheTexture);
+	glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, cacheSize, cacheSize);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+	// the indirection is looked up per mip without filtering
+	unsigned int tiles = m_size / m_tileSize;
+	glGenTextures(1, &m_indirectionTexture);
+	glBindTexture(GL_TEXTURE_2D, m_indirectionTexture);
+	glTexStorage2D(GL_TEXTURE_2D, m_mipCount, GL_RGBA8, tiles, tiles);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	// the single tile of the smallest mip is always there to fall back on
+	std::vector<unsigned char> pixels(paddedSize * paddedSize * 4);
+	file.seekg(sizeof(header) + (std::streamoff)m_mipTileStart[m_mipCount - 1] * pixels.size());
+	file.read((char*)pixels.data(), pixels.size());
+	bool success = file.good();
+	file.close();
+
+	if (success == false) {
+		printf("VirtualTexture: %s is truncated\n", filename);
+		return false;
+	}
+
+	unsigned int replaced = 0;
+	unsigned int top = makeTile(m_mipCount - 1, 0, 0);
+	m_cache.insert(top, replaced, true);
+	uploadTile(top, pixels);
+	updateIndirection();
+
+	m_worker = std::thread(&VirtualTexture::workerThread, this);
+	return true;
+}
+
+void VirtualTexture::beginFeedback(unsigned int screenWidth, unsigned int screenHeight) {
+
+	glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_previousFramebuffer);
+	glGetIntegerv(GL_VIEWPORT, m_previousViewport);
+
+	unsigned int width = screenWidth / FEEDBACK_SCALE > 0 ? screenWidth / FEEDBACK_SCALE : 1;
+	unsigned int height = screenHeight / FEEDBACK_SCALE > 0 ? screenHeight / FEEDBACK_SCALE : 1;
+
+	// (re)create the targets when the screen changes size
+	if (width != m_feedbackWidth ||
+		height != m_feedbackHeight) {
+
+		glDeleteTextures(1, &m_feedbackTexture);
+		glDeleteRenderbuffers(1, &m_feedbackDepth);
+		glDeleteFramebuffers(1, &m_feedbackFramebuffer);
+		glDeleteBuffers(2, m_feedbackBuffers);
+		m_feedbackPending[0] = m_feedbackPending[1] = false;
+
+		m_feedbackWidth = width;
+		m_feedbackHeight = height;
+
+		glGenTextures(1, &m_feedbackTexture);
+		glBindTexture(GL_TEXTURE_2D, m_feedbackTexture);
+		glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+		glBindTexture(GL_TEXTURE_2D, 0);
+
+		glGenRenderbuffers(1, &m_feedbackDepth);
+		glBindRenderbuffer(GL_RENDERBUFFER, m_feedbackDepth);
+		glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+		glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+		glGenFramebuffers(1, &m_feedbackFramebuffer);
+		glBindFramebuffer(GL_FRAMEBUFFER, m_feedbackFramebuffer);
+		glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_feedbackTexture, 0);
+		glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_feedbackDepth);
+		if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+			printf("VirtualTexture: feedback framebuffer incomplete\n");
+
+		glGenBuffers(2, m_feedbackBuffers);
+		for (unsigned int i = 0; i < 2; ++i) {
+			glBindBuffer(GL_PIXEL_PACK_BUFFER, m_feedbackBuffers[i]);
+			glBufferData(GL_PIXEL_PACK_BUFFER, width * height * 4, nullptr, GL_STREAM_READ);
+		}
+		glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	}
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_feedbackFramebuffer);
+	glViewport(0, 0, width, height);
+
+	// alpha stays 0 where nothing using the texture is drawn
+	float clearColour[] = { 0, 0, 0, 0 };
+	float clearDepth = 1;
+	glClearBufferfv(GL_COLOR, 0, clearColour);
+	glClearBufferfv(GL_DEPTH, 0, &clearDepth);
+}
+
+void VirtualTexture::endFeedback() {
+
+	// start reading this frame's feedback, it is looked at in a later update()
+	unsigned int buffer = m_feedbackFrame % 2;
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, m_feedbackBuffers[buffer]);
+	glReadPixels(0, 0, m_feedbackWidth, m_feedbackHeight, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+	m_feedbackPending[buffer] = true;
+	m_feedbackFrame++;
+
+	glBindFramebuffer(GL_FRAMEBUFFER, m_previousFramebuffer);
+	glViewport(m_previousViewport[0], m_previousViewport[1], m_previousViewport[2], m_previousViewport[3]);
+}
+
+void VirtualTexture::readFeedback() {
+
+	// the older of the two buffers has had a frame to finish
+	unsigned int buffer = m_feedbackFrame % 2;
+	if (m_feedbackPending[buffer] == false)
+		return;
+	m_feedbackPending[buffer] = false;
+
+	std::vector<unsigned int> tiles;
+
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, m_feedbackBuffers[buffer]);
+	const unsigned char* pixels = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, m_feedbackWidth * m_feedbackHeight * 4, GL_MAP_READ_BIT);
+	if (pixels != nullptr) {
+		gatherTiles(pixels, m_feedbackWidth * m_feedbackHeight, m_mipCount, tiles);
+		glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+	}
+	glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+
+	std::lock_guard<std::mutex> lock(m_mutex);
+	requestTiles(m_cache, tiles, m_inFlight, m_reads);
+	m_readReady.notify_one();
+}
+
+void VirtualTexture::update(unsigned int maxUploads) {
+
+	if (m_cacheTexture == 0)
+		return;
+
+	readFeedback();
+
+	for (unsigned int i = 0; i < maxUploads; ++i) {
+
+		TileRead read;
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			if (m_completed.empty())
+				break;
+			read = std::move(m_completed.front());
+			m_completed.pop_front();
+			m_inFlight.erase(std::find(m_inFlight.begin(), m_inFlight.end(), read.tile));
+		}
+
+		// if everything is in use it is asked for again by a later frame
+		unsigned int replaced = 0;
+		if (read.pixels.empty() ||
+			m_cache.insert(read.tile, replaced) < 0)
+			continue;
+
+		uploadTile(read.tile, read.pixels);
+	}
+
+	if (m_indirectionDirty)
+		updateIndirection();
+
+	m_cache.nextFrame();
+}
+
+void VirtualTexture::uploadTile(unsigned int tile, const std::vector<unsigned char>& pixels) {
+
+	int slot = m_cache.find(tile);
+	unsigned int paddedSize = m_tileSize + m_border * 2;
+
+	glBindTexture(GL_TEXTURE_2D, m_cacheTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % m_cacheTiles) * paddedSize, (slot / m_cacheTiles) * paddedSize,
+					paddedSize, paddedSize, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	m_indirectionDirty = true;
+}
+
+void VirtualTexture::updateIndirection() {
+
+	glBindTexture(GL_TEXTURE_2D, m_indirectionTexture);
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+
+	// from the smallest mip up, tiles that aren't resident use their parent's entry
+	for (int mip = (int)m_mipCount - 1; mip >= 0; --mip) {
+
+		unsigned int tiles = (m_size >> mip) / m_tileSize;
+		std::vector<unsigned char>& entries = m_indirection[mip];
+
+		for (unsigned int y = 0; y < tiles; ++y) {
+			for (unsigned int x = 0; x < tiles; ++x) {
+				unsigned char* entry = &entries[(y * tiles + x) * 4];
+
+				int slot = m_cache.find(makeTile(mip, x, y));
+				if (slot >= 0) {
+					entry[0] = (unsigned char)(slot % m_cacheTiles);
+					entry[1] = (unsigned char)(slot / m_cacheTiles);
+					entry[2] = (unsigned char)mip;
+					entry[3] = 255;
+				}
+				else {
+					unsigned int parentTiles = tiles / 2;
+					memcpy(entry, &m_indirection[mip + 1][((y / 2) * parentTiles + x / 2) * 4], 4);
+				}
+			}
+		}
+
+		glTexSubImage2D(GL_TEXTURE_2D, mip, 0, 0, tiles, tiles, GL_RGBA, GL_UNSIGNED_BYTE, entries.data());
+	}
+
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	glBindTexture(GL_TEXTURE_2D, 0);
+
+	m_indirectionDirty = false;
+}
+
+void VirtualTexture::workerThread() {
+
+	std::ifstream file(m_filename, std::ios::in | std::ios::binary);
+
+	unsigned int paddedSize = m_tileSize + m_border * 2;
+	unsigned int tileBytes = paddedSize * paddedSize * 4;
+
+	while (true) {
+
+		unsigned int tile = 0;
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_readReady.wait(lock, [this]() { return m_quit || m_reads.empty() == false; });
+			if (m_quit)
+				break;
+
+			tile = m_reads.front();
+			m_reads.pop_front();
+		}
+
+		// a failed read is passed back empty so the tile can be asked for again
+		TileRead read;
+		read.tile = tile;
+
+		unsigned int mip = getTileMip(tile);
+		unsigned int tiles = (m_size >> mip) / m_tileSize;
+		std::streamoff index = m_mipTileStart[mip] + getTileY(tile) * tiles + getTileX(tile);
+
+		// a failed read leaves the stream's error flags set, clear them for the next
+		if (file.is_open()) {
+			file.clear();
+			file.seekg(sizeof(TextureCooker::TiledHeader) + index * tileBytes);
+			read.pixels.resize(tileBytes);
+			file.read((char*)read.pixels.data(), tileBytes);
+			if (file.good() == false)
+				read.pixels.clear();
+		}
+
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_completed.push_back(std::move(read));
+	}
+}
+
+void VirtualTexture::bind(unsigned int program, unsigned int textureUnit) const {
+
+	glActiveTexture(GL_TEXTURE0 + textureUnit);
+	glBindTexture(GL_TEXTURE_2D, m_cacheTexture);
+	glActiveTexture(GL_TEXTURE0 + textureUnit + 1);
+	glBindTexture(GL_TEXTURE_2D, m_indirectionTexture);
+
+	glUniform1i(glGetUniformLocation(program, "virtualCache"), textureUnit);
+	glUniform1i(glGetUniformLocation(program, "virtualIndirection"), textureUnit + 1);
+	glUniform4f(glGetUniformLocation(program, "virtualInfo"), (float)m_size, (float)m_tileSize, (float)m_border, (float)m_mipCount);
+	glUniform1f(glGetUniformLocation(program, "virtualCacheSize"), (float)(m_cacheTiles * (m_tileSize + m_border * 2)));
+}
+
+} // namespace aie
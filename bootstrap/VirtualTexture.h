@@ -0,0 +1,160 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <string>
+#include <unordered_map>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
+
+namespace aie {
+
+// a texture too large to keep resident, streamed in tiles from a file cooked with
+// TextureCooker::cookTiled(). a feedback pass renders which tiles are visible, and
+// they are read on a worker thread into a physical cache texture. shaders sample
+// through an indirection texture that maps each virtual tile to its place in the
+// cache, falling back to a coarser mip until the tile has arrived.
+// the glsl side is bin/shaders/virtual.glsl, declaring sampleVirtual(uv) and
+// virtualFeedback(uv)
+class VirtualTexture {
+public:
+
+	// the least recently used tiles are replaced when the cache is full.
+	// doesn't use OpenGL so it can be driven without a context
+	class TileCache {
+	public:
+
+		TileCache(unsigned int slotCount);
+
+		// marks a tile as needed this frame, returns true if it is resident
+		bool	request(unsigned int tile);
+
+		// returns the slot holding a tile, or -1
+		int		find(unsigned int tile) const;
+
+		// finds a slot for a tile, replacing the least recently used one that isn't pinned
+		// or needed this frame. replaced is set to the tile that was there or INVALID_TILE.
+		// returns -1 if nothing can be replaced
+		int		insert(unsigned int tile, unsigned int& replaced, bool pinned = false);
+
+		// tiles requested after this are needed by the next frame
+		void	nextFrame() { m_frame++; }
+
+		unsigned int	getSlotCount() const	{ return (unsigned int)m_slots.size(); }
+		unsigned int	getHitCount() const		{ return m_hits; }
+		unsigned int	getMissCount() const	{ return m_misses; }
+		unsigned int	getEvictionCount() const	{ return m_evictions; }
+
+	private:
+
+		struct Slot {
+			unsigned int	tile;
+			unsigned int	lastUsed;
+			bool			pinned;
+		};
+
+		std::vector<Slot>						m_slots;
+		std::unordered_map<unsigned int, int>	m_lookup;
+		unsigned int	m_frame;
+		unsigned int	m_hits, m_misses, m_evictions;
+	};
+
+	static const unsigned int INVALID_TILE = 0xffffffff;
+
+	// the feedback buffer is this many times smaller than the screen
+	static const unsigned int FEEDBACK_SCALE = 8;
+
+	// tiles queued for reading at once, the rest wait for a later frame's feedback
+	static const unsigned int MAX_IN_FLIGHT = 32;
+
+	// tiles are identified by their mip and position within it
+	static unsigned int	makeTile(unsigned int mip, unsigned int x, unsigned int y) { return (mip << 24) | (y << 12) | x; }
+	static unsigned int	getTileMip(unsigned int tile)	{ return tile >> 24; }
+	static unsigned int	getTileX(unsigned int tile)		{ return tile & 0xfff; }
+	static unsigned int	getTileY(unsigned int tile)		{ return (tile >> 12) & 0xfff; }
+
+	// cacheTiles is the width and height of the physical cache in tiles
+	VirtualTexture(unsigned int cacheTiles = 16);
+	~VirtualTexture();
+
+	// opens a .vtex file and makes its smallest mip resident
+	bool	load(const char* filename);
+
+	// renders into a small feedback buffer, draw everything using the virtual texture
+	// between these with a shader that outputs virtualFeedback()
+	void	beginFeedback(unsigned int screenWidth, unsigned int screenHeight);
+	void	endFeedback();
+
+	// reads back the previous feedback, queues missing tiles and uploads tiles that have
+	// been read since, up to maxUploads. call once a frame before drawing
+	void	update(unsigned int maxUploads = 8);
+
+	// binds the cache and indirection textures to two texture units starting at
+	// textureUnit and sets the uniforms virtual.glsl uses in a program
+	void	bind(unsigned int program, unsigned int textureUnit) const;
+
+	// the tiles asked for by feedback texels, each once and in order. texels with
+	// no alpha or a mip the texture doesn't have are skipped
+	static void	gatherTiles(const unsigned char* feedback, unsigned int texelCount,
+							unsigned int mipCount, std::vector<unsigned int>& tiles);
+
+	// marks the tiles as needed this frame and queues those that aren't resident
+	// or already being read, up to MAX_IN_FLIGHT. doesn't use OpenGL either
+	static void	requestTiles(TileCache& cache, const std::vector<unsigned int>& tiles,
+							 std::vector<unsigned int>& inFlight, std::deque<unsigned int>& reads);
+
+	unsigned int	getSize() const			{ return m_size; }
+	unsigned int	getMipCount() const		{ return m_mipCount; }
+	const TileCache&	getTileCache() const	{ return m_cache; }
+
+private:
+
+	struct TileRead {
+		unsigned int				tile;
+		std::vector<unsigned char>	pixels;
+	};
+
+	void	workerThread();
+	void	uploadTile(unsigned int tile, const std::vector<unsigned char>& pixels);
+	void	updateIndirection();
+	void	readFeedback();
+
+	std::string		m_filename;
+	unsigned int	m_size;
+	unsigned int	m_tileSize;
+	unsigned int	m_border;
+	unsigned int	m_mipCount;
+	std::vector<unsigned int>	m_mipTileStart;
+
+	// physical cache and indirection, one texel per tile for each mip
+	unsigned int	m_cacheTiles;
+	unsigned int	m_cacheTexture;
+	unsigned int	m_indirectionTexture;
+	std::vector<std::vector<unsigned char>>	m_indirection;
+	bool			m_indirectionDirty;
+	TileCache		m_cache;
+
+	// feedback is read back through pixel buffers a frame late so it never stalls
+	unsigned int	m_feedbackFramebuffer;
+	unsigned int	m_feedbackTexture;
+	unsigned int	m_feedbackDepth;
+	unsigned int	m_feedbackWidth, m_feedbackHeight;
+	unsigned int	m_feedbackBuffers[2];
+	unsigned int	m_feedbackFrame;
+	bool			m_feedbackPending[2];
+	int				m_previousFramebuffer;
+	int				m_previousViewport[4];
+
+	// tiles being read, guarded by m_mutex. feedback stores tile positions in
+	// a byte so a texture can be at most 256 tiles across
+	std::thread						m_worker;
+	std::mutex						m_mutex;
+	std::condition_variable			m_readReady;
+	std::deque<unsigned int>		m_reads;
+	std::deque<TileRead>			m_completed;
+	std::vector<unsigned int>		m_inFlight;
+	bool							m_quit;
+};
+
+} // namespace aie
@@ -0,0 +1,111 @@
+#include "VirtualTexture.h"
+#include <algorithm>
+
+// the parts of VirtualTexture that don't use OpenGL, so which tiles are kept
+// can be simulated without a context
+
+namespace aie {
+
+VirtualTexture::TileCache::TileCache(unsigned int slotCount)
+	: m_frame(1),
+	m_hits(0),
+	m_misses(0),
+	m_evictions(0) {
+
+	Slot empty = { INVALID_TILE, 0, false };
+	m_slots.resize(slotCount, empty);
+}
+
+bool VirtualTexture::TileCache::request(unsigned int tile) {
+
+	auto iter = m_lookup.find(tile);
+	if (iter == m_lookup.end()) {
+		m_misses++;
+		return false;
+	}
+
+	m_slots[iter->second].lastUsed = m_frame;
+	m_hits++;
+	return true;
+}
+
+int VirtualTexture::TileCache::find(unsigned int tile) const {
+	auto iter = m_lookup.find(tile);
+	return iter != m_lookup.end() ? iter->second : -1;
+}
+
+int VirtualTexture::TileCache::insert(unsigned int tile, unsigned int& replaced, bool pinned) {
+
+	replaced = INVALID_TILE;
+
+	int slot = find(tile);
+	if (slot >= 0) {
+		m_slots[slot].lastUsed = m_frame;
+		m_slots[slot].pinned |= pinned;
+		return slot;
+	}
+
+	// an empty slot, or the least recently used one that wasn't needed this frame
+	for (unsigned int i = 0; i < m_slots.size(); ++i) {
+		if (m_slots[i].tile == INVALID_TILE) {
+			slot = i;
+			break;
+		}
+		if (m_slots[i].pinned == false &&
+			m_slots[i].lastUsed < m_frame &&
+			(slot == -1 || m_slots[i].lastUsed < m_slots[slot].lastUsed))
+			slot = i;
+	}
+
+	if (slot == -1)
+		return -1;
+
+	if (m_slots[slot].tile != INVALID_TILE) {
+		replaced = m_slots[slot].tile;
+		m_lookup.erase(replaced);
+		m_evictions++;
+	}
+
+	m_slots[slot].tile = tile;
+	m_slots[slot].lastUsed = m_frame;
+	m_slots[slot].pinned = pinned;
+	m_lookup[tile] = slot;
+	return slot;
+}
+
+void VirtualTexture::gatherTiles(const unsigned char* feedback, unsigned int texelCount,
+								 unsigned int mipCount, std::vector<unsigned int>& tiles) {
+
+	unsigned int last = INVALID_TILE;
+	for (unsigned int i = 0; i < texelCount; ++i) {
+		const unsigned char* texel = feedback + i * 4;
+		if (texel[3] == 0 ||
+			texel[2] >= mipCount)
+			continue;
+
+		// neighbouring texels usually want the same tile
+		unsigned int tile = makeTile(texel[2], texel[0], texel[1]);
+		if (tile != last)
+			tiles.push_back(tile);
+		last = tile;
+	}
+
+	std::sort(tiles.begin(), tiles.end());
+	tiles.erase(std::unique(tiles.begin(), tiles.end()), tiles.end());
+}
+
+void VirtualTexture::requestTiles(TileCache& cache, const std::vector<unsigned int>& tiles,
+								  std::vector<unsigned int>& inFlight, std::deque<unsigned int>& reads) {
+
+	for (auto tile : tiles) {
+		if (cache.request(tile) ||
+			inFlight.size() >= MAX_IN_FLIGHT ||
+			std::find(inFlight.begin(), inFlight.end(), tile) != inFlight.end())
+			continue;
+
+		inFlight.push_back(tile);
+		reads.push_back(tile);
+	}
+}
+
+} // namespace aie
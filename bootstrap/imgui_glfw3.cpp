@@ -19,6 +19,9 @@
 #endif
 
 #include "Input.h"
+#include "StreamBuffer.h"
+#include <string.h>
+#include <stdio.h>
 
 namespace aie {
 
@@ -31,7 +34,9 @@ static GLuint       g_FontTexture = 0;
 static int          g_ShaderHandle = 0, g_VertHandle = 0, g_FragHandle = 0;
 static int          g_AttribLocationTex = 0, g_AttribLocationProjMtx = 0;
 static int          g_AttribLocationPosition = 0, g_AttribLocationUV = 0, g_AttribLocationColor = 0;
-static unsigned int g_VboHandle = 0, g_VaoHandle = 0, g_ElementsHandle = 0;
+static unsigned int g_VaoHandle = 0;
+// used instead of the stream buffer for any list it has no room for
+static unsigned int g_FallbackVaoHandle = 0, g_FallbackVboHandle = 0, g_FallbackIboHandle = 0;
 
 // This is the main rendering function that you have to implement and provide to ImGui (via setting up 'RenderDrawListsFn' in the ImGuiIO structure)
 // If text or lines are blurry when integrating ImGui in your engine:
@@ -81,17 +86,40 @@ void ImGui_RenderDrawLists(ImDrawData* draw_data) {
     glUseProgram(g_ShaderHandle);
     glUniform1i(g_AttribLocationTex, 0);
     glUniformMatrix4fv(g_AttribLocationProjMtx, 1, GL_FALSE, &ortho_projection[0][0]);
-    glBindVertexArray(g_VaoHandle);
+
+    // vertices and indices both live in the shared streaming buffer, which the VAO points at
+    StreamBuffer* stream = StreamBuffer::getInstance();
 
     for (int n = 0; n < draw_data->CmdListsCount; n++) {
         const ImDrawList* cmd_list = draw_data->CmdLists[n];
-        const ImDrawIdx* idx_buffer_offset = 0;
 
-        glBindBuffer(GL_ARRAY_BUFFER, g_VboHandle);
-        glBufferData(GL_ARRAY_BUFFER, (GLsizeiptr)cmd_list->VtxBuffer.size() * sizeof(ImDrawVert), (GLvoid*)&cmd_list->VtxBuffer.front(), GL_STREAM_DRAW);
+        unsigned int vtx_size = (unsigned int)cmd_list->VtxBuffer.size() * sizeof(ImDrawVert);
+        unsigned int idx_size = (unsigned int)cmd_list->IdxBuffer.size() * sizeof(ImDrawIdx);
+        unsigned int vtx_offset = 0, idx_offset = 0;
+        void* vtx_dest = stream->allocate(vtx_size, sizeof(ImDrawVert), vtx_offset);
+        void* idx_dest = vtx_dest != nullptr ? stream->allocate(idx_size, sizeof(ImDrawIdx), idx_offset) : nullptr;
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_ElementsHandle);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, (GLsizeiptr)cmd_list->IdxBuffer.size() * sizeof(ImDrawIdx), (GLvoid*)&cmd_list->IdxBuffer.front(), GL_STREAM_DRAW);
+        if (idx_dest != nullptr) {
+            memcpy(vtx_dest, &cmd_list->VtxBuffer.front(), vtx_size);
+            memcpy(idx_dest, &cmd_list->IdxBuffer.front(), idx_size);
+            glBindVertexArray(g_VaoHandle);
+        }
+        else {
+            // out of stream space, upload this list on its own rather than lose the rest of the ui
+            static bool warned = false;
+            if (warned == false)
+                printf("ImGui: stream buffer full, uploading draw lists directly\n");
+            warned = true;
+
+            vtx_offset = idx_offset = 0;
+            glBindVertexArray(g_FallbackVaoHandle);
+            glBindBuffer(GL_ARRAY_BUFFER, g_FallbackVboHandle);
+            glBufferData(GL_ARRAY_BUFFER, vtx_size, &cmd_list->VtxBuffer.front(), GL_STREAM_DRAW);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, idx_size, &cmd_list->IdxBuffer.front(), GL_STREAM_DRAW);
+        }
+
+        const char* idx_buffer_offset = (const char*)(intptr_t)idx_offset;
+        GLint base_vertex = (GLint)(vtx_offset / sizeof(ImDrawVert));
 
         for (const ImDrawCmd* pcmd = cmd_list->CmdBuffer.begin(); pcmd != cmd_list->CmdBuffer.end(); pcmd++) {
             if (pcmd->UserCallback) {
@@ -99,9 +127,9 @@ void ImGui_RenderDrawLists(ImDrawData* draw_data) {
             } else {
                 glBindTexture(GL_TEXTURE_2D, (GLuint)(intptr_t)pcmd->TextureId);
                 glScissor((int)pcmd->ClipRect.x, (int)(fb_height - pcmd->ClipRect.w), (int)(pcmd->ClipRect.z - pcmd->ClipRect.x), (int)(pcmd->ClipRect.w - pcmd->ClipRect.y));
-                glDrawElements(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, idx_buffer_offset);
+                glDrawElementsBaseVertex(GL_TRIANGLES, (GLsizei)pcmd->ElemCount, sizeof(ImDrawIdx) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, idx_buffer_offset, base_vertex);
             }
-            idx_buffer_offset += pcmd->ElemCount;
+            idx_buffer_offset += pcmd->ElemCount * sizeof(ImDrawIdx);
         }
     }
 
@@ -231,12 +259,10 @@ bool ImGui_CreateDeviceObjects() {
     g_AttribLocationUV = glGetAttribLocation(g_ShaderHandle, "UV");
     g_AttribLocationColor = glGetAttribLocation(g_ShaderHandle, "Color");
 
-    glGenBuffers(1, &g_VboHandle);
-    glGenBuffers(1, &g_ElementsHandle);
-
     glGenVertexArrays(1, &g_VaoHandle);
     glBindVertexArray(g_VaoHandle);
-    glBindBuffer(GL_ARRAY_BUFFER, g_VboHandle);
+    glBindBuffer(GL_ARRAY_BUFFER, StreamBuffer::getInstance()->getHandle());
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, StreamBuffer::getInstance()->getHandle());
     glEnableVertexAttribArray(g_AttribLocationPosition);
     glEnableVertexAttribArray(g_AttribLocationUV);
     glEnableVertexAttribArray(g_AttribLocationColor);
@@ -245,6 +271,20 @@ bool ImGui_CreateDeviceObjects() {
     glVertexAttribPointer(g_AttribLocationPosition, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)OFFSETOF(ImDrawVert, pos));
     glVertexAttribPointer(g_AttribLocationUV, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)OFFSETOF(ImDrawVert, uv));
     glVertexAttribPointer(g_AttribLocationColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), (GLvoid*)OFFSETOF(ImDrawVert, col));
+
+    // the same layout over buffers of its own, for lists the stream buffer can't fit
+    glGenBuffers(1, &g_FallbackVboHandle);
+    glGenBuffers(1, &g_FallbackIboHandle);
+    glGenVertexArrays(1, &g_FallbackVaoHandle);
+    glBindVertexArray(g_FallbackVaoHandle);
+    glBindBuffer(GL_ARRAY_BUFFER, g_FallbackVboHandle);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, g_FallbackIboHandle);
+    glEnableVertexAttribArray(g_AttribLocationPosition);
+    glEnableVertexAttribArray(g_AttribLocationUV);
+    glEnableVertexAttribArray(g_AttribLocationColor);
+    glVertexAttribPointer(g_AttribLocationPosition, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)OFFSETOF(ImDrawVert, pos));
+    glVertexAttribPointer(g_AttribLocationUV, 2, GL_FLOAT, GL_FALSE, sizeof(ImDrawVert), (GLvoid*)OFFSETOF(ImDrawVert, uv));
+    glVertexAttribPointer(g_AttribLocationColor, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(ImDrawVert), (GLvoid*)OFFSETOF(ImDrawVert, col));
 #undef OFFSETOF
 
     ImGui_CreateFontsTexture();
@@ -259,9 +299,12 @@ bool ImGui_CreateDeviceObjects() {
 
 void ImGui_InvalidateDeviceObjects() {
     if (g_VaoHandle) glDeleteVertexArrays(1, &g_VaoHandle);
-    if (g_VboHandle) glDeleteBuffers(1, &g_VboHandle);
-    if (g_ElementsHandle) glDeleteBuffers(1, &g_ElementsHandle);
-    g_VaoHandle = g_VboHandle = g_ElementsHandle = 0;
+    g_VaoHandle = 0;
+
+    if (g_FallbackVaoHandle) glDeleteVertexArrays(1, &g_FallbackVaoHandle);
+    if (g_FallbackVboHandle) glDeleteBuffers(1, &g_FallbackVboHandle);
+    if (g_FallbackIboHandle) glDeleteBuffers(1, &g_FallbackIboHandle);
+    g_FallbackVaoHandle = g_FallbackVboHandle = g_FallbackIboHandle = 0;
 
     glDetachShader(g_ShaderHandle, g_VertHandle);
     glDeleteShader(g_VertHandle);